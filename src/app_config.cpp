@@ -8,23 +8,138 @@ const uint16_t MQTT_PORT = 1883;
 const char *MQTT_CLIENT_ID = "esp32-batt-hybrid-5h-debug-1";
 const char *MQTT_TOPIC = "car/battery/telemetry";
 const char *MQTT_DBG_TOPIC = "car/battery/debug/rint";
+const char *MQTT_DRAIN_TOPIC = "car/battery/drain";
+const char *MQTT_RIPPLE_TOPIC = "car/battery/ripple";
+const char *MQTT_CAPACITY_TOPIC = "car/battery/capacity";
+const char *MQTT_SCHED_TOPIC = "car/battery/debug/sched";
+const char *MQTT_BACKLOG_TOPIC = "car/battery/backlog";
+const char *MQTT_OUTBOX_TOPIC = "car/battery/debug/outbox";
+const char *MQTT_WAKE_TOPIC = "car/battery/debug/wake";
+const char *MQTT_BATCH_TOPIC = "car/battery/batch";
+const char *MQTT_ENERGY_TOPIC = "car/battery/debug/energy";
+const char *MQTT_PROF_TOPIC = "car/battery/debug/prof";
+const char *MQTT_CBOR_TOPIC = "car/battery/cbor";
+const char *MQTT_HISTORY_TOPIC = "car/battery/history";
+const char *MQTT_CMD_TOPIC = "car/battery/cmd";
+const char *MQTT_CMD_RESULT_TOPIC = "car/battery/cmd/result";
+const char *MQTT_CONFIG_TOPIC = "car/battery/config";
+const char *HA_DEVICE_ID = "Toyota_batt_sensor";
+const char *NTP_SERVER = "pool.ntp.org";
 
 #include "learner/battery_config.h"
+#include "log/logger.h"
 #include <Preferences.h>
 
-// Runtime battery capacity (Ah) - initialized from compile-time default
+RuntimeConfig defaultRuntimeConfig() {
+  RuntimeConfig c;
+  c.capacity_Ah = BATTERY_CAPACITY_AH;
+  c.telemetryEnc = TELEMETRY_ENC_JSON;
+  c.rest_A = REST_CURRENT_THRESH_A;
+  c.idle_A = BASE_CONS_THRESH_A;
+  c.sample_ms = SAMPLE_INTERVAL_MS;
+  c.sampleIdle_ms = SAMPLE_INTERVAL_MS_IDLE;
+  c.publish_ms = PUBLISH_INTERVAL_MS;
+  c.publishIdle_ms = PUBLISH_INTERVAL_MS_IDLE;
+  c.parkedMax_ms = (uint32_t)PARKED_IDLE_MAX_MS;
+  return c;
+}
+
+RuntimeConfig runtimeConfig = defaultRuntimeConfig();
+uint32_t runtimeConfigLoadUs = 0;
+
+// Mirrors of runtimeConfig for the code that reads them directly
 float batteryCapacityAh = BATTERY_CAPACITY_AH;
+uint8_t telemetryEncoding = TELEMETRY_ENC_JSON;
+
+static void syncConfigMirrors() {
+  batteryCapacityAh = runtimeConfig.capacity_Ah;
+  telemetryEncoding = (uint8_t)runtimeConfig.telemetryEnc;
+}
+
+// A schema field by name (the names used here are all in the schema)
+static const ConfigField &fieldNamed(const char *name) {
+  return *configField(name, strlen(name));
+}
+
+static bool saveRuntimeConfig() {
+  uint8_t blob[CONFIG_BLOB_MAX];
+  size_t n = configEncode(runtimeConfig, blob, sizeof(blob));
+  Preferences prefs;
+  prefs.begin("battmon", false);
+  bool ok = n && prefs.putBytes(CONFIG_NVS_KEY, blob, n) == n;
+  prefs.end();
+  if (!ok)
+    LOGE("config: NVS write failed");
+  return ok;
+}
 
-void loadBatteryCapacityFromPrefs() {
-  // Delegate loading to the centralized BatteryConfig helper which
-  // knows the correct NVS keys and verification logic.
+// The settings before the config blob: bat_cap (bat_cap2) and tlm_enc,
+// each read with its own Preferences session as they used to be at boot
+static void importLegacyConfig(RuntimeConfig &c) {
+  batteryCapacityAh = c.capacity_Ah;
   batteryConfig.begin();
+  Preferences prefs;
+  prefs.begin("battmon", false);
+  uint8_t enc = prefs.getUChar("tlm_enc", (uint8_t)c.telemetryEnc);
+  prefs.end();
+  // Values out of bounds keep the defaults
+  configSet(c, fieldNamed("capacity_ah"), batteryCapacityAh);
+  configSet(c, fieldNamed("tlm_enc"), (float)enc);
 }
 
-void setBatteryCapacityAh(float ah) {
-  if (!isfinite(ah) || ah <= 0.0f)
-    return;
-  batteryCapacityAh = ah;
-  // Delegate persistence to BatteryConfig to keep NVS writes centralized.
-  batteryConfig.setCapacity(ah);
+void loadRuntimeConfig() {
+  const RuntimeConfig defaults = defaultRuntimeConfig();
+  uint8_t blob[CONFIG_BLOB_MAX];
+  size_t len = 0;
+  uint32_t t0 = micros();
+  Preferences prefs;
+  prefs.begin("battmon", false);
+  // isKey() first: a missing key would log an NVS NOT_FOUND error
+  if (prefs.isKey(CONFIG_NVS_KEY))
+    len = prefs.getBytes(CONFIG_NVS_KEY, blob, sizeof(blob));
+  prefs.end();
+  uint8_t rejected = 0;
+  ConfigLoad r = configDecode(blob, len, defaults, runtimeConfig, &rejected);
+  runtimeConfigLoadUs = micros() - t0;
+
+  if (!len) {
+    uint32_t t1 = micros();
+    importLegacyConfig(runtimeConfig);
+    LOGI("config: imported NVS keys (their reads took %lu us)",
+         (unsigned long)(micros() - t1));
+    saveRuntimeConfig();
+  } else if (r == CFG_LOAD_DEFAULTS) {
+    LOGW("config: stored blob invalid, using defaults");
+  } else if (r == CFG_LOAD_UPGRADED || rejected) {
+    if (rejected)
+      LOGW("config: %u stored values out of bounds, defaults used",
+           (unsigned)rejected);
+    saveRuntimeConfig(); // rewrite with every current field
+  }
+  syncConfigMirrors();
+  LOGI("config v%u loaded in %lu us", (unsigned)CONFIG_VERSION,
+       (unsigned long)runtimeConfigLoadUs);
+}
+
+bool setRuntimeConfigField(uint8_t field, float v) {
+  size_t n;
+  const ConfigField *f = configFields(n);
+  if (field >= n || !configSet(runtimeConfig, f[field], v))
+    return false;
+  syncConfigMirrors();
+  bool ok = saveRuntimeConfig();
+  applyRuntimeConfig();
+  return ok;
+}
+
+static bool setNamedField(const char *name, float v) {
+  size_t n;
+  const ConfigField *f = configFields(n);
+  return setRuntimeConfigField((uint8_t)(&fieldNamed(name) - f), v);
+}
+
+void setTelemetryEncoding(uint8_t enc) { setNamedField("tlm_enc", enc); }
+
+bool setBatteryCapacityAh(float ah) {
+  return setNamedField("capacity_ah", ah);
 }
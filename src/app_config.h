@@ -1,4 +1,5 @@
 #pragma once
+#include "config/config_store.h"
 #include <Arduino.h>
 #include <secret.h>
 // ------------------------------ USER CONFIG ------------------------------
@@ -10,23 +11,73 @@ extern const uint16_t MQTT_PORT;
 extern const char *MQTT_CLIENT_ID;
 extern const char *MQTT_TOPIC;
 extern const char *MQTT_DBG_TOPIC;
+extern const char *MQTT_DRAIN_TOPIC;
+extern const char *MQTT_RIPPLE_TOPIC;
+extern const char *MQTT_CAPACITY_TOPIC;
+extern const char *MQTT_SCHED_TOPIC;
+extern const char *MQTT_BACKLOG_TOPIC;
+extern const char *MQTT_OUTBOX_TOPIC;
+extern const char *MQTT_WAKE_TOPIC;
+extern const char *MQTT_BATCH_TOPIC;
+extern const char *MQTT_ENERGY_TOPIC;
+extern const char *MQTT_PROF_TOPIC;
+extern const char *MQTT_CBOR_TOPIC;
+extern const char *MQTT_HISTORY_TOPIC;
+// Commands as on BLE (comms/command_parser.h); replies as JSON on the result
+// topic. Retained command messages are ignored.
+extern const char *MQTT_CMD_TOPIC;
+extern const char *MQTT_CMD_RESULT_TOPIC;
+// Runtime configuration as JSON (buildConfigJson), retained
+extern const char *MQTT_CONFIG_TOPIC;
+// Home Assistant device id, also the unique_id prefix of its entities
+extern const char *HA_DEVICE_ID;
+extern const char *NTP_SERVER;
 
 const float BATTERY_CAPACITY_AH =
     70.0f; // 9.0f;    // LTX9-4 motorcycle battery //REMEMBER TO UPDATE
 
-// Runtime-overridable battery capacity (Ah). Initialize with compile-time
-// default
+// Runtime battery capacity (Ah), runtimeConfig.capacity_Ah
 extern float batteryCapacityAh;
-// Load persisted battery capacity from NVM (call from `setup()`)
-void loadBatteryCapacityFromPrefs();
-// Update runtime battery capacity and persist to NVM
-void setBatteryCapacityAh(float ah);
+// Update runtime battery capacity and persist it; false if out of bounds
+// (unchanged) or not saved (applied)
+bool setBatteryCapacityAh(float ah);
+
+// Telemetry encodings (bit flags): JSON to MQTT_TOPIC, CBOR
+// (telemetry_cbor.h) to MQTT_CBOR_TOPIC. Selected at runtime with the
+// command ENC, runtimeConfig.telemetryEnc.
+const uint8_t TELEMETRY_ENC_JSON = 0x01;
+const uint8_t TELEMETRY_ENC_CBOR = 0x02;
+extern uint8_t telemetryEncoding;
+// Update and persist; ignored unless at least one known flag is set
+void setTelemetryEncoding(uint8_t enc);
+
+// ------------------ Runtime configuration (config/config_store.h) --------
+// Constants marked "runtime" below are the defaults of runtimeConfig, which
+// is stored as one CRC-checked blob under CONFIG_NVS_KEY and changed with
+// CFG:<name>=<value> on BLE, Serial or MQTT (CFG:<name> reads a value).
+static const char *CONFIG_NVS_KEY = "cfg";
+extern RuntimeConfig runtimeConfig;
+RuntimeConfig defaultRuntimeConfig();
+// One NVS read at boot, before anything uses runtimeConfig. The first boot
+// with it takes over the old per-key settings (bat_cap, tlm_enc).
+void loadRuntimeConfig();
+// Microseconds loadRuntimeConfig() took
+extern uint32_t runtimeConfigLoadUs;
+// Set a field (index into configFields()), persist and apply it; false if
+// the value is out of bounds or could not be written
+bool setRuntimeConfigField(uint8_t field, float v);
+// Apply a changed runtimeConfig (defined in main.cpp)
+void applyRuntimeConfig();
+// Forget the learned capacity fit and anchor, e.g. on CLEAR_NVM (main.cpp)
+void resetCapacityLearning();
 const float INITIAL_BASELINE_mOHM = 35.0f; // known-good baseline for LTX9-4
 
 // Rest detection for OCV correction
 const float REST_CURRENT_THRESH_A =
-    0.60f; // <= this considered "rest" (raised slightly)
+    0.60f; // <= this considered "rest" (raised slightly); runtime: rest_a
 const uint32_t REST_DETECT_SEC = 5 * 60; // need 5 min rest for OCV snap
+// Capacity learning wants a better relaxed OCV than the SOC correction
+const uint32_t CAPACITY_REST_SEC = 30 * 60;
 // Grace window for transient spikes: do not immediately clear `rest_accum_s`
 const uint32_t REST_RESET_GRACE_SEC =
     5; // seconds of sustained non-rest before clearing rest_accum_s
@@ -50,7 +101,8 @@ const uint8_t INA226_ADDR = 0x40; // default
 // Alternator/DC-DC detection voltage
 const float ALT_ON_VOLTAGE_V = 13.2f;
 
-// Cadence (ACTIVE mode)
+// Cadence (ACTIVE mode); runtime: sample_ms, publish_ms, sample_idle_ms,
+// publish_idle_ms
 const uint32_t SAMPLE_INTERVAL_MS = 500;   // ~25 Hz V/I sampling
 const uint32_t TEMP_INTERVAL_MS = 1000;    // 1 Hz temperature sampling
 const uint32_t PUBLISH_INTERVAL_MS = 2000; // every 2 s publish
@@ -58,6 +110,25 @@ const uint32_t SAMPLE_INTERVAL_MS_IDLE =
     1000; // Reduced cadence while Parked&Idle but awake (save power)
 const uint32_t PUBLISH_INTERVAL_MS_IDLE =
     10000; // Reduced cadence while Parked&Idle but awake (save power)
+const uint32_t SCHED_STATS_INTERVAL_MS = 60000; // scheduler stats to MQTT
+// Snapshot wake: longest wait for Wi-Fi before publishing (or giving up)
+const uint32_t WIFI_SNAPSHOT_WAIT_MS = 8000;
+// Snapshot wake target, reset to radio off (over_budget on MQTT_WAKE_TOPIC)
+const uint32_t WAKE_BUDGET_MS = 300;
+// Snapshot wake: broker round-trip confirming the publishes before sleep
+const uint32_t MQTT_SYNC_TIMEOUT_MS = 200;
+// Snapshot wakes per radio wake; frames in between are held in RTC memory and
+// sent as one batch to MQTT_BATCH_TOPIC (1..12)
+const uint8_t SNAPSHOT_BATCH_WAKES = 6; // x 5 min = every 30 min
+// Snapshot wake: bring the radio up early below this battery voltage
+const float SNAPSHOT_ALERT_V = 12.0f;
+
+// Report-by-exception: frames built every publish interval are only sent when
+// a field moves past its deadband (ReportConfig in comms/report_policy.h),
+// the mode or a flag changes, the current steps, or on the heartbeat
+const bool REPORT_BY_EXCEPTION = true;
+const uint32_t REPORT_HEARTBEAT_MS = 60000;       // ACTIVE
+const uint32_t REPORT_HEARTBEAT_MS_IDLE = 300000; // Parked&Idle
 
 // Temp compensation for Rint
 const float REF_TEMP_C = 25.0f;
@@ -71,14 +142,16 @@ const float RINT_MAX_VALID_MOHM =
 
 // ------------------ Parked/Idle detection & sleep policy ------------------
 const float BASE_CONS_THRESH_A = 0.65f; // quiescent I threshold (parked/idle) —
-                                        // raised to reduce false positives
+                                        // raised to reduce false positives;
+                                        // runtime: idle_a
 const uint32_t PARKED_IDLE_ENTRY_DWELL_SEC =
     5 * 60;                            // need 5 min quiet to enter Parked&Idle
 const float STEP_ACTIVITY_DI_A = 1.5f; // ΔI>=1.5A counts as activity
 const uint32_t STEP_ACTIVITY_WINDOW_MS = 200; // within this time window
 // 1 hour timer once Parked&Idle begins
 const uint64_t PARKED_IDLE_MAX_MS =
-    10ULL * 60ULL * 1000ULL; // 10 min awake/idle before deep sleep
+    10ULL * 60ULL * 1000ULL; // 10 min awake/idle before deep sleep; runtime:
+                             // parked_max_ms
 
 // Enforce at least this many milliseconds in Parked&Idle before sleeping
 const uint64_t MIN_PARKED_IDLE_BEFORE_SLEEP_MS =
@@ -87,8 +160,96 @@ const uint64_t MIN_PARKED_IDLE_BEFORE_SLEEP_MS =
 const uint64_t PARKED_WAKE_INTERVAL_US =
     5ULL * 60ULL * 1000000ULL; // 5 min deep sleep
 
+// ------------------ Self-consumption power model ------------------
+// Estimated draw of the monitor itself from the 12 V battery (through the
+// buck converter, about a third of the 3.3 V rail current). Awake time is
+// charged at POWER_AWAKE_MA and each active component adds its own current
+// on top; replace with measured values to tune PARKED_IDLE_MAX_MS and the
+// sleep cadence. Results go hourly to MQTT_ENERGY_TOPIC.
+const float POWER_AWAKE_MA = 15.0f;        // CPU on, radios off
+const float POWER_SENSORS_MA = 2.0f;       // INA226/Hall/DS18B20 reads
+const float POWER_WIFI_CONNECT_MA = 45.0f; // scan, association, DHCP
+const float POWER_WIFI_MA = 8.0f;          // associated, modem sleep
+const float POWER_MQTT_MA = 25.0f;         // connect and publish bursts
+const float POWER_BLE_MA = 5.0f;           // advertising / connected
+const float POWER_OTA_MA = 0.5f;           // ArduinoOTA polling
+const float POWER_SLEEP_MA = 0.5f;         // deep sleep incl. sensor boards
+
+// ------------------ Parked parasitic-drain analyzer ------------------
+// Thresholds sit above the Hall sensor deadband (~0.3 A at 130 A rating);
+// smaller drains read as zero and land in the sketch's "under" bucket.
+const float DRAIN_STEP_A = 0.25f;      // quiescent level change = step event
+const float DRAIN_SLEEP_MAX_A = 0.30f; // level expected once modules sleep
+const float DRAIN_ABNORMAL_A = 0.30f;  // daily median above this is flagged
+const uint32_t DRAIN_SETTLE_SEC =
+    2 * 3600; // modules must be asleep this long after parking
+const uint32_t DRAIN_REPORT_PERIOD_SEC =
+    24 * 3600; // publish a drain report per day of parked time
+
+// ------------------ Alternator ripple analysis ------------------
+// INA226 bus-only conversions at 140 us allow ~4 kHz sampling; ripple
+// above 2 kHz (high engine speed) aliases, which the diode score tolerates
+// because it compares relative line energies.
+const float RIPPLE_SAMPLE_RATE_HZ = 4000.0f;
+const uint32_t RIPPLE_SAMPLE_PERIOD_US = 250;
+const uint32_t RIPPLE_INTERVAL_MS =
+    5UL * 60UL * 1000UL; // one burst per 5 min while charging
+const float INA226_BUS_LSB_MV = 1.25f;
+
+// ------------------ Store-and-forward outbox (LittleFS) ------------------
+// Frames that cannot be published are queued in flash and replayed, oldest
+// first, to MQTT_BACKLOG_TOPIC once MQTT is back.
+const uint16_t OUTBOX_MAX_SEGMENTS = 32; // x 4 KB = 3616 frames
+const uint32_t OUTBOX_STORE_INTERVAL_MS =
+    60000; // one frame per minute while awake and offline
+const int OUTBOX_REPLAY_BATCH = 8;
+const uint32_t OUTBOX_REPLAY_BUDGET_MS = 30;    // per net task run
+const uint32_t OUTBOX_SNAPSHOT_BUDGET_MS = 1500; // per snapshot wake
+// time() below this means SNTP has not set the clock yet (2023-11-14)
+const uint32_t MIN_VALID_EPOCH = 1700000000UL;
+
+// ------------------ History rollups (history/rollup.h) ------------------
+// 1 min / 1 h / 1 day buckets in RAM, checkpointed to LittleFS (by the net
+// task) whenever an hour closes and before deep sleep; written to
+// HISTORY_TMP_PATH first, then renamed. BLE command HIST:M|H|D sends a tier
+// to MQTT_HISTORY_TOPIC, HISTORY_PAGE_ROWS buckets per message.
+static const char *HISTORY_PATH = "/history.bin";
+static const char *HISTORY_TMP_PATH = "/history.tmp";
+const uint8_t HISTORY_PAGE_ROWS = 20;
+
+// Start sending one rollup tier (RollupTier) to MQTT_HISTORY_TOPIC
+void requestHistory(uint8_t tier);
+
+// ------------------ Web dashboard (comms/web_mgr.*) ------------------
+// Dashboard at http://<device>/, live samples on ws://<device>/ws. Pending
+// samples go out as one frame per WEB_FRAME_INTERVAL_MS.
+const uint16_t WEB_PORT = 80;
+const uint32_t WEB_FRAME_INTERVAL_MS = 100;
+
+// ------------------ Logging (log/logger.h) ------------------
+// Records are formatted and written from the idle loop, at most
+// LOG_DRAIN_BUDGET_US per pass. BLE command LOG:E|W|I|D sets the level.
+const uint32_t LOG_DRAIN_BUDGET_US = 500;
+
 // BLE
 static const char *BLE_DEVICE_NAME = "ESP32-BattMon";
+// Packed telemetry (comms/ble_telemetry.h) is notified on a deadband change
+// (ReportPolicy) or at least every BLE_NOTIFY_HEARTBEAT_MS.
+const uint32_t BLE_NOTIFY_HEARTBEAT_MS = 60000;
+// Preferred ATT MTU for bulk transfers; telemetry fits the default 23.
+const uint16_t BLE_MTU = 247;
+// Connection parameters requested from a client: 100-200 ms interval
+// (1.25 ms units), 4 skippable events, 6 s supervision timeout (10 ms units)
+const uint16_t BLE_CONN_MIN_INTERVAL = 80;
+const uint16_t BLE_CONN_MAX_INTERVAL = 160;
+const uint16_t BLE_CONN_LATENCY = 4;
+const uint16_t BLE_CONN_TIMEOUT = 600;
+// History transfer (chTransfer): pumped every BLE_BULK_PUMP_MS, with a
+// 7.5-15 ms interval and no latency requested while it runs
+const uint32_t BLE_BULK_PUMP_MS = 10;
+const uint16_t BLE_BULK_MIN_INTERVAL = 6;
+const uint16_t BLE_BULK_MAX_INTERVAL = 12;
+const uint16_t BLE_BULK_TIMEOUT = 400;
 
 // Enable verbose debug serial output when set to 1
 #ifndef ENABLE_DEBUG_SERIAL
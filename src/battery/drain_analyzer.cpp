@@ -0,0 +1,206 @@
+#include "drain_analyzer.h"
+#include <cstdio>
+#include <cstring>
+
+void DrainAnalyzer::begin(const DrainConfig &cfg) {
+  _cfg = cfg;
+  if (_s.magic != DRAIN_STATE_MAGIC)
+    reset();
+}
+
+void DrainAnalyzer::reset() {
+  memset(&_s, 0, sizeof(_s));
+  _s.magic = DRAIN_STATE_MAGIC;
+  _s.level_A = NAN;
+  _s.lastStep_A = NAN;
+}
+
+void DrainAnalyzer::beginSession() {
+  _s.sessionActive = true;
+  _s.sessionFlags = 0;
+  _s.session_s = 0.0f;
+  _s.level_A = NAN;
+  _s.pendingCount = 0;
+}
+
+void DrainAnalyzer::endSession() {
+  _s.sessionActive = false;
+  _s.sessionFlags = 0;
+  _s.session_s = 0.0f;
+  _s.level_A = NAN;
+  _s.pendingCount = 0;
+}
+
+int DrainAnalyzer::binFor(float current_A) {
+  int bin = (int)floorf(logf(current_A / DRAIN_SKETCH_MIN_A) /
+                        logf(DRAIN_SKETCH_GAMMA));
+  if (bin < 0)
+    bin = 0;
+  if (bin >= DRAIN_SKETCH_BINS)
+    bin = DRAIN_SKETCH_BINS - 1;
+  return bin;
+}
+
+float DrainAnalyzer::binLower(int bin) {
+  return DRAIN_SKETCH_MIN_A * powf(DRAIN_SKETCH_GAMMA, (float)bin);
+}
+
+uint8_t DrainAnalyzer::addSample(float current_A, float dt_s) {
+  if (!std::isfinite(current_A) || !std::isfinite(dt_s) || dt_s <= 0.0f)
+    return DRAIN_EVT_NONE;
+
+  uint8_t evt = DRAIN_EVT_NONE;
+
+  // Period accumulators (discharge only; charging counts as "under")
+  _s.period_s += dt_s;
+  if (current_A > 0.0f)
+    _s.charge_As += current_A * dt_s;
+  if (current_A > _s.max_A)
+    _s.max_A = current_A;
+  if (current_A < DRAIN_SKETCH_MIN_A)
+    _s.under_s += dt_s;
+  else
+    _s.sketch_s[binFor(current_A)] += dt_s;
+
+  evt |= trackLevel(current_A, dt_s);
+
+  // Per-session check: modules should be asleep once settleSec has elapsed
+  if (_s.sessionActive) {
+    float prev = _s.session_s;
+    _s.session_s += dt_s;
+    if (!(_s.sessionFlags & DRAIN_FLAG_NO_SLEEP) &&
+        prev < (float)_cfg.settleSec &&
+        _s.session_s >= (float)_cfg.settleSec &&
+        _s.level_A > _cfg.sleepMaxA) {
+      _s.sessionFlags |= DRAIN_FLAG_NO_SLEEP;
+      _s.periodFlags |= DRAIN_FLAG_NO_SLEEP;
+      evt |= DRAIN_EVT_NO_SLEEP;
+    }
+  }
+
+  if (_s.period_s >= (float)_cfg.reportSec) {
+    finishPeriod();
+    evt |= DRAIN_EVT_REPORT;
+  }
+  return evt;
+}
+
+uint8_t DrainAnalyzer::trackLevel(float current_A, float dt_s) {
+  if (!std::isfinite(_s.level_A)) {
+    _s.level_A = current_A;
+    _s.pendingCount = 0;
+    return DRAIN_EVT_NONE;
+  }
+
+  float diff = current_A - _s.level_A;
+  if (fabsf(diff) < _cfg.stepA) {
+    // Quiet: follow slow drift of the quiescent level
+    _s.pendingCount = 0;
+    float alpha = dt_s / _cfg.levelTauSec;
+    if (alpha > 1.0f)
+      alpha = 1.0f;
+    _s.level_A += alpha * diff;
+    return DRAIN_EVT_NONE;
+  }
+
+  // Candidate new level: require two consecutive samples to confirm so a
+  // single transient (door, interior light blip) is not counted as a step.
+  bool sameSide = (_s.pendingCount > 0) &&
+                  ((_s.pending_A > _s.level_A) == (current_A > _s.level_A)) &&
+                  fabsf(current_A - _s.pending_A) < _cfg.stepA;
+  if (sameSide) {
+    _s.pending_A = (_s.pending_A * _s.pendingCount + current_A) /
+                   (float)(_s.pendingCount + 1);
+    _s.pendingCount++;
+  } else {
+    _s.pending_A = current_A;
+    _s.pendingCount = 1;
+  }
+  if (_s.pendingCount < 2)
+    return DRAIN_EVT_NONE;
+
+  _s.lastStep_A = _s.pending_A - _s.level_A;
+  _s.level_A = _s.pending_A;
+  _s.pendingCount = 0;
+  if (_s.steps < 0xFFFF)
+    _s.steps++;
+  return DRAIN_EVT_STEP;
+}
+
+float DrainAnalyzer::percentile(float q) const {
+  float total = _s.under_s;
+  for (int i = 0; i < DRAIN_SKETCH_BINS; ++i)
+    total += _s.sketch_s[i];
+  if (total <= 0.0f)
+    return NAN;
+  if (q < 0.0f)
+    q = 0.0f;
+  if (q > 1.0f)
+    q = 1.0f;
+
+  float target = q * total;
+  if (target <= _s.under_s)
+    return 0.0f;
+  float cum = _s.under_s;
+  for (int i = 0; i < DRAIN_SKETCH_BINS; ++i) {
+    float w = _s.sketch_s[i];
+    if (w <= 0.0f)
+      continue;
+    if (cum + w >= target) {
+      // Interpolate geometrically inside the bucket
+      float frac = (target - cum) / w;
+      return binLower(i) * powf(DRAIN_SKETCH_GAMMA, frac);
+    }
+    cum += w;
+  }
+  return _s.max_A;
+}
+
+float DrainAnalyzer::mean_A() const {
+  if (_s.period_s <= 0.0f)
+    return NAN;
+  return _s.charge_As / _s.period_s;
+}
+
+void DrainAnalyzer::resetPeriod() {
+  _s.period_s = 0.0f;
+  _s.charge_As = 0.0f;
+  _s.max_A = 0.0f;
+  memset(_s.sketch_s, 0, sizeof(_s.sketch_s));
+  _s.under_s = 0.0f;
+  _s.steps = 0;
+  _s.periodFlags = 0;
+}
+
+void DrainAnalyzer::finishPeriod() {
+  DrainReport &r = _s.report;
+  r.seq++;
+  r.period_s = (uint32_t)_s.period_s;
+  r.mean_A = mean_A();
+  r.p50_A = percentile(0.50f);
+  r.p90_A = percentile(0.90f);
+  r.p99_A = percentile(0.99f);
+  r.max_A = _s.max_A;
+  r.ah = _s.charge_As / 3600.0f;
+  r.steps = _s.steps;
+  r.flags = _s.periodFlags;
+  if (r.p50_A > _cfg.abnormalA)
+    r.flags |= DRAIN_FLAG_HIGH_DRAIN;
+  _s.reportPending = true;
+  resetPeriod();
+}
+
+bool buildDrainReportJson(const DrainReport &r, char *out, size_t outLen) {
+  int n = snprintf(
+      out, outLen,
+      "{\"event\":\"drain_report\",\"seq\":%lu,\"period_s\":%lu,"
+      "\"mean_mA\":%.1f,\"p50_mA\":%.1f,\"p90_mA\":%.1f,\"p99_mA\":%.1f,"
+      "\"max_mA\":%.1f,\"ah\":%.3f,\"steps\":%u,\"no_sleep\":%s,"
+      "\"high_drain\":%s}",
+      (unsigned long)r.seq, (unsigned long)r.period_s, r.mean_A * 1000.0f,
+      r.p50_A * 1000.0f, r.p90_A * 1000.0f, r.p99_A * 1000.0f,
+      r.max_A * 1000.0f, r.ah, (unsigned)r.steps,
+      (r.flags & DRAIN_FLAG_NO_SLEEP) ? "true" : "false",
+      (r.flags & DRAIN_FLAG_HIGH_DRAIN) ? "true" : "false");
+  return n > 0 && (size_t)n < outLen;
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Parked parasitic-drain analyzer.
+//
+// Keeps streaming statistics of the quiescent current while the car is parked
+// (MODE_PARKED_IDLE samples and deep-sleep snapshot wakes): time-weighted
+// mean, percentiles from a fixed log-bucket sketch, and step events in the
+// quiescent level. All state lives in `DrainState`, a plain struct with no
+// constructor, so it can be placed in RTC memory and survive deep sleep.
+
+static constexpr int DRAIN_SKETCH_BINS = 40;
+static constexpr float DRAIN_SKETCH_MIN_A = 0.010f; // lower edge of bin 0
+static constexpr float DRAIN_SKETCH_GAMMA = 1.25f;  // bin width ratio (~±11%)
+static constexpr uint32_t DRAIN_STATE_MAGIC = 0xD7A1E026u;
+
+enum DrainFlags : uint8_t {
+  DRAIN_FLAG_NO_SLEEP = 0x01,   // level never fell below sleep threshold
+  DRAIN_FLAG_HIGH_DRAIN = 0x02, // median drain above abnormal threshold
+};
+
+enum DrainEvent : uint8_t {
+  DRAIN_EVT_NONE = 0,
+  DRAIN_EVT_STEP = 0x01,     // quiescent level stepped up or down
+  DRAIN_EVT_NO_SLEEP = 0x02, // settle time elapsed, level still high
+  DRAIN_EVT_REPORT = 0x04,   // a report period completed (see report())
+};
+
+struct DrainConfig {
+  float stepA = 0.25f;            // level change counted as a step event
+  float sleepMaxA = 0.30f;        // level considered "modules asleep"
+  float abnormalA = 0.30f;        // report median above this is flagged
+  uint32_t settleSec = 2 * 3600;  // modules must be asleep after this
+  uint32_t reportSec = 24 * 3600; // report period (parked time covered)
+  float levelTauSec = 60.0f;      // EWMA time constant for level tracking
+};
+
+// Completed report for one period (normally one day of parked time).
+struct DrainReport {
+  uint32_t seq;      // increments for every completed report
+  uint32_t period_s; // parked time covered by this report
+  float mean_A;
+  float p50_A, p90_A, p99_A;
+  float max_A;
+  float ah;       // charge drawn while parked in this period
+  uint16_t steps; // step events in this period
+  uint8_t flags;  // DrainFlags
+};
+
+// Plain state (zero-initialisable, RTC-safe). Do not add constructors or
+// default member initialisers: `RTC_DATA_ATTR` copies must not be reset by
+// C++ static initialisation on every wake.
+struct DrainState {
+  uint32_t magic;
+  // Accumulators for the current report period
+  float period_s;
+  float charge_As;
+  float max_A;
+  float sketch_s[DRAIN_SKETCH_BINS]; // seconds spent in each bucket
+  float under_s; // seconds below DRAIN_SKETCH_MIN_A (incl. charging)
+  uint16_t steps;
+  uint8_t periodFlags;
+  // Parked session (reset when the car becomes active)
+  bool sessionActive;
+  uint8_t sessionFlags;
+  float session_s;
+  float level_A; // tracked quiescent level, NAN until first sample
+  float pending_A;
+  uint8_t pendingCount;
+  float lastStep_A;
+  // Last completed report, kept until published
+  bool reportPending;
+  DrainReport report;
+};
+
+class DrainAnalyzer {
+public:
+  explicit DrainAnalyzer(DrainState &state) : _s(state) {}
+
+  // Validate persisted state (RTC memory) and reset it if it is garbage.
+  void begin(const DrainConfig &cfg);
+  void reset();
+
+  // Parked session boundaries. Statistics for the report period keep
+  // accumulating across sessions; only the no-sleep tracker is per session.
+  void beginSession();
+  void endSession();
+  bool inSession() const { return _s.sessionActive; }
+
+  // Add one current sample covering `dt_s` seconds. Returns DrainEvent bits.
+  uint8_t addSample(float current_A, float dt_s);
+
+  // Percentile (0..1) of the current period, estimated from the sketch.
+  float percentile(float q) const;
+  float mean_A() const;
+  float level_A() const { return _s.level_A; }
+  float lastStep_A() const { return _s.lastStep_A; }
+  float session_s() const { return _s.session_s; }
+
+  bool reportPending() const { return _s.reportPending; }
+  const DrainReport &report() const { return _s.report; }
+  void clearReport() { _s.reportPending = false; }
+
+private:
+  DrainState &_s;
+  DrainConfig _cfg;
+
+  static int binFor(float current_A);
+  static float binLower(int bin);
+  void resetPeriod();
+  void finishPeriod();
+  uint8_t trackLevel(float current_A, float dt_s);
+};
+
+// Serialise a report as JSON.
+bool buildDrainReportJson(const DrainReport &r, char *out, size_t outLen);
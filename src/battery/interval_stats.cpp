@@ -0,0 +1,55 @@
+#include "interval_stats.h"
+#include <math.h>
+
+void IntervalAggregator::Moments::add(float x) {
+  ++n;
+  if (n == 1 || x < min)
+    min = x;
+  if (n == 1 || x > max)
+    max = x;
+  float w = 1.0f / (float)n;
+  mean += (x - mean) * w;
+  meanSq += (x * x - meanSq) * w;
+}
+
+void IntervalAggregator::Moments::fill(float &mn, float &mx, float &mu,
+                                       float &rms) const {
+  if (!n) {
+    mn = mx = mu = rms = NAN;
+    return;
+  }
+  mn = min;
+  mx = max;
+  mu = mean;
+  rms = sqrtf(meanSq);
+}
+
+void IntervalAggregator::add(float V, float I, uint32_t now_ms) {
+  if (isfinite(V))
+    _v.add(V);
+  if (!isfinite(I))
+    return;
+  _i.add(I);
+  if (_hasLast)
+    _charge_As += 0.5 * ((double)_lastI + I) * (now_ms - _lastMs) / 1000.0;
+  _lastI = I;
+  _lastMs = now_ms;
+  _hasLast = true;
+}
+
+IntervalStats IntervalAggregator::stats() const {
+  IntervalStats s;
+  s.n = _i.n;
+  s.span_ms = _hasLast && _i.n ? _lastMs - _startMs : 0;
+  _v.fill(s.V_min, s.V_max, s.V_mean, s.V_rms);
+  _i.fill(s.I_min, s.I_max, s.I_mean, s.I_rms);
+  s.charge_mAh = (float)(_charge_As / 3.6);
+  return s;
+}
+
+void IntervalAggregator::reset(uint32_t now_ms) {
+  _v = Moments();
+  _i = Moments();
+  _charge_As = 0.0;
+  _startMs = now_ms;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Publish-interval statistics of voltage and current.
+//
+// Every sample between two published frames goes into the aggregator, so a
+// load burst shorter than the publish interval still shows in the frame as
+// min/max and in the mean/RMS. Mean and mean square are updated in one pass
+// (running means, no sums that grow with the interval), and the charge is
+// integrated with the trapezoidal rule like the coulomb counter. Fixed size,
+// no allocation.
+
+struct IntervalStats {
+  uint32_t n;       // samples with a finite current
+  uint32_t span_ms; // interval start to last sample
+  float V_min, V_max, V_mean, V_rms;
+  float I_min, I_max, I_mean, I_rms;
+  float charge_mAh; // integral of the current, same sign as current_A
+};
+
+class IntervalAggregator {
+public:
+  // Non-finite values are skipped (a missing voltage still counts the
+  // current).
+  void add(float V, float I, uint32_t now_ms);
+  // Statistics since the last reset(); NaN min/max/mean/RMS without samples
+  IntervalStats stats() const;
+  // Start a new interval at `now_ms`. The last sample is kept, so the charge
+  // between it and the next sample is counted in the new interval.
+  void reset(uint32_t now_ms);
+
+private:
+  struct Moments {
+    uint32_t n;
+    float min, max, mean, meanSq;
+    void add(float x);
+    void fill(float &mn, float &mx, float &mu, float &rms) const;
+  };
+
+  Moments _v{}, _i{};
+  uint32_t _startMs = 0, _lastMs = 0;
+  float _lastI = 0.0f;
+  bool _hasLast = false;
+  double _charge_As = 0.0;
+};
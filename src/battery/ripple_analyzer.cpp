@@ -0,0 +1,164 @@
+#include "ripple_analyzer.h"
+#include "../dsp/fft_q15.h"
+#include <cmath>
+#include <cstdio>
+
+// Hann window: a centred tone spreads over bins k-1..k+1 with relative
+// magnitudes 1/2 : 1 : 1/2, i.e. 1.5x the peak-bin energy, and the coherent
+// gain is 1/2. With the FFT's 1/N output scaling a tone of amplitude A lands
+// at |X[k]| = A / 4.
+static constexpr float HANN_ENERGY_SPREAD = 1.5f;
+static constexpr float HANN_AMPLITUDE_FACTOR = 4.0f;
+static constexpr float Q15_INPUT_PEAK = 16383.0f; // leave 6 dB headroom
+
+// Ripple candidates as multiples of the dominant line: if the dominant line is
+// itself a diode-fault sub-harmonic, the real ripple line sits at 2x/3x/6x.
+static const int RIPPLE_MULTIPLES[] = {6, 3, 2};
+static constexpr float RIPPLE_CANDIDATE_MIN_RATIO = 0.25f;
+static constexpr int RIPPLE_MIN_BINS_FOR_SCORE = 24;
+
+RippleResult RippleAnalyzer::analyze(const uint16_t *raw, int n,
+                                     float sampleRateHz, float lsb_mV) {
+  RippleResult r;
+  r.valid = false;
+  r.ripple_mVrms = NAN;
+  r.ripple_mVpp = NAN;
+  r.dominant_Hz = NAN;
+  r.dominant_mV = NAN;
+  r.ripple_Hz = NAN;
+  r.diodeScore = NAN;
+  if (!raw || n != RIPPLE_N || !(sampleRateHz > 0.0f))
+    return r;
+
+  // Time-domain statistics
+  int64_t sum = 0;
+  uint16_t lo = raw[0], hi = raw[0];
+  for (int i = 0; i < n; ++i) {
+    sum += raw[i];
+    if (raw[i] < lo)
+      lo = raw[i];
+    if (raw[i] > hi)
+      hi = raw[i];
+  }
+  const float mean = (float)sum / (float)n;
+  float acc2 = 0.0f;
+  float maxAbs = 0.0f;
+  for (int i = 0; i < n; ++i) {
+    float d = (float)raw[i] - mean;
+    acc2 += d * d;
+    if (fabsf(d) > maxAbs)
+      maxAbs = fabsf(d);
+  }
+  r.ripple_mVrms = sqrtf(acc2 / (float)n) * lsb_mV;
+  r.ripple_mVpp = (float)(hi - lo) * lsb_mV;
+  r.valid = true;
+  if (maxAbs <= 0.0f) {
+    r.dominant_Hz = 0.0f;
+    r.dominant_mV = 0.0f;
+    return r;
+  }
+
+  // Scale into Q15, window, transform
+  _scale = Q15_INPUT_PEAK / maxAbs;
+  for (int i = 0; i < n; ++i) {
+    float d = ((float)raw[i] - mean) * _scale;
+    _re[i] = (int16_t)lrintf(d * (float)hannQ15(i, n) / 32768.0f);
+    _im[i] = 0;
+  }
+  fftQ15(_re, _im, RIPPLE_LOG2N);
+
+  // Dominant line above RIPPLE_MIN_HZ
+  const float binHz = sampleRateHz / (float)n;
+  int minBin = (int)ceilf(RIPPLE_MIN_HZ / binHz);
+  if (minBin < 2)
+    minBin = 2;
+  const int maxBin = n / 2 - 2;
+  int kd = minBin;
+  uint32_t best = 0;
+  for (int k = minBin; k <= maxBin; ++k) {
+    uint32_t p = fftQ15Power(_re, _im, k);
+    if (p > best) {
+      best = p;
+      kd = k;
+    }
+  }
+  // Parabolic interpolation on magnitudes
+  float m0 = magnitude(kd - 1), m1 = magnitude(kd), m2 = magnitude(kd + 1);
+  float den = m0 - 2.0f * m1 + m2;
+  float delta = (den != 0.0f) ? 0.5f * (m0 - m2) / den : 0.0f;
+  if (delta > 0.5f)
+    delta = 0.5f;
+  if (delta < -0.5f)
+    delta = -0.5f;
+  const float kdFrac = (float)kd + delta;
+  r.dominant_Hz = kdFrac * binHz;
+  r.dominant_mV = binAmplitude(kd) * lsb_mV;
+
+  // Pick the ripple fundamental
+  const float eDominant = bandEnergy(kd, 1);
+  float krFrac = kdFrac;
+  for (size_t i = 0; i < sizeof(RIPPLE_MULTIPLES) / sizeof(int); ++i) {
+    float cand = kdFrac * (float)RIPPLE_MULTIPLES[i];
+    int kc = (int)lrintf(cand);
+    if (kc > maxBin)
+      continue;
+    if (bandEnergy(kc, 1) >= RIPPLE_CANDIDATE_MIN_RATIO * eDominant) {
+      krFrac = cand;
+      break;
+    }
+  }
+  r.ripple_Hz = krFrac * binHz;
+
+  // Diode score: sub-harmonic energy at j/6 of the ripple line
+  const int kr = (int)lrintf(krFrac);
+  if (kr < RIPPLE_MIN_BINS_FOR_SCORE)
+    return r;
+  const float eMain = bandEnergy(kr, 2);
+  float eSub = 0.0f;
+  for (int j = 1; j <= 5; ++j) {
+    int kj = (int)lrintf(krFrac * (float)j / 6.0f);
+    if (kj >= minBin)
+      eSub += bandEnergy(kj, 1);
+  }
+  if (eMain + eSub > 0.0f)
+    r.diodeScore = eSub / (eMain + eSub);
+  return r;
+}
+
+float RippleAnalyzer::magnitude(int k) const {
+  if (k < 0 || k >= RIPPLE_N)
+    return 0.0f;
+  return sqrtf((float)fftQ15Power(_re, _im, k));
+}
+
+float RippleAnalyzer::bandEnergy(int center, int halfWidth) const {
+  float e = 0.0f;
+  for (int k = center - halfWidth; k <= center + halfWidth; ++k) {
+    if (k < 1 || k >= RIPPLE_N / 2)
+      continue;
+    e += (float)fftQ15Power(_re, _im, k);
+  }
+  return e;
+}
+
+float RippleAnalyzer::binAmplitude(int k) const {
+  // Sum +-2 bins so off-bin tones (scalloping) are still measured in full
+  float e = bandEnergy(k, 2);
+  return HANN_AMPLITUDE_FACTOR * sqrtf(e / HANN_ENERGY_SPREAD) / _scale;
+}
+
+bool buildRippleJson(const RippleResult &r, char *out, size_t outLen) {
+  char scoreStr[16];
+  if (std::isfinite(r.diodeScore))
+    snprintf(scoreStr, sizeof(scoreStr), "%.3f", r.diodeScore);
+  else
+    snprintf(scoreStr, sizeof(scoreStr), "null");
+  int n = snprintf(out, outLen,
+                   "{\"event\":\"ripple\",\"ripple_mVrms\":%.1f,"
+                   "\"ripple_mVpp\":%.1f,\"dominant_Hz\":%.1f,"
+                   "\"dominant_mV\":%.1f,\"ripple_Hz\":%.1f,"
+                   "\"diode_score\":%s}",
+                   r.ripple_mVrms, r.ripple_mVpp, r.dominant_Hz, r.dominant_mV,
+                   r.ripple_Hz, scoreStr);
+  return n > 0 && (size_t)n < outLen;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Alternator ripple analysis over a burst capture of raw INA226 bus-voltage
+// codes (see INA226Bus::captureBusRaw).
+//
+// The capture is mean-removed, Hann-windowed and transformed with the Q15 FFT.
+// A healthy three-phase bridge produces ripple at 6x the alternator's
+// electrical frequency; an open or shorted rectifier diode adds strong lines
+// at 1/6..5/6 of that ripple frequency. `diodeScore` is the share of ripple
+// energy in those sub-harmonics (0 = clean, towards 1 = likely diode fault).
+
+static constexpr int RIPPLE_LOG2N = 9;
+static constexpr int RIPPLE_N = 1 << RIPPLE_LOG2N; // samples per capture
+static constexpr float RIPPLE_MIN_HZ = 30.0f; // ignore slow load variations
+
+struct RippleResult {
+  bool valid;
+  float ripple_mVrms; // AC RMS of the capture (time domain)
+  float ripple_mVpp;  // peak-to-peak of the capture
+  float dominant_Hz;  // strongest spectral line (interpolated)
+  float dominant_mV;  // amplitude of that line
+  float ripple_Hz;    // line used as the rectifier ripple fundamental
+  float diodeScore;   // NAN if the ripple line is too low to resolve
+};
+
+class RippleAnalyzer {
+public:
+  // `raw` holds `n` (== RIPPLE_N) bus-voltage codes sampled at sampleRateHz;
+  // lsb_mV is the code weight (1.25 mV for the INA226 bus register).
+  RippleResult analyze(const uint16_t *raw, int n, float sampleRateHz,
+                       float lsb_mV);
+
+  // Amplitude (in input codes) of a sinusoid centred on bin k, from the last
+  // analysed spectrum. Exposed for tests.
+  float binAmplitude(int k) const;
+
+private:
+  int16_t _re[RIPPLE_N];
+  int16_t _im[RIPPLE_N];
+  float _scale = 1.0f; // codes -> Q15 input scale of the last capture
+
+  float bandEnergy(int center, int halfWidth) const;
+  float magnitude(int k) const;
+};
+
+// Serialise a ripple result as JSON.
+bool buildRippleJson(const RippleResult &r, char *out, size_t outLen);
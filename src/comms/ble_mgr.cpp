@@ -1,5 +1,7 @@
 #include "ble_mgr.h"
 #include "../learner/rint_learner.h"
+#include "../log/logger.h"
+#include "../sched/profiler.h"
 #include <Preferences.h>
 #include <app_config.h>
 #include <comms/mqtt_mgr.h>
@@ -7,87 +9,91 @@
 // mqtt instance declared in main.cpp
 extern MqttMgr mqtt;
 
+// Command writes are parsed without allocating (the NimBLE task runs this)
+// and queued for BleMgr::process()
 class CommandCallbacks : public NimBLECharacteristicCallbacks {
 public:
   explicit CommandCallbacks(BleMgr *mgr) : _mgr(mgr) {}
   void onWrite(NimBLECharacteristic *pCharacteristic,
                NimBLEConnInfo &connInfo) override {
-    std::string value = pCharacteristic->getValue();
-    DBG_PRINTF("[BLE] Command received (queued): %s\n", value.c_str());
-    // Make a case-insensitive copy for command matching
-    std::string u = value;
-    for (auto &ch : u)
-      ch = (char)toupper((unsigned char)ch);
-    // Check for SET_CAP command with a numeric parameter
-    if (u.rfind("SET_CAP", 0) == 0) {
-      // Accept formats: "SET_CAP:12.5" or "SET_CAP 12.5" or "SET_CAP=12.5"
-      size_t pos = value.find_first_of(": =", 7);
-      std::string num;
-      if (pos != std::string::npos)
-        num = value.substr(pos + 1);
-      else if (value.size() > 7)
-        num = value.substr(7);
-      float v = NAN;
-      if (!num.empty())
-        v = atof(num.c_str());
-      if (isfinite(v) && v > 0.0f) {
-        _mgr->enqueueCommand(BleMgr::CMD_SET_CAP, v);
-        pCharacteristic->setValue("QUEUED_SET_CAP");
-        pCharacteristic->notify();
-      } else {
-        pCharacteristic->setValue("BAD_PARAM");
-        pCharacteristic->notify();
-      }
+    NimBLEAttValue value = pCharacteristic->getValue();
+    // NOTE: processing of queued commands (including NVS_TEST) occurs
+    // in BleMgr::process() running in the main loop. Avoid doing heavy
+    // work inside the NimBLE callback context.
+    _mgr->submitCommand((const char *)value.data(), value.size(),
+                        CMD_SRC_BLE);
+  }
+
+private:
+  BleMgr *_mgr;
+};
+
+// Legacy string characteristics: formatted from the latest packed frame
+// when a client reads them (NimBLE task), never notified
+class LegacyReadCallbacks : public NimBLECharacteristicCallbacks {
+public:
+  explicit LegacyReadCallbacks(BleMgr *mgr) : _mgr(mgr) {}
+  void onRead(NimBLECharacteristic *ch, NimBLEConnInfo &connInfo) override {
+    BleHandles &h = _mgr->handles();
+    char buf[24];
+    if (ch == h.chCapacity) {
+      snprintf(buf, sizeof(buf), "%.2f Ah", batteryCapacityAh);
+      ch->setValue(buf);
       return;
     }
-
-    // Check for SET_BASE or SET_BASELINE to set Rint baseline (mOhm)
-    if (u.rfind("SET_BASE", 0) == 0 || u.rfind("SET_BASELINE", 0) == 0) {
-      size_t pos = value.find_first_of(": =", 9);
-      std::string num;
-      if (pos != std::string::npos)
-        num = value.substr(pos + 1);
-      else if (value.size() > 9)
-        num = value.substr(9);
-      float v = NAN;
-      if (!num.empty())
-        v = atof(num.c_str());
-      if (isfinite(v) && v > 0.0f) {
-        _mgr->enqueueCommand(BleMgr::CMD_SET_BASE, v);
-        pCharacteristic->setValue("QUEUED_SET_BASE");
-        pCharacteristic->notify();
-      } else {
-        pCharacteristic->setValue("BAD_PARAM");
-        pCharacteristic->notify();
-      }
+    uint8_t raw[BLE_TELEMETRY_BYTES];
+    BleTelemetry t;
+    if (!_mgr->latest(raw) || !decodeBleTelemetry(raw, sizeof(raw), t))
+      return; // keep the placeholder set in begin()
+    if (ch == h.chMode) {
+      ch->setValue((t.flags & BLE_TF_PARKED) ? "parked-idle" : "active");
       return;
     }
+    if (ch == h.chVoltage)
+      fmt(buf, sizeof(buf), "%.2f V", "— V", t.V);
+    else if (ch == h.chCurrent)
+      fmt(buf, sizeof(buf), "%.2f A", "— A", t.I);
+    else if (ch == h.chTemperature)
+      fmt(buf, sizeof(buf), "%.1f °C", "— °C", t.T);
+    else if (ch == h.chSOC)
+      fmt(buf, sizeof(buf), "%.1f %%", "— %", t.soc_pct);
+    else if (ch == h.chSOH)
+      fmt(buf, sizeof(buf), "%.1f %%", "— %", t.soh_pct);
+    else if (ch == h.chAhLeft)
+      fmt(buf, sizeof(buf), "%.2f Ah", "— Ah", t.ah_left);
+    else
+      return;
+    ch->setValue(buf);
+  }
 
-    if (u == "CLEAR_NVM") {
-      _mgr->enqueueCommand(BleMgr::CMD_CLEAR_NVM);
-      pCharacteristic->setValue("QUEUED_CLEAR_NVM");
-      pCharacteristic->notify();
-    } else if (u == "NVS_TEST") {
-      _mgr->enqueueCommand(BleMgr::CMD_NVS_TEST);
-      pCharacteristic->setValue("QUEUED_NVS_TEST");
-      pCharacteristic->notify();
-    } else if (u == "RESET") {
-      _mgr->enqueueCommand(BleMgr::CMD_RESET);
-      pCharacteristic->setValue("QUEUED_RESET");
-      pCharacteristic->notify();
-    } else if (u == "CLEAR_RESET") {
-      _mgr->enqueueCommand(BleMgr::CMD_CLEAR_RESET);
-      pCharacteristic->setValue("QUEUED_CLEAR_RESET");
-      pCharacteristic->notify();
-    }
-    // NOTE: processing of queued commands (including NVS_TEST) occurs
-    // in BleMgr::process() running in the main loop. Avoid doing heavy
-    // work inside the NimBLE callback context.
-    else {
-      DBG_PRINTF("[BLE] Unknown command (queued): %s\n", value.c_str());
-      pCharacteristic->setValue("UNKNOWN_CMD");
-      pCharacteristic->notify();
+private:
+  BleMgr *_mgr;
+
+  static void fmt(char *buf, size_t len, const char *f, const char *none,
+                  float v) {
+    if (isfinite(v))
+      snprintf(buf, len, f, v);
+    else
+      snprintf(buf, len, "%s", none);
+  }
+};
+
+// Transfer control writes: copied into the mailbox, handled in the loop
+class TransferCallbacks : public NimBLECharacteristicCallbacks {
+public:
+  explicit TransferCallbacks(BleMgr *mgr) : _mgr(mgr) {}
+  void onWrite(NimBLECharacteristic *ch, NimBLEConnInfo &connInfo) override {
+    NimBLEAttValue v = ch->getValue();
+    uint8_t head = _mgr->_ctlHead;
+    if ((uint8_t)(head - _mgr->_ctlTail) >= BleMgr::CTL_SLOTS ||
+        v.size() > sizeof(BleMgr::ControlMsg::b)) {
+      _mgr->_ctlDropped++;
+      return;
     }
+    BleMgr::ControlMsg &m = _mgr->_ctl[head & (BleMgr::CTL_SLOTS - 1)];
+    memcpy(m.b, v.data(), v.size());
+    m.len = (uint8_t)v.size();
+    _mgr->_ctlHead = head + 1;
   }
 
 private:
@@ -98,15 +104,31 @@ class ServerCallbacks : public NimBLEServerCallbacks {
 public:
   explicit ServerCallbacks(BleMgr *mgr) : _mgr(mgr) {}
   void onConnect(NimBLEServer *pServer, NimBLEConnInfo &connInfo) override {
+    _mgr->_connectSinceMs = millis();
+    _mgr->_connHandle = connInfo.getConnHandle();
+    _mgr->_mtu = 23;
+    _mgr->_bulkReset = true;
+    _mgr->_newClient = true;
     _mgr->_clientConnected = true;
+    // Long interval plus slave latency: the link idles between the sparse
+    // telemetry notifications
+    pServer->updateConnParams(connInfo.getConnHandle(), BLE_CONN_MIN_INTERVAL,
+                              BLE_CONN_MAX_INTERVAL, BLE_CONN_LATENCY,
+                              BLE_CONN_TIMEOUT);
     DBG_PRINTLN("[BLE] Client connected");
   }
   void onDisconnect(NimBLEServer *pServer, NimBLEConnInfo &connInfo,
                     int reason) override {
     _mgr->_clientConnected = false;
+    _mgr->_bulkReset = true;
+    _mgr->_connectedMs += millis() - _mgr->_connectSinceMs;
     DBG_PRINTLN("[BLE] Client disconnected - advertising");
     NimBLEDevice::startAdvertising();
   }
+  void onMTUChange(uint16_t mtu, NimBLEConnInfo &connInfo) override {
+    _mgr->_mtu = mtu;
+    LOGI("BLE MTU %u", (unsigned)mtu);
+  }
 
 private:
   BleMgr *_mgr;
@@ -115,40 +137,40 @@ private:
 void BleMgr::begin(const char *deviceName) {
   NimBLEDevice::init(deviceName);
   NimBLEDevice::setPower(ESP_PWR_LVL_N0);
+  NimBLEDevice::setMTU(BLE_MTU);
   _server = NimBLEDevice::createServer();
   _server->setCallbacks(new ServerCallbacks(this));
 
   auto svc = _server->createService("a94f0001-12d3-11ee-be56-0242ac120002");
   _handles.chVoltage = svc->createCharacteristic(
-      "a94f0002-12d3-11ee-be56-0242ac120002",
-      NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY);
+      "a94f0002-12d3-11ee-be56-0242ac120002", NIMBLE_PROPERTY::READ);
   _handles.chCurrent = svc->createCharacteristic(
-      "a94f0003-12d3-11ee-be56-0242ac120002",
-      NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY);
+      "a94f0003-12d3-11ee-be56-0242ac120002", NIMBLE_PROPERTY::READ);
   _handles.chTemperature = svc->createCharacteristic(
-      "a94f0004-12d3-11ee-be56-0242ac120002",
-      NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY);
+      "a94f0004-12d3-11ee-be56-0242ac120002", NIMBLE_PROPERTY::READ);
   _handles.chMode = svc->createCharacteristic(
-      "a94f0005-12d3-11ee-be56-0242ac120002",
-      NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY);
+      "a94f0005-12d3-11ee-be56-0242ac120002", NIMBLE_PROPERTY::READ);
   _handles.chCommand = svc->createCharacteristic(
       "a94f0006-12d3-11ee-be56-0242ac120002",
       NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::WRITE | NIMBLE_PROPERTY::NOTIFY);
   _handles.chSOC = svc->createCharacteristic(
-      "a94f0007-12d3-11ee-be56-0242ac120002",
-      NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY);
+      "a94f0007-12d3-11ee-be56-0242ac120002", NIMBLE_PROPERTY::READ);
   _handles.chSOH = svc->createCharacteristic(
-      "a94f0008-12d3-11ee-be56-0242ac120002",
-      NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY);
+      "a94f0008-12d3-11ee-be56-0242ac120002", NIMBLE_PROPERTY::READ);
   _handles.chCapacity = svc->createCharacteristic(
-      "a94f0009-12d3-11ee-be56-0242ac120002",
-      NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY);
+      "a94f0009-12d3-11ee-be56-0242ac120002", NIMBLE_PROPERTY::READ);
   _handles.chStatus = svc->createCharacteristic(
       "a94f000a-12d3-11ee-be56-0242ac120002",
       NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY);
   _handles.chAhLeft = svc->createCharacteristic(
-      "a94f000b-12d3-11ee-be56-0242ac120002",
+      "a94f000b-12d3-11ee-be56-0242ac120002", NIMBLE_PROPERTY::READ);
+  _handles.chTelemetry = svc->createCharacteristic(
+      "a94f000c-12d3-11ee-be56-0242ac120002",
       NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY);
+  _handles.chTransfer = svc->createCharacteristic(
+      "a94f000d-12d3-11ee-be56-0242ac120002",
+      NIMBLE_PROPERTY::WRITE | NIMBLE_PROPERTY::WRITE_NR |
+          NIMBLE_PROPERTY::NOTIFY);
 
   _handles.chVoltage->createDescriptor("2901")->setValue("Battery Voltage (V)");
   _handles.chCurrent->createDescriptor("2901")->setValue("Battery Current (A)");
@@ -163,7 +185,18 @@ void BleMgr::begin(const char *deviceName) {
       "Battery Capacity (Ah)");
   _handles.chStatus->createDescriptor("2901")->setValue("Device Status");
   _handles.chAhLeft->createDescriptor("2901")->setValue("Ah Left (Ah)");
+  _handles.chTelemetry->createDescriptor("2901")->setValue(
+      "Telemetry (packed v1)");
+  _handles.chTransfer->createDescriptor("2901")->setValue(
+      "History transfer");
   _handles.chCommand->setCallbacks(new CommandCallbacks(this));
+  _handles.chTransfer->setCallbacks(new TransferCallbacks(this));
+  auto legacy = new LegacyReadCallbacks(this);
+  for (NimBLECharacteristic *ch :
+       {_handles.chVoltage, _handles.chCurrent, _handles.chTemperature,
+        _handles.chMode, _handles.chSOC, _handles.chSOH, _handles.chCapacity,
+        _handles.chAhLeft})
+    ch->setCallbacks(legacy);
 
   _handles.chVoltage->setValue("— V");
   _handles.chCurrent->setValue("— A");
@@ -191,52 +224,118 @@ void BleMgr::begin(const char *deviceName) {
   DBG_PRINTLN("[BLE] Advertising started");
 }
 
-void BleMgr::update(float V, float I, float T, const char *mode, float soc_pct,
-                    float soh_pct, float ah_left) {
+void BleMgr::update(const TelemetryFrame &f, uint32_t now_ms) {
+  uint8_t frame[BLE_TELEMETRY_BYTES];
+  if (!encodeBleTelemetry(f, _seq, frame, sizeof(frame)))
+    return;
+  portENTER_CRITICAL(&_mux);
+  memcpy(_packed, frame, sizeof(frame));
+  _havePacked = true;
+  portEXIT_CRITICAL(&_mux);
+  _handles.chTelemetry->setValue(frame, sizeof(frame));
   if (!_clientConnected)
     return;
-  char bufV[16], bufI[16], bufT[16], bufSOC[16], bufSOH[16];
-  snprintf(bufV, sizeof(bufV), "%.2f V", V);
-  snprintf(bufI, sizeof(bufI), "%.2f A", I);
-  if (isfinite(T))
-    snprintf(bufT, sizeof(bufT), "%.1f °C", T);
-  else
-    snprintf(bufT, sizeof(bufT), "— °C");
-  if (isfinite(soc_pct))
-    snprintf(bufSOC, sizeof(bufSOC), "%.1f %%", soc_pct);
-  else
-    snprintf(bufSOC, sizeof(bufSOC), "— %%");
-  if (isfinite(soh_pct))
-    snprintf(bufSOH, sizeof(bufSOH), "%.1f %%", soh_pct);
-  else
-    snprintf(bufSOH, sizeof(bufSOH), "— %%");
-  _handles.chVoltage->setValue(bufV);
-  _handles.chCurrent->setValue(bufI);
-  _handles.chTemperature->setValue(bufT);
-  _handles.chMode->setValue(mode);
-  _handles.chSOC->setValue(bufSOC);
-  _handles.chSOH->setValue(bufSOH);
-  _handles.chVoltage->notify();
-  _handles.chCurrent->notify();
-  _handles.chTemperature->notify();
-  _handles.chMode->notify();
-  _handles.chSOC->notify();
-  _handles.chSOH->notify();
-  if (_handles.chCapacity) {
-    char bufCap[16];
-    snprintf(bufCap, sizeof(bufCap), "%.2f Ah", batteryCapacityAh);
-    _handles.chCapacity->setValue(bufCap);
-    _handles.chCapacity->notify();
+  if (_newClient) {
+    _newClient = false;
+    _gate.reset(); // a new client gets the current frame right away
+  }
+  if (_gate.check(f, now_ms, false, BLE_NOTIFY_HEARTBEAT_MS) == RR_NONE)
+    return;
+  _gate.sent(f, now_ms);
+  _handles.chTelemetry->notify();
+  _notifies++;
+  _seq++;
+}
+
+bool BleMgr::latest(uint8_t *out) const {
+  portENTER_CRITICAL(&_mux);
+  bool have = _havePacked;
+  if (have)
+    memcpy(out, _packed, sizeof(_packed));
+  portEXIT_CRITICAL(&_mux);
+  return have;
+}
+
+uint32_t BleMgr::connectedMs(uint32_t now_ms) const {
+  return _connectedMs + (_clientConnected ? now_ms - _connectSinceMs : 0);
+}
+
+void BleMgr::serviceTransfer(uint32_t now_ms) {
+  if (_bulkReset) {
+    // The device side does not outlive a connection; the client resumes
+    _bulkReset = false;
+    _fastConn = false;
+    if (_bulk.active())
+      _bulk.abort();
+  }
+  while (_ctlTail != _ctlHead) {
+    const ControlMsg &m = _ctl[_ctlTail & (CTL_SLOTS - 1)];
+    if (m.len && m.b[0] == BULK_START) {
+      uint16_t mtu = _mtu;
+      _bulk.setMaxNotify(mtu > 3 ? mtu - 3 : 20);
+    }
+    _bulk.onControl(m.b, m.len, now_ms);
+    _ctlTail = _ctlTail + 1;
   }
-  if (_handles.chAhLeft) {
-    char bufAh[16];
-    if (isfinite(ah_left))
-      snprintf(bufAh, sizeof(bufAh), "%.2f Ah", ah_left);
+  bool active = _bulk.active() && _clientConnected;
+  if (active != _fastConn && _clientConnected) {
+    // Short interval without latency for the transfer, low power after
+    if (active)
+      _server->updateConnParams(_connHandle, BLE_BULK_MIN_INTERVAL,
+                                BLE_BULK_MAX_INTERVAL, 0, BLE_BULK_TIMEOUT);
     else
-      snprintf(bufAh, sizeof(bufAh), "— Ah");
-    _handles.chAhLeft->setValue(bufAh);
-    _handles.chAhLeft->notify();
+      _server->updateConnParams(_connHandle, BLE_CONN_MIN_INTERVAL,
+                                BLE_CONN_MAX_INTERVAL, BLE_CONN_LATENCY,
+                                BLE_CONN_TIMEOUT);
+    if (!active)
+      LOGI("BLE transfer: %lu bytes, %lu chunks, %lu rewinds",
+           (unsigned long)_bulk.acked(), (unsigned long)_bulk.chunks(),
+           (unsigned long)_bulk.rewinds());
+    _fastConn = active;
   }
+  if (!active)
+    return;
+  // As many notifications as the window and the stack's buffers take
+  uint8_t pkt[BLE_MTU - 3];
+  size_t n;
+  while ((n = _bulk.poll(pkt, sizeof(pkt), now_ms)) > 0) {
+    if (!_handles.chTransfer->notify(pkt, n, _connHandle)) {
+      _bulk.unsent();
+      break;
+    }
+  }
+}
+
+static_assert(TELEMETRY_ENC_JSON == 1 && TELEMETRY_ENC_CBOR == 2,
+              "ENC words in command_parser.cpp");
+
+bool BleMgr::submitCommand(const char *in, size_t len, CommandSource src) {
+  ParsedCommand p;
+  CommandParse r = parseCommand(in, len, p);
+  uint16_t id = 0;
+  if (r == CMD_PARSE_UNKNOWN) {
+    DBG_PRINTF("[BLE] Unknown command from source %u\n", (unsigned)src);
+    reply(src, 0, "UNKNOWN_CMD");
+  } else if (r == CMD_PARSE_BAD_PARAM) {
+    reply(src, 0, "BAD_PARAM");
+  } else if (!enqueueCommand(p.spec->id, p.param, &id, src, p.field)) {
+    reply(src, 0, "BUSY");
+  } else {
+    reply(src, id, p.spec->queued);
+    return true;
+  }
+  return false;
+}
+
+bool BleMgr::enqueueCommand(CommandId cmd, float param, uint16_t *id,
+                            CommandSource src, uint8_t field) {
+  QueuedCommand c{(uint8_t)cmd, 0, param, (uint8_t)src, field};
+  CommandQueue &q = src == CMD_SRC_BLE ? _commands : _localCommands;
+  if (!q.push(c))
+    return false;
+  if (id)
+    *id = c.id;
+  return true;
 }
 
 void BleMgr::process() {
@@ -253,10 +352,13 @@ void BleMgr::process() {
     }
   }
 
-  if (_pendingCommand == CMD_NONE)
+  // One command per pass, so a burst does not hold up a due task
+  QueuedCommand c;
+  if (!_commands.pop(c) && !_localCommands.pop(c))
     return;
-  uint8_t cmd = _pendingCommand;
-  _pendingCommand = CMD_NONE;
+  uint8_t cmd = c.cmd;
+  _ackId = c.id;
+  _ackSource = c.source;
 
   if (!_handles.chCommand)
     return;
@@ -272,12 +374,12 @@ void BleMgr::process() {
     prefs.clear();
     prefs.end();
     DBG_PRINTLN("[BLE]   - Cleared 'hall' namespace");
-    _handles.chCommand->setValue("NVM_CLEARED");
-    _handles.chCommand->notify();
+    // The RAM fit and the RTC anchor would outlive the NVS copy
+    resetCapacityLearning();
+    ack("NVM_CLEARED");
   } else if (cmd == CMD_RESET) {
     DBG_PRINTLN("[BLE] Processing RESET (main loop)...");
-    _handles.chCommand->setValue("RESETTING");
-    _handles.chCommand->notify();
+    ack("RESETTING");
     delay(2000);
     ESP.restart();
   } else if (cmd == CMD_CLEAR_RESET) {
@@ -289,47 +391,40 @@ void BleMgr::process() {
     prefs.begin("hall", false);
     prefs.clear();
     prefs.end();
-    _handles.chCommand->setValue("NVM_CLEARED_RESETTING");
-    _handles.chCommand->notify();
+    resetCapacityLearning(); // the RTC anchor survives the restart
+    ack("NVM_CLEARED_RESETTING");
     delay(2000);
     ESP.restart();
   } else if (cmd == CMD_SET_CAP) {
-    float v = _pendingParam;
-    _pendingParam = NAN;
+    float v = c.param;
     if (isfinite(v) && v > 0.0f) {
       DBG_PRINTF("[BLE] Processing SET_CAP (main loop): %.3f Ah\n", v);
-      // Delegate persistence to BatteryConfig via setBatteryCapacityAh()
-      setBatteryCapacityAh(v);
-      // Immediately update capacity characteristic so BLE clients see the new
-      // value
-      if (_handles.chCapacity) {
-        char bufCap[32];
-        snprintf(bufCap, sizeof(bufCap), "%.2f Ah", batteryCapacityAh);
-        _handles.chCapacity->setValue(bufCap);
-        _handles.chCapacity->notify();
-      }
-      // Publish capacity change over MQTT if connected
-      if (mqtt.connected()) {
-        char js[128];
-        snprintf(js, sizeof(js), "{\"event\":\"cap_set\",\"value_Ah\":%.3f}",
-                 v);
-        mqtt.publish(MQTT_TOPIC, js, true);
-        mqtt.loop();
+      // Persisted in the runtime config. False if out of bounds (unchanged)
+      // or if applied but not saved.
+      bool saved = setBatteryCapacityAh(v);
+      if (!saved && batteryCapacityAh != v) {
+        ack("CAP_OUT_OF_RANGE");
+      } else {
+        // Publish the applied capacity over MQTT if connected
+        if (mqtt.connected()) {
+          char js[128];
+          snprintf(js, sizeof(js),
+                   "{\"event\":\"cap_set\",\"value_Ah\":%.3f}",
+                   batteryCapacityAh);
+          mqtt.publish(MQTT_TOPIC, js, true);
+          mqtt.loop();
+        }
+        // Read back the runtime value (updated by setBatteryCapacityAh)
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%s:%.3fAh RB:%.3fAh",
+                 saved ? "CAP_SET" : "CAP_SAVE_FAILED", v, batteryCapacityAh);
+        ack(buf);
       }
-      // Use runtime value (already updated and persisted by
-      // setBatteryCapacityAh)
-      char buf[64];
-      snprintf(buf, sizeof(buf), "CAP_SET:%.3fAh RB:%.3fAh", v,
-               batteryCapacityAh);
-      _handles.chCommand->setValue(buf);
-      _handles.chCommand->notify();
     } else {
-      _handles.chCommand->setValue("CAP_BAD_PARAM");
-      _handles.chCommand->notify();
+      ack("CAP_BAD_PARAM");
     }
   } else if (cmd == CMD_SET_BASE) {
-    float v = _pendingParam;
-    _pendingParam = NAN;
+    float v = c.param;
     if (isfinite(v) && v > 0.0f) {
       DBG_PRINTF("[BLE] Processing SET_BASE (main loop): %.3f mOhm\n", v);
       // Update learner baseline
@@ -344,11 +439,9 @@ void BleMgr::process() {
       }
       char buf[32];
       snprintf(buf, sizeof(buf), "BASE_SET:%.3fmOhm", v);
-      _handles.chCommand->setValue(buf);
-      _handles.chCommand->notify();
+      ack(buf);
     } else {
-      _handles.chCommand->setValue("BASE_BAD_PARAM");
-      _handles.chCommand->notify();
+      ack("BASE_BAD_PARAM");
     }
   } else if (cmd == CMD_NVS_TEST) {
     DBG_PRINTLN("[BLE] Processing NVS_TEST (main loop)...");
@@ -372,7 +465,100 @@ void BleMgr::process() {
              wrote ? 1 : 0, has ? 1 : 0, (unsigned long)probe,
              (unsigned long)rb);
     ble_notify_status(msg);
-    _handles.chCommand->setValue("NVS_TEST_DONE");
+    ack("NVS_TEST_DONE");
+  } else if (cmd == CMD_SET_ENC) {
+    uint8_t enc = (uint8_t)c.param;
+    setTelemetryEncoding(enc);
+    char buf[32];
+    bool json = telemetryEncoding & TELEMETRY_ENC_JSON;
+    bool cbor = telemetryEncoding & TELEMETRY_ENC_CBOR;
+    snprintf(buf, sizeof(buf), "ENC_SET:%s",
+             json && cbor ? "BOTH" : (json ? "JSON" : "CBOR"));
+    ack(buf);
+  } else if (cmd == CMD_HISTORY) {
+    uint8_t tier = (uint8_t)c.param;
+    requestHistory(tier);
+    ack("HIST_STARTED");
+  } else if (cmd == CMD_LOG_LEVEL) {
+    LogLevel l = (LogLevel)(uint8_t)c.param;
+    logger.setLevel(l);
+    char buf[24];
+    snprintf(buf, sizeof(buf), "LOG_LEVEL:%s", logLevelName(l));
+    ack(buf);
+  } else if (cmd == CMD_CONFIG) {
+    size_t n;
+    const ConfigField *f = configFields(n);
+    char buf[48];
+    if (c.field >= n) {
+      ack("CFG_BAD_FIELD");
+    } else if (isnan(c.param)) {
+      configFormat(runtimeConfig, f[c.field], buf, sizeof(buf));
+      ack(buf);
+    } else if (setRuntimeConfigField(c.field, c.param)) {
+      // The parser checked the bounds; what is left to fail is the write
+      size_t k = snprintf(buf, sizeof(buf), "CFG_SET:");
+      configFormat(runtimeConfig, f[c.field], buf + k, sizeof(buf) - k);
+      ack(buf);
+    } else {
+      ack("CFG_SAVE_FAILED");
+    }
+  }
+#if PROFILER_ENABLED
+  else if (cmd == CMD_PROF_DUMP) {
+    // One JSON message per zone to MQTT (if connected) and serial
+    char js[200];
+    int zones = 0;
+    for (ProfZone *z = ProfZone::first(); z; z = z->next()) {
+      if (!buildProfJson(z->name(), z->hist(), profTicksPerUs(), js,
+                         sizeof(js)))
+        continue;
+      Serial.println(js);
+      if (mqtt.connected())
+        mqtt.publish(MQTT_PROF_TOPIC, js, false);
+      zones++;
+    }
+    for (ProfStack *s = ProfStack::first(); s; s = s->next()) {
+      if (!buildProfStackJson(*s, js, sizeof(js)))
+        continue;
+      Serial.println(js);
+      if (mqtt.connected())
+        mqtt.publish(MQTT_PROF_TOPIC, js, false);
+      zones++;
+    }
+    char buf[32];
+    snprintf(buf, sizeof(buf), "PROF_SENT:%d", zones);
+    ack(buf);
+  } else if (cmd == CMD_PROF_RESET) {
+    for (ProfZone *z = ProfZone::first(); z; z = z->next())
+      profReset(z->hist());
+    for (ProfStack *s = ProfStack::first(); s; s = s->next())
+      s->reset();
+    ack("PROF_CLEARED");
+  }
+#endif
+}
+
+// Completion reply to the channel the command came from
+void BleMgr::ack(const char *msg) { reply(_ackSource, _ackId, msg); }
+
+// "<msg> #<id>" on the command characteristic or Serial,
+// {"id":<id>,"result":"<msg>"} on MQTT_CMD_RESULT_TOPIC; id 0: not queued
+void BleMgr::reply(uint8_t source, uint16_t id, const char *msg) {
+  char buf[96];
+  if (source == CMD_SRC_MQTT) {
+    snprintf(buf, sizeof(buf), "{\"id\":%u,\"result\":\"%s\"}",
+             (unsigned)id, msg);
+    mqtt.publish(MQTT_CMD_RESULT_TOPIC, buf, false);
+    return;
+  }
+  if (id)
+    snprintf(buf, sizeof(buf), "%s #%u", msg, (unsigned)id);
+  else
+    snprintf(buf, sizeof(buf), "%s", msg);
+  if (source == CMD_SRC_SERIAL) {
+    Serial.println(buf);
+  } else if (_handles.chCommand) {
+    _handles.chCommand->setValue(buf);
     _handles.chCommand->notify();
   }
 }
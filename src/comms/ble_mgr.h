@@ -1,5 +1,9 @@
 
 #pragma once
+#include "ble_telemetry.h"
+#include "bulk_transfer.h"
+#include "command_parser.h"
+#include "command_queue.h"
 #include <Arduino.h>
 #include <NimBLEDevice.h>
 
@@ -14,37 +18,101 @@ struct BleHandles {
   NimBLECharacteristic *chCapacity{nullptr};
   NimBLECharacteristic *chStatus{nullptr};
   NimBLECharacteristic *chAhLeft{nullptr};
+  NimBLECharacteristic *chTelemetry{nullptr};
+  NimBLECharacteristic *chTransfer{nullptr};
 };
 
+// Telemetry goes out as one packed notification on chTelemetry
+// (ble_telemetry.h), only when a value moved past its deadband or the
+// heartbeat expired. The per-value string characteristics are read-only and
+// formatted from the latest frame when a client reads them.
+//
+// Commands from the command characteristic, Serial and MQTT are parsed by
+// one table (command_parser.h), queued and run by process().
+//
+// History downloads run on chTransfer (bulk_transfer.h): the client's
+// control writes are queued by the NimBLE task and handled, with the DATA
+// notifications, by serviceTransfer() in the loop. While a transfer runs
+// the connection is switched to the short BLE_BULK_* interval.
 class BleMgr {
 public:
   void begin(const char *deviceName);
-  void update(float V, float I, float T, const char *mode, float soc_pct,
-              float soh_pct, float ah_left);
-  enum PendingCommand : uint8_t {
-    CMD_NONE = 0,
-    CMD_CLEAR_NVM,
-    CMD_RESET,
-    CMD_CLEAR_RESET,
-    CMD_SET_CAP,
-    CMD_SET_BASE,
-    CMD_NVS_TEST
-  };
-  void enqueueCommand(PendingCommand cmd, float param = NAN) {
-    _pendingCommand = (uint8_t)cmd;
-    _pendingParam = param;
-  }
+  void update(const TelemetryFrame &f, uint32_t now_ms);
+  // Parse a command line from any channel (command_parser.h) and queue
+  // it; the immediate reply ("QUEUED_<CMD> #<id>", "BAD_PARAM",
+  // "UNKNOWN_CMD" or "BUSY") goes back on the same channel. BLE writes
+  // come from the NimBLE task, Serial and MQTT lines from the loop, each
+  // into its own queue. False if nothing was queued.
+  bool submitCommand(const char *in, size_t len, CommandSource src);
+  // Queue a command for process(); false if the queue is full. The
+  // command's ID (for the replies) goes to *id; `field` is the config
+  // field of CMD_CONFIG.
+  bool enqueueCommand(CommandId cmd, float param = NAN,
+                      uint16_t *id = nullptr, CommandSource src = CMD_SRC_BLE,
+                      uint8_t field = 0);
+  // Runs the oldest queued command (call every loop pass), replies on the
+  // channel it came from and keeps advertising alive
   void process();
   bool clientConnected() const { return _clientConnected; }
   BleHandles &handles() { return _handles; }
+  const CommandQueue &commands() const { return _commands; }
+  const CommandQueue &localCommands() const { return _localCommands; }
+
+  uint32_t notifications() const { return _notifies; }
+  uint32_t suppressed() const { return _gate.suppressed(); }
+  // Time with a client connected, including the current connection
+  uint32_t connectedMs(uint32_t now_ms) const;
+
+  // Latest packed frame; false before the first update()
+  bool latest(uint8_t *out) const;
+
+  void setBulkSource(BulkSource *src) { _bulk.setSource(src); }
+  // Handle queued transfer control writes and send the DATA the window
+  // allows; call every BLE_BULK_PUMP_MS.
+  void serviceTransfer(uint32_t now_ms);
+  bool bulkActive() const { return _bulk.active(); }
+  const BulkSender &bulk() const { return _bulk; }
 
 private:
   friend class ServerCallbacks;
-  bool _clientConnected{false};
+  friend class TransferCallbacks;
+  volatile bool _clientConnected{false};
+  volatile bool _newClient{false}; // gate reset pending (set on connect)
+  ReportPolicy _gate{bleReportConfig()};
+  uint16_t _seq{0};
+  uint32_t _notifies{0};
+  uint32_t _connectedMs{0}, _connectSinceMs{0};
+
+  // Written by update(), read by the NimBLE task for the legacy values
+  mutable portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+  uint8_t _packed[BLE_TELEMETRY_BYTES];
+  bool _havePacked{false};
+
+  // Transfer control writes, NimBLE task -> loop (single producer, single
+  // consumer; the indices only grow and wrap with uint8_t)
+  static constexpr uint8_t CTL_SLOTS = 4; // power of two
+  struct ControlMsg {
+    uint8_t len;
+    uint8_t b[15];
+  };
+  ControlMsg _ctl[CTL_SLOTS];
+  volatile uint8_t _ctlHead{0}, _ctlTail{0};
+  uint32_t _ctlDropped{0};
+  BulkSender _bulk;
+  volatile bool _bulkReset{false}; // connection changed
+  bool _fastConn{false};
+  volatile uint16_t _connHandle{0xFFFF};
+  volatile uint16_t _mtu{23};
+
   NimBLEServer *_server{nullptr};
   BleHandles _handles;
-  volatile uint8_t _pendingCommand{CMD_NONE};
-  volatile float _pendingParam{NAN};
+  CommandQueue _commands;      // BLE (NimBLE task)
+  CommandQueue _localCommands; // Serial and MQTT (loop)
+  uint16_t _ackId{0};          // command process() is running
+  uint8_t _ackSource{CMD_SRC_BLE};
+
+  void ack(const char *msg);
+  void reply(uint8_t source, uint16_t id, const char *msg);
 };
 
 // Extern global instance (defined in main.cpp)
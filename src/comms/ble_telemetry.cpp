@@ -0,0 +1,98 @@
+#include "ble_telemetry.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+static void bleput16(uint8_t *p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static uint16_t bleget16(const uint8_t *p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+// Unsigned fixed point; 0xFFFF = none
+static uint16_t scaleU(float v, float scale) {
+  if (!isfinite(v))
+    return 0xFFFF;
+  float x = roundf(v * scale);
+  return x <= 0.0f ? 0 : x >= 65534.0f ? 65534 : (uint16_t)x;
+}
+
+// Signed fixed point; INT16_MIN = none
+static int16_t scaleS(float v, float scale) {
+  if (!isfinite(v))
+    return INT16_MIN;
+  float x = roundf(v * scale);
+  return x <= -32767.0f ? -32767 : x >= 32767.0f ? 32767 : (int16_t)x;
+}
+
+static float unscaleU(uint16_t v, float scale) {
+  return v == 0xFFFF ? NAN : v / scale;
+}
+
+static float unscaleS(uint16_t v, float scale) {
+  return (int16_t)v == INT16_MIN ? NAN : (int16_t)v / scale;
+}
+
+size_t encodeBleTelemetry(const TelemetryFrame &f, uint16_t seq, uint8_t *out,
+                          size_t len) {
+  if (len < BLE_TELEMETRY_BYTES)
+    return 0;
+  uint8_t flags = 0;
+  if (f.mode && strcmp(f.mode, "active"))
+    flags |= BLE_TF_PARKED;
+  if (f.alternator_on)
+    flags |= BLE_TF_ALTERNATOR;
+  if (f.hasRint25)
+    flags |= BLE_TF_RINT25;
+  out[0] = BLE_TELEMETRY_VERSION;
+  out[1] = flags;
+  bleput16(out + 2, seq);
+  bleput16(out + 4, scaleU(f.V, 1000.0f));
+  bleput16(out + 6, (uint16_t)scaleS(f.I, 100.0f));
+  bleput16(out + 8, (uint16_t)scaleS(f.T, 10.0f));
+  bleput16(out + 10, scaleU(f.soc_pct, 100.0f));
+  bleput16(out + 12, scaleU(f.soh_pct, 100.0f));
+  bleput16(out + 14, scaleU(f.ah_left, 20.0f));
+  bleput16(out + 16, scaleU(f.battery_capacity_ah, 10.0f));
+  bleput16(out + 18, scaleU(f.hasRint25 ? f.Rint25_mOhm : NAN, 100.0f));
+  return BLE_TELEMETRY_BYTES;
+}
+
+bool decodeBleTelemetry(const uint8_t *in, size_t len, BleTelemetry &t) {
+  if (len < BLE_TELEMETRY_BYTES || in[0] != BLE_TELEMETRY_VERSION)
+    return false;
+  t.version = in[0];
+  t.flags = in[1];
+  t.seq = bleget16(in + 2);
+  t.V = unscaleU(bleget16(in + 4), 1000.0f);
+  t.I = unscaleS(bleget16(in + 6), 100.0f);
+  t.T = unscaleS(bleget16(in + 8), 10.0f);
+  t.soc_pct = unscaleU(bleget16(in + 10), 100.0f);
+  t.soh_pct = unscaleU(bleget16(in + 12), 100.0f);
+  t.ah_left = unscaleU(bleget16(in + 14), 20.0f);
+  t.capacity_ah = unscaleU(bleget16(in + 16), 10.0f);
+  t.Rint25_mOhm = unscaleU(bleget16(in + 18), 100.0f);
+  return true;
+}
+
+ReportConfig bleReportConfig() {
+  ReportConfig c;
+  c.field[RF_RINT] = {INFINITY, 0.0f, 0};
+  c.field[RF_RINT_BASE] = {INFINITY, 0.0f, 0};
+  return c;
+}
+
+bool buildBleStatsJson(uint32_t notifies, uint32_t suppressed,
+                       uint32_t connected_ms, char *out, size_t outLen) {
+  float perHour =
+      connected_ms ? notifies * 3600000.0f / (float)connected_ms : 0.0f;
+  int n = snprintf(out, outLen,
+                   "{\"task\":\"ble\",\"notify\":%lu,\"suppressed\":%lu,"
+                   "\"connected_s\":%lu,\"notify_h\":%.1f}",
+                   (unsigned long)notifies, (unsigned long)suppressed,
+                   (unsigned long)(connected_ms / 1000), perHour);
+  return n > 0 && (size_t)n < outLen;
+}
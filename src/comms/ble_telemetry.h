@@ -0,0 +1,64 @@
+#pragma once
+#include "report_policy.h"
+#include <cstddef>
+#include <cstdint>
+
+// Packed BLE telemetry: the whole frame in one notification of a single
+// characteristic instead of one string notification per value.
+//
+// Frame (little-endian, BLE_TELEMETRY_BYTES; fits the 20-byte payload of
+// the default 23-byte ATT MTU, so no MTU exchange is needed):
+//   [0]      BLE_TELEMETRY_VERSION
+//   [1]      flags: bit 0 parked (mode other than "active"), bit 1 alternator
+//            on, bit 2 Rint25 valid
+//   [2..3]   sequence number (gaps = notifications missed by the client)
+//   [4..5]   u16 V in mV                 (0xFFFF = none)
+//   [6..7]   i16 I in 10 mA              (INT16_MIN = none)
+//   [8..9]   i16 T in 0.1 °C             (INT16_MIN = none)
+//   [10..11] u16 SOC in 0.01 %           (0xFFFF = none)
+//   [12..13] u16 SOH in 0.01 %           (0xFFFF = none)
+//   [14..15] u16 Ah left in 0.05 Ah      (0xFFFF = none)
+//   [16..17] u16 capacity in 0.1 Ah      (0xFFFF = none)
+//   [18..19] u16 Rint25 in 0.01 mOhm     (0xFFFF = none)
+// Ah left and capacity cover the configured 1000 Ah and a learned capacity
+// above it (version 1 used 0.01 Ah for both and saturated at 655 Ah).
+// Readers must check the version; fields may be appended in later versions
+// so a reader should accept frames longer than it knows.
+//
+// Notifications are gated with a ReportPolicy of its own
+// (bleReportConfig()): the same per-field deadbands as MQTT, with the
+// fields not in the frame ignored.
+
+static constexpr uint8_t BLE_TELEMETRY_VERSION = 2;
+static constexpr size_t BLE_TELEMETRY_BYTES = 20;
+
+enum BleTelemetryFlag : uint8_t {
+  BLE_TF_PARKED = 1 << 0,
+  BLE_TF_ALTERNATOR = 1 << 1,
+  BLE_TF_RINT25 = 1 << 2,
+};
+
+// A decoded frame; values not present are NaN
+struct BleTelemetry {
+  uint8_t version;
+  uint8_t flags;
+  uint16_t seq;
+  float V, I, T;
+  float soc_pct, soh_pct;
+  float ah_left, capacity_ah;
+  float Rint25_mOhm;
+};
+
+// Returns BLE_TELEMETRY_BYTES, or 0 if `len` is too small.
+size_t encodeBleTelemetry(const TelemetryFrame &f, uint16_t seq, uint8_t *out,
+                          size_t len);
+bool decodeBleTelemetry(const uint8_t *in, size_t len, BleTelemetry &t);
+
+// Deadbands for BLE notifications: changes of Rint and the baseline, which
+// the frame does not carry, do not trigger one.
+ReportConfig bleReportConfig();
+
+// Telemetry notifications sent and suppressed, with the rate per hour of
+// connected time, as JSON.
+bool buildBleStatsJson(uint32_t notifies, uint32_t suppressed,
+                       uint32_t connected_ms, char *out, size_t outLen);
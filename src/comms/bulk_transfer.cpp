@@ -0,0 +1,241 @@
+#include "bulk_transfer.h"
+#include <string.h>
+
+static void bulkPut16(uint8_t *p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static void bulkPut32(uint8_t *p, uint32_t v) {
+  bulkPut16(p, (uint16_t)v);
+  bulkPut16(p + 2, (uint16_t)(v >> 16));
+}
+
+static uint16_t bulkGet16(const uint8_t *p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t bulkGet32(const uint8_t *p) {
+  return bulkGet16(p) | ((uint32_t)bulkGet16(p + 2) << 16);
+}
+
+static uint8_t clampWindow(uint8_t w) {
+  return w < 1 ? 1 : w > BULK_MAX_WINDOW ? BULK_MAX_WINDOW : w;
+}
+
+// ------------------------------ BulkSender ------------------------------
+
+void BulkSender::onControl(const uint8_t *msg, size_t len, uint32_t now_ms) {
+  if (!len)
+    return;
+  switch (msg[0]) {
+  case BULK_START: {
+    if (len < BULK_START_LEN)
+      return;
+    _source = msg[1];
+    uint32_t from = bulkGet32(msg + 2);
+    uint32_t offset = bulkGet32(msg + 6);
+    _window = clampWindow(msg[10]);
+    size_t chunk = _maxNotify > BULK_DATA_HEADER
+                       ? _maxNotify - BULK_DATA_HEADER
+                       : 1;
+    _chunk = chunk > 0xFFFF ? 0xFFFF : (uint16_t)chunk;
+    _total = _tag = 0;
+    if (!_src || !_src->open(_source, from, _total, _tag))
+      _status = BULK_ERR_SOURCE;
+    else if (offset > _total)
+      _status = BULK_ERR_OFFSET;
+    else
+      _status = BULK_OK;
+    _start = _acked = _next = (_status == BULK_OK) ? offset : 0;
+    _progressMs = now_ms;
+    _state = ST_INFO;
+    break;
+  }
+  case BULK_ACK: {
+    if (len < BULK_ACK_LEN || _state != ST_SENDING)
+      return;
+    uint32_t off = bulkGet32(msg + 1);
+    if (off < _acked || off > _next)
+      return; // stale or bogus
+    if (off > _acked) {
+      _acked = off;
+      _progressMs = now_ms;
+    }
+    if ((msg[5] & BULK_ACK_GAP) && _next > _acked) {
+      _next = _acked;
+      _rewinds++;
+      _progressMs = now_ms;
+    }
+    break;
+  }
+  case BULK_ABORT:
+    _state = ST_IDLE;
+    break;
+  default:
+    break;
+  }
+}
+
+size_t BulkSender::poll(uint8_t *out, size_t len, uint32_t now_ms) {
+  _lastData = 0;
+  _lastInfo = false;
+  if (_state == ST_INFO) {
+    if (len < BULK_INFO_LEN)
+      return 0;
+    out[0] = BULK_INFO;
+    out[1] = _source;
+    out[2] = _status;
+    bulkPut32(out + 3, _total);
+    bulkPut32(out + 7, _tag);
+    bulkPut16(out + 11, _chunk);
+    _state = (_status == BULK_OK) ? ST_SENDING : ST_IDLE;
+    _lastInfo = true;
+    return BULK_INFO_LEN;
+  }
+  if (_state != ST_SENDING)
+    return 0;
+  if (_acked >= _total) {
+    _state = ST_IDLE; // everything acknowledged
+    return 0;
+  }
+  if (_next > _acked && now_ms - _progressMs >= BULK_ACK_TIMEOUT_MS) {
+    _next = _acked; // go back N
+    _rewinds++;
+    _progressMs = now_ms;
+  }
+  if (_next >= _total || _next - _acked >= (uint32_t)_window * _chunk ||
+      len <= BULK_DATA_HEADER)
+    return 0;
+  // Chunks stay on their boundaries from the START offset
+  uint32_t rel = _next - _start;
+  size_t n = _chunk - rel % _chunk;
+  if (n > _total - _next)
+    n = _total - _next;
+  if (n > len - BULK_DATA_HEADER)
+    n = len - BULK_DATA_HEADER;
+  size_t got = _src->read(_next, out + BULK_DATA_HEADER, n);
+  if (!got) {
+    _state = ST_IDLE; // the source shrank under us
+    return 0;
+  }
+  out[0] = BULK_DATA;
+  bulkPut16(out + 1, (uint16_t)(rel / _chunk));
+  bulkPut32(out + 3, _next);
+  _next += got;
+  _lastData = got;
+  _chunks++;
+  return BULK_DATA_HEADER + got;
+}
+
+void BulkSender::unsent() {
+  if (_lastInfo) {
+    _state = ST_INFO;
+  } else if (_lastData) {
+    _next -= _lastData;
+    _chunks--;
+  }
+  _lastInfo = false;
+  _lastData = 0;
+}
+
+// ------------------------------ BulkReceiver ------------------------------
+
+size_t BulkReceiver::start(uint8_t source, uint32_t from, uint8_t window,
+                           uint8_t *out, size_t len) {
+  if (len < BULK_START_LEN)
+    return 0;
+  if (source != _source || from != _from) {
+    _rx = 0;
+    _haveTag = false;
+  }
+  _source = source;
+  _from = from;
+  _window = clampWindow(window);
+  _info = false;
+  _status = BULK_OK;
+  _gapSent = _dupAcked = false;
+  _sinceAck = 0;
+  _startOffset = _rx;
+  out[0] = BULK_START;
+  out[1] = source;
+  bulkPut32(out + 2, from);
+  bulkPut32(out + 6, _rx);
+  out[10] = _window;
+  return BULK_START_LEN;
+}
+
+size_t BulkReceiver::ack(uint8_t flags, uint8_t *out, size_t outLen) {
+  if (outLen < BULK_ACK_LEN)
+    return 0;
+  out[0] = BULK_ACK;
+  bulkPut32(out + 1, _rx);
+  out[5] = flags;
+  _sinceAck = 0;
+  return BULK_ACK_LEN;
+}
+
+size_t BulkReceiver::onNotify(const uint8_t *in, size_t len, uint8_t *out,
+                              size_t outLen) {
+  if (!len)
+    return 0;
+  if (in[0] == BULK_INFO) {
+    if (len < BULK_INFO_LEN || in[1] != _source)
+      return 0;
+    _status = in[2];
+    _info = true;
+    if (_status != BULK_OK)
+      return 0;
+    uint32_t total = bulkGet32(in + 3);
+    uint32_t tag = bulkGet32(in + 7);
+    _chunk = bulkGet16(in + 11);
+    if (_startOffset && (!_haveTag || tag != _tag || total < _rx)) {
+      // Different content than the interrupted transfer: from the start
+      _rx = 0;
+      _tag = tag;
+      _haveTag = true;
+      return start(_source, _from, _window, out, outLen);
+    }
+    _tag = tag;
+    _haveTag = true;
+    _total = total;
+    return 0;
+  }
+  if (in[0] != BULK_DATA || len <= BULK_DATA_HEADER || !_info ||
+      _status != BULK_OK)
+    return 0;
+  uint16_t seq = bulkGet16(in + 1);
+  uint32_t off = bulkGet32(in + 3);
+  size_t n = len - BULK_DATA_HEADER;
+  if (off < _startOffset || !_chunk ||
+      (uint16_t)((off - _startOffset) / _chunk) != seq || off + n > _total)
+    return 0; // malformed
+  if (off > _rx) {
+    // Missed a chunk: ask once for everything from _rx again
+    if (_gapSent)
+      return 0;
+    _gapSent = true;
+    return ack(BULK_ACK_GAP, out, outLen);
+  }
+  if (off + n <= _rx) {
+    // Sent again after a lost ACK: acknowledge once more
+    _dups++;
+    if (_dupAcked)
+      return 0;
+    _dupAcked = true;
+    return ack(0, out, outLen);
+  }
+  size_t skip = _rx - off;
+  for (size_t i = skip; i < n; ++i) {
+    uint32_t at = off + i;
+    if (at < _cap)
+      _buf[at] = in[BULK_DATA_HEADER + i];
+  }
+  _rx = off + n;
+  _gapSent = _dupAcked = false;
+  _sinceAck++;
+  uint16_t every = _window / 2 ? _window / 2 : 1;
+  if (_rx == _total || _sinceAck >= every)
+    return ack(0, out, outLen);
+  return 0;
+}
@@ -0,0 +1,139 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Chunked, resumable bulk download (history over BLE without Wi-Fi).
+//
+// The client writes control messages to the transfer characteristic and
+// the device answers with notifications on it (little-endian):
+//
+//   client -> device
+//     START [0x01][source u8][from u32][offset u32][window u8]
+//           send `source` records from time `from` on, starting at byte
+//           `offset` (0, or what a previous transfer already delivered);
+//           at most `window` chunks unacknowledged
+//     ACK   [0x02][offset u32][flags u8]
+//           everything below `offset` arrived; flag BULK_ACK_GAP: a chunk
+//           was missed, send again from `offset` now
+//     ABORT [0x03]
+//   device -> client
+//     INFO  [0x81][source u8][status u8][total u32][tag u32][chunk u16]
+//           answer to START: total bytes, a tag identifying the content
+//           (resume only if it matches the previous transfer's) and the
+//           payload size of a full chunk
+//     DATA  [0x82][seq u16][offset u32][payload...]
+//           seq counts chunks from the START offset
+//
+// Flow control is go-back-N: the sender keeps at most `window` chunks in
+// flight, a gap ACK or BULK_ACK_TIMEOUT_MS without progress rewinds it to
+// the last acknowledged byte. Chunks fill the negotiated MTU.
+//
+// BulkSender runs on the device over a BulkSource; BulkReceiver is the
+// client side (reference for the phone app, and the loopback test).
+
+static constexpr uint8_t BULK_START = 0x01;
+static constexpr uint8_t BULK_ACK = 0x02;
+static constexpr uint8_t BULK_ABORT = 0x03;
+static constexpr uint8_t BULK_INFO = 0x81;
+static constexpr uint8_t BULK_DATA = 0x82;
+
+static constexpr size_t BULK_START_LEN = 11;
+static constexpr size_t BULK_ACK_LEN = 6;
+static constexpr size_t BULK_INFO_LEN = 13;
+static constexpr size_t BULK_DATA_HEADER = 7;
+static constexpr uint8_t BULK_ACK_GAP = 0x01;
+
+static constexpr uint8_t BULK_MAX_WINDOW = 32;
+static constexpr uint32_t BULK_ACK_TIMEOUT_MS = 1000;
+
+enum BulkStatus : uint8_t {
+  BULK_OK = 0,
+  BULK_ERR_SOURCE = 1, // unknown source
+  BULK_ERR_OFFSET = 2, // offset past the end
+};
+
+// Records to send, addressed by byte offset. The content from `from` on
+// must only grow at the end while a transfer runs.
+class BulkSource {
+public:
+  virtual ~BulkSource() {}
+  // Select `source` from time `from`. false if the source is unknown.
+  virtual bool open(uint8_t source, uint32_t from, uint32_t &total,
+                    uint32_t &tag) = 0;
+  // Copy up to `len` bytes at `offset`; returns the bytes copied.
+  virtual size_t read(uint32_t offset, uint8_t *out, size_t len) = 0;
+};
+
+class BulkSender {
+public:
+  explicit BulkSender(BulkSource *src = nullptr) : _src(src) {}
+  void setSource(BulkSource *src) { _src = src; }
+  // Largest notification the link takes now (ATT MTU - 3); fixes the chunk
+  // size of the next START.
+  void setMaxNotify(size_t n) { _maxNotify = n; }
+
+  // A control message from the client.
+  void onControl(const uint8_t *msg, size_t len, uint32_t now_ms);
+  // The next notification to send, 0 if there is none now (idle, window
+  // full or waiting for an ACK).
+  size_t poll(uint8_t *out, size_t len, uint32_t now_ms);
+  // The transport could not queue the notification poll() returned last;
+  // it is produced again by the next poll().
+  void unsent();
+  void abort() { _state = ST_IDLE; }
+
+  bool active() const { return _state != ST_IDLE; }
+  uint32_t total() const { return _total; }
+  uint32_t acked() const { return _acked; }
+  uint32_t chunks() const { return _chunks; }
+  uint32_t rewinds() const { return _rewinds; }
+
+private:
+  enum State : uint8_t { ST_IDLE, ST_INFO, ST_SENDING };
+  BulkSource *_src;
+  size_t _maxNotify = 20;
+  State _state = ST_IDLE;
+  uint8_t _source = 0, _status = BULK_OK, _window = 1;
+  uint16_t _chunk = 0;
+  uint32_t _tag = 0;
+  uint32_t _start = 0, _total = 0, _acked = 0, _next = 0;
+  uint32_t _progressMs = 0;
+  size_t _lastData = 0; // payload bytes of the last DATA from poll()
+  bool _lastInfo = false;
+  uint32_t _chunks = 0, _rewinds = 0;
+};
+
+class BulkReceiver {
+public:
+  // Received bytes go to `buf` (at their offset); more than `cap` are
+  // counted but not stored.
+  BulkReceiver(uint8_t *buf, size_t cap) : _buf(buf), _cap(cap) {}
+
+  // START for `source` from `from`, resuming after what was received if
+  // the previous transfer was of the same source and `from`.
+  size_t start(uint8_t source, uint32_t from, uint8_t window, uint8_t *out,
+               size_t len);
+  // Feed one notification. Returns the length of a control message to
+  // write back (an ACK, or a new START when resuming is not possible),
+  // 0 if none is due.
+  size_t onNotify(const uint8_t *in, size_t len, uint8_t *out,
+                  size_t outLen);
+
+  bool done() const { return _info && _status == BULK_OK && _rx == _total; }
+  uint8_t status() const { return _status; }
+  uint32_t received() const { return _rx; }
+  uint32_t total() const { return _total; }
+  uint32_t duplicates() const { return _dups; }
+
+private:
+  uint8_t *_buf;
+  size_t _cap;
+  uint8_t _source = 0xFF, _window = 1, _status = BULK_OK;
+  uint32_t _from = 0, _tag = 0, _total = 0, _rx = 0, _startOffset = 0;
+  uint16_t _chunk = 0;
+  bool _info = false, _haveTag = false, _gapSent = false, _dupAcked = false;
+  uint16_t _sinceAck = 0;
+  uint32_t _dups = 0;
+
+  size_t ack(uint8_t flags, uint8_t *out, size_t outLen);
+};
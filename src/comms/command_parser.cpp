@@ -0,0 +1,162 @@
+#include "command_parser.h"
+#include "../config/config_store.h"
+#include "../log/logger.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Word arguments: ENC JSON/CBOR/BOTH = 1/2/3 (the TELEMETRY_ENC_* bits),
+// HIST M/H/D = RollupTier. Aliases share the command ID.
+static const CommandSpec COMMANDS[] = {
+    {"SET_CAP", CMD_SET_CAP, ARG_POSITIVE, nullptr, 0, "QUEUED_SET_CAP"},
+    {"SET_BASELINE", CMD_SET_BASE, ARG_POSITIVE, nullptr, 0,
+     "QUEUED_SET_BASE"},
+    {"SET_BASE", CMD_SET_BASE, ARG_POSITIVE, nullptr, 0, "QUEUED_SET_BASE"},
+    {"ENC", CMD_SET_ENC, ARG_WORD, "JSON|CBOR|BOTH", 1, "QUEUED_ENC"},
+    {"HIST", CMD_HISTORY, ARG_WORD, "M|H|D", 0, "QUEUED_HIST"},
+    {"LOG", CMD_LOG_LEVEL, ARG_LOG_LEVEL, nullptr, 0, "QUEUED_LOG"},
+    {"CFG", CMD_CONFIG, ARG_CONFIG, nullptr, 0, "QUEUED_CFG"},
+    {"CLEAR_NVM", CMD_CLEAR_NVM, ARG_NONE, nullptr, 0, "QUEUED_CLEAR_NVM"},
+    {"NVS_TEST", CMD_NVS_TEST, ARG_NONE, nullptr, 0, "QUEUED_NVS_TEST"},
+    {"RESET", CMD_RESET, ARG_NONE, nullptr, 0, "QUEUED_RESET"},
+    {"CLEAR_RESET", CMD_CLEAR_RESET, ARG_NONE, nullptr, 0,
+     "QUEUED_CLEAR_RESET"},
+#if defined(PROFILER_ENABLED) && PROFILER_ENABLED
+    {"PROF", CMD_PROF_DUMP, ARG_NONE, nullptr, 0, "QUEUED_PROF"},
+    {"PROF_RESET", CMD_PROF_RESET, ARG_NONE, nullptr, 0,
+     "QUEUED_PROF_RESET"},
+#endif
+};
+static const size_t COMMAND_COUNT = sizeof(COMMANDS) / sizeof(COMMANDS[0]);
+
+const CommandSpec *commandTable(size_t &count) {
+  count = COMMAND_COUNT;
+  return COMMANDS;
+}
+
+static char upper(char c) {
+  return (c >= 'a' && c <= 'z') ? (char)(c - 'a' + 'A') : c;
+}
+
+static bool isSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static bool isSeparator(char c) { return c == ':' || c == ' ' || c == '='; }
+
+// Index of the word in `words` equal to `a` (case-insensitive), -1 if none
+static int matchWord(const char *words, const char *a, size_t n) {
+  int index = 0;
+  for (const char *w = words; *w; ++index) {
+    size_t k = 0;
+    while (w[k] && w[k] != '|' && k < n && upper(a[k]) == w[k])
+      ++k;
+    if (k == n && (!w[k] || w[k] == '|'))
+      return index;
+    while (*w && *w != '|')
+      ++w;
+    if (*w)
+      ++w;
+  }
+  return -1;
+}
+
+// "<field>" or "<field>=<value>" ('=', ':' or ' ' between)
+static bool parseConfigArg(const char *a, size_t n, float &param,
+                           uint8_t &field) {
+  size_t k = 0;
+  while (k < n && !isSeparator(a[k]))
+    ++k;
+  size_t fieldCount;
+  const ConfigField *fields = configFields(fieldCount);
+  const ConfigField *f = configField(a, k);
+  if (!f)
+    return false;
+  field = (uint8_t)(f - fields);
+  if (k == n)
+    return true; // read
+  char buf[16];
+  size_t m = n - k - 1;
+  if (!m || m >= sizeof(buf))
+    return false;
+  memcpy(buf, a + k + 1, m);
+  buf[m] = '\0';
+  char *end;
+  float v = strtof(buf, &end);
+  if (end != buf + m || !configInRange(*f, v))
+    return false;
+  param = v;
+  return true;
+}
+
+static bool parseArg(const CommandSpec &c, const char *a, size_t n,
+                     float &param, uint8_t &field) {
+  char buf[16];
+  if (c.arg == ARG_NONE)
+    return n == 0;
+  if (c.arg == ARG_CONFIG)
+    return parseConfigArg(a, n, param, field);
+  if (!n || n >= sizeof(buf))
+    return false;
+  switch (c.arg) {
+  case ARG_POSITIVE: {
+    memcpy(buf, a, n);
+    buf[n] = '\0';
+    char *end;
+    float v = strtof(buf, &end);
+    if (end != buf + n || !isfinite(v) || v <= 0.0f)
+      return false;
+    param = v;
+    return true;
+  }
+  case ARG_WORD: {
+    int i = matchWord(c.words, a, n);
+    if (i < 0)
+      return false;
+    param = (float)(c.wordBase + i);
+    return true;
+  }
+  case ARG_LOG_LEVEL: {
+    memcpy(buf, a, n);
+    buf[n] = '\0';
+    LogLevel l = logLevelFromName(buf);
+    if (l >= LL_COUNT)
+      return false;
+    param = (float)l;
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+CommandParse parseCommand(const char *in, size_t len, ParsedCommand &out) {
+  out.spec = nullptr;
+  out.param = NAN;
+  out.field = 0;
+  while (len && isSpace(*in))
+    ++in, --len;
+  while (len && isSpace(in[len - 1]))
+    --len;
+  for (size_t i = 0; i < COMMAND_COUNT; ++i) {
+    const CommandSpec &c = COMMANDS[i];
+    size_t k = 0;
+    while (c.name[k] && k < len && upper(in[k]) == c.name[k])
+      ++k;
+    if (c.name[k])
+      continue;
+    // Name matched: end of input, a separator, or a number right after it
+    const char *a = in + k;
+    size_t n = len - k;
+    if (n && isSeparator(*a)) {
+      ++a, --n;
+    } else if (n && !(c.arg == ARG_POSITIVE &&
+                      ((*a >= '0' && *a <= '9') || *a == '.'))) {
+      continue; // a longer name, e.g. SET_BASELINE for SET_BASE
+    }
+    out.spec = &c;
+    return parseArg(c, a, n, out.param, out.field) ? CMD_PARSE_OK
+                                                   : CMD_PARSE_BAD_PARAM;
+  }
+  return CMD_PARSE_UNKNOWN;
+}
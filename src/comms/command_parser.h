@@ -0,0 +1,63 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Text commands ("SET_CAP:12.5", "LOG W", "RESET", ...) for every command
+// channel: BLE, Serial and MQTT. One table lists each command's name, its
+// argument type and the reply sent once it is queued; parseCommand() walks
+// it without copying the input or allocating, so it can run in the NimBLE
+// task. Names and word arguments are matched case-insensitively, the
+// argument follows ':', ' ' or '=' (numbers may also follow the name
+// directly) and surrounding whitespace is ignored.
+
+enum CommandId : uint8_t {
+  CMD_NONE = 0,
+  CMD_CLEAR_NVM,
+  CMD_RESET,
+  CMD_CLEAR_RESET,
+  CMD_SET_CAP,
+  CMD_SET_BASE,
+  CMD_NVS_TEST,
+  CMD_PROF_DUMP,
+  CMD_PROF_RESET,
+  CMD_SET_ENC,
+  CMD_HISTORY,
+  CMD_LOG_LEVEL,
+  CMD_CONFIG
+};
+
+enum CommandArg : uint8_t {
+  ARG_NONE,
+  ARG_POSITIVE, // finite number > 0
+  ARG_WORD,     // one of CommandSpec::words, param = wordBase + index
+  ARG_LOG_LEVEL, // logLevelFromName(), param = LogLevel
+  ARG_CONFIG     // "<field>" (read) or "<field>=<value>" (set), see
+                 // config/config_store.h; field = schema index, the value
+                 // must be within the field's bounds
+};
+
+struct CommandSpec {
+  const char *name; // upper case
+  CommandId id;
+  CommandArg arg;
+  const char *words;  // ARG_WORD: '|'-separated, upper case
+  uint8_t wordBase;   // ARG_WORD: param of the first word
+  const char *queued; // reply once queued
+};
+
+enum CommandParse : uint8_t {
+  CMD_PARSE_OK,
+  CMD_PARSE_BAD_PARAM, // known command, argument missing or invalid
+  CMD_PARSE_UNKNOWN
+};
+
+struct ParsedCommand {
+  const CommandSpec *spec;
+  float param;   // NAN without an argument
+  uint8_t field; // ARG_CONFIG: index into configFields()
+};
+
+CommandParse parseCommand(const char *in, size_t len, ParsedCommand &out);
+
+// The command table (for help output and tests)
+const CommandSpec *commandTable(size_t &count);
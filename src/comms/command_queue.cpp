@@ -0,0 +1,43 @@
+#include "command_queue.h"
+#include <stdio.h>
+
+bool CommandQueue::push(QueuedCommand &c) {
+  uint32_t head = _head.load(std::memory_order_relaxed);
+  uint32_t used = head - _tail.load(std::memory_order_acquire);
+  if (used >= CMD_QUEUE_SLOTS) {
+    _dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  c.id = _nextId;
+  _nextId = _nextId == 0xFFFF ? 1 : _nextId + 1;
+  _slots[head & (CMD_QUEUE_SLOTS - 1)] = c;
+  _head.store(head + 1, std::memory_order_release);
+  if (used + 1 > _maxDepth)
+    _maxDepth = (uint8_t)(used + 1);
+  _queued.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+bool CommandQueue::pop(QueuedCommand &out) {
+  uint32_t tail = _tail.load(std::memory_order_relaxed);
+  if (tail == _head.load(std::memory_order_acquire))
+    return false;
+  out = _slots[tail & (CMD_QUEUE_SLOTS - 1)];
+  _tail.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+uint8_t CommandQueue::depth() const {
+  return (uint8_t)(_head.load(std::memory_order_acquire) -
+                   _tail.load(std::memory_order_acquire));
+}
+
+bool buildCommandQueueJson(const CommandQueue &q, const char *name, char *out,
+                           size_t outLen) {
+  int n = snprintf(out, outLen,
+                   "{\"task\":\"%s\",\"depth\":%u,\"max_depth\":%u,"
+                   "\"queued\":%lu,\"dropped\":%lu}",
+                   name, (unsigned)q.depth(), (unsigned)q.maxDepth(),
+                   (unsigned long)q.queued(), (unsigned long)q.dropped());
+  return n > 0 && (size_t)n < outLen;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Commands from one producer task (the NimBLE task, or the loop itself for
+// Serial and MQTT) to the main loop in a fixed ring, so a second write before
+// the loop gets to the first one is queued instead of overwriting it. push()
+// gives each command an ID that the client sees in the "queued" reply and
+// again in the completion reply. A full queue drops the new command and
+// counts it.
+
+static constexpr uint8_t CMD_QUEUE_SLOTS = 8; // power of two
+
+// Where a command came from, and where its replies go
+enum CommandSource : uint8_t { CMD_SRC_BLE, CMD_SRC_SERIAL, CMD_SRC_MQTT };
+
+struct QueuedCommand {
+  uint8_t cmd; // CommandId (command_parser.h)
+  uint16_t id; // set by push(); 1..65535, never 0
+  float param;
+  uint8_t source; // CommandSource
+  uint8_t field;  // CMD_CONFIG: index into configFields()
+};
+
+class CommandQueue {
+public:
+  // Producer: stores `c` with the next ID (also written to c.id). False if
+  // the queue is full.
+  bool push(QueuedCommand &c);
+  // Consumer: the oldest command; false if there is none.
+  bool pop(QueuedCommand &out);
+
+  uint8_t depth() const;
+  uint8_t maxDepth() const { return _maxDepth; }
+  uint32_t queued() const { return _queued.load(std::memory_order_relaxed); }
+  uint32_t dropped() const {
+    return _dropped.load(std::memory_order_relaxed);
+  }
+
+private:
+  QueuedCommand _slots[CMD_QUEUE_SLOTS];
+  std::atomic<uint32_t> _head{0}; // written by the producer only
+  std::atomic<uint32_t> _tail{0}; // written by the consumer only
+  uint16_t _nextId = 1;
+  volatile uint8_t _maxDepth = 0;
+  std::atomic<uint32_t> _queued{0}, _dropped{0};
+};
+
+// {"task":"<name>","depth":d,"max_depth":m,"queued":q,"dropped":n}
+bool buildCommandQueueJson(const CommandQueue &q, const char *name, char *out,
+                           size_t outLen);
@@ -0,0 +1,32 @@
+#include "conn_backoff.h"
+
+uint32_t ConnBackoff::nextDelayMs(uint32_t rnd) {
+  uint32_t d = _baseMs;
+  for (uint8_t i = 0; i < _failures && d < _maxMs; ++i)
+    d = (d > _maxMs / 2) ? _maxMs : d * 2;
+  if (d > _maxMs)
+    d = _maxMs;
+  if (_failures < 255)
+    _failures++;
+
+  uint8_t pct = _jitterPct > 100 ? 100 : _jitterPct;
+  uint32_t span = (uint32_t)((uint64_t)d * pct / 100u);
+  if (span == 0)
+    return d;
+  return d - span + rnd % (span + 1);
+}
+
+void BlockedTimeMeter::add(uint32_t now_ms, uint32_t blocked_ms) {
+  if (!_started) {
+    _started = true;
+    _windowStart = now_ms;
+  }
+  if (now_ms - _windowStart >= WINDOW_MS) {
+    // A window with no samples at all reads as zero blocked time
+    uint32_t windows = (now_ms - _windowStart) / WINDOW_MS;
+    _last = (windows == 1) ? _cur : 0;
+    _cur = 0;
+    _windowStart += windows * WINDOW_MS;
+  }
+  _cur += blocked_ms;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+
+// Reconnect pacing and blocked-time accounting for the Wi-Fi and MQTT
+// connection state machines.
+
+// Exponential backoff with jitter. The n-th consecutive failure waits
+// min(maxMs, baseMs * 2^n), of which the upper `jitterPct` percent is
+// randomised so that a fleet of devices (or Wi-Fi and MQTT on one device) do
+// not retry in lock-step.
+class ConnBackoff {
+public:
+  ConnBackoff(uint32_t baseMs, uint32_t maxMs, uint8_t jitterPct)
+      : _baseMs(baseMs), _maxMs(maxMs), _jitterPct(jitterPct) {}
+
+  // Delay before the next attempt after a failure. `rnd` is any 32-bit
+  // random value (esp_random() on target).
+  uint32_t nextDelayMs(uint32_t rnd);
+  void reset() { _failures = 0; }
+  uint8_t failures() const { return _failures; }
+
+private:
+  uint32_t _baseMs;
+  uint32_t _maxMs;
+  uint8_t _jitterPct;
+  uint8_t _failures = 0;
+};
+
+// Milliseconds the main loop spent blocked in connection code, per hour.
+// `lastHour_ms()` is the last completed window; windows are anchored to the
+// first sample.
+class BlockedTimeMeter {
+public:
+  void add(uint32_t now_ms, uint32_t blocked_ms);
+  void tick(uint32_t now_ms) { add(now_ms, 0); }
+  uint32_t lastHour_ms() const { return _last; }
+  uint32_t currentHour_ms() const { return _cur; }
+
+  static constexpr uint32_t WINDOW_MS = 3600UL * 1000UL;
+
+private:
+  bool _started = false;
+  uint32_t _windowStart = 0;
+  uint32_t _cur = 0;
+  uint32_t _last = 0;
+};
@@ -1,11 +1,11 @@
 
 #pragma once
 #include <Arduino.h>
-#include <PubSubClient.h>
+#include "mqtt_mgr.h"
 #include <cstring>
 
 struct DebugPublisher {
-  PubSubClient *client = nullptr;
+  MqttMgr *client = nullptr;
   const char *topic = nullptr;
   bool enabled = true;
   uint32_t minIntervalMs = 300;
@@ -31,7 +31,7 @@ struct DebugPublisher {
     if (gate && (now - *gate) < minIntervalMs)
       return;
     if (client->connected()) {
-      client->publish(topic, json, false);
+      client->publish(topic, json, false, 0); // best effort
       if (gate)
         *gate = now;
     }
@@ -0,0 +1,80 @@
+#include "ha_discovery.h"
+#include "../json_writer.h"
+#include <stdio.h>
+
+// Every entity reads its value from the telemetry JSON on the state topic
+const HaEntity HA_ENTITIES[] = {
+    {"sensor", "voltage", "Battery Voltage", "V", "voltage",
+     "{{ '%.2f' | format(value_json.voltage_V) }}"},
+    {"sensor", "current", "Battery Current", "A", nullptr,
+     "{{ value_json.current_A }}"},
+    {"sensor", "soc", "Battery SOC", "%", "battery",
+     "{{ value_json.soc_pct }}"},
+    {"sensor", "soh", "Battery SOH", "%", nullptr,
+     "{{ value_json.soh_pct }}"},
+    {"sensor", "ah_left", "Battery Ah Left", "Ah", nullptr,
+     "{{ '%.2f' | format(value_json.ah_left) }}"},
+    {"sensor", "rint", "Rint (mOhm)", "m\xCE\xA9", nullptr,
+     "{% if value_json.Rint_mOhm is not none %}{{ value_json.Rint_mOhm }}"
+     "{% else %}{{ value_json.RintBaseline_mOhm }}{% endif %}"},
+    {"binary_sensor", "alternator", "Alternator On", nullptr, nullptr,
+     "{{ value_json.alternator_on }}"},
+    {"sensor", "mode", "Battery Mode", nullptr, nullptr,
+     "{{ value_json.mode }}"},
+    {"sensor", "uptime", "Battery Uptime", "s", nullptr,
+     "{{ (value_json.up_ms / 1000) | int }}"},
+    {"sensor", "capacity", "Battery Capacity", "Ah", nullptr,
+     "{{ value_json.battery_capacity_ah }}"},
+};
+const size_t HA_ENTITY_COUNT = sizeof(HA_ENTITIES) / sizeof(HA_ENTITIES[0]);
+
+// Abbreviated discovery keys keep the payload at about 2 KB
+size_t buildHaDiscovery(const char *haId, const char *clientId,
+                        const char *stateTopic, char *out, size_t outLen) {
+  JsonWriter w(out, outLen);
+  w.beginObject().beginObject("dev").beginArray("ids");
+  w.str(nullptr, haId).str(nullptr, clientId).endArray();
+  w.str("name", "Battery Monitor").endObject();
+  w.beginObject("o").str("name", "12VBatteryMonitor").endObject();
+  w.str("stat_t", stateTopic);
+
+  w.beginObject("cmps");
+  char uid[64];
+  for (size_t i = 0; i < HA_ENTITY_COUNT; ++i) {
+    const HaEntity &e = HA_ENTITIES[i];
+    snprintf(uid, sizeof(uid), "%s_%s", haId, e.id);
+    w.beginObject(uid).str("p", e.component).str("name", e.name);
+    if (e.unit)
+      w.str("unit_of_meas", e.unit);
+    if (e.deviceClass)
+      w.str("dev_cla", e.deviceClass);
+    w.str("val_tpl", e.valueTemplate);
+    if (e.component[0] == 'b') // binary_sensor: template yields true/false
+      w.str("pl_on", "true").str("pl_off", "false");
+    w.str("uniq_id", uid).endObject();
+  }
+  w.endObject().endObject();
+  return w.ok() ? w.length() : 0;
+}
+
+uint32_t haDiscoveryHash(const char *payload, size_t len) {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < len; ++i) {
+    h ^= (uint8_t)payload[i];
+    h *= 16777619u;
+  }
+  return h ? h : 1;
+}
+
+bool haDiscoveryTopic(const char *haId, char *out, size_t outLen) {
+  int n = snprintf(out, outLen, "homeassistant/device/%s/config", haId);
+  return n > 0 && (size_t)n < outLen;
+}
+
+bool haLegacyTopic(const char *haId, size_t i, char *out, size_t outLen) {
+  if (i >= HA_ENTITY_COUNT)
+    return false;
+  int n = snprintf(out, outLen, "homeassistant/%s/%s_%s/config",
+                   HA_ENTITIES[i].component, haId, HA_ENTITIES[i].id);
+  return n > 0 && (size_t)n < outLen;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Home Assistant MQTT discovery as one device-based message
+// (homeassistant/device/<id>/config) generated from a constant entity table.
+//
+// The payload is retained at the broker, so it only has to be published when
+// its content changes: the caller keeps haDiscoveryHash() of the last
+// published payload in NVS and compares it on connect.
+//
+// Entity unique_ids match the earlier one-config-per-entity topics, which the
+// caller clears once with haLegacyTopic().
+
+struct HaEntity {
+  const char *component;   // "sensor" | "binary_sensor"
+  const char *id;          // unique_id suffix
+  const char *name;
+  const char *unit;        // nullptr = none
+  const char *deviceClass; // nullptr = none
+  const char *valueTemplate;
+};
+
+extern const HaEntity HA_ENTITIES[];
+extern const size_t HA_ENTITY_COUNT;
+
+static constexpr size_t HA_DISCOVERY_MAX = 3072;
+
+// Discovery payload for device `haId`; `stateTopic` is the telemetry topic.
+// Returns the length, 0 if it does not fit.
+size_t buildHaDiscovery(const char *haId, const char *clientId,
+                        const char *stateTopic, char *out, size_t outLen);
+// FNV-1a over the payload; never 0, so 0 can mean "nothing published".
+uint32_t haDiscoveryHash(const char *payload, size_t len);
+// homeassistant/device/<haId>/config
+bool haDiscoveryTopic(const char *haId, char *out, size_t outLen);
+// homeassistant/<component>/<haId>_<id>/config of entity `i`
+bool haLegacyTopic(const char *haId, size_t i, char *out, size_t outLen);
@@ -1,50 +1,215 @@
-
 #include "mqtt_mgr.h"
+#include "../log/logger.h"
+
+// TCP connect plus CONNACK; a dead broker costs at most this per (backed-off)
+// attempt, and connectNow() waits no longer.
+static constexpr uint32_t MQTT_CONNECT_TIMEOUT_MS = 2000;
+// Received bytes waiting for the loop task
+static constexpr size_t MQTT_RX_BUFFER = 1024;
+
+size_t MqttMgr::TcpTransport::write(const uint8_t *data, size_t len) {
+  if (!_tcp.canSend())
+    return 0;
+  size_t n = _tcp.space();
+  if (n > len)
+    n = len;
+  return n ? _tcp.add((const char *)data, n) : 0;
+}
+
+MqttMgr::MqttMgr() {
+  _tcp.onConnect([this](void *, AsyncClient *) { _evtConnected = true; });
+  _tcp.onDisconnect([this](void *, AsyncClient *) { _evtClosed = true; });
+  _tcp.onError([this](void *, AsyncClient *, int8_t) { _evtClosed = true; });
+  _tcp.onData([this](void *, AsyncClient *, void *data, size_t len) {
+    if (!_rx || xStreamBufferSend(_rx, data, len, 0) != len)
+      _evtRxOverflow = true;
+  });
+}
 
 void MqttMgr::setServer(const char *host, uint16_t port) {
-  _client.setServer(host, port);
+  _host = host;
+  _port = port;
+  if (!_rx)
+    _rx = xStreamBufferCreate(MQTT_RX_BUFFER, 1);
+}
+
+void MqttMgr::setCredentials(const char *clientId, const char *user,
+                             const char *pass) {
+  _cfg.clientId = clientId;
+  _cfg.user = user;
+  _cfg.pass = pass;
+}
+
+bool MqttMgr::startConnect(uint32_t now) {
+  _evtConnected = false;
+  _evtClosed = false;
+  _evtRxOverflow = false;
+  if (_rx)
+    xStreamBufferReset(_rx);
+  _tcpState = TCP_CONNECTING;
+  _attemptMs = now;
+  if (_tcp.connect(_host, _port))
+    return true;
+  closeSocket(now);
+  return false;
 }
 
-bool MqttMgr::ensureConnected(const char *clientId, const char *user,
-                              const char *pass, uint32_t timeoutMs) {
-  uint32_t start = millis();
-  while (!_client.connected() && millis() - start < timeoutMs) {
-    if (_client.connect(clientId, user, pass)) {
+// Socket gone or given up. An established session retries right away,
+// a failed attempt backs off.
+void MqttMgr::closeSocket(uint32_t now) {
+  if (_tcpState != TCP_DOWN)
+    _tcp.close(true); // reports the disconnect before it returns
+  _tcpState = TCP_DOWN;
+  _evtConnected = false;
+  _evtClosed = false;
+  _session.end();
+  if (_sessionUp) {
+    _sessionUp = false;
+    _wasConnected = true;
 #if debugMqttMgr
-      Serial.println("MQTT connected.");
+    LOGW("MQTT connection lost.");
 #endif
-      return true;
-      delay(200);
-    }
+    return;
   }
-  Serial.println("MQTT connect timeout.");
-  return _client.connected();
+  _failures++;
+  _nextAttemptMs = now + _backoff.nextDelayMs(esp_random());
+  LOGW("MQTT connect failed (CONNACK %u)", (unsigned)_session.connackCode());
 }
 
-bool MqttMgr::publish(const char *topic, const char *payload, bool retain) {
+void MqttMgr::sessionUp() {
 #if debugMqttMgr
-  Serial.print("Publishing to topic: ");
-  Serial.println(topic);
-  Serial.print("Payload length: ");
-  Serial.println(strlen(payload));
-  Serial.print("Payload: ");
-  Serial.println(payload);
-  Serial.print("MQTT connected: ");
-  Serial.println(_client.connected() ? "YES" : "NO");
+  LOGI("MQTT connected.");
 #endif
+  _sessionUp = true;
+  _backoff.reset();
+  if (_onConnected)
+    _onConnected();
+}
 
-  if (!_client.connected()) {
-#if debugMqttMgr
-    Serial.println("ERROR: MQTT not connected, cannot publish.");
-#endif
+void MqttMgr::pump(uint32_t now) {
+  if (_evtClosed) {
+    if (_tcpState != TCP_DOWN)
+      closeSocket(now);
+    _evtClosed = false;
+    return;
+  }
+  if (_evtConnected && _tcpState == TCP_CONNECTING) {
+    _evtConnected = false;
+    _tcpState = TCP_UP;
+    _tcp.setNoDelay(true);
+    _session.begin(_cfg, now);
+  }
+  if (_tcpState != TCP_UP)
+    return;
+  uint8_t buf[128];
+  size_t n;
+  while ((n = xStreamBufferReceive(_rx, buf, sizeof(buf), 0)) > 0)
+    _session.receive(buf, n);
+  if (_evtRxOverflow || !_session.poll(_tx, now)) {
+    closeSocket(now);
+    return;
+  }
+  if (_session.connected() && !_sessionUp)
+    sessionUp();
+}
+
+bool MqttMgr::connectNow() {
+  if (_session.connected())
+    return true;
+  if (!_cfg.clientId || !_host)
+    return false;
+  uint32_t t0 = millis();
+  if (_tcpState == TCP_DOWN && !startConnect(t0))
+    return false;
+  while (_tcpState != TCP_DOWN && !_session.connected() &&
+         millis() - _attemptMs < MQTT_CONNECT_TIMEOUT_MS) {
+    delay(1);
+    pump(millis());
+  }
+  uint32_t now = millis();
+  if (_meter)
+    _meter->add(now, now - t0);
+  if (!_session.connected() && _tcpState != TCP_DOWN)
+    closeSocket(now);
+  return _session.connected();
+}
+
+void MqttMgr::service(uint32_t now, bool linkUp) {
+  pump(now);
+  if (_tcpState != TCP_DOWN) {
+    if (!_sessionUp && now - _attemptMs >= MQTT_CONNECT_TIMEOUT_MS)
+      closeSocket(now);
+    return;
+  }
+  if (_wasConnected) {
+    // Session dropped: first retry right away, repeats back off
+    _wasConnected = false;
+    _nextAttemptMs = now;
+  }
+  if (!linkUp || !_cfg.clientId || !_host ||
+      (int32_t)(now - _nextAttemptMs) < 0)
+    return;
+  startConnect(now);
+}
+
+bool MqttMgr::sync(uint32_t timeoutMs) {
+  if (!_session.connected())
+    return false;
+  snprintf(_syncTopic, sizeof(_syncTopic), "%s/sync", _cfg.clientId);
+  char token[12];
+  snprintf(token, sizeof(token), "%lu", (unsigned long)++_syncSent);
+  if (!publish(_syncTopic, token, false, 1))
     return false;
+  uint32_t t0 = millis();
+  pump(t0);
+  while (!_session.idle()) {
+    if (millis() - t0 >= timeoutMs || !_session.connected())
+      return false;
+    delay(1);
+    pump(millis());
+  }
+  return true;
+}
+
+void MqttMgr::disconnect() {
+  if (_tcpState == TCP_UP) {
+    _session.disconnect();
+    _session.poll(_tx, millis());
+    _tcp.close(false); // after what was added
+  } else if (_tcpState == TCP_CONNECTING) {
+    _tcp.close(true);
   }
+  _tcpState = TCP_DOWN;
+  _evtConnected = false;
+  _evtClosed = false;
+  _session.end();
+  _sessionUp = false;
+  _wasConnected = false;
+}
 
-  bool result = _client.publish(topic, payload, retain);
+bool MqttMgr::publish(const char *topic, const char *payload, bool retain,
+                      uint8_t qos) {
+  bool result = publish(topic, (const uint8_t *)payload, strlen(payload),
+                        retain, qos);
 #if debugMqttMgr
-  Serial.print("Publish result: ");
-  Serial.println(result ? "SUCCESS" : "FAILED");
+  Serial.printf("MQTT publish %s (%u B): %s\n", topic,
+                (unsigned)strlen(payload), result ? "queued" : "FAILED");
 #endif
-
   return result;
 }
+
+bool MqttMgr::publish(const char *topic, const uint8_t *payload, size_t len,
+                      bool retain, uint8_t qos) {
+  return _session.publish(topic, payload, len, retain, qos);
+}
+
+bool MqttMgr::beginPublish(const char *topic, size_t len, bool retain,
+                           uint8_t qos) {
+  return _session.beginPublish(topic, len, retain, qos);
+}
+
+bool MqttMgr::write(const uint8_t *data, size_t len) {
+  return _session.write(data, len);
+}
+
+bool MqttMgr::endPublish() { return _session.endPublish(); }
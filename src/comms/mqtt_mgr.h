@@ -1,20 +1,112 @@
-
 #pragma once
+#include "conn_backoff.h"
+#include "mqtt_session.h"
 #include <Arduino.h>
-#include <PubSubClient.h>
+#include <AsyncTCP.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/stream_buffer.h>
 #define debugMqttMgr 0
 
+// Outbound queue (encoded PUBLISH packets until sent, QoS 1 until PUBACK)
+static constexpr size_t MQTT_QUEUE_BYTES = 6144;
+
+// MQTT session manager on an AsyncTCP socket. publish() only queues the
+// packet (MqttSession) and returns; `service()` / `loop()` hand queued bytes
+// to the socket as far as its send window allows, process what arrived and
+// make at most one reconnect attempt per call once the backoff delay has
+// passed. Nothing here waits for the network except connectNow() and
+// sync(), which the snapshot wake uses on purpose.
+//
+// Socket events and received bytes come from the AsyncTCP task through
+// flags and a stream buffer; the session itself only runs on the caller's
+// task.
 class MqttMgr {
 public:
-  explicit MqttMgr(Client &net) : _client(net) {}
+  MqttMgr();
   void setServer(const char *host, uint16_t port);
-  bool ensureConnected(const char *clientId, const char *user, const char *pass,
-                       uint32_t timeoutMs = 7000);
-  bool connected() { return _client.connected(); }
-  bool publish(const char *topic, const char *payload, bool retain);
-  void loop() { _client.loop(); }
-  PubSubClient *raw() { return &_client; }
+  void setCredentials(const char *clientId, const char *user,
+                      const char *pass);
+  // Called once after every successful (re)connect
+  void onConnected(void (*cb)()) { _onConnected = cb; }
+  void setBlockedMeter(BlockedTimeMeter *m) { _meter = m; }
+
+  // Connect and wait for the CONNACK, bounded by MQTT_CONNECT_TIMEOUT_MS.
+  bool connectNow();
+  void service(uint32_t now, bool linkUp);
+
+  bool connected() const { return _session.connected(); }
+  // Queue a PUBLISH (QoS 0 or 1); false if not connected or the queue is
+  // full.
+  bool publish(const char *topic, const char *payload, bool retain,
+               uint8_t qos = 1);
+  bool publish(const char *topic, const uint8_t *payload, size_t len,
+               bool retain, uint8_t qos = 1);
+  // Streamed publish without a payload buffer of the caller's: announce
+  // `len`, write() the payload in any number of pieces, then endPublish().
+  // The pieces go straight into the queue; a short stream is discarded.
+  bool beginPublish(const char *topic, size_t len, bool retain,
+                    uint8_t qos = 1);
+  bool write(const uint8_t *data, size_t len);
+  bool endPublish();
+  // Not restored after a reconnect; subscribe again from onConnected().
+  bool subscribe(const char *topic, uint8_t qos = 1) {
+    return _session.subscribe(topic, qos);
+  }
+  void onMessage(MqttSession::MessageFn fn, void *ctx) {
+    _session.onMessage(fn, ctx);
+  }
+  // Move queued and received bytes now (service() without reconnecting)
+  void loop() { pump(millis()); }
+  // Wait until everything queued so far is acknowledged: a QoS 1 token is
+  // queued last, and the broker acknowledges in order. On success the radio
+  // can be switched off.
+  bool sync(uint32_t timeoutMs);
+  // Send DISCONNECT and close the socket.
+  void disconnect();
+  uint32_t connectFailures() const { return _failures; }
+  size_t queuedBytes() const { return _session.queuedBytes(); }
+  uint16_t inflight() const { return _session.inflight(); }
 
 private:
-  PubSubClient _client;
-};
\ No newline at end of file
+  enum TcpState : uint8_t { TCP_DOWN, TCP_CONNECTING, TCP_UP };
+
+  // Session bytes into the socket's send window
+  class TcpTransport : public MqttTransport {
+  public:
+    explicit TcpTransport(AsyncClient &tcp) : _tcp(tcp) {}
+    size_t write(const uint8_t *data, size_t len) override;
+    void flush() override { _tcp.send(); }
+
+  private:
+    AsyncClient &_tcp;
+  };
+
+  AsyncClient _tcp;
+  TcpTransport _tx{_tcp};
+  uint8_t _queue[MQTT_QUEUE_BYTES];
+  MqttSession _session{_queue, sizeof(_queue)};
+  MqttSessionConfig _cfg;
+  const char *_host = nullptr;
+  uint16_t _port = 1883;
+  void (*_onConnected)() = nullptr;
+  BlockedTimeMeter *_meter = nullptr;
+  ConnBackoff _backoff{2000, 5UL * 60UL * 1000UL, 50};
+  TcpState _tcpState = TCP_DOWN;
+  uint32_t _attemptMs = 0;
+  uint32_t _nextAttemptMs = 0;
+  uint32_t _failures = 0;
+  bool _wasConnected = false;
+  bool _sessionUp = false;
+  char _syncTopic[64] = "";
+  uint32_t _syncSent = 0;
+  // Set from the AsyncTCP task, consumed by pump()
+  StreamBufferHandle_t _rx = nullptr;
+  volatile bool _evtConnected{false};
+  volatile bool _evtClosed{false};
+  volatile bool _evtRxOverflow{false};
+
+  bool startConnect(uint32_t now);
+  void closeSocket(uint32_t now);
+  void pump(uint32_t now);
+  void sessionUp();
+};
@@ -0,0 +1,436 @@
+#include "mqtt_session.h"
+#include <string.h>
+
+// Record flags
+static constexpr uint8_t F_QOS1 = 0x01;
+static constexpr uint8_t F_SENT = 0x02; // QoS 1, waiting for PUBACK
+static constexpr uint8_t F_DONE = 0x04; // acked, or QoS 0 and sent
+static constexpr uint8_t F_OPEN = 0x08; // streamed publish still written
+static constexpr uint8_t F_DUP = 0x10;  // resend after a reconnect
+
+// Packet types (upper nibble of the first byte)
+static constexpr uint8_t PT_CONNECT = 1, PT_CONNACK = 2, PT_PUBLISH = 3,
+                         PT_PUBACK = 4, PT_SUBSCRIBE = 8, PT_SUBACK = 9,
+                         PT_PINGREQ = 12, PT_PINGRESP = 13,
+                         PT_DISCONNECT = 14;
+
+static size_t lenBytes(size_t n) {
+  return n < 128 ? 1 : n < 16384 ? 2 : n < 2097152 ? 3 : 4;
+}
+
+static uint8_t *putLen(uint8_t *p, size_t n) {
+  do {
+    uint8_t b = n & 0x7F;
+    n >>= 7;
+    *p++ = n ? (b | 0x80) : b;
+  } while (n);
+  return p;
+}
+
+static uint8_t *put16(uint8_t *p, uint16_t v) {
+  *p++ = (uint8_t)(v >> 8);
+  *p++ = (uint8_t)v;
+  return p;
+}
+
+static uint8_t *putStr(uint8_t *p, const char *s, size_t n) {
+  p = put16(p, (uint16_t)n);
+  memcpy(p, s, n);
+  return p + n;
+}
+
+MqttSession::Rec MqttSession::rec(size_t off) const {
+  Rec r;
+  memcpy(&r, _q + off, REC_HDR);
+  return r;
+}
+
+void MqttSession::setRec(size_t off, const Rec &r) {
+  memcpy(_q + off, &r, REC_HDR);
+}
+
+uint16_t MqttSession::pid() {
+  if (++_nextPid == 0)
+    _nextPid = 1;
+  return _nextPid;
+}
+
+// Room for a record at the tail, compacting the queue if that helps
+uint8_t *MqttSession::reserve(size_t pktLen, uint16_t id, uint8_t flags) {
+  size_t need = REC_HDR + pktLen;
+  if (pktLen > 0xFFFF || need > _cap)
+    return nullptr;
+  if (_tail + need > _cap && _head) {
+    memmove(_q, _q + _head, _tail - _head);
+    _tail -= _head;
+    _sendRec -= _head;
+    _head = 0;
+  }
+  if (_tail + need > _cap)
+    return nullptr;
+  Rec r = {(uint16_t)pktLen, id, flags, 0};
+  setRec(_tail, r);
+  uint8_t *p = _q + _tail + REC_HDR;
+  _tail += need;
+  return p;
+}
+
+// Drop finished records from the head
+void MqttSession::pop() {
+  while (_head < _tail) {
+    Rec r = rec(_head);
+    if (!(r.flags & F_DONE))
+      break;
+    _head += REC_HDR + r.len;
+  }
+  if (_head == _tail)
+    _head = _tail = _sendRec = 0;
+}
+
+bool MqttSession::ctrl(const uint8_t *pkt, size_t len) {
+  if (_ctrlLen + len > CTRL_MAX)
+    return false;
+  memcpy(_ctrl + _ctrlLen, pkt, len);
+  _ctrlLen += len;
+  return true;
+}
+
+void MqttSession::begin(const MqttSessionConfig &cfg, uint32_t now_ms) {
+  _cfg = cfg;
+  _state = ST_CONNECTING;
+  _dead = false;
+  _connack = 0;
+  _ctrlLen = 0;
+  _sendRec = _head;
+  _sendPos = 0;
+  _rxStage = 0;
+  _pingOut = false;
+  _connectMs = _lastTxMs = now_ms;
+
+  const char *id = cfg.clientId ? cfg.clientId : "";
+  bool user = cfg.user && *cfg.user;
+  bool pass = user && cfg.pass && *cfg.pass;
+  size_t idLen = strlen(id), userLen = user ? strlen(cfg.user) : 0,
+         passLen = pass ? strlen(cfg.pass) : 0;
+  size_t rem = 10 + 2 + idLen + (user ? 2 + userLen : 0) +
+               (pass ? 2 + passLen : 0);
+  uint8_t pkt[CTRL_MAX];
+  if (1 + lenBytes(rem) + rem > sizeof(pkt)) {
+    _dead = true;
+    return;
+  }
+  uint8_t *p = pkt;
+  *p++ = PT_CONNECT << 4;
+  p = putLen(p, rem);
+  p = putStr(p, "MQTT", 4);
+  *p++ = 4; // protocol level 3.1.1
+  *p++ = 0x02 | (user ? 0x80 : 0) | (pass ? 0x40 : 0); // clean session
+  p = put16(p, cfg.keepAlive_s);
+  p = putStr(p, id, idLen);
+  if (user)
+    p = putStr(p, cfg.user, userLen);
+  if (pass)
+    p = putStr(p, cfg.pass, passLen);
+  ctrl(pkt, p - pkt);
+}
+
+void MqttSession::end() {
+  _state = ST_DOWN;
+  _ctrlLen = 0;
+  _sendPos = 0;
+  _pingOut = false;
+  if (_open) {
+    _tail = _openRec;
+    _open = false;
+  }
+  // Everything not acked goes out again; what reached the wire as a whole
+  // packet is marked as a duplicate
+  for (size_t off = _head; off < _tail;) {
+    Rec r = rec(off);
+    if ((r.flags & F_SENT) && !(r.flags & F_DONE)) {
+      _q[off + REC_HDR] |= 0x08;
+      r.flags = (r.flags & ~F_SENT) | F_DUP;
+      setRec(off, r);
+    }
+    off += REC_HDR + r.len;
+  }
+  _sendRec = _head;
+  pop();
+}
+
+void MqttSession::disconnect() {
+  static const uint8_t pkt[] = {PT_DISCONNECT << 4, 0};
+  if (_state == ST_DOWN)
+    return;
+  ctrl(pkt, sizeof(pkt));
+  _state = ST_DOWN; // the current packet is finished, nothing new starts
+}
+
+bool MqttSession::poll(MqttTransport &t, uint32_t now_ms) {
+  if (_dead)
+    return false;
+  uint32_t timeout = _cfg.ackTimeout_ms;
+  if (_state == ST_CONNECTING && now_ms - _connectMs > timeout)
+    return false;
+  if (_state == ST_CONNECTED) {
+    if (_pingOut && now_ms - _pingMs > timeout)
+      return false;
+    // Records are sent in order, so the first one waiting is the oldest
+    for (size_t off = _head; off < _sendRec;) {
+      Rec r = rec(off);
+      if ((r.flags & F_SENT) && !(r.flags & F_DONE)) {
+        if (now_ms - r.sentMs > timeout)
+          return false;
+        break;
+      }
+      off += REC_HDR + r.len;
+    }
+    if (_cfg.keepAlive_s && !_pingOut &&
+        now_ms - _lastTxMs >= _cfg.keepAlive_s * 1000UL) {
+      static const uint8_t ping[] = {PT_PINGREQ << 4, 0};
+      if (ctrl(ping, sizeof(ping))) {
+        _pingOut = true;
+        _pingMs = now_ms;
+      }
+    }
+  }
+
+  bool wrote = false;
+  for (;;) {
+    if (!_sendPos && _ctrlLen) {
+      size_t n = t.write(_ctrl, _ctrlLen);
+      if (!n)
+        break;
+      memmove(_ctrl, _ctrl + n, _ctrlLen - n);
+      _ctrlLen -= n;
+      wrote = true;
+      continue;
+    }
+    if (!_sendPos) {
+      if (_state != ST_CONNECTED)
+        break;
+      while (_sendRec < _tail && (rec(_sendRec).flags & F_DONE))
+        _sendRec += REC_HDR + rec(_sendRec).len;
+      if (_sendRec >= _tail || (rec(_sendRec).flags & F_OPEN))
+        break;
+    }
+    Rec r = rec(_sendRec);
+    size_t n = t.write(_q + _sendRec + REC_HDR + _sendPos, r.len - _sendPos);
+    if (!n)
+      break;
+    wrote = true;
+    _sendPos += n;
+    if (_sendPos < r.len)
+      continue;
+    if (r.flags & F_DUP) {
+      r.flags &= ~F_DUP;
+      _resent++;
+    }
+    if (r.flags & F_QOS1) {
+      r.flags |= F_SENT;
+      r.sentMs = now_ms;
+    } else {
+      r.flags |= F_DONE;
+    }
+    setRec(_sendRec, r);
+    _sendRec += REC_HDR + r.len;
+    _sendPos = 0;
+  }
+  if (wrote) {
+    _lastTxMs = now_ms;
+    t.flush();
+  }
+  pop();
+  return true;
+}
+
+void MqttSession::receive(const uint8_t *data, size_t len) {
+  for (size_t i = 0; i < len && !_dead; ++i) {
+    uint8_t b = data[i];
+    if (_rxStage == 0) {
+      _rxType = b;
+      _rxLen = 0;
+      _rxLenBytes = 0;
+      _rxStage = 1;
+    } else if (_rxStage == 1) {
+      _rxLen |= (uint32_t)(b & 0x7F) << (7 * _rxLenBytes++);
+      if (b & 0x80) {
+        if (_rxLenBytes == 4)
+          _dead = true; // remaining length over 4 bytes
+        continue;
+      }
+      _rxGot = 0;
+      if (_rxLen) {
+        _rxStage = 2;
+        continue;
+      }
+      handle();
+      _rxStage = 0;
+    } else {
+      // Bodies larger than the buffer are consumed and ignored
+      if (_rxGot < RX_MAX)
+        _rx[_rxGot] = b;
+      if (++_rxGot < _rxLen)
+        continue;
+      handle();
+      _rxStage = 0;
+    }
+  }
+}
+
+void MqttSession::handle() {
+  uint8_t type = _rxType >> 4;
+  if (_rxLen > RX_MAX)
+    return;
+  switch (type) {
+  case PT_CONNACK:
+    if (_rxLen < 2 || _state != ST_CONNECTING) {
+      _dead = true;
+      return;
+    }
+    _connack = _rx[1];
+    if (_connack)
+      _dead = true;
+    else
+      _state = ST_CONNECTED;
+    return;
+  case PT_PUBACK:
+    if (_rxLen >= 2)
+      ack((uint16_t)(_rx[0] << 8 | _rx[1]));
+    return;
+  case PT_PINGRESP:
+    _pingOut = false;
+    return;
+  case PT_SUBACK:
+    return;
+  case PT_PUBLISH:
+    break;
+  default:
+    _dead = true;
+    return;
+  }
+
+  uint8_t qos = (_rxType >> 1) & 0x03;
+  if (_rxLen < 2)
+    return;
+  size_t tl = (size_t)_rx[0] << 8 | _rx[1];
+  size_t pos = 2 + tl + (qos ? 2 : 0);
+  if (pos > _rxLen || qos > 1)
+    return;
+  if (qos) {
+    uint8_t puback[4] = {PT_PUBACK << 4, 2, _rx[2 + tl], _rx[3 + tl]};
+    ctrl(puback, sizeof(puback));
+  }
+  char topic[128];
+  if (!_onMsg || tl >= sizeof(topic))
+    return;
+  memcpy(topic, _rx + 2, tl);
+  topic[tl] = '\0';
+  _onMsg(_msgCtx, topic, _rx + pos, _rxLen - pos, (_rxType & 0x01) != 0);
+}
+
+void MqttSession::ack(uint16_t id) {
+  for (size_t off = _head; off < _sendRec;) {
+    Rec r = rec(off);
+    if (r.pid == id && (r.flags & F_SENT) && !(r.flags & F_DONE)) {
+      r.flags |= F_DONE;
+      setRec(off, r);
+      _acked++;
+      break;
+    }
+    off += REC_HDR + r.len;
+  }
+  pop();
+}
+
+uint16_t MqttSession::inflight() const {
+  uint16_t n = 0;
+  for (size_t off = _head; off < _tail;) {
+    Rec r = rec(off);
+    if ((r.flags & F_SENT) && !(r.flags & F_DONE))
+      n++;
+    off += REC_HDR + r.len;
+  }
+  return n;
+}
+
+// Fixed header, topic and packet id of a PUBLISH whose payload is `len`
+static uint8_t *publishHeader(uint8_t *p, const char *topic, size_t tl,
+                              size_t rem, bool retain, uint8_t qos,
+                              uint16_t id) {
+  *p++ = (uint8_t)(PT_PUBLISH << 4 | qos << 1 | (retain ? 1 : 0));
+  p = putLen(p, rem);
+  p = putStr(p, topic, tl);
+  if (qos)
+    p = put16(p, id);
+  return p;
+}
+
+bool MqttSession::publish(const char *topic, const uint8_t *payload,
+                          size_t len, bool retain, uint8_t qos) {
+  if (!beginPublish(topic, len, retain, qos))
+    return false;
+  write(payload, len);
+  return endPublish();
+}
+
+bool MqttSession::beginPublish(const char *topic, size_t len, bool retain,
+                               uint8_t qos) {
+  if (!connected() || _open || !topic || qos > 1)
+    return false;
+  size_t tl = strlen(topic);
+  size_t rem = 2 + tl + (qos ? 2 : 0) + len;
+  size_t pktLen = 1 + lenBytes(rem) + rem;
+  uint16_t id = qos ? pid() : 0;
+  uint8_t *p = reserve(pktLen, id, F_OPEN | (qos ? F_QOS1 : 0));
+  if (!p)
+    return false;
+  uint8_t *body = publishHeader(p, topic, tl, rem, retain, qos, id);
+  _open = true;
+  _openRec = _tail - REC_HDR - pktLen;
+  _openPos = body - p;
+  return true;
+}
+
+bool MqttSession::write(const uint8_t *data, size_t len) {
+  if (!_open)
+    return false;
+  Rec r = rec(_openRec);
+  if (len > r.len - _openPos)
+    return false;
+  memcpy(_q + _openRec + REC_HDR + _openPos, data, len);
+  _openPos += len;
+  return true;
+}
+
+bool MqttSession::endPublish() {
+  if (!_open)
+    return false;
+  _open = false;
+  Rec r = rec(_openRec);
+  if (_openPos != r.len) {
+    _tail = _openRec; // always the last record
+    pop();
+    return false;
+  }
+  r.flags &= ~F_OPEN;
+  setRec(_openRec, r);
+  return true;
+}
+
+bool MqttSession::subscribe(const char *topic, uint8_t qos) {
+  if (!connected() || !topic || qos > 1)
+    return false;
+  size_t tl = strlen(topic);
+  size_t rem = 2 + 2 + tl + 1;
+  uint8_t pkt[CTRL_MAX];
+  if (1 + lenBytes(rem) + rem > sizeof(pkt))
+    return false;
+  uint8_t *p = pkt;
+  *p++ = PT_SUBSCRIBE << 4 | 0x02;
+  p = putLen(p, rem);
+  p = put16(p, pid());
+  p = putStr(p, topic, tl);
+  *p++ = qos;
+  return ctrl(pkt, p - pkt);
+}
@@ -0,0 +1,136 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// MQTT 3.1.1 client session, independent of the socket: the caller feeds
+// received bytes to receive() and lets poll() hand queued bytes to a
+// non-blocking transport. Nothing here waits for the network.
+//
+// Outbound PUBLISH packets are encoded into a caller-provided queue. QoS 0
+// packets leave the queue once the transport took them; QoS 1 packets stay
+// until the broker's PUBACK. After a dropped connection (end()) the unacked
+// ones are sent again with DUP set once the next CONNACK arrives, so nothing
+// accepted by publish() is lost while the device stays up. Control packets
+// (CONNECT, SUBSCRIBE, PUBACK, PINGREQ) have a small queue of their own and
+// never split a PUBLISH on the wire.
+//
+// poll() reports a dead session (CONNACK refused or missing, PUBACK or
+// PINGRESP overdue, malformed input); the caller then closes the socket and
+// calls end().
+
+// Byte sink of the session, e.g. an AsyncTCP client.
+class MqttTransport {
+public:
+  virtual ~MqttTransport() {}
+  // Take up to `len` bytes without blocking; returns how many were taken.
+  virtual size_t write(const uint8_t *data, size_t len) = 0;
+  // Push what write() took onto the wire.
+  virtual void flush() {}
+};
+
+struct MqttSessionConfig {
+  const char *clientId = nullptr;
+  const char *user = nullptr; // nullptr or "" = none
+  const char *pass = nullptr;
+  uint16_t keepAlive_s = 15;
+  // CONNACK, PUBACK and PINGRESP must arrive within this
+  uint32_t ackTimeout_ms = 10000;
+};
+
+class MqttSession {
+public:
+  // `retained`: the broker's stored copy, sent on subscribing
+  typedef void (*MessageFn)(void *ctx, const char *topic,
+                            const uint8_t *payload, size_t len,
+                            bool retained);
+
+  MqttSession(uint8_t *queue, size_t queueLen) : _q(queue), _cap(queueLen) {}
+
+  // Transport connected: CONNECT goes out first, queued PUBLISH packets
+  // after the CONNACK.
+  void begin(const MqttSessionConfig &cfg, uint32_t now_ms);
+  // Transport closed. Unacked QoS 1 packets are kept for the next begin().
+  void end();
+  // Bytes received from the transport.
+  void receive(const uint8_t *data, size_t len);
+  // Send what the transport takes, keepalive and timeouts. False once the
+  // session is dead.
+  bool poll(MqttTransport &t, uint32_t now_ms);
+  // Queue DISCONNECT (sent by the next poll()).
+  void disconnect();
+
+  bool connected() const { return _state == ST_CONNECTED; }
+  // Return code of the last CONNACK (0 = accepted)
+  uint8_t connackCode() const { return _connack; }
+
+  // Queue a PUBLISH; false if not connected or the queue is full.
+  bool publish(const char *topic, const uint8_t *payload, size_t len,
+               bool retain, uint8_t qos);
+  // Streamed PUBLISH of `len` bytes written into the queue piecewise. An
+  // incomplete one is discarded by endPublish().
+  bool beginPublish(const char *topic, size_t len, bool retain, uint8_t qos);
+  bool write(const uint8_t *data, size_t len);
+  bool endPublish();
+  bool subscribe(const char *topic, uint8_t qos);
+  void onMessage(MessageFn fn, void *ctx) {
+    _onMsg = fn;
+    _msgCtx = ctx;
+  }
+
+  // Nothing queued, unsent or waiting for a PUBACK
+  bool idle() const { return _head == _tail && !_ctrlLen; }
+  size_t queuedBytes() const { return _tail - _head; }
+  uint16_t inflight() const;
+  uint32_t acked() const { return _acked; }
+  uint32_t resent() const { return _resent; }
+
+private:
+  enum State : uint8_t { ST_DOWN, ST_CONNECTING, ST_CONNECTED };
+  struct Rec {
+    uint16_t len; // packet bytes after the header
+    uint16_t pid;
+    uint8_t flags;
+    uint32_t sentMs;
+  };
+  static constexpr size_t REC_HDR = sizeof(Rec);
+  static constexpr size_t CTRL_MAX = 320;
+  static constexpr size_t RX_MAX = 320;
+
+  uint8_t *_q;
+  size_t _cap;
+  size_t _head = 0, _tail = 0;
+  size_t _sendRec = 0, _sendPos = 0; // record being sent, bytes done
+  size_t _openRec = 0, _openPos = 0; // streamed publish being written
+  bool _open = false;
+
+  uint8_t _ctrl[CTRL_MAX];
+  size_t _ctrlLen = 0;
+
+  MqttSessionConfig _cfg;
+  State _state = ST_DOWN;
+  uint8_t _connack = 0;
+  bool _dead = false;
+  uint16_t _nextPid = 0;
+  uint32_t _connectMs = 0, _lastTxMs = 0, _pingMs = 0;
+  bool _pingOut = false;
+  uint32_t _acked = 0, _resent = 0;
+
+  // Incoming packet parser
+  uint8_t _rxType = 0;
+  uint32_t _rxLen = 0, _rxGot = 0;
+  uint8_t _rxLenBytes = 0;
+  uint8_t _rxStage = 0; // 0 = type, 1 = length, 2 = body
+  uint8_t _rx[RX_MAX];
+
+  MessageFn _onMsg = nullptr;
+  void *_msgCtx = nullptr;
+
+  Rec rec(size_t off) const;
+  void setRec(size_t off, const Rec &r);
+  uint8_t *reserve(size_t pktLen, uint16_t pid, uint8_t flags);
+  void pop();
+  uint16_t pid();
+  bool ctrl(const uint8_t *pkt, size_t len);
+  void handle();
+  void ack(uint16_t pid);
+};
@@ -0,0 +1,314 @@
+#include "outbox.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+static constexpr uint32_t OUTBOX_MAGIC = 0x4F424F58; // "OBOX"
+static constexpr uint8_t RECORD_VERSION = 1;
+static constexpr int MAX_LISTED_SEGMENTS = 64;
+
+// Record layout (little-endian):
+//   0 ts u32 | 4 up_ms u32 | 8 V mV u16 | 10 I cA i16 | 12 T dC i16
+//  14 soc c% u16 | 16 soh c% u16 | 18 Rint c-mOhm u16 | 20 Rint25 u16
+//  22 RintBaseline u16 | 24 ah_left cAh u16 | 26 capacity dAh u16
+//  28 rest_s u16 | 30 lowCurrentAccum_s u16 | 32 mode/flags | 33 version
+//  34 CRC-16/CCITT over bytes 0..33
+static constexpr uint16_t U16_NULL = 0xFFFF;
+static constexpr int16_t I16_NULL = INT16_MIN;
+static constexpr uint8_t FLAG_ALT_ON = 0x10;
+static constexpr uint8_t FLAG_HAS_RINT = 0x20;
+static constexpr uint8_t FLAG_HAS_RINT25 = 0x40;
+static const char *const MODES[] = {"active", "parked-idle", "parked-sleep",
+                                    "snapshot"};
+
+static void put16(uint8_t *p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+static void put32(uint8_t *p, uint32_t v) {
+  put16(p, (uint16_t)v);
+  put16(p + 2, (uint16_t)(v >> 16));
+}
+static uint16_t get16(const uint8_t *p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+static uint32_t get32(const uint8_t *p) {
+  return get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+static uint16_t crc16(const uint8_t *p, size_t n) {
+  uint16_t crc = 0xFFFF;
+  while (n--) {
+    crc ^= (uint16_t)(*p++) << 8;
+    for (int i = 0; i < 8; ++i)
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : crc << 1;
+  }
+  return crc;
+}
+
+// Scaled and clamped; non-finite maps to `nullv` (which is never a value).
+static uint16_t toU16(float v, float scale, uint16_t nullv = 0) {
+  if (!isfinite(v))
+    return nullv;
+  float x = roundf(v * scale);
+  float hi = (nullv == U16_NULL) ? 65534.0f : 65535.0f;
+  return (uint16_t)(x < 0.0f ? 0.0f : (x > hi ? hi : x));
+}
+static int16_t toI16(float v, float scale, int16_t nullv = 0) {
+  if (!isfinite(v))
+    return nullv;
+  float x = roundf(v * scale);
+  return (int16_t)(x < -32767.0f ? -32767.0f : (x > 32767.0f ? 32767.0f : x));
+}
+static float fromU16(uint16_t v, float scale, bool nullable) {
+  return (nullable && v == U16_NULL) ? NAN : v / scale;
+}
+static uint16_t sat16(uint32_t v) { return v > 0xFFFFu ? 0xFFFF : v; }
+
+void packOutboxRecord(const TelemetryFrame &f, uint32_t ts, OutboxRecord &r) {
+  uint8_t *b = r.b;
+  put32(b + 0, ts);
+  put32(b + 4, f.up_ms);
+  put16(b + 8, toU16(f.V, 1000.0f));
+  put16(b + 10, (uint16_t)toI16(f.I, 100.0f));
+  put16(b + 12, (uint16_t)toI16(f.T, 10.0f, I16_NULL));
+  put16(b + 14, toU16(f.soc_pct, 100.0f));
+  put16(b + 16, toU16(f.soh_pct, 100.0f, U16_NULL));
+  put16(b + 18, toU16(f.Rint_mOhm, 100.0f, U16_NULL));
+  put16(b + 20, toU16(f.Rint25_mOhm, 100.0f, U16_NULL));
+  put16(b + 22, toU16(f.RintBaseline_mOhm, 100.0f));
+  put16(b + 24, toU16(f.ah_left, 100.0f));
+  put16(b + 26, toU16(f.battery_capacity_ah, 10.0f));
+  put16(b + 28, sat16(f.rest_s));
+  put16(b + 30, sat16(f.lowCurrentAccum_s));
+  uint8_t mode = 0;
+  for (uint8_t i = 0; i < sizeof(MODES) / sizeof(MODES[0]); ++i)
+    if (f.mode && !strcmp(f.mode, MODES[i]))
+      mode = i;
+  b[32] = mode | (f.alternator_on ? FLAG_ALT_ON : 0) |
+          (f.hasRint ? FLAG_HAS_RINT : 0) |
+          (f.hasRint25 ? FLAG_HAS_RINT25 : 0);
+  b[33] = RECORD_VERSION;
+  put16(b + 34, crc16(b, 34));
+}
+
+bool unpackOutboxRecord(const OutboxRecord &r, TelemetryFrame &f,
+                        uint32_t &ts) {
+  const uint8_t *b = r.b;
+  if (b[33] != RECORD_VERSION || get16(b + 34) != crc16(b, 34))
+    return false;
+  ts = get32(b + 0);
+  f.up_ms = get32(b + 4);
+  f.V = get16(b + 8) / 1000.0f;
+  f.I = (int16_t)get16(b + 10) / 100.0f;
+  int16_t t = (int16_t)get16(b + 12);
+  f.T = (t == I16_NULL) ? NAN : t / 10.0f;
+  f.soc_pct = get16(b + 14) / 100.0f;
+  f.soh_pct = fromU16(get16(b + 16), 100.0f, true);
+  f.Rint_mOhm = fromU16(get16(b + 18), 100.0f, true);
+  f.Rint25_mOhm = fromU16(get16(b + 20), 100.0f, true);
+  f.RintBaseline_mOhm = get16(b + 22) / 100.0f;
+  f.ah_left = get16(b + 24) / 100.0f;
+  f.battery_capacity_ah = get16(b + 26) / 10.0f;
+  f.rest_s = get16(b + 28);
+  f.lowCurrentAccum_s = get16(b + 30);
+  f.mode = MODES[b[32] & 0x03];
+  f.alternator_on = b[32] & FLAG_ALT_ON;
+  f.hasRint = b[32] & FLAG_HAS_RINT;
+  f.hasRint25 = b[32] & FLAG_HAS_RINT25;
+  f.net_blocked_ms_h = 0;
+  f.hasStats = false; // records carry no interval statistics
+  f.stats = {};
+  return true;
+}
+
+bool buildOutboxRecordJson(const OutboxRecord &r, char *out, size_t outLen) {
+  TelemetryFrame f{};
+  uint32_t ts;
+  if (!unpackOutboxRecord(r, f, ts) || !buildTelemetryJson(f, out, outLen))
+    return false;
+  // Replace the closing brace with the capture timestamp
+  size_t n = strlen(out) - 1;
+  int m = ts ? snprintf(out + n, outLen - n, ",\"ts\":%lu}", (unsigned long)ts)
+             : snprintf(out + n, outLen - n, ",\"ts\":null}");
+  return m > 0 && (size_t)m < outLen - n;
+}
+
+// ------------------------------ Outbox ------------------------------
+
+uint32_t Outbox::recordsIn(uint32_t id) {
+  int32_t sz = (id == _tail) ? (int32_t)_tailBytes : _st.size(id);
+  return sz > 0 ? (uint32_t)sz / OUTBOX_RECORD_SIZE : 0;
+}
+
+void Outbox::begin() {
+  uint32_t ids[MAX_LISTED_SEGMENTS];
+  int n = _st.list(ids, MAX_LISTED_SEGMENTS);
+  _segCount = 0;
+  _pending = 0;
+  if (n <= 0) {
+    clear();
+    return;
+  }
+  _head = _tail = ids[0];
+  for (int i = 1; i < n; ++i) {
+    if (ids[i] < _head)
+      _head = ids[i];
+    if (ids[i] > _tail)
+      _tail = ids[i];
+  }
+  _segCount = (uint16_t)n;
+  _nextId = _tail + 1;
+  int32_t tailSize = _st.size(_tail);
+  _tailBytes = tailSize > 0 ? (uint32_t)tailSize : 0;
+
+  if (_cur.magic != OUTBOX_MAGIC || _cur.segment < _head ||
+      _cur.segment > _tail || _st.size(_cur.segment) < 0) {
+    _cur.magic = OUTBOX_MAGIC;
+    _cur.segment = _head;
+    _cur.offset = 0;
+  }
+  _cur.offset -= _cur.offset % OUTBOX_RECORD_SIZE;
+  uint32_t done = _cur.offset / OUTBOX_RECORD_SIZE;
+  uint32_t inCur = recordsIn(_cur.segment);
+  if (done > inCur)
+    done = inCur;
+  _cur.offset = done * OUTBOX_RECORD_SIZE;
+  _pending = inCur - done;
+  for (uint32_t id = _cur.segment + 1; id <= _tail; ++id)
+    _pending += recordsIn(id);
+}
+
+void Outbox::clear() {
+  _segCount = 0;
+  _pending = 0;
+  _tailBytes = 0;
+  _cur.magic = OUTBOX_MAGIC;
+  _cur.segment = _nextId;
+  _cur.offset = 0;
+}
+
+bool Outbox::push(const OutboxRecord &r) {
+  if (_segCount == 0) {
+    _head = _tail = _nextId++;
+    _tailBytes = 0;
+    _segCount = 1;
+    _cur.magic = OUTBOX_MAGIC;
+    _cur.segment = _head;
+    _cur.offset = 0;
+  } else if (_tailBytes + OUTBOX_RECORD_SIZE > SEGMENT_BYTES ||
+             _tailBytes % OUTBOX_RECORD_SIZE != 0) {
+    // Full, or ends in a torn record: start a new segment
+    _tail = _nextId++;
+    _tailBytes = 0;
+    _segCount++;
+    if (_segCount > _maxSegments)
+      dropHead();
+  }
+  if (!_st.append(_tail, r.b, OUTBOX_RECORD_SIZE)) {
+    _stats.writeErrors++;
+    return false;
+  }
+  _tailBytes += OUTBOX_RECORD_SIZE;
+  _pending++;
+  _stats.stored++;
+  return true;
+}
+
+void Outbox::dropHead() {
+  uint32_t unsent = recordsIn(_head);
+  if (_cur.segment == _head)
+    unsent -= _cur.offset / OUTBOX_RECORD_SIZE;
+  _st.remove(_head);
+  _pending -= unsent;
+  _stats.dropped += unsent;
+  _segCount--;
+  _head++;
+  while (_head < _tail && _st.size(_head) < 0)
+    _head++;
+  if (_cur.segment < _head) {
+    _cur.segment = _head;
+    _cur.offset = 0;
+  }
+}
+
+// Delete the fully replayed head segment and move on to the next one.
+void Outbox::advanceSegment() {
+  if (_cur.segment == _tail) {
+    if (_pending == 0) {
+      _st.remove(_tail);
+      clear();
+    }
+    return;
+  }
+  _st.remove(_cur.segment);
+  _segCount--;
+  do {
+    _cur.segment++;
+  } while (_cur.segment < _tail && _st.size(_cur.segment) < 0);
+  _cur.offset = 0;
+  _head = _cur.segment;
+}
+
+int Outbox::peek(OutboxRecord *out, int max) {
+  int n = 0;
+  while (n < max && (uint32_t)n < _pending) {
+    uint32_t off = _cur.offset + (uint32_t)n * OUTBOX_RECORD_SIZE;
+    if (off / OUTBOX_RECORD_SIZE >= recordsIn(_cur.segment)) {
+      if (n > 0 || _cur.segment == _tail)
+        break;
+      advanceSegment();
+      continue;
+    }
+    OutboxRecord &r = out[n];
+    TelemetryFrame f{};
+    uint32_t ts;
+    bool ok = _st.read(_cur.segment, off, r.b, OUTBOX_RECORD_SIZE) ==
+                  (int32_t)OUTBOX_RECORD_SIZE &&
+              unpackOutboxRecord(r, f, ts);
+    if (ok) {
+      n++;
+      continue;
+    }
+    if (n > 0)
+      break;
+    _stats.corrupt++;
+    consume(1);
+  }
+  return n;
+}
+
+void Outbox::consume(uint32_t n) {
+  if (n > _pending)
+    n = _pending;
+  _cur.offset += n * OUTBOX_RECORD_SIZE;
+  _pending -= n;
+  if (_cur.offset / OUTBOX_RECORD_SIZE >= recordsIn(_cur.segment))
+    advanceSegment();
+}
+
+void Outbox::commit(int n, uint32_t bytes, uint32_t elapsed_ms) {
+  if (n <= 0)
+    return;
+  _stats.replayed += (uint32_t)n;
+  _stats.replayBytes += bytes;
+  _stats.replayTime_ms += elapsed_ms;
+  consume((uint32_t)n);
+}
+
+bool buildOutboxJson(const Outbox &o, char *out, size_t outLen) {
+  const OutboxStats &s = o.stats();
+  float secs = s.replayTime_ms / 1000.0f;
+  float rps = secs > 0.0f ? s.replayed / secs : 0.0f;
+  float bps = secs > 0.0f ? s.replayBytes / secs : 0.0f;
+  int n = snprintf(out, outLen,
+                   "{\"event\":\"outbox\",\"pending\":%lu,\"segments\":%u,"
+                   "\"stored\":%lu,\"replayed\":%lu,\"dropped\":%lu,"
+                   "\"corrupt\":%lu,\"write_errors\":%lu,"
+                   "\"replay_rec_s\":%.1f,\"replay_B_s\":%.0f}",
+                   (unsigned long)o.pending(), (unsigned)o.segments(),
+                   (unsigned long)s.stored, (unsigned long)s.replayed,
+                   (unsigned long)s.dropped, (unsigned long)s.corrupt,
+                   (unsigned long)s.writeErrors, rps, bps);
+  return n > 0 && (size_t)n < outLen;
+}
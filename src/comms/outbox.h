@@ -0,0 +1,119 @@
+#pragma once
+#include "../telemetry_payload.h"
+#include <cstddef>
+#include <cstdint>
+
+// Store-and-forward outbox for telemetry frames that could not be published.
+//
+// Frames are packed into fixed 36-byte records (scaled integers + CRC-16) and
+// appended to numbered segment files of at most one 4 KB flash block. When
+// MQTT is back the oldest records are replayed first with their original
+// capture time; fully replayed segments are deleted whole.
+//
+// Flash wear: segments are append-only and never rewritten, new segments get
+// fresh sequence numbers, the replay cursor lives in RTC memory rather than
+// flash, and the number of segments is capped. When the cap is hit the
+// oldest segment is dropped (counted as `dropped`).
+//
+// Delivery is at-least-once: after a power loss the RTC cursor is gone and
+// the oldest remaining segment is replayed from its start.
+//
+// The LittleFS backend is in outbox_fs.*.
+
+static constexpr size_t OUTBOX_RECORD_SIZE = 36;
+
+struct OutboxRecord {
+  uint8_t b[OUTBOX_RECORD_SIZE];
+};
+
+// Pack a frame captured at `ts` (Unix seconds, 0 = clock not set).
+void packOutboxRecord(const TelemetryFrame &f, uint32_t ts, OutboxRecord &r);
+// Returns false on CRC or format mismatch. `f.mode` points to static storage.
+bool unpackOutboxRecord(const OutboxRecord &r, TelemetryFrame &f,
+                        uint32_t &ts);
+// Telemetry JSON (buildTelemetryJson) with a trailing "ts" field; the
+// timestamp is null when the clock was not set at capture.
+bool buildOutboxRecordJson(const OutboxRecord &r, char *out, size_t outLen);
+
+// Segment file access, implemented over LittleFS on target. Segments are
+// identified by a 32-bit sequence number.
+class OutboxStorage {
+public:
+  virtual ~OutboxStorage() {}
+  // Fill `ids` with existing segments (any order); returns the count.
+  virtual int list(uint32_t *ids, int maxIds) = 0;
+  virtual bool append(uint32_t id, const uint8_t *data, size_t len) = 0;
+  // Bytes read, or -1 if the segment does not exist.
+  virtual int32_t read(uint32_t id, uint32_t offset, uint8_t *out,
+                       size_t len) = 0;
+  // Segment size in bytes, or -1 if it does not exist.
+  virtual int32_t size(uint32_t id) = 0;
+  virtual bool remove(uint32_t id) = 0;
+};
+
+// Replay position. Plain POD so it can live in RTC memory; begin() resets it
+// if the magic does not match.
+struct OutboxCursor {
+  uint32_t magic;
+  uint32_t segment;
+  uint32_t offset; // bytes into `segment`
+};
+
+struct OutboxStats {
+  uint32_t stored;
+  uint32_t replayed;
+  uint32_t dropped; // never sent: rotated out when the outbox was full
+  uint32_t corrupt; // failed CRC (e.g. torn write at power loss)
+  uint32_t writeErrors;
+  uint32_t replayBytes; // JSON bytes published by replay
+  uint32_t replayTime_ms;
+};
+
+class Outbox {
+public:
+  static constexpr uint32_t SEGMENT_BYTES = 4096; // one LittleFS block
+  static constexpr uint32_t RECORDS_PER_SEGMENT =
+      SEGMENT_BYTES / OUTBOX_RECORD_SIZE;
+
+  Outbox(OutboxStorage &storage, OutboxCursor &cursor, uint16_t maxSegments)
+      : _st(storage), _cur(cursor), _maxSegments(maxSegments) {}
+
+  // Scan existing segments and validate the cursor.
+  void begin();
+
+  bool push(const OutboxRecord &r);
+
+  // Copy up to `max` records from the replay position without consuming
+  // them. A record that fails its CRC is skipped (and counted) when it is
+  // first in line, otherwise it ends the batch.
+  int peek(OutboxRecord *out, int max);
+  // Consume the first `n` records returned by peek(), crediting the replay
+  // throughput counters.
+  void commit(int n, uint32_t bytes, uint32_t elapsed_ms);
+
+  uint32_t pending() const { return _pending; }
+  bool empty() const { return _pending == 0; }
+  uint16_t segments() const { return _segCount; }
+  const OutboxStats &stats() const { return _stats; }
+
+private:
+  OutboxStorage &_st;
+  OutboxCursor &_cur;
+  uint16_t _maxSegments;
+  uint16_t _segCount = 0;
+  uint32_t _head = 0; // oldest segment
+  uint32_t _tail = 0; // segment being appended
+  uint32_t _tailBytes = 0;
+  uint32_t _nextId = 1;
+  uint32_t _pending = 0;
+  OutboxStats _stats = {};
+
+  uint32_t recordsIn(uint32_t id);
+  void dropHead();
+  void advanceSegment();
+  void consume(uint32_t n);
+  void clear();
+};
+
+// Outbox counters and replay throughput as JSON.
+bool buildOutboxJson(const Outbox &o, char *out, size_t outLen);
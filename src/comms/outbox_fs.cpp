@@ -0,0 +1,88 @@
+#include "outbox_fs.h"
+#include "../log/logger.h"
+#include <LittleFS.h>
+
+static const char *OUTBOX_DIR = "/outbox";
+
+static void segPath(uint32_t id, char *out, size_t len) {
+  snprintf(out, len, "%s/%08lx.seg", OUTBOX_DIR, (unsigned long)id);
+}
+
+bool OutboxLittleFs::begin() {
+  _mounted = LittleFS.begin(/*formatOnFail*/ true);
+  if (_mounted && !LittleFS.exists(OUTBOX_DIR))
+    LittleFS.mkdir(OUTBOX_DIR);
+  if (!_mounted)
+    LOGE("LittleFS mount failed; outbox disabled");
+  return _mounted;
+}
+
+int OutboxLittleFs::list(uint32_t *ids, int maxIds) {
+  if (!_mounted)
+    return 0;
+  File dir = LittleFS.open(OUTBOX_DIR);
+  if (!dir || !dir.isDirectory())
+    return 0;
+  int n = 0;
+  for (File f = dir.openNextFile(); f && n < maxIds; f = dir.openNextFile()) {
+    const char *name = f.name();
+    const char *slash = strrchr(name, '/');
+    if (slash)
+      name = slash + 1;
+    char *end = nullptr;
+    unsigned long id = strtoul(name, &end, 16);
+    if (end && !strcmp(end, ".seg"))
+      ids[n++] = (uint32_t)id;
+  }
+  return n;
+}
+
+bool OutboxLittleFs::append(uint32_t id, const uint8_t *data, size_t len) {
+  if (!_mounted)
+    return false;
+  char path[32];
+  segPath(id, path, sizeof(path));
+  File f = LittleFS.open(path, FILE_APPEND);
+  if (!f)
+    return false;
+  bool ok = f.write(data, len) == len;
+  f.close();
+  return ok;
+}
+
+int32_t OutboxLittleFs::read(uint32_t id, uint32_t offset, uint8_t *out,
+                             size_t len) {
+  if (!_mounted)
+    return -1;
+  char path[32];
+  segPath(id, path, sizeof(path));
+  File f = LittleFS.open(path, FILE_READ);
+  if (!f)
+    return -1;
+  int32_t n = f.seek(offset) ? (int32_t)f.read(out, len) : 0;
+  f.close();
+  return n;
+}
+
+int32_t OutboxLittleFs::size(uint32_t id) {
+  if (!_mounted)
+    return -1;
+  char path[32];
+  segPath(id, path, sizeof(path));
+  if (!LittleFS.exists(path))
+    return -1;
+  File f = LittleFS.open(path, FILE_READ);
+  if (!f)
+    return -1;
+  int32_t sz = (int32_t)f.size();
+  f.close();
+  return sz;
+}
+
+bool OutboxLittleFs::remove(uint32_t id) {
+  if (!_mounted)
+    return false;
+  char path[32];
+  segPath(id, path, sizeof(path));
+  return LittleFS.remove(path);
+}
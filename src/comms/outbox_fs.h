@@ -0,0 +1,22 @@
+#pragma once
+#include "outbox.h"
+#include <Arduino.h>
+
+// Outbox segments as files `/outbox/<8 hex digits>.seg` on LittleFS (the
+// default "spiffs" data partition).
+class OutboxLittleFs : public OutboxStorage {
+public:
+  // Mount (formatting an unformatted partition) and create the directory.
+  bool begin();
+  bool mounted() const { return _mounted; }
+
+  int list(uint32_t *ids, int maxIds) override;
+  bool append(uint32_t id, const uint8_t *data, size_t len) override;
+  int32_t read(uint32_t id, uint32_t offset, uint8_t *out,
+               size_t len) override;
+  int32_t size(uint32_t id) override;
+  bool remove(uint32_t id) override;
+
+private:
+  bool _mounted = false;
+};
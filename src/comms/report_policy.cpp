@@ -0,0 +1,103 @@
+#include "report_policy.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+static float fieldValue(const TelemetryFrame &f, uint8_t i) {
+  switch (i) {
+  case RF_V:
+    return f.V;
+  case RF_I:
+    return f.I;
+  case RF_T:
+    return f.T;
+  case RF_SOC:
+    return f.soc_pct;
+  case RF_SOH:
+    return f.soh_pct;
+  case RF_AH_LEFT:
+    return f.ah_left;
+  case RF_RINT:
+    return f.Rint_mOhm;
+  case RF_RINT25:
+    return f.Rint25_mOhm;
+  case RF_RINT_BASE:
+    return f.RintBaseline_mOhm;
+  default:
+    return f.battery_capacity_ah;
+  }
+}
+
+static bool sameMode(const char *a, const char *b) {
+  if (!a || !b)
+    return a == b;
+  return !strcmp(a, b);
+}
+
+// Past the deadband, or a change between finite and not finite
+static bool moved(const Deadband &d, float ref, float v) {
+  bool rf = isfinite(ref), vf = isfinite(v);
+  if (rf != vf)
+    return true;
+  if (!vf)
+    return false;
+  float band = fmaxf(d.abs, d.rel * fabsf(ref));
+  return fabsf(v - ref) > band;
+}
+
+ReportReason ReportPolicy::check(const TelemetryFrame &f, uint32_t now_ms,
+                                 bool event, uint32_t heartbeat_ms,
+                                 uint16_t *changed) {
+  uint16_t mask = 0;
+  bool silence = false;
+  if (_have) {
+    for (uint8_t i = 0; i < RF_FIELDS; ++i) {
+      const Deadband &d = _cfg.field[i];
+      if (moved(d, _ref[i], fieldValue(f, i)))
+        mask |= (uint16_t)(1u << i);
+      if (d.maxSilence_ms && now_ms - _fieldMs[i] >= d.maxSilence_ms)
+        silence = true;
+    }
+  }
+  if (changed)
+    *changed = mask;
+
+  ReportReason r = RR_NONE;
+  if (!_have)
+    r = RR_FIRST;
+  else if (event)
+    r = RR_EVENT;
+  else if (!sameMode(f.mode, _mode) || f.alternator_on != _alt ||
+           f.hasRint != _hasRint || f.hasRint25 != _hasRint25)
+    r = RR_STATE;
+  else if (mask)
+    r = RR_DEADBAND;
+  else if (silence)
+    r = RR_SILENCE;
+  else if (heartbeat_ms && now_ms - _frameMs >= heartbeat_ms)
+    r = RR_HEARTBEAT;
+  if (r == RR_NONE)
+    _suppressed++;
+  return r;
+}
+
+void ReportPolicy::sent(const TelemetryFrame &f, uint32_t now_ms) {
+  for (uint8_t i = 0; i < RF_FIELDS; ++i) {
+    _ref[i] = fieldValue(f, i);
+    _fieldMs[i] = now_ms;
+  }
+  _frameMs = now_ms;
+  _mode = f.mode;
+  _alt = f.alternator_on;
+  _hasRint = f.hasRint;
+  _hasRint25 = f.hasRint25;
+  _have = true;
+  _reports++;
+}
+
+bool buildReportJson(const ReportPolicy &p, char *out, size_t outLen) {
+  int n = snprintf(out, outLen,
+                   "{\"task\":\"report\",\"sent\":%lu,\"suppressed\":%lu}",
+                   (unsigned long)p.reports(), (unsigned long)p.suppressed());
+  return n > 0 && (size_t)n < outLen;
+}
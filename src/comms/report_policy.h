@@ -0,0 +1,92 @@
+#pragma once
+#include "../telemetry_payload.h"
+#include <cstddef>
+#include <cstdint>
+
+// Report-by-exception: decides whether a telemetry frame is worth sending.
+//
+// Every numeric field has a deadband, the larger of an absolute step and a
+// fraction of the last reported value, and an optional maximum silence. A
+// frame goes out when any field moves past its deadband (or becomes/stops
+// being NaN), the mode or a flag changes, an event is signalled (current
+// step), a field's silence expires, or the frame heartbeat expires.
+// Counters (rest_s, up_ms, ...) never trigger a report on their own.
+//
+// The last reported frame is the reference; sent() updates it. reset() forces
+// the next check to report, e.g. after MQTT reconnects.
+
+enum ReportField : uint8_t {
+  RF_V,
+  RF_I,
+  RF_T,
+  RF_SOC,
+  RF_SOH,
+  RF_AH_LEFT,
+  RF_RINT,
+  RF_RINT25,
+  RF_RINT_BASE,
+  RF_CAPACITY,
+  RF_FIELDS
+};
+
+enum ReportReason : uint8_t {
+  RR_NONE,      // suppressed
+  RR_FIRST,     // no reference yet (boot or reset())
+  RR_EVENT,     // signalled by the caller
+  RR_STATE,     // mode, alternator or Rint flags changed
+  RR_DEADBAND,  // a field moved past its deadband
+  RR_SILENCE,   // a field's maximum silence expired
+  RR_HEARTBEAT, // nothing sent for the heartbeat interval
+};
+
+struct Deadband {
+  float abs;              // in field units
+  float rel;              // fraction of the last reported value
+  uint32_t maxSilence_ms; // 0 = heartbeat only
+};
+
+struct ReportConfig {
+  Deadband field[RF_FIELDS] = {
+      {0.02f, 0.0f, 0},  // V
+      {0.20f, 0.05f, 0}, // I: 5 % or 0.2 A (Hall noise ~0.1 A)
+      {0.5f, 0.0f, 0},   // T
+      {0.5f, 0.0f, 0},   // soc_pct
+      {0.5f, 0.0f, 0},   // soh_pct
+      {0.1f, 0.0f, 0},   // ah_left
+      {0.5f, 0.02f, 0},  // Rint_mOhm
+      {0.5f, 0.02f, 0},  // Rint25_mOhm
+      {0.1f, 0.0f, 0},   // RintBaseline_mOhm
+      {0.1f, 0.0f, 0},   // battery_capacity_ah
+  };
+};
+
+class ReportPolicy {
+public:
+  explicit ReportPolicy(const ReportConfig &cfg = ReportConfig())
+      : _cfg(cfg) {}
+
+  // Reason to send `f` now, RR_NONE to suppress it (counted). `changed`
+  // (optional) receives a bit per ReportField past its deadband.
+  ReportReason check(const TelemetryFrame &f, uint32_t now_ms, bool event,
+                     uint32_t heartbeat_ms, uint16_t *changed = nullptr);
+  // `f` was handed over for publishing at `now_ms`.
+  void sent(const TelemetryFrame &f, uint32_t now_ms);
+  void reset() { _have = false; }
+
+  uint32_t reports() const { return _reports; }
+  uint32_t suppressed() const { return _suppressed; }
+
+private:
+  ReportConfig _cfg;
+  bool _have = false;
+  float _ref[RF_FIELDS] = {};
+  uint32_t _fieldMs[RF_FIELDS] = {};
+  uint32_t _frameMs = 0;
+  const char *_mode = nullptr;
+  bool _alt = false, _hasRint = false, _hasRint25 = false;
+  uint32_t _reports = 0;
+  uint32_t _suppressed = 0;
+};
+
+// Frames reported and suppressed so far as JSON.
+bool buildReportJson(const ReportPolicy &p, char *out, size_t outLen);
@@ -0,0 +1,145 @@
+#include "sample_stream.h"
+#include <math.h>
+#include <string.h>
+
+static void putU16(uint8_t *p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static void putU32(uint8_t *p, uint32_t v) {
+  putU16(p, (uint16_t)v);
+  putU16(p + 2, (uint16_t)(v >> 16));
+}
+
+static uint16_t getU16(const uint8_t *p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t getU32(const uint8_t *p) {
+  return getU16(p) | ((uint32_t)getU16(p + 2) << 16);
+}
+
+static uint16_t scaleV(float V) {
+  if (!isfinite(V))
+    return 0xFFFF;
+  float x = roundf(V * 1000.0f);
+  return x <= 0.0f ? 0 : x >= 65534.0f ? 65534 : (uint16_t)x;
+}
+
+static int16_t scaleI(float I) {
+  if (!isfinite(I))
+    return INT16_MIN;
+  float x = roundf(I * 100.0f);
+  return x <= -32767.0f ? -32767 : x >= 32767.0f ? 32767 : (int16_t)x;
+}
+
+// ------------------------------ SampleStream ------------------------------
+
+void SampleStream::push(uint32_t t_ms, float V, float I) {
+  uint32_t seq = _seq++;
+  if (_head - _tail >= SAMPLE_STREAM_CAPACITY) {
+    _overruns++;
+    return;
+  }
+  Slot &s = _ring[_head % SAMPLE_STREAM_CAPACITY];
+  s.s.t_ms = t_ms;
+  s.s.V = V;
+  s.s.I = I;
+  s.seq = seq;
+  _head = _head + 1; // publish the slot last
+}
+
+size_t SampleStream::encode(uint8_t *out, size_t len) {
+  uint32_t head = _head;
+  if (head == _tail ||
+      len < SAMPLE_FRAME_HEADER + SAMPLE_FRAME_BYTES_PER_SAMPLE)
+    return 0;
+  size_t room = (len - SAMPLE_FRAME_HEADER) / SAMPLE_FRAME_BYTES_PER_SAMPLE;
+  const Slot &first = _ring[_tail % SAMPLE_STREAM_CAPACITY];
+  out[0] = SAMPLE_FRAME_VERSION;
+  putU32(out + 2, first.seq);
+  putU32(out + 6, first.s.t_ms);
+
+  uint8_t *p = out + SAMPLE_FRAME_HEADER;
+  uint32_t tail = _tail, prevMs = first.s.t_ms;
+  uint8_t n = 0;
+  // Stop at a sequence gap: the next frame starts after it
+  while (tail != head && n < room && n < 255) {
+    const Slot &s = _ring[tail % SAMPLE_STREAM_CAPACITY];
+    if (s.seq != first.seq + n)
+      break;
+    uint32_t dt = s.s.t_ms - prevMs;
+    putU16(p, dt > 0xFFFF ? 0xFFFF : (uint16_t)dt);
+    putU16(p + 2, scaleV(s.s.V));
+    putU16(p + 4, (uint16_t)scaleI(s.s.I));
+    p += SAMPLE_FRAME_BYTES_PER_SAMPLE;
+    prevMs = s.s.t_ms;
+    ++tail;
+    ++n;
+  }
+  out[1] = n;
+  _tail = tail;
+  return (size_t)(p - out);
+}
+
+int decodeSampleFrame(const uint8_t *in, size_t len, SampleFrameHeader &h,
+                      StreamSample *out, size_t maxOut) {
+  if (len < SAMPLE_FRAME_HEADER || in[0] != SAMPLE_FRAME_VERSION)
+    return -1;
+  h.version = in[0];
+  h.n = in[1];
+  h.seq = getU32(in + 2);
+  h.t_ms = getU32(in + 6);
+  if (len != SAMPLE_FRAME_HEADER + h.n * SAMPLE_FRAME_BYTES_PER_SAMPLE)
+    return -1;
+  const uint8_t *p = in + SAMPLE_FRAME_HEADER;
+  uint32_t t = h.t_ms;
+  size_t n = h.n < maxOut ? h.n : maxOut;
+  for (size_t i = 0; i < n; ++i, p += SAMPLE_FRAME_BYTES_PER_SAMPLE) {
+    t += getU16(p);
+    uint16_t mV = getU16(p + 2);
+    int16_t cA = (int16_t)getU16(p + 4);
+    out[i].t_ms = t;
+    out[i].V = mV == 0xFFFF ? NAN : mV / 1000.0f;
+    out[i].I = cA == INT16_MIN ? NAN : cA / 100.0f;
+  }
+  return (int)n;
+}
+
+// ------------------------------ StreamClients ------------------------------
+
+StreamClients::Action StreamClients::offer(uint32_t id, bool queueFull) {
+  StreamClientStats *c = nullptr;
+  for (uint8_t i = 0; i < _n && !c; ++i)
+    if (_c[i].id == id)
+      c = &_c[i];
+  if (!c) {
+    if (_n == STREAM_MAX_CLIENTS)
+      return CLOSE;
+    c = &_c[_n++];
+    memset(c, 0, sizeof(*c));
+    c->id = id;
+  }
+  if (!queueFull) {
+    c->sent++;
+    c->dropRun = 0;
+    _sent++;
+    return SEND;
+  }
+  c->dropped++;
+  _dropped++;
+  if (++c->dropRun < STREAM_MAX_DROP_RUN)
+    return DROP;
+  remove(id);
+  return CLOSE;
+}
+
+void StreamClients::remove(uint32_t id) {
+  for (uint8_t i = 0; i < _n; ++i) {
+    if (_c[i].id == id) {
+      _c[i] = _c[--_n];
+      return;
+    }
+  }
+}
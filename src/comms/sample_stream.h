@@ -0,0 +1,105 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Live V/I samples for the dashboard WebSocket (comms/web_mgr.*).
+//
+// The sampling task only push()es into a fixed ring (O(1), no locks, no
+// network); the web task later drains everything pending into one binary
+// frame and offers it to each client. A client whose send queue is full
+// skips the frame instead of holding up the others or the sampler, and one
+// that stays full for STREAM_MAX_DROP_RUN frames is closed.
+//
+// Frame (little-endian):
+//   [0]    SAMPLE_FRAME_VERSION
+//   [1]    n samples
+//   [2..5] sequence number of the first sample
+//   [6..9] millis() of the first sample
+//   then per sample: u16 ms since the previous sample (0 for the first),
+//   u16 V in mV (0xFFFF = none), i16 I in 10 mA (INT16_MIN = none)
+// Sample sequence numbers are consecutive within a frame, so a client sees
+// lost samples (ring overrun or a skipped frame) as a gap in `seq`.
+
+static constexpr uint8_t SAMPLE_FRAME_VERSION = 1;
+static constexpr size_t SAMPLE_FRAME_HEADER = 10;
+static constexpr size_t SAMPLE_FRAME_BYTES_PER_SAMPLE = 6;
+static constexpr uint8_t SAMPLE_STREAM_CAPACITY = 64; // 32 s at 2 Hz
+static constexpr size_t SAMPLE_FRAME_MAX =
+    SAMPLE_FRAME_HEADER +
+    SAMPLE_STREAM_CAPACITY * SAMPLE_FRAME_BYTES_PER_SAMPLE;
+
+struct StreamSample {
+  uint32_t t_ms;
+  float V, I;
+};
+
+struct SampleFrameHeader {
+  uint8_t version;
+  uint8_t n;
+  uint32_t seq;
+  uint32_t t_ms;
+};
+
+// Single producer (push) / single consumer (encode) ring
+class SampleStream {
+public:
+  // Never blocks; a sample arriving with the ring full is dropped (and
+  // counted), leaving a gap in the sequence numbers.
+  void push(uint32_t t_ms, float V, float I);
+  size_t pending() const { return (uint32_t)(_head - _tail); }
+  // Drain the pending samples into one frame. Returns its length, 0 if
+  // nothing is pending or `len` is below SAMPLE_FRAME_HEADER plus one
+  // sample. Samples that do not fit, or follow a gap, stay pending for the
+  // next frame.
+  size_t encode(uint8_t *out, size_t len);
+  uint32_t overruns() const { return _overruns; }
+
+private:
+  struct Slot {
+    StreamSample s;
+    uint32_t seq;
+  };
+  Slot _ring[SAMPLE_STREAM_CAPACITY];
+  volatile uint32_t _head = 0; // written by push()
+  volatile uint32_t _tail = 0; // written by encode()
+  uint32_t _seq = 0;           // next sample, dropped ones included
+  uint32_t _overruns = 0;
+};
+
+// Decode a frame; returns the number of samples written to `out` (NAN for
+// none), or -1 if the frame is malformed.
+int decodeSampleFrame(const uint8_t *in, size_t len, SampleFrameHeader &h,
+                      StreamSample *out, size_t maxOut);
+
+// ------------------------------ Clients ------------------------------
+
+static constexpr uint8_t STREAM_MAX_CLIENTS = 4;
+static constexpr uint16_t STREAM_MAX_DROP_RUN = 50; // 5 s at 10 frames/s
+
+struct StreamClientStats {
+  uint32_t id;
+  uint32_t sent, dropped;
+  uint16_t dropRun; // consecutive frames dropped
+};
+
+// Per-client backpressure. offer() is asked once per frame and client with
+// the state of that client's send queue.
+class StreamClients {
+public:
+  enum Action : uint8_t { SEND, DROP, CLOSE };
+
+  // Unknown ids are added on their first offer(); with all slots taken the
+  // newcomer is closed.
+  Action offer(uint32_t id, bool queueFull);
+  void remove(uint32_t id);
+  uint8_t count() const { return _n; }
+  const StreamClientStats &at(uint8_t i) const { return _c[i]; }
+  // Totals, including clients that have gone
+  uint32_t sent() const { return _sent; }
+  uint32_t dropped() const { return _dropped; }
+
+private:
+  StreamClientStats _c[STREAM_MAX_CLIENTS];
+  uint8_t _n = 0;
+  uint32_t _sent = 0, _dropped = 0;
+};
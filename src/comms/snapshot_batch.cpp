@@ -0,0 +1,65 @@
+#include "snapshot_batch.h"
+#include <string.h>
+
+static constexpr uint32_t BATCH_MAGIC = 0x42415443; // "BATC"
+static constexpr uint8_t BATCH_VERSION = 1;
+
+SnapshotBatcher::SnapshotBatcher(SnapshotBatch &b, uint8_t every)
+    : _b(b), _every(every < 1 ? 1
+                              : (every > SNAPSHOT_BATCH_MAX ? SNAPSHOT_BATCH_MAX
+                                                            : every)) {}
+
+void SnapshotBatcher::begin() {
+  if (_b.magic != BATCH_MAGIC || _b.count > SNAPSHOT_BATCH_MAX) {
+    memset(&_b, 0, sizeof(_b));
+    _b.magic = BATCH_MAGIC;
+  }
+}
+
+bool SnapshotBatcher::add(const TelemetryFrame &f, uint32_t ts) {
+  if (full())
+    return false;
+  packOutboxRecord(f, ts, _b.rec[_b.count++]);
+  return true;
+}
+
+size_t SnapshotBatcher::encode(uint32_t now, uint8_t *out,
+                               size_t outLen) const {
+  size_t n = SNAPSHOT_BATCH_HEADER + _b.count * OUTBOX_RECORD_SIZE;
+  if (n > outLen)
+    return 0;
+  out[0] = 'S';
+  out[1] = 'B';
+  out[2] = BATCH_VERSION;
+  out[3] = _b.count;
+  for (int i = 0; i < 4; ++i)
+    out[4 + i] = (uint8_t)(now >> (8 * i));
+  memcpy(out + SNAPSHOT_BATCH_HEADER, _b.rec, _b.count * OUTBOX_RECORD_SIZE);
+  return n;
+}
+
+int decodeSnapshotBatch(const uint8_t *buf, size_t len,
+                        SnapshotBatchEntry *out, int max, uint32_t *sentAt) {
+  if (len < SNAPSHOT_BATCH_HEADER || buf[0] != 'S' || buf[1] != 'B' ||
+      buf[2] != BATCH_VERSION ||
+      len != SNAPSHOT_BATCH_HEADER + buf[3] * OUTBOX_RECORD_SIZE)
+    return -1;
+  uint32_t now = 0;
+  for (int i = 0; i < 4; ++i)
+    now |= (uint32_t)buf[4 + i] << (8 * i);
+  if (sentAt)
+    *sentAt = now;
+  int n = 0;
+  for (uint8_t i = 0; i < buf[3] && n < max; ++i) {
+    OutboxRecord r;
+    memcpy(r.b, buf + SNAPSHOT_BATCH_HEADER + i * OUTBOX_RECORD_SIZE,
+           OUTBOX_RECORD_SIZE);
+    SnapshotBatchEntry &e = out[n];
+    e = SnapshotBatchEntry{};
+    if (!unpackOutboxRecord(r, e.f, e.ts))
+      continue;
+    e.age_s = now >= e.ts ? now - e.ts : 0;
+    ++n;
+  }
+  return n;
+}
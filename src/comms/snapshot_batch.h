@@ -0,0 +1,69 @@
+#pragma once
+#include "outbox.h"
+#include <cstddef>
+#include <cstdint>
+
+// Snapshot frames collected in RTC memory across timer wakes, so the radio is
+// only brought up every N wakes (or early on an event) and the whole batch
+// goes out as one binary MQTT publish.
+//
+// Payload layout (little-endian):
+//   0 'S' | 1 'B' | 2 version | 3 count | 4 sender clock u32 (time())
+//   8 count x 36-byte outbox records (see outbox.cpp), oldest first
+//
+// Record timestamps are the raw time() at capture. The ESP32 RTC keeps that
+// clock running through deep sleep even before SNTP has set it, so the
+// decoder can always derive each record's age from the sender clock.
+//
+// The decoder is shared with the host tool, tools/telemetry_decode.cpp.
+
+static constexpr uint8_t SNAPSHOT_BATCH_MAX = 12; // fits a 512-byte packet
+static constexpr size_t SNAPSHOT_BATCH_HEADER = 8;
+static constexpr size_t SNAPSHOT_BATCH_BYTES =
+    SNAPSHOT_BATCH_HEADER + SNAPSHOT_BATCH_MAX * OUTBOX_RECORD_SIZE;
+
+// Plain POD so it can live in RTC memory; begin() resets it if the magic does
+// not match.
+struct SnapshotBatch {
+  uint32_t magic;
+  uint8_t count;
+  OutboxRecord rec[SNAPSHOT_BATCH_MAX];
+};
+
+class SnapshotBatcher {
+public:
+  // `every`: wakes per transmission, clamped to 1..SNAPSHOT_BATCH_MAX.
+  SnapshotBatcher(SnapshotBatch &b, uint8_t every);
+
+  void begin();
+  // Append a frame captured at `ts`; false if the batch is full.
+  bool add(const TelemetryFrame &f, uint32_t ts);
+  // Bring the radio up this wake: an event is pending or the frame this wake
+  // is about to add completes N.
+  bool due(bool event) const { return event || _b.count + 1 >= _every; }
+  // Encode the batch into `out`; returns the payload size, 0 if it does
+  // not fit.
+  size_t encode(uint32_t now, uint8_t *out, size_t outLen) const;
+  void clear() { _b.count = 0; }
+
+  uint8_t count() const { return _b.count; }
+  bool full() const { return _b.count >= SNAPSHOT_BATCH_MAX; }
+  const OutboxRecord &record(uint8_t i) const { return _b.rec[i]; }
+
+private:
+  SnapshotBatch &_b;
+  uint8_t _every;
+};
+
+struct SnapshotBatchEntry {
+  TelemetryFrame f{}; // `mode` points to static storage
+  uint32_t ts = 0;    // sender clock at capture
+  uint32_t age_s = 0; // seconds before the batch was sent
+};
+
+// Decode a batch payload into at most `max` entries. Records that fail their
+// CRC are skipped. Returns the number of entries, or -1 if the header or
+// length is malformed. `sentAt` (optional) receives the sender clock.
+int decodeSnapshotBatch(const uint8_t *buf, size_t len,
+                        SnapshotBatchEntry *out, int max,
+                        uint32_t *sentAt = nullptr);
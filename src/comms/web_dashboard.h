@@ -0,0 +1,56 @@
+#pragma once
+#include <Arduino.h>
+
+// Dashboard page served from flash at "/". Plots the last 600 samples from
+// the "/ws" stream (frame layout in sample_stream.h) and counts the samples
+// lost to skipped frames from the gaps in their sequence numbers.
+static const char WEB_DASHBOARD_HTML[] PROGMEM = R"html(<!DOCTYPE html>
+<html><head><meta charset="utf-8">
+<meta name="viewport" content="width=device-width,initial-scale=1">
+<title>12V battery</title>
+<style>
+body{font:14px sans-serif;margin:1em;background:#111;color:#ddd}
+canvas{width:100%;height:260px;background:#000;margin-top:.5em}
+span{margin-right:1.5em}#v{color:#4c4}#i{color:#c84}
+</style></head><body>
+<h3>12V battery</h3>
+<div><span id="v">-- V</span><span id="i">-- A</span>
+<span id="st">connecting</span><span id="lost">lost 0</span></div>
+<canvas id="c"></canvas>
+<script>
+const N=600,V=[],I=[];let next=-1,lost=0;
+const $=id=>document.getElementById(id);
+function draw(){
+  const c=$('c'),g=c.getContext('2d');
+  c.width=c.clientWidth;c.height=c.clientHeight;
+  [[V,'#4c4'],[I,'#c84']].forEach(([a,col])=>{
+    const f=a.filter(isFinite);if(!f.length)return;
+    let lo=Math.min(...f),hi=Math.max(...f);
+    if(hi-lo<1e-3){lo-=0.5;hi+=0.5}
+    g.strokeStyle=col;g.beginPath();let pen=false;
+    a.forEach((y,k)=>{
+      if(!isFinite(y)){pen=false;return}
+      const X=k*c.width/(N-1),Y=c.height-2-(y-lo)/(hi-lo)*(c.height-4);
+      if(pen)g.lineTo(X,Y);else g.moveTo(X,Y);pen=true});
+    g.stroke()})}
+function frame(b){
+  const d=new DataView(b);if(d.getUint8(0)!==1)return;
+  const n=d.getUint8(1),seq=d.getUint32(2,true);
+  if(next>=0&&seq!==next)lost+=(seq-next)>>>0;
+  next=(seq+n)>>>0;
+  for(let k=0;k<n;k++){
+    const o=10+6*k,mv=d.getUint16(o+2,true),ca=d.getInt16(o+4,true);
+    V.push(mv===65535?NaN:mv/1000);I.push(ca===-32768?NaN:ca/100)}
+  V.splice(0,V.length-N);I.splice(0,I.length-N);
+  $('v').textContent=V[V.length-1].toFixed(3)+' V';
+  $('i').textContent=I[I.length-1].toFixed(2)+' A';
+  $('lost').textContent='lost '+lost;draw()}
+function connect(){
+  const ws=new WebSocket('ws://'+location.host+'/ws');
+  ws.binaryType='arraybuffer';
+  ws.onopen=()=>{$('st').textContent='live';next=-1};
+  ws.onmessage=e=>frame(e.data);
+  ws.onclose=()=>{$('st').textContent='reconnecting';setTimeout(connect,2000)}}
+connect();
+</script></body></html>
+)html";
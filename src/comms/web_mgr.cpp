@@ -0,0 +1,94 @@
+#include "web_mgr.h"
+#include "../json_writer.h"
+#include "web_dashboard.h"
+#include <app_config.h>
+
+WebMgr::WebMgr() : _server(WEB_PORT), _ws("/ws") {}
+
+void WebMgr::begin() {
+  if (_started)
+    return;
+  _ws.onEvent([this](AsyncWebSocket *, AsyncWebSocketClient *client,
+                     AwsEventType type, void *, uint8_t *,
+                     size_t) { onEvent(client, type); });
+  _server.addHandler(&_ws);
+  _server.on("/", HTTP_GET, [](AsyncWebServerRequest *req) {
+    req->send_P(200, "text/html", WEB_DASHBOARD_HTML);
+  });
+  _server.on("/stream", HTTP_GET, [this](AsyncWebServerRequest *req) {
+    char js[128];
+    JsonWriter w(js, sizeof(js));
+    w.beginObject()
+        .u32("clients", _nIds)
+        .u32("sent", _clients.sent())
+        .u32("dropped", _clients.dropped())
+        .u32("overruns", _stream.overruns())
+        .endObject();
+    req->send(200, "application/json", js);
+  });
+  _server.begin();
+  _started = true;
+}
+
+// AsyncTCP task: only the id list changes here
+void WebMgr::onEvent(AsyncWebSocketClient *client, AwsEventType type) {
+  uint32_t id = client->id();
+  bool full = false;
+  portENTER_CRITICAL(&_mux);
+  if (type == WS_EVT_CONNECT) {
+    if (_nIds < STREAM_MAX_CLIENTS)
+      _ids[_nIds++] = id;
+    else
+      full = true;
+  } else if (type == WS_EVT_DISCONNECT) {
+    for (uint8_t i = 0; i < _nIds; ++i) {
+      if (_ids[i] == id) {
+        _ids[i] = _ids[--_nIds];
+        break;
+      }
+    }
+  }
+  portEXIT_CRITICAL(&_mux);
+  if (full)
+    client->close();
+}
+
+void WebMgr::service() {
+  if (!_started)
+    return;
+  uint32_t ids[STREAM_MAX_CLIENTS];
+  portENTER_CRITICAL(&_mux);
+  uint8_t n = _nIds;
+  memcpy(ids, _ids, n * sizeof(ids[0]));
+  portEXIT_CRITICAL(&_mux);
+
+  // Forget clients that have gone
+  for (uint8_t i = _clients.count(); i-- > 0;) {
+    uint32_t id = _clients.at(i).id;
+    bool known = false;
+    for (uint8_t k = 0; k < n && !known; ++k)
+      known = ids[k] == id;
+    if (!known)
+      _clients.remove(id);
+  }
+  _ws.cleanupClients(STREAM_MAX_CLIENTS);
+
+  size_t len = _stream.encode(_frame, sizeof(_frame));
+  if (!len)
+    return;
+  for (uint8_t k = 0; k < n; ++k) {
+    AsyncWebSocketClient *c = _ws.client(ids[k]);
+    if (!c || c->status() != WS_CONNECTED)
+      continue;
+    switch (_clients.offer(ids[k], c->queueIsFull())) {
+    case StreamClients::SEND:
+      c->binary(_frame, len);
+      break;
+    case StreamClients::CLOSE:
+      c->close();
+      break;
+    default: // dropped for this client only
+      break;
+    }
+  }
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "sample_stream.h"
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// Embedded HTTP server: the dashboard page at "/", live V/I sample frames
+// (sample_stream.h) on the WebSocket "/ws" and the stream counters as JSON
+// at "/stream".
+//
+// push() is all the sampling task does. service(), from its own scheduler
+// task, encodes the pending samples into one frame and queues it to every
+// client whose send queue has room; a full queue skips the frame for that
+// client only (StreamClients). Sending happens on the AsyncTCP task, so
+// neither path waits on a socket.
+class WebMgr {
+public:
+  WebMgr();
+  // Start listening; call once Wi-Fi is up (the socket survives reconnects).
+  void begin();
+  bool started() const { return _started; }
+  void push(uint32_t t_ms, float V, float I) {
+    if (_nIds)
+      _stream.push(t_ms, V, I);
+  }
+  void service();
+  AsyncWebServer &server() { return _server; }
+
+private:
+  AsyncWebServer _server;
+  AsyncWebSocket _ws;
+  SampleStream _stream;
+  StreamClients _clients;
+  uint8_t _frame[SAMPLE_FRAME_MAX];
+  bool _started{false};
+
+  // Connected WebSocket ids, maintained by the event handler (AsyncTCP task)
+  portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+  uint32_t _ids[STREAM_MAX_CLIENTS];
+  volatile uint8_t _nIds{0};
+
+  void onEvent(AsyncWebSocketClient *client, AwsEventType type);
+};
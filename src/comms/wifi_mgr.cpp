@@ -1,54 +1,178 @@
 #include "wifi_mgr.h"
+#include "../log/logger.h"
 
-bool WiFiMgr::connectSmart(const char *ssid, const char *pass,
-                           uint32_t cooldownMs, uint8_t maxAttempts) {
-  if (WiFi.status() == WL_CONNECTED)
-    return true;
-  uint32_t now = millis();
-  if (now - _lastAttemptMs < cooldownMs) {
-    Serial.println("WiFi cooldown, skip.");
-    return false;
-  }
+// Give up on an attempt that produced neither an IP nor a disconnect event
+static constexpr uint32_t WIFI_ATTEMPT_TIMEOUT_MS = 15000;
+// A cached reconnect normally completes in well under 300 ms
+static constexpr uint32_t WIFI_FAST_ATTEMPT_TIMEOUT_MS = 1500;
+// Fast reconnects reuse the address without DHCP; after this many the next
+// connect goes through DHCP again to refresh the lease (~1 h at 5 min wakes)
+static constexpr uint8_t WIFI_FAST_MAX_REUSE = 12;
+static constexpr uint32_t WIFI_CACHE_MAGIC = 0x57464331; // "WFC1"
+// Longest sleep in waitConnected() between state-machine steps
+static constexpr uint32_t WIFI_WAIT_SLICE_MS = 100;
+static constexpr EventBits_t EVT_GOT_IP = 1 << 0;
+static constexpr EventBits_t EVT_DISCONNECTED = 1 << 1;
 
-  // Ensure WiFi is fully off before starting
-  WiFi.disconnect(true);
-  WiFi.mode(WIFI_OFF);
-  delay(100);
+void WiFiMgr::begin(const char *ssid, const char *pass) {
+  _ssid = ssid;
+  _pass = pass;
+  _enabled = true;
+  _state = WIFI_ST_OFF;
+  _nextAttemptMs = millis();
+  WiFi.persistent(false);
+  if (_events)
+    return; // handlers already registered
+  _events = xEventGroupCreate();
+  WiFi.onEvent(
+      [this](WiFiEvent_t, WiFiEventInfo_t) {
+        _evtGotIp = true;
+        xEventGroupSetBits(_events, EVT_GOT_IP);
+      },
+      ARDUINO_EVENT_WIFI_STA_GOT_IP);
+  WiFi.onEvent(
+      [this](WiFiEvent_t, WiFiEventInfo_t info) {
+        _lastReason = info.wifi_sta_disconnected.reason;
+        _evtDisconnected = true;
+        xEventGroupSetBits(_events, EVT_DISCONNECTED);
+      },
+      ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+}
 
+bool WiFiMgr::cacheUsable() const {
+  return _reuseCache && _cache && _cache->magic == WIFI_CACHE_MAGIC &&
+         _cache->uses < WIFI_FAST_MAX_REUSE && _cache->ip != 0;
+}
+
+void WiFiMgr::saveCache() {
+  if (!_cache)
+    return;
+  if (_fastConnected) {
+    _cache->uses++;
+    return;
+  }
+  const uint8_t *bssid = WiFi.BSSID();
+  if (!bssid)
+    return;
+  memcpy(_cache->bssid, bssid, sizeof(_cache->bssid));
+  _cache->channel = (uint8_t)WiFi.channel();
+  _cache->ip = (uint32_t)WiFi.localIP();
+  _cache->gateway = (uint32_t)WiFi.gatewayIP();
+  _cache->subnet = (uint32_t)WiFi.subnetMask();
+  _cache->dns = (uint32_t)WiFi.dnsIP();
+  _cache->uses = 0;
+  _cache->magic = WIFI_CACHE_MAGIC;
+}
+
+void WiFiMgr::startAttempt(uint32_t now) {
+  uint32_t t0 = millis();
+  _evtGotIp = false;
+  _evtDisconnected = false;
   WiFi.mode(WIFI_STA);
-  WiFi.begin(ssid, pass);
-  uint8_t attempts = 0;
+  WiFi.setAutoReconnect(false); // retries are paced by the backoff instead
+  _fastAttempt = cacheUsable() && _backoff.failures() == 0;
+  if (_fastAttempt) {
+    // No scan (known channel and AP) and no DHCP (cached address)
+    WiFi.config(IPAddress(_cache->ip), IPAddress(_cache->gateway),
+                IPAddress(_cache->subnet), IPAddress(_cache->dns));
+    WiFi.begin(_ssid, _pass, _cache->channel, _cache->bssid, true);
+  } else {
+    WiFi.config(IPAddress(), IPAddress(), IPAddress()); // DHCP
+    WiFi.begin(_ssid, _pass);
+  }
+  if (_meter)
+    _meter->add(now, millis() - t0);
+  _state = WIFI_ST_CONNECTING;
+  _stateSinceMs = now;
 #if debugWiFiMgr
-  Serial.print("Connecting to WiFi SSID: ");
-  Serial.println(ssid);
-  Serial.print("Connecting to WiFi with password:");
-  Serial.println(pass);
+  LOGI("WiFi attempt to SSID: %s", _ssid);
 #endif
+}
 
-  while (WiFi.status() != WL_CONNECTED && attempts < maxAttempts) {
+void WiFiMgr::fail(uint32_t now) {
+  uint32_t t0 = millis();
+  WiFi.disconnect(true);
+  if (_meter)
+    _meter->add(now, millis() - t0);
+  uint32_t d = 0;
+  if (_fastAttempt) {
+    // Stale cache (AP changed channel, address taken): scan + DHCP right away
+    _cache->magic = 0;
+    _fastAttempt = false;
+  } else {
+    d = _backoff.nextDelayMs(esp_random());
+  }
+  _nextAttemptMs = now + d;
+  _state = WIFI_ST_BACKOFF;
+  _stateSinceMs = now;
 #if debugWiFiMgr
-    Serial.print(".");
+  LOGW("WiFi failed (reason %u), retry in %lu ms", (unsigned)_lastReason,
+       (unsigned long)d);
 #endif
-    delay(500);
-    attempts++;
+}
+
+void WiFiMgr::service(uint32_t now) {
+  if (!_enabled || !_ssid)
+    return;
+  switch (_state) {
+  case WIFI_ST_OFF:
+  case WIFI_ST_BACKOFF:
+    if ((int32_t)(now - _nextAttemptMs) >= 0)
+      startAttempt(now);
+    break;
+  case WIFI_ST_CONNECTING:
+    if (_evtGotIp || WiFi.status() == WL_CONNECTED) {
+      _evtGotIp = false;
+      _evtDisconnected = false;
+      _backoff.reset();
+      _fastConnected = _fastAttempt;
+      _fastAttempt = false;
+      saveCache();
+      _state = WIFI_ST_CONNECTED;
+      _stateSinceMs = now;
+      WiFi.setSleep(true);
 #if debugWiFiMgr
-    Serial.print("WiFi attempt ");
-    Serial.println(attempts);
+      IPAddress ip = WiFi.localIP();
+      LOGI("WiFi connected, IP address: %u.%u.%u.%u", (unsigned)ip[0],
+           (unsigned)ip[1], (unsigned)ip[2], (unsigned)ip[3]);
 #endif
+    } else if (_evtDisconnected ||
+               now - _stateSinceMs >= (_fastAttempt
+                                           ? WIFI_FAST_ATTEMPT_TIMEOUT_MS
+                                           : WIFI_ATTEMPT_TIMEOUT_MS)) {
+      fail(now);
+    }
+    break;
+  case WIFI_ST_CONNECTED:
+    if (_evtDisconnected || WiFi.status() != WL_CONNECTED) {
+      // Link lost: the first retry follows quickly, repeats back off
+      _reconnects++;
+      fail(now);
+    }
+    break;
   }
+}
 
-  _lastAttemptMs = now;
-
-  if (WiFi.status() == WL_CONNECTED) {
-#if debugWiFiMgr
-    Serial.println("");
-    Serial.print("WiFi connected, IP address: ");
-    Serial.println(WiFi.localIP());
-#endif
-    WiFi.setSleep(true);
-    return true;
+bool WiFiMgr::waitConnected(uint32_t timeoutMs) {
+  // The whole wait is charged once below, not per step
+  BlockedTimeMeter *meter = _meter;
+  _meter = nullptr;
+  uint32_t start = millis();
+  service(start);
+  while (!connected()) {
+    uint32_t waited = millis() - start;
+    if (waited >= timeoutMs)
+      break;
+    uint32_t slice = timeoutMs - waited;
+    if (slice > WIFI_WAIT_SLICE_MS)
+      slice = WIFI_WAIT_SLICE_MS;
+    xEventGroupWaitBits(_events, EVT_GOT_IP | EVT_DISCONNECTED, pdTRUE,
+                        pdFALSE, pdMS_TO_TICKS(slice));
+    service(millis());
   }
-  WiFi.disconnect(true);
-  WiFi.mode(WIFI_OFF);
-  return false;
-}
\ No newline at end of file
+  service(millis());
+  _meter = meter;
+  if (_meter)
+    _meter->add(millis(), millis() - start);
+  return connected();
+}
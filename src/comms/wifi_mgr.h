@@ -1,20 +1,88 @@
 
 #pragma once
+#include "conn_backoff.h"
 #include <Arduino.h>
 #include <WiFi.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
 // #define debugWiFiMgr 1
 
+// Association details of the last DHCP connection, kept in RTC memory so a
+// timer wake can skip the scan and DHCP. Plain POD; invalid unless `magic`
+// matches.
+struct WifiFastCache {
+  uint32_t magic;
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint8_t uses; // fast reconnects since the lease was last refreshed
+  uint32_t ip, gateway, subnet, dns;
+};
+
+// Event-driven Wi-Fi station manager. `service()` advances a small state
+// machine and never waits: link changes arrive through WiFi.onEvent and
+// failed attempts are retried with exponential backoff and jitter.
 class WiFiMgr {
 public:
-  bool connectSmart(const char *ssid, const char *pass, uint32_t cooldownMs,
-                    uint8_t maxAttempts);
+  enum State : uint8_t {
+    WIFI_ST_OFF,
+    WIFI_ST_CONNECTING,
+    WIFI_ST_CONNECTED,
+    WIFI_ST_BACKOFF,
+  };
+
+  // Register event handlers and store credentials; the first attempt starts
+  // on the next service() call.
+  void begin(const char *ssid, const char *pass);
+  void service(uint32_t now);
+  // Setup/snapshot only: service until connected or `timeoutMs` elapses,
+  // sleeping on the connect/disconnect events in between. The wait is
+  // charged to the blocked-time meter.
+  bool waitConnected(uint32_t timeoutMs);
+
+  // Refresh `cache` after every DHCP connection. With `reuse`, the first
+  // attempt connects to the cached BSSID/channel with the cached address as
+  // static IP; if that fails the cache is dropped and a normal scan + DHCP
+  // attempt follows immediately.
+  void setFastCache(WifiFastCache *cache, bool reuse) {
+    _cache = cache;
+    _reuseCache = reuse;
+  }
+  bool lastConnectFast() const { return _fastConnected; }
+
   bool connected() const { return WiFi.status() == WL_CONNECTED; }
+  State state() const { return _state; }
+  uint32_t reconnects() const { return _reconnects; }
+  void setBlockedMeter(BlockedTimeMeter *m) { _meter = m; }
   void powerSaveOn() { WiFi.setSleep(true); }
   void off() {
     WiFi.disconnect(true);
     WiFi.mode(WIFI_OFF);
+    _state = WIFI_ST_OFF;
+    _enabled = false;
   }
 
 private:
-  uint32_t _lastAttemptMs{0};
+  const char *_ssid = nullptr;
+  const char *_pass = nullptr;
+  bool _enabled = false;
+  State _state{WIFI_ST_OFF};
+  uint32_t _stateSinceMs{0};
+  uint32_t _nextAttemptMs{0};
+  uint32_t _reconnects{0};
+  ConnBackoff _backoff{1000, 5UL * 60UL * 1000UL, 50};
+  BlockedTimeMeter *_meter = nullptr;
+  WifiFastCache *_cache = nullptr;
+  bool _reuseCache = false;
+  bool _fastAttempt = false;
+  bool _fastConnected = false;
+  // Set from the Wi-Fi event task, consumed by service()
+  volatile bool _evtGotIp{false};
+  volatile bool _evtDisconnected{false};
+  volatile uint8_t _lastReason{0};
+  EventGroupHandle_t _events = nullptr; // wakes waitConnected()
+
+  bool cacheUsable() const;
+  void saveCache();
+  void startAttempt(uint32_t now);
+  void fail(uint32_t now);
 };
@@ -0,0 +1,173 @@
+#include "config_store.h"
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#define CFG_FIELD(name, type, member, lo, hi)                                 \
+  { name, type, (uint16_t)offsetof(RuntimeConfig, member), lo, hi }
+
+static const ConfigField FIELDS[] = {
+    CFG_FIELD("capacity_ah", CFG_FLOAT, capacity_Ah, 1.0f, 1000.0f),
+    CFG_FIELD("tlm_enc", CFG_U32, telemetryEnc, 1.0f, 3.0f),
+    CFG_FIELD("rest_a", CFG_FLOAT, rest_A, 0.01f, 5.0f),
+    CFG_FIELD("idle_a", CFG_FLOAT, idle_A, 0.01f, 5.0f),
+    CFG_FIELD("sample_ms", CFG_U32, sample_ms, 50.0f, 10000.0f),
+    CFG_FIELD("sample_idle_ms", CFG_U32, sampleIdle_ms, 50.0f, 60000.0f),
+    CFG_FIELD("publish_ms", CFG_U32, publish_ms, 500.0f, 600000.0f),
+    CFG_FIELD("publish_idle_ms", CFG_U32, publishIdle_ms, 500.0f, 3600000.0f),
+    // Up to 4 h, which a float command argument still holds exactly
+    CFG_FIELD("parked_max_ms", CFG_U32, parkedMax_ms, 60000.0f, 14400000.0f),
+};
+static const size_t FIELD_COUNT = sizeof(FIELDS) / sizeof(FIELDS[0]);
+static_assert(FIELD_COUNT * 4 + CONFIG_HEADER_BYTES + 4 <= CONFIG_BLOB_MAX,
+              "CONFIG_BLOB_MAX");
+
+const ConfigField *configFields(size_t &count) {
+  count = FIELD_COUNT;
+  return FIELDS;
+}
+
+static char lower(char c) {
+  return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+}
+
+const ConfigField *configField(const char *name, size_t len) {
+  for (size_t i = 0; i < FIELD_COUNT; ++i) {
+    const char *n = FIELDS[i].name;
+    size_t k = 0;
+    while (k < len && n[k] && lower(name[k]) == n[k])
+      ++k;
+    if (k == len && !n[k])
+      return &FIELDS[i];
+  }
+  return nullptr;
+}
+
+static uint32_t rawGet(const RuntimeConfig &c, const ConfigField &f) {
+  uint32_t v;
+  memcpy(&v, (const uint8_t *)&c + f.offset, 4);
+  return v;
+}
+
+static void rawSet(RuntimeConfig &c, const ConfigField &f, uint32_t v) {
+  memcpy((uint8_t *)&c + f.offset, &v, 4);
+}
+
+static float rawValue(const ConfigField &f, uint32_t raw) {
+  if (f.type == CFG_U32)
+    return (float)raw;
+  float v;
+  memcpy(&v, &raw, 4);
+  return v;
+}
+
+float configGet(const RuntimeConfig &c, const ConfigField &f) {
+  return rawValue(f, rawGet(c, f));
+}
+
+bool configInRange(const ConfigField &f, float v) {
+  if (!isfinite(v) || v < f.min || v > f.max)
+    return false;
+  return f.type != CFG_U32 || v == floorf(v);
+}
+
+bool configSet(RuntimeConfig &c, const ConfigField &f, float v) {
+  if (!configInRange(f, v))
+    return false;
+  uint32_t raw;
+  if (f.type == CFG_U32)
+    raw = (uint32_t)v;
+  else
+    memcpy(&raw, &v, 4);
+  rawSet(c, f, raw);
+  return true;
+}
+
+// CRC-32 (IEEE, bitwise)
+static uint32_t cfgCrc(const uint8_t *p, size_t n) {
+  uint32_t c = 0xFFFFFFFFu;
+  for (size_t i = 0; i < n; ++i) {
+    c ^= p[i];
+    for (int k = 0; k < 8; ++k)
+      c = (c >> 1) ^ (0xEDB88320u & (0u - (c & 1)));
+  }
+  return ~c;
+}
+
+static void cfgPut32(uint8_t *p, uint32_t v) {
+  for (int i = 0; i < 4; ++i)
+    p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint32_t cfgGet32(const uint8_t *p) {
+  return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+         (uint32_t)p[3] << 24;
+}
+
+size_t configEncode(const RuntimeConfig &c, uint8_t *out, size_t len) {
+  size_t n = CONFIG_HEADER_BYTES + FIELD_COUNT * 4 + 4;
+  if (len < n)
+    return 0;
+  out[0] = (uint8_t)CONFIG_MAGIC;
+  out[1] = (uint8_t)(CONFIG_MAGIC >> 8);
+  out[2] = CONFIG_VERSION;
+  out[3] = (uint8_t)FIELD_COUNT;
+  for (size_t i = 0; i < FIELD_COUNT; ++i)
+    cfgPut32(out + CONFIG_HEADER_BYTES + 4 * i, rawGet(c, FIELDS[i]));
+  cfgPut32(out + n - 4, cfgCrc(out, n - 4));
+  return n;
+}
+
+ConfigLoad configDecode(const uint8_t *in, size_t len,
+                        const RuntimeConfig &defaults, RuntimeConfig &out,
+                        uint8_t *rejected) {
+  out = defaults;
+  if (rejected)
+    *rejected = 0;
+  if (!in || len < CONFIG_HEADER_BYTES + 4)
+    return CFG_LOAD_DEFAULTS;
+  size_t stored = in[3];
+  size_t n = CONFIG_HEADER_BYTES + stored * 4 + 4;
+  if ((in[0] | in[1] << 8) != CONFIG_MAGIC || in[2] != CONFIG_VERSION ||
+      len < n || cfgGet32(in + n - 4) != cfgCrc(in, n - 4))
+    return CFG_LOAD_DEFAULTS;
+  // Fields beyond ours come from a newer firmware and are skipped
+  size_t use = stored < FIELD_COUNT ? stored : FIELD_COUNT;
+  for (size_t i = 0; i < use; ++i) {
+    uint32_t raw = cfgGet32(in + CONFIG_HEADER_BYTES + 4 * i);
+    if (configInRange(FIELDS[i], rawValue(FIELDS[i], raw)))
+      rawSet(out, FIELDS[i], raw);
+    else if (rejected)
+      (*rejected)++;
+  }
+  return stored < FIELD_COUNT ? CFG_LOAD_UPGRADED : CFG_LOAD_OK;
+}
+
+size_t configFormat(const RuntimeConfig &c, const ConfigField &f, char *out,
+                    size_t len) {
+  int n;
+  if (f.type == CFG_U32)
+    n = snprintf(out, len, "%s=%lu", f.name, (unsigned long)rawGet(c, f));
+  else
+    n = snprintf(out, len, "%s=%g", f.name, (double)configGet(c, f));
+  return n < 0 ? 0 : (size_t)n >= len ? len - 1 : (size_t)n;
+}
+
+bool buildConfigJson(const RuntimeConfig &c, uint32_t load_us, char *out,
+                     size_t outLen) {
+  int n = snprintf(out, outLen, "{\"v\":%u", (unsigned)CONFIG_VERSION);
+  for (size_t i = 0; i < FIELD_COUNT && n > 0 && (size_t)n < outLen; ++i) {
+    const ConfigField &f = FIELDS[i];
+    if (f.type == CFG_U32)
+      n += snprintf(out + n, outLen - n, ",\"%s\":%lu", f.name,
+                    (unsigned long)rawGet(c, f));
+    else
+      n += snprintf(out + n, outLen - n, ",\"%s\":%g", f.name,
+                    (double)configGet(c, f));
+  }
+  if (n > 0 && (size_t)n < outLen)
+    n += snprintf(out + n, outLen - n, ",\"load_us\":%lu}",
+                  (unsigned long)load_us);
+  return n > 0 && (size_t)n < outLen;
+}
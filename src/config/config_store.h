@@ -0,0 +1,73 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Runtime configuration: the tuning values that used to need a reflash,
+// with a schema (name, type, bounds) and one versioned, CRC-checked blob
+// for NVS, read with a single getBytes() at boot.
+//
+// Blob: [magic u16][version u8][field count u8][value u32 per field, in
+// schema order][crc32 of everything before], little-endian. Fields are only
+// ever appended: an older blob has fewer fields and the new ones take
+// their defaults; CONFIG_VERSION changes only when a field's meaning does,
+// and a blob of another version is ignored. Each stored value is checked
+// against its bounds on load; one out of range falls back to its default.
+//
+// The defaults come from the firmware (app_config.h constants), so they
+// live in one place.
+
+static constexpr uint16_t CONFIG_MAGIC = 0x4643; // "CF"
+static constexpr uint8_t CONFIG_VERSION = 1;
+
+struct RuntimeConfig {
+  float capacity_Ah;
+  uint32_t telemetryEnc; // TELEMETRY_ENC_* bits
+  float rest_A;          // |I| below this is rest (OCV correction)
+  float idle_A;          // |I| below this counts towards Parked&Idle
+  uint32_t sample_ms, sampleIdle_ms;
+  uint32_t publish_ms, publishIdle_ms;
+  uint32_t parkedMax_ms; // awake in Parked&Idle before deep sleep
+};
+
+enum ConfigType : uint8_t { CFG_FLOAT, CFG_U32 };
+
+struct ConfigField {
+  const char *name; // lower case, for CFG:<name>=<value>
+  ConfigType type;
+  uint16_t offset; // in RuntimeConfig
+  float min, max;
+};
+
+static constexpr size_t CONFIG_HEADER_BYTES = 4;
+static constexpr size_t CONFIG_BLOB_MAX = CONFIG_HEADER_BYTES + 4 * 16 + 4;
+
+enum ConfigLoad : uint8_t {
+  CFG_LOAD_OK,
+  CFG_LOAD_UPGRADED, // older blob: fields added since took their defaults
+  CFG_LOAD_DEFAULTS  // missing, corrupt or another version
+};
+
+const ConfigField *configFields(size_t &count);
+// Case-insensitive; nullptr if unknown
+const ConfigField *configField(const char *name, size_t len);
+
+float configGet(const RuntimeConfig &c, const ConfigField &f);
+// False (and `c` unchanged) if `v` is out of bounds, or not an integer for
+// an integer field.
+bool configSet(RuntimeConfig &c, const ConfigField &f, float v);
+bool configInRange(const ConfigField &f, float v);
+
+// Blob length, 0 if `len` is too small.
+size_t configEncode(const RuntimeConfig &c, uint8_t *out, size_t len);
+// `out` gets `defaults` overlaid with the valid stored values.
+// `rejected` (optional) counts stored values that were out of bounds.
+ConfigLoad configDecode(const uint8_t *in, size_t len,
+                        const RuntimeConfig &defaults, RuntimeConfig &out,
+                        uint8_t *rejected = nullptr);
+
+// "name=value" for one field
+size_t configFormat(const RuntimeConfig &c, const ConfigField &f, char *out,
+                    size_t len);
+// {"v":1,"capacity_ah":70,...,"load_us":n}
+bool buildConfigJson(const RuntimeConfig &c, uint32_t load_us, char *out,
+                     size_t outLen);
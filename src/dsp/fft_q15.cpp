@@ -0,0 +1,92 @@
+#include "fft_q15.h"
+#include <cmath>
+
+namespace {
+
+constexpr int MAX_N = 1 << FFT_Q15_MAX_LOG2;
+constexpr float TWO_PI = 6.28318530717958647692f;
+
+int16_t sCos[MAX_N / 2];
+int16_t sSin[MAX_N / 2];
+bool sTwiddleReady = false;
+
+int16_t toQ15(float v) {
+  float s = v * 32768.0f;
+  if (s > 32767.0f)
+    s = 32767.0f;
+  if (s < -32768.0f)
+    s = -32768.0f;
+  return (int16_t)lrintf(s);
+}
+
+void buildTwiddles() {
+  for (int i = 0; i < MAX_N / 2; ++i) {
+    float a = TWO_PI * (float)i / (float)MAX_N;
+    sCos[i] = toQ15(cosf(a));
+    sSin[i] = toQ15(sinf(a));
+  }
+  sTwiddleReady = true;
+}
+
+// Round-to-nearest Q15 product
+inline int32_t mulQ15(int32_t a, int32_t b) {
+  return (a * b + (1 << 14)) >> 15;
+}
+
+} // namespace
+
+bool fftQ15(int16_t *re, int16_t *im, int log2n) {
+  if (log2n < 1 || log2n > FFT_Q15_MAX_LOG2)
+    return false;
+  if (!sTwiddleReady)
+    buildTwiddles();
+  const int n = 1 << log2n;
+
+  // Bit-reversal permutation
+  for (int i = 1, j = 0; i < n; ++i) {
+    int bit = n >> 1;
+    for (; j & bit; bit >>= 1)
+      j ^= bit;
+    j ^= bit;
+    if (i < j) {
+      int16_t t = re[i];
+      re[i] = re[j];
+      re[j] = t;
+      t = im[i];
+      im[i] = im[j];
+      im[j] = t;
+    }
+  }
+
+  // Butterflies with 1/2 scaling per stage
+  for (int len = 2; len <= n; len <<= 1) {
+    const int half = len >> 1;
+    const int step = MAX_N / len;
+    for (int base = 0; base < n; base += len) {
+      for (int j = 0; j < half; ++j) {
+        // w = exp(-i*2*pi*j/len) = cos - i*sin
+        const int32_t wr = sCos[j * step];
+        const int32_t wi = -(int32_t)sSin[j * step];
+        const int p = base + j;
+        const int q = p + half;
+        // |x|*|w| <= sqrt(2) * 2^30 so the int32 sums cannot overflow
+        const int32_t tr = mulQ15(re[q], wr) - mulQ15(im[q], wi);
+        const int32_t ti = mulQ15(re[q], wi) + mulQ15(im[q], wr);
+        const int32_t ur = re[p];
+        const int32_t ui = im[p];
+        re[p] = (int16_t)((ur + tr) >> 1);
+        im[p] = (int16_t)((ui + ti) >> 1);
+        re[q] = (int16_t)((ur - tr) >> 1);
+        im[q] = (int16_t)((ui - ti) >> 1);
+      }
+    }
+  }
+  return true;
+}
+
+int16_t hannQ15(int i, int n) {
+  if (n <= 1)
+    return 32767;
+  float w = 0.5f - 0.5f * cosf(TWO_PI * (float)i / (float)n);
+  return toQ15(w);
+}
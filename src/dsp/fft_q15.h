@@ -0,0 +1,26 @@
+#pragma once
+#include <cstdint>
+
+// Fixed-point (Q15) in-place radix-2 decimation-in-time FFT.
+//
+// Every butterfly stage scales by 1/2, so the output is X[k] / N. Butterflies
+// never grow the complex magnitude, so any input whose |re + i*im| <= 32767
+// (every real int16 input except -32768) cannot overflow. The twiddle table
+// is built once on first use for the largest supported size and shared by
+// smaller sizes.
+
+static constexpr int FFT_Q15_MAX_LOG2 = 10; // up to 1024 points
+
+// Transform `re`/`im` (length 1 << log2n) in place. Returns false if log2n is
+// out of range.
+bool fftQ15(int16_t *re, int16_t *im, int log2n);
+
+// Squared magnitude of bin k (Q15 units squared).
+inline uint32_t fftQ15Power(const int16_t *re, const int16_t *im, int k) {
+  int32_t r = re[k];
+  int32_t i = im[k];
+  return (uint32_t)(r * r) + (uint32_t)(i * i);
+}
+
+// Q15 Hann window coefficient i of n (computed, not tabulated).
+int16_t hannQ15(int i, int n);
@@ -0,0 +1,40 @@
+#include "history_source.h"
+#include <string.h>
+
+bool RollupSource::open(uint8_t source, uint32_t from, uint32_t &total,
+                        uint32_t &tag) {
+  if (source >= TIER_COUNT)
+    return false;
+  _tier = (RollupTier)source;
+  _from = from;
+  RollupBucket b;
+  uint32_t n = 0;
+  tag = 0;
+  for (uint16_t i = 0; _r.at(_tier, i, b); ++i) {
+    if (b.start < from)
+      continue;
+    if (!n)
+      tag = b.start;
+    n++;
+  }
+  total = n * (uint32_t)sizeof(RollupBucket);
+  _tag = tag;
+  return true;
+}
+
+size_t RollupSource::read(uint32_t offset, uint8_t *out, size_t len) {
+  const size_t B = sizeof(RollupBucket);
+  RollupBucket rows[12]; // a full 244-byte chunk spans at most 12 records
+  size_t first = offset / B, skip = offset % B;
+  size_t want = (skip + len + B - 1) / B;
+  if (want > 12)
+    want = 12;
+  if (!_r.query(_tier, _from, 0xFFFFFFFFu, rows, 1) || rows[0].start != _tag)
+    return 0; // the first record left the ring
+  size_t n = _r.query(_tier, _from, 0xFFFFFFFFu, rows, want, first);
+  size_t avail = n * B > skip ? n * B - skip : 0;
+  if (len > avail)
+    len = avail;
+  memcpy(out, (const uint8_t *)rows + skip, len);
+  return len;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include "../comms/bulk_transfer.h"
+#include "rollup.h"
+
+// Rollup tiers as bulk transfer sources (comms/bulk_transfer.h): source
+// 0/1/2 = minute/hour/day ring, the content is the closed buckets starting
+// at or after `from`, oldest first, as 24-byte RollupBucket records (the
+// layout in rollup.h, little-endian). The open buckets are not included.
+// The tag is the first record's start time, so a resumed transfer starts
+// over if that bucket has since been dropped from the ring. A drop during
+// a transfer would shift every offset, so read() then returns nothing and
+// the transfer ends; the client's next START sees the new tag.
+class RollupSource : public BulkSource {
+public:
+  explicit RollupSource(const Rollup &r) : _r(r) {}
+  bool open(uint8_t source, uint32_t from, uint32_t &total,
+            uint32_t &tag) override;
+  size_t read(uint32_t offset, uint8_t *out, size_t len) override;
+
+private:
+  const Rollup &_r;
+  RollupTier _tier = TIER_MINUTE;
+  uint32_t _from = 0, _tag = 0;
+};
@@ -0,0 +1,269 @@
+#include "rollup.h"
+#include "../json_writer.h"
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+static const uint32_t TIER_SECONDS[TIER_COUNT] = {60, 3600, 86400};
+static const uint16_t TIER_CAPACITY[TIER_COUNT] = {ROLLUP_MINUTES,
+                                                   ROLLUP_HOURS, ROLLUP_DAYS};
+static const uint16_t TIER_OFFSET[TIER_COUNT] = {
+    0, ROLLUP_MINUTES, ROLLUP_MINUTES + ROLLUP_HOURS};
+static const char *const TIER_NAMES[TIER_COUNT] = {"minute", "hour", "day"};
+
+uint32_t Rollup::tierSeconds(RollupTier tier) { return TIER_SECONDS[tier]; }
+uint16_t Rollup::tierCapacity(RollupTier tier) { return TIER_CAPACITY[tier]; }
+
+// ------------------------------ Scaling ------------------------------
+
+static uint16_t scaleU(float v, float scale, bool has) {
+  if (!has)
+    return ROLLUP_NONE_U;
+  float x = roundf(v * scale);
+  return x <= 0.0f ? 0 : x >= 65534.0f ? 65534 : (uint16_t)x;
+}
+
+static int16_t scaleS(float v, float scale, bool has) {
+  if (!has)
+    return ROLLUP_NONE;
+  float x = roundf(v * scale);
+  return x <= -32767.0f ? -32767 : x >= 32767.0f ? 32767 : (int16_t)x;
+}
+
+float rollupV(uint16_t mV) {
+  return mV == ROLLUP_NONE_U ? NAN : mV / 1000.0f;
+}
+float rollupI(int16_t cA) { return cA == ROLLUP_NONE ? NAN : cA / 100.0f; }
+float rollupT(int16_t dC) { return dC == ROLLUP_NONE ? NAN : dC / 10.0f; }
+float rollupSoc(uint16_t cpct) {
+  return cpct == ROLLUP_NONE_U ? NAN : cpct / 100.0f;
+}
+float rollupRint(uint16_t cmOhm) {
+  return cmOhm == ROLLUP_NONE_U ? NAN : cmOhm / 100.0f;
+}
+
+static void toBucket(const RollupAcc &a, RollupBucket &b) {
+  b.start = a.start;
+  b.n = a.n > 0xFFFF ? 0xFFFF : (uint16_t)a.n;
+  bool v = a.nV, i = a.n;
+  b.V_min_mV = scaleU(a.V_min, 1000.0f, v);
+  b.V_max_mV = scaleU(a.V_max, 1000.0f, v);
+  b.V_mean_mV = scaleU(v ? a.V_sum / a.nV : 0.0f, 1000.0f, v);
+  b.I_min_cA = scaleS(a.I_min, 100.0f, i);
+  b.I_max_cA = scaleS(a.I_max, 100.0f, i);
+  b.I_mean_cA = scaleS(a.I_sum / a.n, 100.0f, i);
+  b.T_dC = scaleS(a.nT ? a.T_sum / a.nT : 0.0f, 10.0f, a.nT);
+  b.soc_cpct = scaleU(a.nSoc ? a.soc_sum / a.nSoc : 0.0f, 100.0f, a.nSoc);
+  b.rint_cmOhm =
+      scaleU(a.nRint ? a.rint_sum / a.nRint : 0.0f, 100.0f, a.nRint);
+}
+
+// ------------------------------ Rollup ------------------------------
+
+void Rollup::clear() {
+  memset(&_s, 0, sizeof(_s));
+  _s.magic = ROLLUP_MAGIC;
+}
+
+void Rollup::begin() {
+  if (!valid())
+    clear();
+}
+
+// Merge an open bucket into its parent; sums keep the weights exact
+void Rollup::accumulate(RollupAcc &a, const RollupAcc &f) const {
+  if (f.nV) {
+    a.V_min = a.nV ? fminf(a.V_min, f.V_min) : f.V_min;
+    a.V_max = a.nV ? fmaxf(a.V_max, f.V_max) : f.V_max;
+  }
+  if (f.n) {
+    a.I_min = a.n ? fminf(a.I_min, f.I_min) : f.I_min;
+    a.I_max = a.n ? fmaxf(a.I_max, f.I_max) : f.I_max;
+  }
+  a.n += f.n;
+  a.nV += f.nV;
+  a.nT += f.nT;
+  a.nSoc += f.nSoc;
+  a.nRint += f.nRint;
+  a.V_sum += f.V_sum;
+  a.I_sum += f.I_sum;
+  a.T_sum += f.T_sum;
+  a.soc_sum += f.soc_sum;
+  a.rint_sum += f.rint_sum;
+}
+
+void Rollup::close(uint8_t tier) {
+  RollupAcc &a = _s.open[tier];
+  if (!a.n)
+    return;
+  uint16_t cap = TIER_CAPACITY[tier];
+  uint16_t slot = (_s.head[tier] + _s.count[tier]) % cap;
+  if (_s.count[tier] == cap)
+    _s.head[tier] = (_s.head[tier] + 1) % cap; // oldest overwritten
+  else
+    _s.count[tier]++;
+  toBucket(a, _s.buckets[TIER_OFFSET[tier] + slot]);
+
+  if (tier + 1 < TIER_COUNT) {
+    RollupAcc &p = _s.open[tier + 1];
+    uint32_t start = a.start - a.start % TIER_SECONDS[tier + 1];
+    if (p.n && p.start != start)
+      close(tier + 1);
+    if (!p.n)
+      p.start = start;
+    accumulate(p, a);
+  }
+  if (tier == TIER_HOUR)
+    _hourClosed = true;
+  memset(&a, 0, sizeof(a));
+}
+
+bool Rollup::add(uint32_t t, float V, float I, float T, float soc,
+                 float rint) {
+  _hourClosed = false;
+  if (!t || !isfinite(I))
+    return false;
+  RollupAcc &a = _s.open[TIER_MINUTE];
+  uint32_t minute = t - t % 60;
+  if (a.n && minute < a.start)
+    return false; // clock stepped back; keep the rings in time order
+  if (a.n && minute != a.start) {
+    close(TIER_MINUTE);
+    // Parents whose period ended close now too, so the open buckets always
+    // nest and current() never mixes two periods
+    for (uint8_t k = TIER_HOUR; k < TIER_COUNT; ++k)
+      if (_s.open[k].n && _s.open[k].start != minute - minute % TIER_SECONDS[k])
+        close(k);
+  }
+  if (!a.n)
+    a.start = minute;
+  RollupAcc s = {};
+  s.n = 1;
+  s.I_min = s.I_max = s.I_sum = I;
+  if (isfinite(V)) {
+    s.nV = 1;
+    s.V_min = s.V_max = s.V_sum = V;
+  }
+  if (isfinite(T)) {
+    s.nT = 1;
+    s.T_sum = T;
+  }
+  if (isfinite(soc)) {
+    s.nSoc = 1;
+    s.soc_sum = soc;
+  }
+  if (isfinite(rint)) {
+    s.nRint = 1;
+    s.rint_sum = rint;
+  }
+  accumulate(a, s);
+  return _hourClosed;
+}
+
+bool Rollup::at(RollupTier tier, uint16_t i, RollupBucket &b) const {
+  if (i >= _s.count[tier])
+    return false;
+  uint16_t slot = (_s.head[tier] + i) % TIER_CAPACITY[tier];
+  b = _s.buckets[TIER_OFFSET[tier] + slot];
+  return true;
+}
+
+// First bucket starting at or after `t`
+uint16_t Rollup::lowerBound(RollupTier tier, uint32_t t) const {
+  uint16_t lo = 0, hi = _s.count[tier];
+  RollupBucket b;
+  while (lo < hi) {
+    uint16_t mid = lo + (hi - lo) / 2;
+    at(tier, mid, b);
+    if (b.start < t)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+size_t Rollup::query(RollupTier tier, uint32_t from, uint32_t to,
+                     RollupBucket *out, size_t maxOut, size_t skip) const {
+  size_t n = 0;
+  RollupBucket b;
+  for (size_t i = lowerBound(tier, from) + skip;
+       n < maxOut && i < _s.count[tier]; ++i) {
+    at(tier, (uint16_t)i, b);
+    if (b.start >= to)
+      break;
+    out[n++] = b;
+  }
+  return n;
+}
+
+bool Rollup::current(RollupTier tier, RollupBucket &b) const {
+  // Lower tiers' open buckets are not merged upwards yet
+  RollupAcc a = _s.open[tier];
+  for (int t = tier - 1; t >= 0; --t) {
+    const RollupAcc &o = _s.open[t];
+    if (!o.n)
+      continue;
+    if (!a.n)
+      a.start = o.start - o.start % TIER_SECONDS[tier];
+    accumulate(a, o);
+  }
+  if (!a.n)
+    return false;
+  toBucket(a, b);
+  return true;
+}
+
+// CRC-32 (IEEE, bitwise) over everything before the crc field
+uint32_t Rollup::crc() const {
+  const uint8_t *p = (const uint8_t *)&_s;
+  uint32_t c = 0xFFFFFFFFu;
+  for (size_t i = 0; i < offsetof(RollupState, crc); ++i) {
+    c ^= p[i];
+    for (int k = 0; k < 8; ++k)
+      c = (c >> 1) ^ (0xEDB88320u & (0u - (c & 1)));
+  }
+  return ~c;
+}
+
+void Rollup::seal() { _s.crc = crc(); }
+
+bool Rollup::valid() const {
+  if (_s.magic != ROLLUP_MAGIC || _s.crc != crc())
+    return false;
+  for (uint8_t t = 0; t < TIER_COUNT; ++t)
+    if (_s.head[t] >= TIER_CAPACITY[t] || _s.count[t] > TIER_CAPACITY[t])
+      return false;
+  return true;
+}
+
+// ------------------------------ JSON ------------------------------
+
+void writeRollupJson(JsonWriter &w, RollupTier tier, const RollupBucket *b,
+                     size_t n) {
+  w.beginObject().str("tier", TIER_NAMES[tier]).beginArray("rows");
+  for (size_t i = 0; i < n; ++i) {
+    const RollupBucket &r = b[i];
+    w.beginArray(nullptr)
+        .u32(nullptr, r.start)
+        .u32(nullptr, r.n)
+        .num(nullptr, rollupV(r.V_min_mV), 3)
+        .num(nullptr, rollupV(r.V_max_mV), 3)
+        .num(nullptr, rollupV(r.V_mean_mV), 3)
+        .num(nullptr, rollupI(r.I_min_cA), 2)
+        .num(nullptr, rollupI(r.I_max_cA), 2)
+        .num(nullptr, rollupI(r.I_mean_cA), 2)
+        .num(nullptr, rollupT(r.T_dC), 1)
+        .num(nullptr, rollupSoc(r.soc_cpct), 2)
+        .num(nullptr, rollupRint(r.rint_cmOhm), 2)
+        .endArray();
+  }
+  w.endArray().endObject();
+}
+
+bool buildRollupJson(RollupTier tier, const RollupBucket *b, size_t n,
+                     char *out, size_t outLen) {
+  JsonWriter w(out, outLen);
+  writeRollupJson(w, tier, b, n);
+  return w.ok();
+}
@@ -0,0 +1,122 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// On-device history: V, I, T, SOC and Rint in three fixed rings of 1 minute,
+// 1 hour and 1 day buckets.
+//
+// Samples only go into the open minute bucket. When a minute closes it is
+// stored in the minute ring and merged into the open hour bucket, a closed
+// hour into the open day bucket, so a sample costs O(1) and every bucket
+// close O(1) more. Closed buckets are stored as 24-byte scaled integers;
+// the open ones keep float sums until they close.
+//
+// All state is one plain struct (RollupState) so it can be written to flash
+// as a checkpoint and read back at boot; seal() adds the CRC that valid()
+// checks. Buckets are keyed by Unix time (UTC days); samples from before
+// the clock is set are not recorded.
+
+static constexpr uint16_t ROLLUP_MINUTES = 120; // 2 h
+static constexpr uint16_t ROLLUP_HOURS = 72;    // 3 days
+static constexpr uint16_t ROLLUP_DAYS = 60;
+static constexpr uint16_t ROLLUP_BUCKETS =
+    ROLLUP_MINUTES + ROLLUP_HOURS + ROLLUP_DAYS;
+static constexpr uint32_t ROLLUP_MAGIC = 0x524F4C31u; // "ROL1"
+
+enum RollupTier : uint8_t {
+  TIER_MINUTE,
+  TIER_HOUR,
+  TIER_DAY,
+  TIER_COUNT
+};
+
+// Closed bucket. Means are weighted by samples; a field without any finite
+// sample is ROLLUP_NONE (INT16_MIN, or 0xFFFF unsigned).
+struct RollupBucket {
+  uint32_t start; // Unix seconds
+  uint16_t n;     // samples (saturates)
+  uint16_t V_min_mV, V_max_mV, V_mean_mV;
+  int16_t I_min_cA, I_max_cA, I_mean_cA; // 10 mA
+  int16_t T_dC;                          // 0.1 degC
+  uint16_t soc_cpct;                     // 0.01 %
+  uint16_t rint_cmOhm;                   // 0.01 mOhm
+};
+static_assert(sizeof(RollupBucket) == 24, "RollupBucket layout");
+
+static constexpr int16_t ROLLUP_NONE = INT16_MIN;
+static constexpr uint16_t ROLLUP_NONE_U = 0xFFFF;
+
+// Open bucket
+struct RollupAcc {
+  uint32_t start;
+  uint32_t n;
+  float V_min, V_max, V_sum;
+  float I_min, I_max, I_sum;
+  float T_sum, soc_sum, rint_sum;
+  uint32_t nV, nT, nSoc, nRint;
+};
+
+// Plain state (zero-initialisable); see the note on DrainState.
+struct RollupState {
+  uint32_t magic;
+  uint16_t head[TIER_COUNT]; // oldest bucket
+  uint16_t count[TIER_COUNT];
+  RollupAcc open[TIER_COUNT];
+  RollupBucket buckets[ROLLUP_BUCKETS];
+  uint32_t crc;
+};
+
+class Rollup {
+public:
+  explicit Rollup(RollupState &s) : _s(s) {}
+
+  // Clears the state unless valid() (e.g. after restoring a checkpoint).
+  void begin();
+  void clear();
+  // One sample at Unix time `t`; non-finite values are skipped per field.
+  // Returns true when an hour bucket closed (a good time to checkpoint).
+  bool add(uint32_t t, float V, float I, float T, float soc, float rint);
+
+  uint16_t count(RollupTier tier) const { return _s.count[tier]; }
+  // i-th closed bucket of `tier`, 0 = oldest
+  bool at(RollupTier tier, uint16_t i, RollupBucket &b) const;
+  // Closed buckets starting in [from, to), oldest first. Returns how many
+  // were copied; `skip` of them are skipped first (paging).
+  size_t query(RollupTier tier, uint32_t from, uint32_t to, RollupBucket *out,
+               size_t maxOut, size_t skip = 0) const;
+  // The open bucket of `tier` so far; false if it has no samples.
+  bool current(RollupTier tier, RollupBucket &b) const;
+
+  // CRC over the state, for writing it out / checking it after reading.
+  void seal();
+  bool valid() const;
+
+  static uint32_t tierSeconds(RollupTier tier);
+  static uint16_t tierCapacity(RollupTier tier);
+
+private:
+  RollupState &_s;
+  bool _hourClosed = false;
+
+  void accumulate(RollupAcc &a, const RollupAcc &from) const;
+  void close(uint8_t tier);
+  uint16_t lowerBound(RollupTier tier, uint32_t t) const;
+  uint32_t crc() const;
+};
+
+// Bucket field values back in V, A, degC, % and mOhm (NAN for none)
+float rollupV(uint16_t mV);
+float rollupI(int16_t cA);
+float rollupT(int16_t dC);
+float rollupSoc(uint16_t cpct);
+float rollupRint(uint16_t cmOhm);
+
+class JsonWriter;
+
+// {"tier":"hour","rows":[[start,n,V_min,V_max,V_mean,I_min,I_max,I_mean,
+// T,soc,rint],...]} with the rows in the order given
+void writeRollupJson(JsonWriter &w, RollupTier tier, const RollupBucket *b,
+                     size_t n);
+// Same into a buffer; false if it does not fit.
+bool buildRollupJson(RollupTier tier, const RollupBucket *b, size_t n,
+                     char *out, size_t outLen);
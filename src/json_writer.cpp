@@ -0,0 +1,207 @@
+#include "json_writer.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+static const double POW10[] = {1.0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6};
+
+// Largest magnitude handled without printf: keeps the scaled value an exact
+// integer in a double and the digits in a uint64_t.
+static constexpr double FAST_MAX = 1e12;
+
+static size_t utoa(char *out, uint64_t v) {
+  char tmp[21];
+  size_t n = 0;
+  do {
+    tmp[n++] = (char)('0' + v % 10);
+    v /= 10;
+  } while (v);
+  for (size_t i = 0; i < n; ++i)
+    out[i] = tmp[n - 1 - i];
+  return n;
+}
+
+size_t fmtFixed(char *out, float v, uint8_t decimals) {
+  if (!isfinite(v))
+    return 0;
+  if (decimals > 6)
+    decimals = 6;
+  double a = fabs((double)v);
+  if (a >= FAST_MAX)
+    return (size_t)snprintf(out, 48, "%.*f", decimals, (double)v);
+
+  // A float has a 24-bit mantissa and 10^6 < 2^20, so the product below is
+  // exact in a double: rounding on it matches printf on the exact value.
+  double x = a * POW10[decimals];
+  double ip = floor(x);
+  double frac = x - ip;
+  uint64_t q = (uint64_t)ip;
+  if (frac > 0.5 || (frac == 0.5 && (q & 1)))
+    q++;
+
+  size_t n = 0;
+  if (signbit(v))
+    out[n++] = '-';
+  uint64_t scale = (uint64_t)POW10[decimals];
+  n += utoa(out + n, q / scale);
+  if (decimals) {
+    out[n++] = '.';
+    uint64_t f = q % scale;
+    for (int d = decimals - 1; d >= 0; --d) {
+      out[n + d] = (char)('0' + f % 10);
+      f /= 10;
+    }
+    n += decimals;
+  }
+  out[n] = '\0';
+  return n;
+}
+
+void JsonWriter::terminate() {
+  if (!_len)
+    return;
+  _buf[_pos < _len ? _pos : _len - 1] = '\0';
+}
+
+bool JsonWriter::drain() {
+  bool ok = _sink(_ctx, _buf, _pos);
+  _drained += _pos;
+  _pos = 0;
+  return ok;
+}
+
+void JsonWriter::put(char c) {
+  if (!_overflow && _buf && _pos + 1 < _len)
+    _buf[_pos++] = c;
+  else
+    put(&c, 1);
+}
+
+void JsonWriter::put(const char *s, size_t n) {
+  if (_overflow)
+    return;
+  if (!_buf) { // dry run
+    _pos += n;
+    return;
+  }
+  // Fill the staging buffer (one byte kept for the NUL) and drain it
+  while (_sink && _len > 1 && _pos + n >= _len) {
+    size_t k = _len - 1 - _pos;
+    memcpy(_buf + _pos, s, k);
+    _pos += k;
+    s += k;
+    n -= k;
+    if (!drain()) {
+      _overflow = true;
+      return;
+    }
+  }
+  if (_pos + n < _len) {
+    memcpy(_buf + _pos, s, n);
+    _pos += n;
+  } else {
+    _overflow = true;
+  }
+}
+
+bool JsonWriter::flush() {
+  if (_sink && _pos && !_overflow && !drain())
+    _overflow = true;
+  terminate();
+  return ok();
+}
+
+void JsonWriter::putStr(const char *s) { put(s, strlen(s)); }
+
+void JsonWriter::key(const char *k) {
+  if (!_first)
+    put(',');
+  _first = false;
+  if (!k)
+    return; // array element
+  put('"');
+  putStr(k);
+  put('"');
+  put(':');
+}
+
+JsonWriter &JsonWriter::beginObject() {
+  put('{');
+  _first = true;
+  terminate();
+  return *this;
+}
+
+JsonWriter &JsonWriter::endObject() {
+  put('}');
+  _first = false;
+  terminate();
+  return *this;
+}
+
+JsonWriter &JsonWriter::beginObject(const char *k) {
+  key(k);
+  return beginObject();
+}
+
+JsonWriter &JsonWriter::beginArray(const char *k) {
+  key(k);
+  put('[');
+  _first = true;
+  terminate();
+  return *this;
+}
+
+JsonWriter &JsonWriter::endArray() {
+  put(']');
+  _first = false;
+  terminate();
+  return *this;
+}
+
+JsonWriter &JsonWriter::str(const char *k, const char *v) {
+  key(k);
+  put('"');
+  for (const char *p = v ? v : ""; *p; ++p) {
+    if (*p == '"' || *p == '\\')
+      put('\\');
+    put(*p);
+  }
+  put('"');
+  terminate();
+  return *this;
+}
+
+JsonWriter &JsonWriter::num(const char *k, float v, uint8_t decimals) {
+  key(k);
+  char tmp[48];
+  size_t n = fmtFixed(tmp, v, decimals);
+  if (n)
+    put(tmp, n);
+  else
+    putStr("null");
+  terminate();
+  return *this;
+}
+
+JsonWriter &JsonWriter::u32(const char *k, uint32_t v) {
+  key(k);
+  char tmp[12];
+  put(tmp, utoa(tmp, v));
+  terminate();
+  return *this;
+}
+
+JsonWriter &JsonWriter::boolean(const char *k, bool v) {
+  key(k);
+  putStr(v ? "true" : "false");
+  terminate();
+  return *this;
+}
+
+JsonWriter &JsonWriter::null(const char *k) {
+  key(k);
+  putStr("null");
+  terminate();
+  return *this;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Zero-allocation streaming JSON writer for fixed-size output buffers.
+//
+// Floats are formatted with a fixed number of decimals by fmtFixed(), which
+// produces the same text as printf("%.<d>f") (round half to even on the
+// exact binary value) without going through the C library's float printf.
+// Non-finite floats are written as null.
+//
+// The writer never writes past `len` and always NUL-terminates; ok() is
+// false once anything did not fit (same contract as snprintf's `n < len`).
+//
+// With a sink the buffer is only a staging area: whenever it fills up, its
+// contents are handed to the sink and writing continues from the start, so
+// output of any length streams through a few dozen bytes (call flush() at
+// the end). A default-constructed writer is a dry run that only counts.
+
+// Format `v` with `decimals` (0..6) digits after the point into `out`
+// (at least 48 bytes). Returns the length, or 0 if `v` is not finite.
+size_t fmtFixed(char *out, float v, uint8_t decimals);
+
+// Receives staged output; false aborts the writer (ok() turns false).
+typedef bool (*JsonSink)(void *ctx, const char *data, size_t len);
+
+class JsonWriter {
+public:
+  JsonWriter(char *buf, size_t len) : _buf(buf), _len(len) {
+    if (len)
+      buf[0] = '\0';
+  }
+  // Staging buffer (at least 2 bytes) drained into `sink`
+  JsonWriter(char *buf, size_t len, JsonSink sink, void *ctx)
+      : JsonWriter(buf, len) {
+    _sink = sink;
+    _ctx = ctx;
+  }
+  // Dry run: nothing is written, length() is what would have been
+  JsonWriter() {}
+
+  JsonWriter &beginObject();
+  JsonWriter &endObject();
+  // Nested object or array under `key`. Inside an array pass a null key to
+  // the value functions.
+  JsonWriter &beginObject(const char *key);
+  JsonWriter &beginArray(const char *key);
+  JsonWriter &endArray();
+  // String value; quotes and backslashes are escaped.
+  JsonWriter &str(const char *key, const char *v);
+  // Fixed-decimal number, null if not finite.
+  JsonWriter &num(const char *key, float v, uint8_t decimals);
+  JsonWriter &u32(const char *key, uint32_t v);
+  JsonWriter &boolean(const char *key, bool v);
+  JsonWriter &null(const char *key);
+
+  // Hand any staged output to the sink; returns ok().
+  bool flush();
+
+  bool ok() const { return !_overflow && (_len || !_buf); }
+  // Bytes written so far, including those already passed to the sink
+  size_t length() const { return _drained + _pos; }
+
+private:
+  char *_buf = nullptr;
+  size_t _len = 0;
+  size_t _pos = 0;
+  JsonSink _sink = nullptr;
+  void *_ctx = nullptr;
+  size_t _drained = 0;
+  bool _overflow = false;
+  bool _first = true;
+
+  void put(char c);
+  void put(const char *s, size_t n);
+  void putStr(const char *s);
+  void key(const char *k);
+  void terminate();
+  bool drain();
+};
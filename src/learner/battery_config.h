@@ -1,4 +1,6 @@
-// Simple battery capacity persistence helper
+// Simple battery capacity persistence helper (NVS keys bat_cap/bat_cap2).
+// Superseded by the runtime config blob (app_config.h); begin() is only
+// called once to import a capacity set before it.
 #pragma once
 #include <Arduino.h>
 
@@ -0,0 +1,156 @@
+#include "capacity_learner.h"
+#include <cstdio>
+#include <cstring>
+
+void CapacityLearner::begin(const CapacityConfig &cfg) {
+  _cfg = cfg;
+  if (_f.magic != CAPACITY_FIT_MAGIC || !std::isfinite(_f.sxx) ||
+      !std::isfinite(_f.sxy) || !std::isfinite(_f.syy) ||
+      !std::isfinite(_f.n) || _f.sxx < 0.0f) {
+    memset(&_f, 0, sizeof(_f));
+    _f.magic = CAPACITY_FIT_MAGIC;
+  }
+  if (_a.magic != CAPACITY_ANCHOR_MAGIC) {
+    memset(&_a, 0, sizeof(_a));
+    _a.magic = CAPACITY_ANCHOR_MAGIC;
+  }
+}
+
+void CapacityLearner::reset() {
+  memset(&_f, 0, sizeof(_f));
+  _f.magic = CAPACITY_FIT_MAGIC;
+  memset(&_a, 0, sizeof(_a));
+  _a.magic = CAPACITY_ANCHOR_MAGIC;
+}
+
+bool CapacityLearner::setNominal(float nominalAh) {
+  bool changed = !std::isnan(_nominalAh) && nominalAh != _nominalAh;
+  _nominalAh = nominalAh;
+  if (changed)
+    reset();
+  return changed;
+}
+
+void CapacityLearner::addCharge(float dAh) {
+  if (!_a.valid || !std::isfinite(dAh))
+    return;
+  _a.netAh += dAh;
+  _a.throughputAh += fabsf(dAh);
+}
+
+void CapacityLearner::setAnchor(float soc_pct) {
+  _a.valid = true;
+  _a.soc_pct = soc_pct;
+  _a.netAh = 0.0f;
+  _a.throughputAh = 0.0f;
+}
+
+uint8_t CapacityLearner::addRestPoint(float ocvSoc_pct, float nominalAh) {
+  if (!std::isfinite(ocvSoc_pct) || !std::isfinite(nominalAh) ||
+      nominalAh <= 0.0f)
+    return CAP_EVT_NONE;
+
+  if (!_a.valid) {
+    setAnchor(ocvSoc_pct);
+    return CAP_EVT_ANCHORED;
+  }
+
+  const float dSoc = _a.soc_pct - ocvSoc_pct; // positive = discharged
+  if (fabsf(dSoc) < _cfg.minDeltaSocPct) {
+    // Too small to fit. If almost nothing moved, the newer (longer rested)
+    // reading is the better anchor; otherwise let the swing grow, unless the
+    // counting error has grown too large to be useful.
+    if (_a.throughputAh <= _cfg.refreshMaxAh ||
+        _a.throughputAh > _cfg.maxThroughputFrac * nominalAh) {
+      setAnchor(ocvSoc_pct);
+      return CAP_EVT_ANCHORED;
+    }
+    return CAP_EVT_NONE;
+  }
+
+  const float x = dSoc / 100.0f;
+  const float y = _a.netAh;
+  const float ratio = y / x;
+  if (!(ratio >= _cfg.minRatio * nominalAh &&
+        ratio <= _cfg.maxRatio * nominalAh)) {
+    setAnchor(ocvSoc_pct);
+    return CAP_EVT_REJECTED;
+  }
+
+  // Variance of y - C*x: OCV error on both ends plus counting error
+  float prior = capacityAh();
+  if (!std::isfinite(prior))
+    prior = nominalAh;
+  const float ocvAh = 1.41421356f * (_cfg.ocvSigmaPct / 100.0f) * prior;
+  const float countAh = _cfg.coulombErrFrac * _a.throughputAh;
+  float var = ocvAh * ocvAh + countAh * countAh;
+  if (var < 1e-6f)
+    var = 1e-6f;
+  const float w = 1.0f / var;
+
+  _f.sxx = _cfg.forget * _f.sxx + w * x * x;
+  _f.sxy = _cfg.forget * _f.sxy + w * x * y;
+  _f.syy = _cfg.forget * _f.syy + w * y * y;
+  _f.n = _cfg.forget * _f.n + 1.0f;
+
+  setAnchor(ocvSoc_pct);
+  return CAP_EVT_UPDATED;
+}
+
+float CapacityLearner::capacityAh() const {
+  if (!(_f.sxx > 0.0f))
+    return NAN;
+  return _f.sxy / _f.sxx;
+}
+
+float CapacityLearner::sigmaAh() const {
+  if (!(_f.sxx > 0.0f))
+    return NAN;
+  // Reduced chi^2 inflates the error when pairs scatter more than modelled
+  float scale = 1.0f;
+  if (_f.n > 1.5f) {
+    float chi2 = _f.syy - _f.sxy * _f.sxy / _f.sxx;
+    if (chi2 < 0.0f)
+      chi2 = 0.0f; // rounding
+    float red = chi2 / (_f.n - 1.0f);
+    if (red > scale)
+      scale = red;
+  }
+  return sqrtf(scale / _f.sxx);
+}
+
+bool CapacityLearner::confident() const {
+  float c = capacityAh();
+  float s = sigmaAh();
+  if (!std::isfinite(c) || !std::isfinite(s) || c <= 0.0f)
+    return false;
+  return _f.n >= _cfg.minPoints && s / c <= _cfg.maxRelSigma;
+}
+
+float usableCapacityAh(const CapacityLearner &l, float nominalAh,
+                       float soh_frac) {
+  if (l.confident())
+    return l.capacityAh();
+  return nominalAh * soh_frac;
+}
+
+bool buildCapacityJson(const CapacityLearner &l, float nominalAh, char *out,
+                       size_t outLen) {
+  char cStr[16], sStr[16];
+  float c = l.capacityAh();
+  float s = l.sigmaAh();
+  if (std::isfinite(c))
+    snprintf(cStr, sizeof(cStr), "%.2f", c);
+  else
+    snprintf(cStr, sizeof(cStr), "null");
+  if (std::isfinite(s))
+    snprintf(sStr, sizeof(sStr), "%.2f", s);
+  else
+    snprintf(sStr, sizeof(sStr), "null");
+  int n = snprintf(out, outLen,
+                   "{\"capacity_ah\":%s,\"sigma_ah\":%s,\"points\":%.1f,"
+                   "\"confident\":%s,\"nominal_ah\":%.1f}",
+                   cStr, sStr, l.points(), l.confident() ? "true" : "false",
+                   nominalAh);
+  return n > 0 && (size_t)n < outLen;
+}
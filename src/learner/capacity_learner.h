@@ -0,0 +1,108 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Online usable-capacity estimator.
+//
+// Each rested-OCV SOC reading is paired with the previous one (the anchor) and
+// the net charge counted between them. One pair gives one observation
+//   dAh = C * dSOC / 100
+// and C is fitted through the origin by weighted least squares. The weight of
+// a pair is the inverse of its expected variance: OCV error on both ends
+// (scaled by C) plus a coulomb-counting error proportional to the charge
+// throughput since the anchor. With inverse-variance weights the standard
+// error of C is 1/sqrt(sum w*x^2), scaled up by the residual chi^2 when the
+// points disagree more than expected.
+//
+// Sums decay by `forget` per accepted pair so the estimate follows ageing.
+// Every update is O(1). The fit (`CapacityFit`, 20 bytes) is persisted in NVS;
+// the anchor (`CapacityAnchor`) lives in RTC memory so it survives deep sleep.
+
+static constexpr uint32_t CAPACITY_FIT_MAGIC = 0xCA9F1028u;
+static constexpr uint32_t CAPACITY_ANCHOR_MAGIC = 0xCA9A1028u;
+
+enum CapacityEvent : uint8_t {
+  CAP_EVT_NONE = 0,
+  CAP_EVT_ANCHORED = 1, // rest point stored as the new anchor
+  CAP_EVT_UPDATED = 2,  // pair accepted, fit changed (persist it)
+  CAP_EVT_REJECTED = 3, // pair failed the plausibility check, re-anchored
+};
+
+struct CapacityConfig {
+  float minDeltaSocPct = 10.0f;   // smaller swings wait for more charge
+  float ocvSigmaPct = 3.0f;       // 1-sigma OCV SOC error per rest point
+  float coulombErrFrac = 0.03f;   // 1-sigma counting error per Ah moved
+  float refreshMaxAh = 0.2f;      // below this, a new rest point replaces
+                                  // the anchor (better relaxed OCV)
+  float maxThroughputFrac = 2.0f; // drop the anchor past this * capacity
+  float minRatio = 0.3f;          // plausible C range vs. nominal
+  float maxRatio = 1.5f;
+  float forget = 0.95f;      // sum decay per accepted pair
+  float minPoints = 3.0f;    // effective pairs before the fit is used
+  float maxRelSigma = 0.10f; // sigma/C required for the fit to be used
+};
+
+// Plain structs (zero-initialisable). Do not add constructors or default
+// member initialisers: the anchor is an `RTC_DATA_ATTR` copy and the fit is
+// stored as raw bytes.
+struct CapacityFit {
+  uint32_t magic;
+  float sxx; // sum w * x^2, x = dSOC / 100
+  float sxy; // sum w * x * y, y = dAh
+  float syy; // sum w * y^2
+  float n;   // effective number of pairs (decays with `forget`)
+};
+
+struct CapacityAnchor {
+  uint32_t magic;
+  bool valid;
+  float soc_pct;      // OCV SOC at the anchor
+  float netAh;        // net discharge since the anchor (charge negative)
+  float throughputAh; // |charge| moved since the anchor
+};
+
+class CapacityLearner {
+public:
+  CapacityLearner(CapacityFit &fit, CapacityAnchor &anchor)
+      : _f(fit), _a(anchor) {}
+
+  // Validate persisted state and reset whatever is garbage.
+  void begin(const CapacityConfig &cfg);
+  void reset();
+  // The configured capacity the fit was learned against. The first call
+  // records it; a later change (new battery, corrected SET_CAP) resets the
+  // fit and the anchor and returns true, so the caller persists the fit.
+  bool setNominal(float nominalAh);
+
+  // Coulomb-counted charge, positive = discharge (same sign as the current).
+  void addCharge(float dAh);
+
+  // A rested OCV SOC reading. `nominalAh` is the configured capacity, used as
+  // the prior for weights and the plausibility range. Returns CapacityEvent.
+  uint8_t addRestPoint(float ocvSoc_pct, float nominalAh);
+
+  float capacityAh() const; // NAN until at least one pair is accepted
+  float sigmaAh() const;    // standard error of capacityAh()
+  float points() const { return _f.n; }
+  bool confident() const;
+  const CapacityFit &fit() const { return _f; }
+  bool anchored() const { return _a.valid; }
+
+private:
+  CapacityFit &_f;
+  CapacityAnchor &_a;
+  CapacityConfig _cfg;
+  float _nominalAh = NAN; // not recorded yet
+
+  void setAnchor(float soc_pct);
+};
+
+// Capacity for SOC and Ah-left: the learned value once the fit is confident,
+// otherwise `nominalAh` scaled by `soh_frac`.
+float usableCapacityAh(const CapacityLearner &l, float nominalAh,
+                       float soh_frac);
+
+// Serialise the current estimate as JSON.
+bool buildCapacityJson(const CapacityLearner &l, float nominalAh, char *out,
+                       size_t outLen);
@@ -0,0 +1,45 @@
+#include "log_output.h"
+#include <WebSerial.h>
+
+void LogOutput::attachWeb(AsyncWebServer &server) {
+  if (_web)
+    return;
+  WebSerial.begin(&server);
+  _web = true;
+}
+
+// Format the next record into _line; false if there is none
+bool LogOutput::next() {
+  if (!_log.pop(_line, sizeof(_line) - 1))
+    return false;
+  if (_web)
+    WebSerial.println(_line);
+  _len = strlen(_line);
+  _line[_len++] = '\n';
+  _off = 0;
+  return true;
+}
+
+void LogOutput::drain(uint32_t budget_us) {
+  uint32_t t0 = micros();
+  do {
+    if (_off == _len && !next())
+      return;
+    int room = Serial.availableForWrite();
+    if (room <= 0)
+      return;
+    size_t n = _len - _off;
+    if ((size_t)room < n)
+      n = (size_t)room;
+    Serial.write((const uint8_t *)_line + _off, n);
+    _off += n;
+  } while (micros() - t0 < budget_us);
+}
+
+void LogOutput::flush() {
+  do {
+    Serial.write((const uint8_t *)_line + _off, _len - _off);
+    _off = _len;
+  } while (next());
+  Serial.flush();
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "logger.h"
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// Sinks for the deferred logger: the USB serial port and, once the web
+// server runs, WebSerial ("/webserial").
+//
+// drain() runs from the idle loop. It formats records one at a time and
+// hands the UART only as many bytes as its TX buffer has room for, keeping
+// the rest of a line for the next call, so it never waits on 115200 baud.
+// WebSerial gets each whole line (it queues on the AsyncTCP task).
+class LogOutput {
+public:
+  explicit LogOutput(Logger &log) : _log(log) {}
+
+  void attachWeb(AsyncWebServer &server);
+  // Write until the budget is spent, the UART buffer is full or the ring
+  // is empty.
+  void drain(uint32_t budget_us);
+  // Write everything, waiting for the UART (before deep sleep).
+  void flush();
+
+private:
+  Logger &_log;
+  char _line[LOG_LINE_MAX + 1];
+  size_t _len = 0, _off = 0; // pending part of _line for the UART
+  bool _web = false;
+
+  bool next();
+};
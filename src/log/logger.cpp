@@ -0,0 +1,180 @@
+#include "logger.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *const LEVEL_NAMES[LL_COUNT] = {"ERROR", "WARN", "INFO",
+                                                  "DEBUG"};
+
+Logger::Logger(LogClockFn clock) : _clock(clock) {
+  for (uint32_t i = 0; i < LOG_RING_ENTRIES; ++i)
+    _ring[i].seq.store(i, std::memory_order_relaxed);
+}
+
+// Bounded multi-producer queue: each slot's sequence number says whether it
+// is free for the producer at `pos` (seq == pos) or holds a record for the
+// consumer (seq == pos + 1).
+void Logger::push(uint8_t level, const char *fmt, const LogArg *a,
+                  uint8_t n) {
+  uint32_t pos = _enq.load(std::memory_order_relaxed);
+  Record *r;
+  for (;;) {
+    r = &_ring[pos & (LOG_RING_ENTRIES - 1)];
+    int32_t diff =
+        (int32_t)(r->seq.load(std::memory_order_acquire) - pos);
+    if (diff == 0) {
+      if (_enq.compare_exchange_weak(pos, pos + 1,
+                                     std::memory_order_relaxed))
+        break;
+    } else if (diff < 0) {
+      _dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    } else {
+      pos = _enq.load(std::memory_order_relaxed);
+    }
+  }
+  r->fmt = fmt;
+  r->t_ms = _clock ? _clock() : 0;
+  r->level = level;
+  r->n = n;
+  for (uint8_t i = 0; i < n; ++i)
+    r->a[i] = a[i];
+  r->seq.store(pos + 1, std::memory_order_release);
+}
+
+bool Logger::empty() const {
+  const Record &r = _ring[_deq & (LOG_RING_ENTRIES - 1)];
+  return r.seq.load(std::memory_order_acquire) != _deq + 1 &&
+         _dropped.load(std::memory_order_relaxed) == _reported;
+}
+
+static size_t prefix(char *out, size_t len, uint32_t t_ms, char level) {
+  int w = snprintf(out, len, "[%lu.%03lu] %c ", (unsigned long)(t_ms / 1000),
+                   (unsigned long)(t_ms % 1000), level);
+  return w < 0 ? 0 : (size_t)w >= len ? len - 1 : (size_t)w;
+}
+
+bool Logger::pop(char *out, size_t len) {
+  if (!len)
+    return false;
+  uint32_t dropped = _dropped.load(std::memory_order_relaxed);
+  if (dropped != _reported) {
+    size_t p = prefix(out, len, _clock ? _clock() : 0, 'W');
+    snprintf(out + p, len - p, "log: %lu records dropped",
+             (unsigned long)(dropped - _reported));
+    _reported = dropped;
+    return true;
+  }
+  Record &r = _ring[_deq & (LOG_RING_ENTRIES - 1)];
+  if (r.seq.load(std::memory_order_acquire) != _deq + 1)
+    return false;
+  size_t p = prefix(out, len, r.t_ms, LEVEL_NAMES[r.level][0]);
+  logFormat(out + p, len - p, r.fmt, r.a, r.n);
+  r.seq.store(_deq + LOG_RING_ENTRIES, std::memory_order_release);
+  _deq++;
+  return true;
+}
+
+// ------------------------------ Formatting ------------------------------
+
+size_t logFormat(char *out, size_t len, const char *fmt, const LogArg *a,
+                 uint8_t n) {
+  if (!len)
+    return 0;
+  size_t o = 0;
+  uint8_t k = 0;
+  auto put = [&](const char *s, size_t m) {
+    if (o + m >= len)
+      m = len - 1 - o;
+    memcpy(out + o, s, m);
+    o += m;
+  };
+  const char *p = fmt;
+  while (*p && o < len - 1) {
+    if (*p != '%') {
+      const char *q = strchr(p, '%');
+      size_t m = q ? (size_t)(q - p) : strlen(p);
+      put(p, m);
+      p += m;
+      continue;
+    }
+    if (p[1] == '%') {
+      put("%", 1);
+      p += 2;
+      continue;
+    }
+    // One conversion: flags, width, precision, then length modifiers,
+    // which are dropped because every argument is stored as 32 bits
+    char spec[16];
+    size_t s = 0;
+    const char *q = p;
+    spec[s++] = *q++;
+    while (*q && strchr("-+ #0123456789.", *q) && s < sizeof(spec) - 3)
+      spec[s++] = *q++;
+    while (*q && strchr("hlLqjzt", *q))
+      ++q;
+    char conv = *q;
+    if (!conv || !strchr("diuxXocspfFeEgG", conv) || k >= n) {
+      put(p, (size_t)(q - p) + (conv ? 1 : 0)); // left as written
+      p = q + (conv ? 1 : 0);
+      continue;
+    }
+    spec[s++] = conv;
+    spec[s] = '\0';
+    const LogArg &v = a[k++];
+    char tmp[48];
+    int w;
+    switch (conv) {
+    case 'd':
+    case 'i':
+    case 'c':
+      w = snprintf(tmp, sizeof(tmp), spec, (int)v.i);
+      break;
+    case 's':
+      w = snprintf(tmp, sizeof(tmp), spec, v.s ? v.s : "(null)");
+      break;
+    case 'p':
+      w = snprintf(tmp, sizeof(tmp), spec, (const void *)v.s);
+      break;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+      w = snprintf(tmp, sizeof(tmp), spec, (double)v.f);
+      break;
+    default: // u x X o
+      w = snprintf(tmp, sizeof(tmp), spec, (unsigned)v.u);
+      break;
+    }
+    if (conv == 's' && v.s && w >= (int)sizeof(tmp)) {
+      // Long strings are copied straight (width/precision ignored)
+      put(v.s, strlen(v.s));
+    } else if (w > 0) {
+      put(tmp, (size_t)w < sizeof(tmp) ? (size_t)w : sizeof(tmp) - 1);
+    }
+    p = q + 1;
+  }
+  if (o && out[o - 1] == '\n')
+    --o;
+  out[o] = '\0';
+  return o;
+}
+
+const char *logLevelName(LogLevel l) {
+  return l < LL_COUNT ? LEVEL_NAMES[l] : "?";
+}
+
+LogLevel logLevelFromName(const char *s) {
+  if (!s || !*s)
+    return LL_COUNT;
+  for (uint8_t l = 0; l < LL_COUNT; ++l) {
+    const char *name = LEVEL_NAMES[l];
+    size_t i = 0;
+    while (s[i] && name[i] && (s[i] & ~0x20) == name[i])
+      ++i;
+    if (i && !s[i] && (i == 1 || !name[i]))
+      return (LogLevel)l;
+  }
+  return LL_COUNT;
+}
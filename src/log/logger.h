@@ -0,0 +1,122 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Deferred-formatting logger.
+//
+// A log call stores only the format string's address, a timestamp and the
+// raw arguments (one 32-bit word each) in a fixed ring; nothing is
+// formatted and no output is written. The idle loop later pop()s records,
+// formats them with the printf conversions in the format string and writes
+// them to the sinks (log/log_output.*), so a log call on the sampling path
+// costs a level check and a few stores instead of several milliseconds of
+// UART time at 115200 baud.
+//
+// The ring is lock-free for several producers (loop, BLE and AsyncTCP
+// tasks) and one consumer. When it is full new records are dropped and
+// counted; the next pop() reports how many.
+//
+// Rules for call sites: the format string must be a literal, %s arguments
+// must outlive the record (literals or static buffers, never a stack
+// buffer or a temporary String), and 64-bit arguments are not supported.
+// Floats are stored as float. A trailing newline in the format is dropped;
+// the sinks end each record with one.
+
+enum LogLevel : uint8_t { LL_ERROR, LL_WARN, LL_INFO, LL_DEBUG, LL_COUNT };
+
+static constexpr uint8_t LOG_MAX_ARGS = 8;
+static constexpr uint16_t LOG_RING_ENTRIES = 64; // power of two
+static constexpr size_t LOG_LINE_MAX = 160;      // formatted, with prefix
+
+union LogArg {
+  int32_t i;
+  uint32_t u;
+  float f;
+  const char *s;
+};
+
+inline LogArg logArg(int v) {
+  LogArg a;
+  a.i = v;
+  return a;
+}
+inline LogArg logArg(unsigned v) {
+  LogArg a;
+  a.u = v;
+  return a;
+}
+inline LogArg logArg(long v) { return logArg((int)v); }
+inline LogArg logArg(unsigned long v) { return logArg((unsigned)v); }
+inline LogArg logArg(double v) {
+  LogArg a;
+  a.f = (float)v;
+  return a;
+}
+inline LogArg logArg(const char *v) {
+  LogArg a;
+  a.s = v;
+  return a;
+}
+
+typedef uint32_t (*LogClockFn)();
+
+class Logger {
+public:
+  explicit Logger(LogClockFn clock);
+
+  void setLevel(LogLevel l) { _level = l; }
+  LogLevel level() const { return (LogLevel)_level; }
+  bool enabled(LogLevel l) const { return l <= _level; }
+
+  template <typename... A> void log(LogLevel l, const char *fmt, A... args) {
+    static_assert(sizeof...(A) <= LOG_MAX_ARGS, "too many log arguments");
+    if (l > _level)
+      return;
+    const LogArg a[sizeof...(A) + 1] = {logArg(args)..., logArg(0)};
+    push(l, fmt, a, sizeof...(A));
+  }
+
+  // Consumer: format the oldest record as "[s.mmm] L message" into `out`.
+  // False if there is nothing to report.
+  bool pop(char *out, size_t len);
+  bool empty() const;
+  uint32_t dropped() const { return _dropped.load(); }
+
+private:
+  struct Record {
+    std::atomic<uint32_t> seq;
+    const char *fmt;
+    uint32_t t_ms;
+    uint8_t level, n;
+    LogArg a[LOG_MAX_ARGS];
+  };
+
+  Record _ring[LOG_RING_ENTRIES];
+  std::atomic<uint32_t> _enq{0};
+  uint32_t _deq = 0; // consumer only
+  std::atomic<uint32_t> _dropped{0};
+  uint32_t _reported = 0; // drops already reported by pop()
+  LogClockFn _clock;
+  volatile uint8_t _level = LL_INFO;
+
+  void push(uint8_t level, const char *fmt, const LogArg *a, uint8_t n);
+};
+
+// printf `fmt` with stored arguments. Supports the flags, width, precision
+// and length modifiers of %d %i %u %x %X %o %c %s %p %f %F %e %E %g %G and
+// %%. Returns the length written (truncated to len - 1).
+size_t logFormat(char *out, size_t len, const char *fmt, const LogArg *a,
+                 uint8_t n);
+
+const char *logLevelName(LogLevel l);
+// "E", "W", "I", "D" or a full name (case-insensitive); LL_COUNT if unknown
+LogLevel logLevelFromName(const char *s);
+
+// The firmware's logger (defined in main.cpp)
+extern Logger logger;
+
+#define LOGE(...) logger.log(LL_ERROR, __VA_ARGS__)
+#define LOGW(...) logger.log(LL_WARN, __VA_ARGS__)
+#define LOGI(...) logger.log(LL_INFO, __VA_ARGS__)
+#define LOGD(...) logger.log(LL_DEBUG, __VA_ARGS__)
@@ -8,165 +8,83 @@
 #include <DallasTemperature.h>
 #include <NimBLEDevice.h>
 #include <OneWire.h>
+#include <LittleFS.h>
 #include <Preferences.h>
-#include <PubSubClient.h>
 #include <WiFi.h>
 #include <Wire.h>
 #include <algorithm> // for std::sort (hall zero trimmed mean)
 #include <app_config.h>
+#include <battery/drain_analyzer.h>
+#include <battery/interval_stats.h>
 #include <battery/ocv_estimator.h>
+#include <battery/ripple_analyzer.h>
 #include <battery/state_detector.h>
 #include <cmath>
 #include <comms/ble_mgr.h>
+#include <comms/conn_backoff.h>
 #include <comms/debug_publisher.h>
+#include <comms/ha_discovery.h>
 #include <comms/mqtt_mgr.h>
+#include <comms/outbox.h>
+#include <comms/outbox_fs.h>
+#include <comms/report_policy.h>
+#include <comms/snapshot_batch.h>
+#include <comms/web_mgr.h>
 #include <comms/wifi_mgr.h>
 #include <cstring> // for strncmp, atoi
 #include <esp_bt.h>
 #include <esp_sleep.h>
+#include <learner/capacity_learner.h>
 #include <learner/rint_learner.h>
+#include <log/log_output.h>
+#include <log/logger.h>
+#include <esp_timer.h>
+#include <history/history_source.h>
+#include <history/rollup.h>
+#include <json_writer.h>
+#include <power/energy_model.h>
 #include <power/sleep_mgr.h>
+#include <power/wake_profile.h>
+#include <sched/profiler.h>
+#include <sched/scheduler.h>
 #include <sensor/ds18b20.h>
 #include <sensor/hall_sensor.h>
 #include <sensor/ina226.h>
+#include <telemetry_cbor.h>
 #include <telemetry_payload.h>
 
 // Forward-declare global mqtt instance (defined later in this file)
 extern MqttMgr mqtt;
 
-// Publish Home Assistant MQTT discovery config for sensors
+// Publish the Home Assistant discovery payload (comms/ha_discovery.h) unless
+// the broker already holds this exact content. The hash of the last payload
+// published is kept in NVS; none stored means the per-entity configs of older
+// firmware may still be retained, so they are cleared first.
 void publishHADiscovery() {
   if (!mqtt.connected())
     return;
-  const char *base = MQTT_TOPIC; // state topic
-  const char *haId =
-      "Toyota_batt_sensor"; // Home Assistant discovery ID / unique_id base
-  // Device object
-  char deviceJson[256];
-  snprintf(deviceJson, sizeof(deviceJson),
-           "{\"identifiers\":[\"%s\",\"%s\"],\"name\":\"Battery Monitor\"}",
-           haId, MQTT_CLIENT_ID);
-
-  // Helper buffers
-  char topic[160];
-  char payload[512];
-
-  // Voltage
-  snprintf(topic, sizeof(topic), "homeassistant/sensor/%s_voltage/config",
-           haId);
-  // Format voltage as a two-decimal float for Home Assistant display
-  // (e.g. 12.00)
-  snprintf(payload, sizeof(payload),
-           "{\"name\":\"Battery "
-           "Voltage\",\"state_topic\":\"%s\",\"unit_of_measurement\":\"V\","
-           "\"device_class\":\"voltage\",\"value_template\":\"{{ '%%.2f' | "
-           "format(value_json.voltage_V) "
-           "}}\",\"unique_id\":\"%s_voltage\",\"device\":%s}",
-           base, haId, deviceJson);
-  mqtt.publish(topic, payload, true);
-
-  // Current
-  snprintf(topic, sizeof(topic), "homeassistant/sensor/%s_current/config",
-           haId);
-  snprintf(payload, sizeof(payload),
-           "{\"name\":\"Battery "
-           "Current\",\"state_topic\":\"%s\",\"unit_of_measurement\":\"A\","
-           "\"value_template\":\"{{ value_json.current_A "
-           "}}\",\"unique_id\":\"%s_current\",\"device\":%s}",
-           base, haId, deviceJson);
-  mqtt.publish(topic, payload, true);
-
-  // SOC
-  snprintf(topic, sizeof(topic), "homeassistant/sensor/%s_soc/config", haId);
-  snprintf(payload, sizeof(payload),
-           "{\"name\":\"Battery "
-           "SOC\",\"state_topic\":\"%s\",\"unit_of_measurement\":\"%%\","
-           "\"device_class\":\"battery\",\"value_template\":\"{{ "
-           "value_json.soc_pct }}\",\"unique_id\":\"%s_soc\",\"device\":%s}",
-           base, haId, deviceJson);
-  mqtt.publish(topic, payload, true);
-
-  // SOH
-  snprintf(topic, sizeof(topic), "homeassistant/sensor/%s_soh/config", haId);
-  snprintf(payload, sizeof(payload),
-           "{\"name\":\"Battery "
-           "SOH\",\"state_topic\":\"%s\",\"unit_of_measurement\":\"%%\","
-           "\"value_template\":\"{{ value_json.soh_pct "
-           "}}\",\"unique_id\":\"%s_soh\",\"device\":%s}",
-           base, haId, deviceJson);
-  mqtt.publish(topic, payload, true);
-
-  // Ah left (remaining capacity in Ah)
-  snprintf(topic, sizeof(topic), "homeassistant/sensor/%s_ah_left/config",
-           haId);
-  // Format Ah as a two-decimal float for Home Assistant display (e.g. 12.34)
-  snprintf(payload, sizeof(payload),
-           "{\"name\":\"Battery Ah "
-           "Left\",\"state_topic\":\"%s\",\"unit_of_measurement\":\"Ah\","
-           "\"value_template\":\"{{ '%%.2f' | format(value_json.ah_left) "
-           "}}\",\"unique_id\":\"%s_ah_left\",\"device\":%s}",
-           base, haId, deviceJson);
-  mqtt.publish(topic, payload, true);
-
-  // Rint
-  snprintf(topic, sizeof(topic), "homeassistant/sensor/%s_rint/config", haId);
-  snprintf(payload, sizeof(payload),
-           "{\"name\":\"Rint "
-           "(mOhm)\",\"state_topic\":\"%s\",\"unit_of_measurement\":\"mΩ\","
-           "\"value_template\":\"{% if value_json.Rint_mOhm is not none %}{{ "
-           "value_json.Rint_mOhm }}{% else %}{{ value_json.RintBaseline_mOhm "
-           "}}{% endif %}\",\"unique_id\":\"%s_rint\",\"device\":%s}",
-           base, haId, deviceJson);
-  // Note: the above template uses Jinja; Home Assistant will parse it. If the
-  // template syntax causes issues in the C string on some toolchains you can
-  // simplify to always show RintBaseline.
-  mqtt.publish(topic, payload, true);
-  // Note: the above template uses Jinja; Home Assistant will parse it. If the
-  // template syntax causes issues in the C string on some toolchains you can
-  // simplify to always show RintBaseline.
-  mqtt.publish(topic, payload, true);
-
-  // Alternator (binary sensor)
-  snprintf(topic, sizeof(topic),
-           "homeassistant/binary_sensor/%s_alternator/config", haId);
-  snprintf(payload, sizeof(payload),
-           "{\"name\":\"Alternator "
-           "On\",\"state_topic\":\"%s\",\"value_template\":\"{{ "
-           "value_json.alternator_on "
-           "}}\",\"payload_on\":\"true\",\"payload_off\":\"false\",\"unique_"
-           "id\":\"%s_alternator\",\"device\":%s}",
-           base, haId, deviceJson);
-  mqtt.publish(topic, payload, true);
-
-  // Mode
-  snprintf(topic, sizeof(topic), "homeassistant/sensor/%s_mode/config", haId);
-  snprintf(payload, sizeof(payload),
-           "{\"name\":\"Battery "
-           "Mode\",\"state_topic\":\"%s\",\"value_template\":\"{{ "
-           "value_json.mode }}\",\"unique_id\":\"%s_mode\",\"device\":%s}",
-           base, haId, deviceJson);
-  mqtt.publish(topic, payload, true);
-
-  // Uptime
-  snprintf(topic, sizeof(topic), "homeassistant/sensor/%s_uptime/config", haId);
-  snprintf(payload, sizeof(payload),
-           "{\"name\":\"Battery "
-           "Uptime\",\"state_topic\":\"%s\",\"unit_of_measurement\":\"s\","
-           "\"value_template\":\"{{ (value_json.up_ms / 1000) | int "
-           "}}\",\"unique_id\":\"%s_uptime\",\"device\":%s}",
-           base, haId, deviceJson);
-  mqtt.publish(topic, payload, true);
-
-  // Battery Capacity
-  snprintf(topic, sizeof(topic), "homeassistant/sensor/%s_capacity/config",
-           haId);
-  snprintf(payload, sizeof(payload),
-           "{\"name\":\"Battery "
-           "Capacity\",\"state_topic\":\"%s\",\"unit_of_measurement\":\"Ah\","
-           "\"value_template\":\"{{ value_json.battery_capacity_ah "
-           "}}\",\"unique_id\":\"%s_capacity\",\"device\":%s}",
-           base, haId, deviceJson);
-  mqtt.publish(topic, payload, true);
+  static char payload[HA_DISCOVERY_MAX];
+  size_t len = buildHaDiscovery(HA_DEVICE_ID, MQTT_CLIENT_ID, MQTT_TOPIC,
+                                payload, sizeof(payload));
+  if (!len)
+    return;
+  uint32_t hash = haDiscoveryHash(payload, len);
+  Preferences prefs;
+  prefs.begin("battmon", false);
+  uint32_t stored = prefs.getUInt("ha_hash", 0);
+  if (stored != hash) {
+    char topic[96];
+    bool ok = true;
+    for (size_t i = 0; !stored && ok && i < HA_ENTITY_COUNT; ++i) {
+      if (haLegacyTopic(HA_DEVICE_ID, i, topic, sizeof(topic)))
+        ok = mqtt.publish(topic, (const uint8_t *)"", 0, true);
+    }
+    ok = ok && haDiscoveryTopic(HA_DEVICE_ID, topic, sizeof(topic)) &&
+         mqtt.publish(topic, (const uint8_t *)payload, len, true);
+    if (ok)
+      prefs.putUInt("ha_hash", hash);
+  }
+  prefs.end();
 }
 
 #define DEBUG_POWER_MANAGEMENT 1
@@ -176,6 +94,9 @@ void publishHADiscovery() {
 // #define DEBUG_HALL_SENSOR 1
 
 // Class init
+static uint32_t logMillis() { return millis(); }
+Logger logger(logMillis);
+LogOutput logOut(logger);
 DS18B20Sensor ds(ONE_WIRE_PIN, DS_RES_BITS);
 INA226Bus ina(INA226_ADDR);
 HallSensor hall(PIN_VOUT, PIN_VREF, HAVE_VREF_PIN, ADC_BITS, ADC_ATTEN,
@@ -184,11 +105,19 @@ HallZeroStore hallZero;
 BleMgr ble;
 DebugPublisher gRintDbg;
 WiFiMgr wifi;
-WiFiClient _net;
-MqttMgr mqtt(_net);
+MqttMgr mqtt;
 RintLearner learner;
 BatteryStateDetector stateDetector;
 OcvEstimator ocvEst; // Static helper class
+// Parked drain statistics survive deep sleep between snapshot wakes
+RTC_DATA_ATTR DrainState drainState;
+DrainAnalyzer drain(drainState);
+RippleAnalyzer ripple;
+// Capacity fit is persisted in NVS; the rest-point anchor survives deep sleep
+CapacityFit capFit;
+RTC_DATA_ATTR CapacityAnchor capAnchor;
+CapacityLearner capLearner(capFit, capAnchor);
+static uint16_t rippleRaw[RIPPLE_N];
 
 // ==================== Zeroing =====================
 // static float zero_mV = 0.0f;   // stored offset (Δ at zero current)
@@ -203,17 +132,142 @@ float last_I_A = 0.0f;
 float last_V_V = 12.6f;
 float last_T_C = 25.0f;
 uint32_t lastSampleMs = 0;
-uint32_t lastTempMs = 0;
-uint32_t lastPublishMs = 0;
+uint32_t lastRippleMs = 0;
+// Every V/I sample since the last published frame
+IntervalAggregator intervalStats;
+bool capRestPointTaken = false; // capacity point taken in this rest period
+// The same two across deep sleep, for snapshot wakes (set before sleeping)
+RTC_DATA_ATTR float sleepRest_s = 0.0f;
+RTC_DATA_ATTR bool sleepRestPointTaken = false;
 float lowCurrentAccum_s = 0.0f; // time I below threshold with alternator off
 uint32_t parkedIdleEnterMs = 0; // when we entered Parked&Idle
 
 enum Mode { MODE_ACTIVE = 0, MODE_PARKED_IDLE = 1 };
 Mode mode = MODE_ACTIVE;
 
+// Profiling zones (build with -DPROFILER_ENABLED=1; BLE command PROF dumps
+// them to MQTT_PROF_TOPIC)
+PROF_ZONE(profIna, "ina.readBusVoltage_V");
+PROF_ZONE(profHall, "hall.readCurrentA");
+PROF_ZONE(profIngest, "learner.ingest");
+PROF_ZONE(profJson, "publishTelemetryJson");
+PROF_ZONE(profCbor, "encodeTelemetryCbor");
+PROF_ZONE(profBle, "ble.update");
+PROF_ZONE(profMqtt, "mqtt.service");
+PROF_ZONE(profOta, "ArduinoOTA.handle");
+// Deepest stack use of the telemetry publish, painted 1.5 KB deep
+PROF_STACK(stackPublish, "publishTelemetryJson");
+static constexpr size_t STACK_PROBE_BYTES = 1536;
+
+// ------------------------------ Scheduler ------------------------------
+// loop() runs one ready task per pass, most urgent first (see
+// sched/scheduler.h). Stats go to MQTT_SCHED_TOPIC every
+// SCHED_STATS_INTERVAL_MS.
+void taskSample(uint32_t now);
+void taskParkedTimer(uint32_t now);
+void taskTemperature(uint32_t now);
+void taskRipple(uint32_t now);
+void taskPublish(uint32_t now);
+void taskNetService(uint32_t now);
+void taskBleBulk(uint32_t now);
+void taskWeb(uint32_t now);
+void taskSchedStats(uint32_t now);
+
+enum SchedTaskId {
+  TASK_SAMPLE,
+  TASK_PARKED_TIMER,
+  TASK_TEMPERATURE,
+  TASK_RIPPLE,
+  TASK_PUBLISH,
+  TASK_NET_SERVICE,
+  TASK_BLE_BULK,
+  TASK_WEB,
+  TASK_SCHED_STATS,
+  TASK_COUNT
+};
+
+SchedTask schedTasks[TASK_COUNT] = {
+    // name, fn, period_ms, deadline_ms, priority, enabled
+    {"sample", taskSample, SAMPLE_INTERVAL_MS, 100, 0, true, 0, {}},
+    {"parked", taskParkedTimer, 1000, 0, 1, true, 0, {}},
+    {"temp", taskTemperature, TEMP_INTERVAL_MS, 0, 2, true, 0, {}},
+    {"ripple", taskRipple, 1000, 0, 3, true, 0, {}},
+    {"publish", taskPublish, PUBLISH_INTERVAL_MS, 0, 4, true, 0, {}},
+    {"net", taskNetService, 10, 50, 5, true, 0, {}},
+    {"bulk", taskBleBulk, BLE_BULK_PUMP_MS, 0, 6, true, 0, {}},
+    {"web", taskWeb, WEB_FRAME_INTERVAL_MS, 0, 7, true, 0, {}},
+    {"stats", taskSchedStats, SCHED_STATS_INTERVAL_MS, 0, 8, true, 0, {}},
+};
+
+// Arduino's millis()/micros() return unsigned long; adapt to the clock type
+static uint32_t schedMillis() { return (uint32_t)millis(); }
+static uint32_t schedMicros() { return (uint32_t)micros(); }
+Scheduler sched(schedTasks, TASK_COUNT, schedMillis, schedMicros);
+
+// Sampling and publish cadence follow the current mode (runtimeConfig)
+void applyModeCadence() {
+  bool active = (mode == MODE_ACTIVE);
+  const RuntimeConfig &c = runtimeConfig;
+  sched.setPeriod(TASK_SAMPLE, active ? c.sample_ms : c.sampleIdle_ms);
+  sched.setPeriod(TASK_PUBLISH, active ? c.publish_ms : c.publishIdle_ms);
+}
+
 // OTA initialization guard
 static bool otaInitialized = false;
 
+// Loop time spent blocked in connection code (telemetry: net_blocked_ms_h)
+BlockedTimeMeter netBlocked;
+// Latest telemetry frame waiting for the net task (JSON is built on send)
+static TelemetryFrame telemetryFrame;
+static bool telemetryPending = false;
+// Same frame as CBOR when selected (telemetryEncoding); 0 = nothing pending
+static uint8_t telemetryCbor[TELEMETRY_CBOR_MAX];
+static size_t telemetryCborLen = 0;
+// Report-by-exception; a current step sends the next frame right away
+ReportPolicy reportPolicy;
+static bool reportEvent = false;
+
+// Store-and-forward outbox; the replay cursor survives deep sleep
+RTC_DATA_ATTR OutboxCursor outboxCursor;
+OutboxLittleFs outboxFs;
+Outbox outbox(outboxFs, outboxCursor, OUTBOX_MAX_SEGMENTS);
+static uint32_t lastOutboxStoreMs = 0;
+static bool sntpStarted = false;
+// Snapshot wakes only mount LittleFS when frames are known to be queued
+RTC_DATA_ATTR bool outboxHasData = true;
+
+// History rollups: RAM rings checkpointed to HISTORY_PATH. A HIST request
+// is sent from the net task one page at a time, from historyFrom on.
+static RollupState historyState;
+Rollup history(historyState);
+RollupSource historySource(history); // BLE history transfer
+static uint8_t historyTier = TIER_COUNT; // TIER_COUNT = no request
+static uint32_t historyFrom = 0;
+static bool historySaveDue = false; // an hour closed; the net task saves
+
+// Web dashboard and live sample WebSocket; started once Wi-Fi is up
+WebMgr web;
+
+// Snapshot wake: Wi-Fi reconnect cache and per-phase timings (RTC memory)
+RTC_DATA_ATTR WifiFastCache wifiCache;
+RTC_DATA_ATTR WakeProfile wakeProfile;
+WakeTimer wakeTimer(wakeProfile, schedMicros);
+static bool snapshotWake = false;
+
+// Self-consumption accounting (power model in app_config.h); the ledger
+// survives deep sleep
+static const PowerModel powerModel = {
+    POWER_AWAKE_MA,
+    {POWER_SENSORS_MA, POWER_WIFI_CONNECT_MA, POWER_WIFI_MA, POWER_MQTT_MA,
+     POWER_BLE_MA, POWER_OTA_MA},
+    POWER_SLEEP_MA};
+RTC_DATA_ATTR EnergyLedger energyLedger;
+static uint64_t energyMicros() { return (uint64_t)esp_timer_get_time(); }
+EnergyMeter energy(energyLedger, powerModel, energyMicros);
+// Snapshot frames collected across radio-less wakes
+RTC_DATA_ATTR SnapshotBatch snapshotBatch;
+SnapshotBatcher batcher(snapshotBatch, SNAPSHOT_BATCH_WAKES);
+
 // Complementary SOC filter params
 static constexpr float SOC_FILTER_TAU_S =
     300.0f; // seconds (time constant toward OCV)
@@ -245,552 +299,1069 @@ float compensateOCVTo25C(float vbatt, float tempC) {
   return vbatt + dv;
 }
 
+// Publish drain analyzer events and any pending daily drain report. A report
+// stays pending (in RTC memory) until MQTT is reachable.
+void publishDrainEvents(uint8_t evt) {
+  if (!mqtt.connected())
+    return;
+  char js[256];
+  if (evt & DRAIN_EVT_STEP) {
+    snprintf(js, sizeof(js),
+             "{\"event\":\"drain_step\",\"dI_A\":%.3f,\"level_A\":%.3f}",
+             drain.lastStep_A(), drain.level_A());
+    mqtt.publish(MQTT_DRAIN_TOPIC, js, false);
+  }
+  if (evt & DRAIN_EVT_NO_SLEEP) {
+    snprintf(js, sizeof(js),
+             "{\"event\":\"drain_no_sleep\",\"level_A\":%.3f,"
+             "\"parked_s\":%lu}",
+             drain.level_A(), (unsigned long)drain.session_s());
+    mqtt.publish(MQTT_DRAIN_TOPIC, js, false);
+  }
+  if (drain.reportPending() &&
+      buildDrainReportJson(drain.report(), js, sizeof(js))) {
+    if (mqtt.publish(MQTT_DRAIN_TOPIC, js, true))
+      drain.clearReport();
+  }
+}
+
+// Usable capacity for SOC and Ah-left: the learned value once its fit is
+// confident, otherwise the configured capacity scaled by `soh_frac`.
+float usableCapacityAh(float soh_frac) {
+  return usableCapacityAh(capLearner, batteryCapacityAh, soh_frac);
+}
+
+// Persist the capacity fit and publish it (retained)
+static void saveCapacityFit() {
+  Preferences prefs;
+  prefs.begin("battmon", false);
+  prefs.putBytes("cap_fit", &capFit, sizeof(capFit));
+  prefs.end();
+  char js[160];
+  if (mqtt.connected() &&
+      buildCapacityJson(capLearner, batteryCapacityAh, js, sizeof(js)))
+    mqtt.publish(MQTT_CAPACITY_TOPIC, js, true);
+}
+
+// Feed a rested OCV SOC reading to the capacity learner. A changed fit is
+// persisted and published (retained).
+void onCapacityRestPoint(float ocvSoc_pct) {
+  if (capLearner.addRestPoint(ocvSoc_pct, batteryCapacityAh) !=
+      CAP_EVT_UPDATED)
+    return;
+  LOGI("Capacity fit: %.2f Ah (sigma %.2f Ah, %.1f pts)",
+       capLearner.capacityAh(), capLearner.sigmaAh(), capLearner.points());
+  saveCapacityFit();
+}
+
+// Forget the learned capacity (declared in app_config.h)
+void resetCapacityLearning() {
+  capLearner.reset();
+  saveCapacityFit();
+}
+
+// Capture one ripple burst (~130 ms, blocking) and publish the analysis.
+void runRippleCapture() {
+  if (!ina.captureBusRaw(rippleRaw, RIPPLE_N, RIPPLE_SAMPLE_PERIOD_US)) {
+    LOGW("Ripple capture failed (I2C)");
+    return;
+  }
+  RippleResult r = ripple.analyze(rippleRaw, RIPPLE_N, RIPPLE_SAMPLE_RATE_HZ,
+                                  INA226_BUS_LSB_MV);
+  if (!r.valid)
+    return;
+  LOGI("Ripple: %.1f mVrms, %.1f Hz, diode score %.3f", r.ripple_mVrms,
+       r.ripple_Hz, r.diodeScore);
+  char js[256];
+  if (mqtt.connected() && buildRippleJson(r, js, sizeof(js)))
+    mqtt.publish(MQTT_RIPPLE_TOPIC, js, false);
+}
+
+// ArduinoOTA, once Wi-Fi is up. If `OTA_PASSWORD` is defined in
+// `src/secret.h` it is applied; otherwise OTA runs without a password.
+void setupOta() {
+  ArduinoOTA.setHostname(MQTT_CLIENT_ID);
+#ifdef OTA_PASSWORD
+  ArduinoOTA.setPassword(OTA_PASSWORD);
+#endif
+  ArduinoOTA.onStart([]() { Serial.println("OTA Start"); });
+  ArduinoOTA.onEnd([]() { Serial.println("OTA End"); });
+  ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) {
+    Serial.printf("OTA Progress: %u%%\r", (progress / (total / 100)));
+  });
+  ArduinoOTA.onError([](ota_error_t err) {
+    Serial.printf("OTA Error[%u]: ", (unsigned)err);
+    if (err == OTA_AUTH_ERROR)
+      Serial.println("Auth Failed");
+    else if (err == OTA_BEGIN_ERROR)
+      Serial.println("Begin Failed");
+    else if (err == OTA_CONNECT_ERROR)
+      Serial.println("Connect Failed");
+    else if (err == OTA_RECEIVE_ERROR)
+      Serial.println("Receive Failed");
+    else if (err == OTA_END_ERROR)
+      Serial.println("End Failed");
+  });
+  ArduinoOTA.begin();
+  otaInitialized = true;
+  Serial.println("ArduinoOTA initialized");
+}
+
+// SNTP once per boot when Wi-Fi is up; the clock then keeps running through
+// deep sleep, so outbox records carry real capture times.
+void startSntp() {
+  if (sntpStarted)
+    return;
+  configTime(0, 0, NTP_SERVER);
+  sntpStarted = true;
+}
+
+// Unix time if the clock has been set, else 0
+uint32_t wallClock() {
+  time_t t = time(nullptr);
+  return t >= (time_t)MIN_VALID_EPOCH ? (uint32_t)t : 0;
+}
+
+// Restore the last checkpoint; a missing or corrupt file starts empty
+void loadHistory() {
+  if (outboxFs.mounted() && LittleFS.exists(HISTORY_PATH)) {
+    File f = LittleFS.open(HISTORY_PATH, FILE_READ);
+    if (f.read((uint8_t *)&historyState, sizeof(historyState)) !=
+        sizeof(historyState))
+      historyState.magic = 0;
+    f.close();
+  }
+  history.begin();
+}
+
+// Written to a temp file and renamed over the checkpoint, so a reset
+// mid-write keeps the previous one
+void saveHistory() {
+  historySaveDue = false;
+  if (!outboxFs.mounted())
+    return;
+  history.seal();
+  File f = LittleFS.open(HISTORY_TMP_PATH, FILE_WRITE);
+  if (!f)
+    return;
+  size_t n = f.write((const uint8_t *)&historyState, sizeof(historyState));
+  f.close();
+  if (n != sizeof(historyState) ||
+      !LittleFS.rename(HISTORY_TMP_PATH, HISTORY_PATH)) {
+    LittleFS.remove(HISTORY_TMP_PATH);
+    LOGW("history: checkpoint not saved");
+  }
+}
+
+void requestHistory(uint8_t tier) {
+  if (tier >= TIER_COUNT)
+    return;
+  historyTier = tier;
+  historyFrom = 0;
+}
+
+void storeTelemetry(const TelemetryFrame &tf) {
+  if (!outboxFs.mounted())
+    return;
+  OutboxRecord r;
+  packOutboxRecord(tf, wallClock(), r);
+  if (outbox.push(r))
+    outboxHasData = true;
+}
+
+static bool mqttJsonSink(void *ctx, const char *data, size_t len) {
+  return static_cast<MqttMgr *>(ctx)->write((const uint8_t *)data, len);
+}
+
+// Telemetry JSON written straight into the MQTT client: a dry run gives the
+// packet length, then the writer streams through a small staging buffer
+// into the MQTT queue instead of a full payload buffer.
+bool publishTelemetryJson(const char *topic, const TelemetryFrame &f,
+                          bool retain) {
+  PROF_SCOPE(profJson);
+  size_t len = telemetryJsonLength(f);
+  if (!mqtt.beginPublish(topic, len, retain))
+    return false;
+  char chunk[128];
+  JsonWriter w(chunk, sizeof(chunk), mqttJsonSink, &mqtt);
+  writeTelemetryJson(w, f);
+  w.flush();
+  return mqtt.endPublish();
+}
+
+// Next page of a HIST request, streamed like the telemetry JSON. A page that
+// does not fit the MQTT queue yet is tried again on the next pass.
+void publishHistoryPage() {
+  if (historyTier >= TIER_COUNT || !mqtt.connected())
+    return;
+  RollupTier tier = (RollupTier)historyTier;
+  RollupBucket rows[HISTORY_PAGE_ROWS];
+  size_t n = history.query(tier, historyFrom, 0xFFFFFFFFu, rows,
+                           HISTORY_PAGE_ROWS);
+  if (!n) {
+    historyTier = TIER_COUNT;
+    return;
+  }
+  JsonWriter dry;
+  writeRollupJson(dry, tier, rows, n);
+  if (!mqtt.beginPublish(MQTT_HISTORY_TOPIC, dry.length(), false))
+    return;
+  char chunk[128];
+  JsonWriter w(chunk, sizeof(chunk), mqttJsonSink, &mqtt);
+  writeRollupJson(w, tier, rows, n);
+  w.flush();
+  if (mqtt.endPublish())
+    historyFrom = rows[n - 1].start + 1;
+}
+
+// Records of one replay batch queued for MQTT but not yet committed
+struct OutboxReplay {
+  int n;
+  uint32_t bytes, elapsed_ms;
+};
+
+// Replay the oldest queued frames to MQTT_BACKLOG_TOPIC for up to
+// `budget_ms`. A failed publish stays queued. Counters and replay throughput
+// go to MQTT_OUTBOX_TOPIC once the outbox is empty.
+// With `deferred` (snapshot wake) only one batch is queued and nothing is
+// committed: the caller commits *deferred once mqtt.sync() confirmed it,
+// since the MQTT queue does not survive deep sleep.
+void replayOutbox(uint32_t budget_ms, OutboxReplay *deferred = nullptr) {
+  if (outbox.empty())
+    outboxHasData = false;
+  if (outbox.empty() || !mqtt.connected())
+    return;
+  OutboxRecord batch[OUTBOX_REPLAY_BATCH];
+  char js[700];
+  uint32_t start = millis();
+  do {
+    int n = outbox.peek(batch, OUTBOX_REPLAY_BATCH);
+    if (n <= 0)
+      break;
+    uint32_t t0 = millis(), bytes = 0;
+    int sent = 0;
+    for (; sent < n; ++sent) {
+      if (!buildOutboxRecordJson(batch[sent], js, sizeof(js)))
+        continue; // cannot happen with a 700-byte buffer; drop it
+      if (!mqtt.publish(MQTT_BACKLOG_TOPIC, js, false))
+        break;
+      bytes += strlen(js);
+    }
+    if (deferred) {
+      *deferred = {sent, bytes, (uint32_t)(millis() - t0)};
+      return;
+    }
+    outbox.commit(sent, bytes, millis() - t0);
+    if (sent < n)
+      return;
+  } while (millis() - start < budget_ms);
+
+  if (outbox.empty()) {
+    outboxHasData = false;
+    char stats[256];
+    if (buildOutboxJson(outbox, stats, sizeof(stats)))
+      mqtt.publish(MQTT_OUTBOX_TOPIC, stats, false);
+  }
+}
+
+// Self-consumption of the last closed hour (and day), once per hour
+void publishEnergyReport() {
+  energy.tick();
+  char js[300];
+  if (energy.reportPending() && mqtt.connected() &&
+      buildEnergyJson(energy, js, sizeof(js)) &&
+      mqtt.publish(MQTT_ENERGY_TOPIC, js, false))
+    energy.clearReport();
+}
+
+// Current runtime config, retained on MQTT_CONFIG_TOPIC
+static void publishRuntimeConfig() {
+  char js[384];
+  if (mqtt.connected() &&
+      buildConfigJson(runtimeConfig, runtimeConfigLoadUs, js, sizeof(js)))
+    mqtt.publish(MQTT_CONFIG_TOPIC, js, true);
+}
+
+// After a CFG command changed runtimeConfig (declared in app_config.h)
+void applyRuntimeConfig() {
+  applyModeCadence();
+  // A new nominal capacity (battery swap, SET_CAP) resets the learned fit
+  if (capLearner.setNominal(batteryCapacityAh)) {
+    LOGI("Capacity fit reset (nominal %.1f Ah)", batteryCapacityAh);
+    saveCapacityFit();
+  }
+  publishRuntimeConfig();
+}
+
+// After every MQTT (re)connect: refresh the retained device IP at
+// <MQTT_TOPIC>/ip, the Home Assistant discovery configs and the runtime
+// config. Snapshot wakes skip them; they are refreshed on the next full
+// start.
+void onMqttConnected() {
+  if (snapshotWake)
+    return;
+  reportPolicy.reset(); // the broker may have missed frames
+  IPAddress ip = WiFi.localIP();
+  char ipStr[32];
+  snprintf(ipStr, sizeof(ipStr), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+  char ipTopic[80];
+  snprintf(ipTopic, sizeof(ipTopic), "%s/ip", MQTT_TOPIC);
+  mqtt.publish(ipTopic, ipStr, true);
+  publishHADiscovery();
+  publishRuntimeConfig();
+  mqtt.subscribe(MQTT_CMD_TOPIC);
+}
+
+// Commands on MQTT_CMD_TOPIC. A retained one would run again on every
+// connect (think RESET), so those are dropped.
+void onMqttMessage(void *, const char *topic, const uint8_t *payload,
+                   size_t len, bool retained) {
+  if (strcmp(topic, MQTT_CMD_TOPIC) != 0)
+    return;
+  if (retained) {
+    LOGW("MQTT: retained command ignored");
+    return;
+  }
+  ble.submitCommand((const char *)payload, len, CMD_SRC_MQTT);
+}
+
 // Note: alternator/step-activity detection is implemented in
 // `BatteryStateDetector` (stateDetector) — use its methods.
 
 // ------------------------------ Setup ------------------------------
+// Restore learned and persisted state (NVS) used by both boot paths
+void restoreState() {
+  // Wire debug publisher
+  gRintDbg.client = &mqtt;
+  gRintDbg.topic = MQTT_DBG_TOPIC;
+  gRintDbg.enabled = true;                         // set false to silence
+  gRintDbg.minIntervalMs = 250;                    // per-event rate limit
+  learner.begin(INITIAL_BASELINE_mOHM, &gRintDbg); // enable when needed
+
+  // Load SOC from NVM (battmon namespace already opened by learner)
+  Preferences prefs;
+  prefs.begin("battmon", false);
+  soc_pct = prefs.getFloat("soc_pct", 90.0f);
+  if (!isfinite(soc_pct) || soc_pct < 0.0f || soc_pct > 100.0f) {
+    soc_pct = 90.0f;
+  }
+  // Learned capacity fit; a missing or stale blob is reset by begin()
+  if (prefs.getBytes("cap_fit", &capFit, sizeof(capFit)) != sizeof(capFit))
+    memset(&capFit, 0, sizeof(capFit));
+  prefs.end();
+  capLearner.begin(CapacityConfig());
+  capLearner.setNominal(batteryCapacityAh);
+}
+
+void setupMqtt() {
+  mqtt.setServer(MQTT_HOST, MQTT_PORT);
+  mqtt.setCredentials(MQTT_CLIENT_ID, MQTT_USER, MQTT_PASS);
+  mqtt.setBlockedMeter(&netBlocked);
+  mqtt.onConnected(onMqttConnected);
+  mqtt.onMessage(onMqttMessage, nullptr);
+}
+
+// Move the RTC snapshot batch to the flash outbox (full start, or full and
+// still not sent). Capture times from before SNTP become "unknown".
+void spillSnapshotBatch() {
+  if (!outboxFs.mounted() && outboxFs.begin())
+    outbox.begin();
+  for (uint8_t i = 0; i < batcher.count() && outboxFs.mounted(); ++i) {
+    TelemetryFrame f{};
+    uint32_t ts;
+    if (!unpackOutboxRecord(batcher.record(i), f, ts))
+      continue;
+    OutboxRecord r;
+    packOutboxRecord(f, ts >= MIN_VALID_EPOCH ? ts : 0, r);
+    if (outbox.push(r))
+      outboxHasData = true;
+  }
+  batcher.clear();
+}
+
+// Timer wake while still parked: add one snapshot frame to the RTC batch and
+// sleep again. The radio only comes up every SNAPSHOT_BATCH_WAKES wakes, or
+// early for drain events and low voltage, and then sends the whole batch.
+// Association (from the RTC Wi-Fi cache) runs in the background while state
+// is restored and the temperature conversion finishes. BLE, OTA and HA
+// discovery are skipped, and the broker round-trip replaces fixed delays.
+// Phase timings are kept in RTC memory and published on the next radio wake.
+void runSnapshotWake(uint8_t drainEvt) {
+  snapshotWake = true;
+  batcher.begin();
+  bool event = drainEvt != DRAIN_EVT_NONE || drain.reportPending() ||
+               (isfinite(last_V_V) && last_V_V < SNAPSHOT_ALERT_V);
+  bool radio = batcher.due(event);
+  if (radio) {
+    setupMqtt();
+    wifi.setBlockedMeter(&netBlocked);
+    wifi.setFastCache(&wifiCache, /*reuse*/ true);
+    wifi.begin(WIFI_SSID, WIFI_PASSWORD);
+    wifi.service(millis()); // start the attempt now
+    energy.set(EC_WIFI_CONNECT, true);
+  }
+  restoreState();
+  energy.on(EC_SENSORS);
+  last_T_C = ds.readConversion();
+  energy.off(EC_SENSORS);
+  wakeTimer.mark(WAKE_SENSORS);
+
+  if (radio) {
+    if (wifi.waitConnected(WIFI_SNAPSHOT_WAIT_MS) && !wallClock())
+      startSntp();
+    energy.set(EC_WIFI_CONNECT, false);
+    energy.set(EC_WIFI, wifi.connected());
+    wakeTimer.mark(WAKE_WIFI);
+    energy.on(EC_MQTT); // until disconnect
+    if (wifi.connected())
+      mqtt.connectNow();
+    wakeTimer.mark(WAKE_MQTT);
+  }
+
+  float rint_mOhm = learner.lastRint_mOhm();
+  float rint25_mOhm = learner.lastRint25_mOhm();
+  float base_mOhm = learner.baseline_mOhm();
+  float soh = learner.currentSOH();
+  // Filter extreme Rint values (starter/transient artifacts)
+  float rint_mOhm_f =
+      (isfinite(rint_mOhm) && rint_mOhm <= RINT_MAX_VALID_MOHM) ? rint_mOhm
+                                                                : base_mOhm;
+  float rint25_mOhm_f =
+      (isfinite(rint25_mOhm) && rint25_mOhm <= RINT_MAX_VALID_MOHM)
+          ? rint25_mOhm
+          : base_mOhm;
+
+  // Blend SOC with OCV (snapshot uses adaptive complementary filter too)
+  float soc_for_snapshot = soc_pct;
+  if (isfinite(last_V_V) && isfinite(last_T_C)) {
+    float v25 = compensateOCVTo25C(last_V_V, last_T_C);
+    float ocvSOC = socFromOCV_25C(v25);
+    float alpha = SOC_MIN_ALPHA + (1.0f - SOC_MIN_ALPHA) *
+                                      expf(-rest_accum_s / SOC_FILTER_TAU_S);
+    soc_for_snapshot = alpha * soc_pct + (1.0f - alpha) * ocvSOC;
+    // The snapshot current stands in for the sleep interval, also for the
+    // rest period, which goes on across wakes. As on the awake path, one
+    // capacity-learning point per rest period, once well relaxed.
+    capLearner.addCharge(last_I_A * (PARKED_WAKE_INTERVAL_US / 3.6e9f));
+    bool atRest = fabsf(last_I_A) < runtimeConfig.rest_A &&
+                  !stateDetector.alternatorOn(last_V_V);
+    sleepRest_s = atRest ? sleepRest_s + PARKED_WAKE_INTERVAL_US / 1e6f : 0.0f;
+    if (sleepRest_s < (float)CAPACITY_REST_SEC) {
+      sleepRestPointTaken = false;
+    } else if (!sleepRestPointTaken) {
+      onCapacityRestPoint(ocvSOC);
+      sleepRestPointTaken = true;
+    }
+  }
+  // Estimate Ah left based on rated capacity, SOH and blended SOC
+  float soh_frac = soh;
+  if (soh_frac > 1.1f)
+    soh_frac /= 100.0f;                     // guard against percent return
+  float C_eff = usableCapacityAh(soh_frac); // effective usable Ah
+  float ah_left_snapshot = C_eff * (soc_for_snapshot / 100.0f);
+
+  TelemetryFrame tf{
+      .mode = "snapshot",
+      .V = last_V_V,
+      .I = last_I_A,
+      .T = last_T_C,
+      .soc_pct = soc_for_snapshot,
+      .soh_pct = soh * 100.0f,
+      .Rint_mOhm = rint_mOhm_f,
+      .Rint25_mOhm = rint25_mOhm_f,
+      .RintBaseline_mOhm = base_mOhm,
+      .ah_left = ah_left_snapshot,
+      .battery_capacity_ah = batteryCapacityAh,
+      .alternator_on = stateDetector.alternatorOn(last_V_V),
+      .rest_s = (uint32_t)rest_accum_s,
+      .lowCurrentAccum_s = (uint32_t)lowCurrentAccum_s,
+      .up_ms = millis(),
+      .hasRint = (isfinite(rint_mOhm) && rint_mOhm <= RINT_MAX_VALID_MOHM),
+      .hasRint25 =
+          (isfinite(rint25_mOhm) && rint25_mOhm <= RINT_MAX_VALID_MOHM),
+      .net_blocked_ms_h = netBlocked.lastHour_ms()};
+  LOGI("Snapshot V: %.3f V, I: %.3f A, T: %.1f C, SOC: %.1f %%, SOH: %.1f %%",
+       tf.V, tf.I, tf.T, tf.soc_pct, tf.soh_pct);
+
+  // Raw RTC clock: keeps counting through deep sleep even before SNTP
+  if (!batcher.add(tf, (uint32_t)time(nullptr))) {
+    spillSnapshotBatch();
+    batcher.add(tf, (uint32_t)time(nullptr));
+  }
+
+  // The outbox is only mounted when it holds frames or one must be added.
+  // The batch and the replayed records are only dropped once the broker
+  // has acknowledged them (mqtt.sync()); publish() merely queues them.
+  bool sent = false, published = false;
+  if (mqtt.connected()) {
+    publishDrainEvents(drainEvt);
+    publishTelemetryJson(MQTT_TOPIC, tf, true); // latest state for dashboards
+    if (telemetryEncoding & TELEMETRY_ENC_CBOR) {
+      uint8_t cbor[TELEMETRY_CBOR_MAX];
+      size_t len = encodeTelemetryCbor(tf, cbor, sizeof(cbor));
+      if (len)
+        mqtt.publish(MQTT_CBOR_TOPIC, cbor, len, true);
+    }
+    uint8_t batch[SNAPSHOT_BATCH_BYTES];
+    size_t n = batcher.encode((uint32_t)time(nullptr), batch, sizeof(batch));
+    sent = n && mqtt.publish(MQTT_BATCH_TOPIC, batch, n, false);
+    char js[320];
+    if (buildWakeJson(wakeProfile, WAKE_BUDGET_MS, js, sizeof(js)))
+      mqtt.publish(MQTT_WAKE_TOPIC, js, false);
+    publishEnergyReport();
+    OutboxReplay replay = {0, 0, 0};
+    if (outboxHasData && (outboxFs.mounted() || outboxFs.begin())) {
+      outbox.begin();
+      replayOutbox(OUTBOX_SNAPSHOT_BUDGET_MS, &replay);
+    }
+    if (mqtt.sync(MQTT_SYNC_TIMEOUT_MS)) {
+      published = sent;
+      if (sent)
+        batcher.clear();
+      if (replay.n > 0)
+        outbox.commit(replay.n, replay.bytes, replay.elapsed_ms);
+    }
+    mqtt.disconnect();
+  }
+  energy.set(EC_MQTT, false);
+  if (radio && !published)
+    LOGW("MQTT not confirmed, %u frames held in RTC",
+         (unsigned)batcher.count());
+  wakeTimer.mark(WAKE_PUBLISH);
+
+  if (radio)
+    wifi.off();
+  energy.set(EC_WIFI, false);
+  wakeTimer.mark(WAKE_SHUTDOWN);
+  wakeTimer.finish(WAKE_BUDGET_MS, wifi.lastConnectFast(), published);
+  LOGI("Awake %lu ms, go to sleep", (unsigned long)wakeProfile.total_ms);
+
+#ifndef DEBUG_NO_SLEEP
+  logOut.flush();
+  energy.sleep(PARKED_WAKE_INTERVAL_US);
+  goToDeepSleep(PARKED_WAKE_INTERVAL_US, /*bleStarted*/ false);
+#endif
+}
+
 void setup() {
+  wakeTimer.begin();
+  energy.begin();
   Serial.begin(115200);
-  delay(30);
-  Serial.println("System started");
-  delay(1000);
+  esp_sleep_wakeup_cause_t cause = esp_sleep_get_wakeup_cause();
+  bool wokeFromTimer = (cause == ESP_SLEEP_WAKEUP_TIMER);
+  if (!wokeFromTimer) {
+    // Cold boot: give a serial monitor time to attach
+    delay(30);
+    LOGI("System started");
+    delay(1000);
+  }
   Wire.begin();
-  Serial.println("Wire started");
   ds.begin();
+  ds.startConversion(); // collected after the wake decision
   ina.begin();
   hall.begin();
-  Serial.println("Dallas Temp started");
 
   // --- Hall zero on first boot: apply immediately ---
   if (hallZero.load()) {
     hall.setZero(hallZero.zero_mV);
-    Serial.printf("Loaded HALL zero: %.3f mV\n", hallZero.zero_mV);
+    LOGI("Loaded HALL zero: %.3f mV", hallZero.zero_mV);
   } else {
     float z = hall.captureZeroTrimmedMean(64);
     hall.setZero(z);  // <-- apply now
     hallZero.save(z); // persist
   }
 
-  // Temperature seed
-  last_T_C = ds.readTempC();
-  Serial.print("Dallas Read Temp ");
-  Serial.println(last_T_C);
+  DrainConfig drainCfg;
+  drainCfg.stepA = DRAIN_STEP_A;
+  drainCfg.sleepMaxA = DRAIN_SLEEP_MAX_A;
+  drainCfg.abnormalA = DRAIN_ABNORMAL_A;
+  drainCfg.settleSec = DRAIN_SETTLE_SEC;
+  drainCfg.reportSec = DRAIN_REPORT_PERIOD_SEC;
+  drain.begin(drainCfg);
 
-  // BLE
-  ble.begin(BLE_DEVICE_NAME);
+  // Runtime config: one NVS read; the wake decision below uses it
+  loadRuntimeConfig();
 
   // If woke from timer and still idle → snapshot-only & back to sleep
-  bool snapshotOnly = false;
-  esp_sleep_wakeup_cause_t cause = esp_sleep_get_wakeup_cause();
-  bool wokeFromTimer = (cause == ESP_SLEEP_WAKEUP_TIMER);
-  Serial.print("Wakeup cause: ");
-  Serial.println(cause);
-
+  LOGI("Wakeup cause: %d", (int)cause);
   if (wokeFromTimer) {
+    energy.on(EC_SENSORS);
     float V0 = ina.readBusVoltage_V();
     float I0 = hall.readCurrentA(16);
+    energy.off(EC_SENSORS);
     if (isfinite(V0))
       last_V_V = V0;
     last_I_A = I0;
     bool altOn = stateDetector.alternatorOn(last_V_V);
-    bool activeNow = altOn || (fabsf(last_I_A) > BASE_CONS_THRESH_A);
-    snapshotOnly = !activeNow;
-  }
-
-  // Wi-Fi & MQTT (lwIP initialized after 500ms delay)
-  mqtt.setServer(MQTT_HOST, MQTT_PORT);
-  delay(500); // Give lwIP time to initialize
-
-  // Try WiFi connection in setup (will retry in loop if needed)
-  // Use 0 cooldown for snapshot mode (deep sleep wakeup) to ensure connection
-  uint32_t wifiCooldown = snapshotOnly ? 0 : 10000;
-  wifi.connectSmart(WIFI_SSID, WIFI_PASSWORD, wifiCooldown, /*attempts*/ 15);
-  if (wifi.connected()) {
-    mqtt.ensureConnected(MQTT_CLIENT_ID, MQTT_USER, MQTT_PASS);
-    // Initialize OTA if Wi-Fi is available. If `OTA_PASSWORD` macro is defined
-    // in your `src/secret.h`, it will be applied; otherwise OTA will run
-    // without a password.
-    ArduinoOTA.setHostname(MQTT_CLIENT_ID);
-#ifdef OTA_PASSWORD
-    ArduinoOTA.setPassword(OTA_PASSWORD);
-#endif
-    ArduinoOTA.onStart([]() { Serial.println("OTA Start TEST"); });
-    ArduinoOTA.onEnd([]() { Serial.println("OTA End"); });
-    ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) {
-      Serial.printf("OTA Progress: %u%%\r", (progress / (total / 100)));
-    });
-    ArduinoOTA.onError([](ota_error_t err) {
-      Serial.printf("OTA Error[%u]: ", (unsigned)err);
-      if (err == OTA_AUTH_ERROR)
-        Serial.println("Auth Failed");
-      else if (err == OTA_BEGIN_ERROR)
-        Serial.println("Begin Failed");
-      else if (err == OTA_CONNECT_ERROR)
-        Serial.println("Connect Failed");
-      else if (err == OTA_RECEIVE_ERROR)
-        Serial.println("Receive Failed");
-      else if (err == OTA_END_ERROR)
-        Serial.println("End Failed");
-    });
-    ArduinoOTA.begin();
-    // Publish device IP as retained message to <MQTT_TOPIC>/ip
-    {
-      IPAddress ip = WiFi.localIP();
-      char ipStr[32];
-      snprintf(ipStr, sizeof(ipStr), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
-      char ipTopic[80];
-      snprintf(ipTopic, sizeof(ipTopic), "%s/ip", MQTT_TOPIC);
-      if (mqtt.connected()) {
-        mqtt.publish(ipTopic, ipStr, true);
-        mqtt.loop();
-        delay(50);
-        // Publish Home Assistant discovery configs
-        publishHADiscovery();
-      }
+    bool activeNow = altOn || (fabsf(last_I_A) > runtimeConfig.idle_A);
+    if (!activeNow) {
+      // The snapshot current stands in for the whole sleep interval
+      runSnapshotWake(
+          drain.addSample(last_I_A, PARKED_WAKE_INTERVAL_US / 1e6f));
+      snapshotWake = false; // DEBUG_NO_SLEEP: continue with a full start
+    } else {
+      drain.endSession();
     }
   }
 
-  // Wire debug publisher
-  gRintDbg.client = mqtt.raw();
-  gRintDbg.topic = MQTT_DBG_TOPIC;
-  gRintDbg.enabled = true;                         // set false to silence
-  gRintDbg.minIntervalMs = 250;                    // per-event rate limit
-  learner.begin(INITIAL_BASELINE_mOHM, &gRintDbg); // enable when needed
-  // Load persisted battery capacity (if previously set via BLE)
-  loadBatteryCapacityFromPrefs();
+  // Temperature seed
+  energy.on(EC_SENSORS);
+  last_T_C = ds.readConversion();
+  energy.off(EC_SENSORS);
+  LOGI("Dallas Read Temp %.2f", last_T_C);
 
-  // Load SOC from NVM (battmon namespace already opened by learner)
-  Preferences prefs;
-  prefs.begin("battmon", false);
-  soc_pct = prefs.getFloat("soc_pct", 90.0f);
-  if (!isfinite(soc_pct) || soc_pct < 0.0f || soc_pct > 100.0f) {
-    soc_pct = 90.0f;
-  }
-  prefs.end();
+  // BLE
+  ble.begin(BLE_DEVICE_NAME);
+  ble.setBulkSource(&historySource);
+  energy.set(EC_BLE, true);
+
+  // Outbox of frames not yet published (LittleFS); snapshots still held in
+  // the RTC batch join it and are replayed by the net task
+  if (outboxFs.mounted() || outboxFs.begin())
+    outbox.begin();
+  loadHistory();
+  batcher.begin();
+  if (batcher.count())
+    spillSnapshotBatch();
+
+  // Wi-Fi & MQTT: the connection state machines run from the net task
+  setupMqtt();
+  wifi.setBlockedMeter(&netBlocked);
+  wifi.setFastCache(&wifiCache, /*reuse*/ false);
+  wifi.begin(WIFI_SSID, WIFI_PASSWORD);
+
+  restoreState();
 
   uint32_t now = millis();
   lastSampleMs = now;
-  lastTempMs = now;
-  lastPublishMs = now;
+  intervalStats.reset(now);
   lowCurrentAccum_s = 0.0f;
   mode = MODE_ACTIVE;
 
   stateDetector.reset();
-
-  if (snapshotOnly) {
-    float rint_mOhm = learner.lastRint_mOhm();
-    float rint25_mOhm = learner.lastRint25_mOhm();
-    float base_mOhm = learner.baseline_mOhm();
-    float soh = learner.currentSOH();
-    // Filter extreme Rint values (starter/transient artifacts)
-    float rint_mOhm_f =
-        (isfinite(rint_mOhm) && rint_mOhm <= RINT_MAX_VALID_MOHM) ? rint_mOhm
-                                                                  : base_mOhm;
-    float rint25_mOhm_f =
-        (isfinite(rint25_mOhm) && rint25_mOhm <= RINT_MAX_VALID_MOHM)
-            ? rint25_mOhm
-            : base_mOhm;
-
-    // Blend SOC with OCV (snapshot uses adaptive complementary filter too)
-    float soc_for_snapshot = soc_pct;
-    if (isfinite(last_V_V) && isfinite(last_T_C)) {
-      float v25 = compensateOCVTo25C(last_V_V, last_T_C);
-      float ocvSOC = socFromOCV_25C(v25);
-      float alpha = SOC_MIN_ALPHA + (1.0f - SOC_MIN_ALPHA) *
-                                        expf(-rest_accum_s / SOC_FILTER_TAU_S);
-      soc_for_snapshot = alpha * soc_pct + (1.0f - alpha) * ocvSOC;
-    }
-    // Estimate Ah left based on rated capacity, SOH and blended SOC
-    float soh_frac = soh;
-    if (soh_frac > 1.1f)
-      soh_frac /= 100.0f;                       // guard against percent return
-    float C_eff = batteryCapacityAh * soh_frac; // effective usable Ah
-    float ah_left_snapshot = C_eff * (soc_for_snapshot / 100.0f);
-
-    TelemetryFrame tf{
-        .mode = "snapshot",
-        .V = last_V_V,
-        .I = last_I_A,
-        .T = last_T_C,
-        .soc_pct = soc_for_snapshot,
-        .soh_pct = soh * 100.0f,
-        .Rint_mOhm = rint_mOhm_f,
-        .Rint25_mOhm = rint25_mOhm_f,
-        .RintBaseline_mOhm = base_mOhm,
-        .ah_left = ah_left_snapshot,
-        .battery_capacity_ah = batteryCapacityAh,
-        .alternator_on = stateDetector.alternatorOn(last_V_V),
-        .rest_s = (uint32_t)rest_accum_s,
-        .lowCurrentAccum_s = (uint32_t)lowCurrentAccum_s,
-        .up_ms = millis(),
-        .hasRint = (isfinite(rint_mOhm) && rint_mOhm <= RINT_MAX_VALID_MOHM),
-        .hasRint25 =
-            (isfinite(rint25_mOhm) && rint25_mOhm <= RINT_MAX_VALID_MOHM)};
-    Serial.println("Publishing snapshot telemetry");
-    Serial.printf(
-        "V: %.3f V, I: %.3f A, T: %.1f C, SOC: %.1f %%, SOH: %.1f %%\n", tf.V,
-        tf.I, tf.T, tf.soc_pct, tf.soh_pct);
-
-    // Update BLE characteristics (include Ah-left)
-    ble.update(tf.V, tf.I, tf.T, "snapshot", tf.soc_pct, tf.soh_pct,
-               tf.ah_left);
-    ble.process();
-
-    char payload[700];
-    if (buildTelemetryJson(tf, payload, sizeof(payload))) {
-      if (wifi.connected() && mqtt.connected()) {
-        mqtt.publish(MQTT_TOPIC, payload, true);
-        mqtt.loop();
-        delay(100); // Give time for message to send
-        Serial.println("MQTT message sent successfully");
-      } else {
-        Serial.println("WARNING: WiFi/MQTT not connected, message not sent");
-      }
-    }
-
-    // Properly disconnect WiFi before sleep
-    wifi.off();
-    delay(100);
-    Serial.println("go to sleep");
-
-#ifndef DEBUG_NO_SLEEP
-    goToDeepSleep(PARKED_WAKE_INTERVAL_US);
-#endif
-  }
+  applyModeCadence();
+  sched.begin();
 }
 
-// (removed duplicate HA discovery block — publishHADiscovery() already
-// publishes Ah_left)
-// ------------------------------ Loop ------------------------------
-void loop() {
-
-  uint32_t now = millis();
+// ------------------------------ Tasks ------------------------------
+// Each former loop() section is a scheduler task; see `schedTasks` above.
 
-  // Cadence by mode
-  uint32_t sampleInterval =
-      (mode == MODE_ACTIVE) ? SAMPLE_INTERVAL_MS : SAMPLE_INTERVAL_MS_IDLE;
-  uint32_t publishInterval =
-      (mode == MODE_ACTIVE) ? PUBLISH_INTERVAL_MS : PUBLISH_INTERVAL_MS_IDLE;
-
-  // --- V/I sampling ---
-  if (now - lastSampleMs >= sampleInterval) {
-    float V = ina.readBusVoltage_V();
-    //    Serial.print("Voltage ");
-    //    Serial.println(V);
-    float I = hall.readCurrentA(64); // use 64 samples for better stability
-
-    // Coulomb counting
-    if (batteryCapacityAh > 0) {
-      float dt_s = (now - lastSampleMs) / 1000.0f;
-      float I_avg = 0.5f * (last_I_A + I);
-      float dAh = I_avg * (dt_s / 3600.0f);
-      float oldSOC = soc_pct;
-      soc_pct -= (dAh / batteryCapacityAh) * 100.0f;
-      // Save to NVM if SOC changed significantly (avoid excessive writes)
-      if (fabsf(soc_pct - oldSOC) > 0.5f) {
-        Preferences prefs;
-        prefs.begin("battmon", false);
-        prefs.putFloat("soc_pct", soc_pct);
-        prefs.end();
-      }
+// V/I sampling, coulomb counting, rest/parked detection
+void taskSample(uint32_t now) {
+  energy.on(EC_SENSORS);
+  float V, I;
+  {
+    PROF_SCOPE(profIna);
+    V = ina.readBusVoltage_V();
+  }
+  {
+    PROF_SCOPE(profHall);
+    I = hall.readCurrentA(64); // use 64 samples for better stability
+  }
+  energy.off(EC_SENSORS);
+  intervalStats.add(V, I, now);
+  web.push(now, V, I);
+  float rint_mOhm = learner.lastRint_mOhm();
+  if (!(rint_mOhm <= RINT_MAX_VALID_MOHM))
+    rint_mOhm = NAN; // transient artifacts stay out of the history
+  if (history.add(wallClock(), V, I, last_T_C, soc_pct, rint_mOhm))
+    historySaveDue = true; // an hour closed
+
+  // Coulomb counting
+  float capAh = usableCapacityAh(1.0f);
+  if (capAh > 0) {
+    float dt_s = (now - lastSampleMs) / 1000.0f;
+    float I_avg = 0.5f * (last_I_A + I);
+    float dAh = I_avg * (dt_s / 3600.0f);
+    float oldSOC = soc_pct;
+    soc_pct -= (dAh / capAh) * 100.0f;
+    capLearner.addCharge(dAh);
+    // Save to NVM if SOC changed significantly (avoid excessive writes)
+    if (fabsf(soc_pct - oldSOC) > 0.5f) {
+      Preferences prefs;
+      prefs.begin("battmon", false);
+      prefs.putFloat("soc_pct", soc_pct);
+      prefs.end();
     }
+  }
 
-    // Rest accumulation for OCV correction
+  // Rest accumulation for OCV correction
 
-    float dt_s = (now - lastSampleMs) / 1000.0f;
-    if (fabsf(I) < REST_CURRENT_THRESH_A && !stateDetector.alternatorOn(V)) {
-      rest_accum_s += dt_s;
+  float dt_s = (now - lastSampleMs) / 1000.0f;
+  if (fabsf(I) < runtimeConfig.rest_A && !stateDetector.alternatorOn(V)) {
+    rest_accum_s += dt_s;
+    rest_reset_accum_s = 0.0f;
+  } else {
+    // brief spikes should not immediately clear the rest accumulator — only
+    // clear if non-rest condition persists for REST_RESET_GRACE_SEC seconds
+    rest_reset_accum_s += dt_s;
+    if (rest_reset_accum_s >= (float)REST_RESET_GRACE_SEC) {
+      rest_accum_s = 0.0f;
       rest_reset_accum_s = 0.0f;
-    } else {
-      // brief spikes should not immediately clear the rest accumulator — only
-      // clear if non-rest condition persists for REST_RESET_GRACE_SEC seconds
-      rest_reset_accum_s += dt_s;
-      if (rest_reset_accum_s >= (float)REST_RESET_GRACE_SEC) {
-        rest_accum_s = 0.0f;
-        rest_reset_accum_s = 0.0f;
-      }
     }
+  }
 
-    // Parked/Idle detection
-    bool altOn = stateDetector.alternatorOn(V);
-    bool activity = stateDetector.hasRecentActivity(I, now);
+  // Parked/Idle detection
+  bool altOn = stateDetector.alternatorOn(V);
+  bool activity = stateDetector.hasRecentActivity(I, now);
 
 #ifdef DEBUG_STATE_DETECTOR
-    Serial.print("StateDetector: ");
-    Serial.print("altOn=");
-    Serial.print(altOn ? "true" : "false");
-    Serial.print(", activity=");
-    Serial.println(activity ? "true" : "false");
-
-    Serial.print("!altOn && fabsf(I):  ");
-    Serial.print((!altOn && fabsf(I)));
+  LOGD("StateDetector: altOn=%s, activity=%s, !altOn && fabsf(I): %d",
+       altOn ? "true" : "false", activity ? "true" : "false",
+       (int)(!altOn && fabsf(I)));
 #endif
-    if (!altOn && fabsf(I) < BASE_CONS_THRESH_A && !activity) {
-      lowCurrentAccum_s += (now - lastSampleMs) / 1000.0f;
+  if (!altOn && fabsf(I) < runtimeConfig.idle_A && !activity) {
+    lowCurrentAccum_s += (now - lastSampleMs) / 1000.0f;
 #ifdef DEBUG_STATE_DETECTOR
-      Serial.print(":  lowCurrentAccum_s=");
-      Serial.print(lowCurrentAccum_s);
-      Serial.print(": Mode ");
-      Serial.println((mode == MODE_ACTIVE) ? "ACTIVE" : "PARKED-IDLE");
+    LOGD("lowCurrentAccum_s=%.2f: Mode %s", lowCurrentAccum_s,
+         (mode == MODE_ACTIVE) ? "ACTIVE" : "PARKED-IDLE");
 #endif
-    } else {
-      lowCurrentAccum_s = 0.0f;
-      if (mode == MODE_PARKED_IDLE)
-        mode = MODE_ACTIVE; // exit parked-idle on activity
+  } else {
+    lowCurrentAccum_s = 0.0f;
+    if (mode == MODE_PARKED_IDLE) {
+      mode = MODE_ACTIVE; // exit parked-idle on activity
+      drain.endSession();
     }
+  }
 
-    // Enter Parked&Idle after dwell
-    if (mode == MODE_ACTIVE &&
-        lowCurrentAccum_s >= (float)PARKED_IDLE_ENTRY_DWELL_SEC) {
-      mode = MODE_PARKED_IDLE;
-      parkedIdleEnterMs = now;
-      if (WiFi.status() == WL_CONNECTED && mqtt.connected()) {
-        mqtt.publish(MQTT_TOPIC, "{\"mode\":\"parked-idle\"}", true);
-        mqtt.loop();
-      }
+  // Enter Parked&Idle after dwell
+  if (mode == MODE_ACTIVE &&
+      lowCurrentAccum_s >= (float)PARKED_IDLE_ENTRY_DWELL_SEC) {
+    mode = MODE_PARKED_IDLE;
+    parkedIdleEnterMs = now;
+    drain.beginSession();
+    if (WiFi.status() == WL_CONNECTED && mqtt.connected()) {
+      mqtt.publish(MQTT_TOPIC, "{\"mode\":\"parked-idle\"}", true);
+      mqtt.loop();
     }
+  }
 
-    // Clamp SOC
-    if (!isfinite(soc_pct))
-      soc_pct = 50.0f;
-    soc_pct = fmaxf(0.0f, fminf(100.0f, soc_pct));
-
-    // Update “last” values once per tick (canonical spot)
-    if (isfinite(V))
-      last_V_V = V;
-    last_I_A = I;
-    lastSampleMs = now;
-
-    // Feed learner with the current sample (either V/I or last_*)
-    if (fabsf(last_I_A) <= RINT_INGEST_MAX_I_A) {
-      learner.ingest(last_V_V, last_I_A, (isfinite(last_T_C) ? last_T_C : NAN),
-                     now);
-    }
+  // Quiescent-current statistics while parked
+  if (mode == MODE_PARKED_IDLE)
+    publishDrainEvents(drain.addSample(I, dt_s));
 
-    // Debug: Show if Rint was calculated (ignore extreme spike values)
-    static float prevRint = NAN;
-    float currRint = learner.lastRint_mOhm();
-    float currRint25 = learner.lastRint25_mOhm();
-    if (isfinite(currRint) && currRint <= RINT_MAX_VALID_MOHM &&
-        currRint != prevRint) {
-      Serial.printf("*** NEW RINT CALCULATED: %.2f mOhm (25C: %.2f mOhm) ***\n",
-                    currRint, currRint25);
-      prevRint = currRint;
-    }
-  }
+  // Clamp SOC
+  if (!isfinite(soc_pct))
+    soc_pct = 50.0f;
+  soc_pct = fmaxf(0.0f, fminf(100.0f, soc_pct));
 
-  // --- Temperature @1 Hz ---
-  if (now - lastTempMs >= TEMP_INTERVAL_MS) {
-    float tC = ds.readTempC();
-    if (isfinite(tC))
-      last_T_C = tC;
-
-    bool altOff = !stateDetector.alternatorOn(last_V_V);
-    if (altOff && rest_accum_s >= (float)REST_DETECT_SEC &&
-        isfinite(last_V_V)) {
-      float v25 = compensateOCVTo25C(last_V_V, last_T_C);
-      float ocvSOC = socFromOCV_25C(v25);
-      float oldSOC = soc_pct;
-      // Adaptive complementary filter: weight coulomb SOC by alpha that
-      // decreases as rest_accum_s grows (trust OCV more when rested).
-      float alpha = SOC_MIN_ALPHA + (1.0f - SOC_MIN_ALPHA) *
-                                        expf(-rest_accum_s / SOC_FILTER_TAU_S);
-      float newSoc = alpha * soc_pct + (1.0f - alpha) * ocvSOC;
-      soc_pct = fmaxf(0.0f, fminf(100.0f, newSoc));
-      // Save to NVM after OCV correction if it moved significantly
-      if (fabsf(soc_pct - oldSOC) > 0.5f) {
-        Preferences prefs;
-        prefs.begin("battmon", false);
-        prefs.putFloat("soc_pct", soc_pct);
-        prefs.end();
-      }
-    }
-    lastTempMs = now;
+  // Current step: publish now instead of at the next publish slot
+  if (fabsf(I - last_I_A) >= STEP_ACTIVITY_DI_A) {
+    reportEvent = true;
+    sched.releaseNow(TASK_PUBLISH);
   }
 
-  // --- Publish after sampling ---
+  // Update “last” values once per tick (canonical spot)
+  if (isfinite(V))
+    last_V_V = V;
+  last_I_A = I;
+  lastSampleMs = now;
 
-  if (now - lastPublishMs >= publishInterval) {
+  // Feed learner with the current sample (either V/I or last_*)
+  if (fabsf(last_I_A) <= RINT_INGEST_MAX_I_A) {
+    PROF_SCOPE(profIngest);
+    learner.ingest(last_V_V, last_I_A, (isfinite(last_T_C) ? last_T_C : NAN),
+                   now);
+  }
 
-    if (!wifi.connected()) {
-      // Serial.println("WiFi not connected, try connect");
-      wifi.connectSmart(WIFI_SSID, WIFI_PASSWORD, 10000, 10);
-    }
-    if (wifi.connected() && !mqtt.connected()) {
-      // Serial.println("MQTT not connected, try connect");
-      mqtt.ensureConnected(MQTT_CLIENT_ID, MQTT_USER, MQTT_PASS);
-      // Initialize OTA if not already initialized
-      if (!otaInitialized) {
-        ArduinoOTA.setHostname(MQTT_CLIENT_ID);
-#ifdef OTA_PASSWORD
-        ArduinoOTA.setPassword(OTA_PASSWORD);
-#endif
-        ArduinoOTA.onStart([]() { Serial.println("OTA Start"); });
-        ArduinoOTA.onEnd([]() { Serial.println("OTA End"); });
-        ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) {
-          Serial.printf("OTA Progress: %u%%\r", (progress / (total / 100)));
-        });
-        ArduinoOTA.onError([](ota_error_t err) {
-          Serial.printf("OTA Error[%u]: ", (unsigned)err);
-          if (err == OTA_AUTH_ERROR)
-            Serial.println("Auth Failed");
-          else if (err == OTA_BEGIN_ERROR)
-            Serial.println("Begin Failed");
-          else if (err == OTA_CONNECT_ERROR)
-            Serial.println("Connect Failed");
-          else if (err == OTA_RECEIVE_ERROR)
-            Serial.println("Receive Failed");
-          else if (err == OTA_END_ERROR)
-            Serial.println("End Failed");
-        });
-        ArduinoOTA.begin();
-        otaInitialized = true;
-        Serial.println("ArduinoOTA initialized (on reconnect)");
-      }
-      // Publish/refresh device IP as retained message to <MQTT_TOPIC>/ip after
-      // reconnect
-      {
-        IPAddress ip = WiFi.localIP();
-        char ipStr[32];
-        snprintf(ipStr, sizeof(ipStr), "%u.%u.%u.%u", ip[0], ip[1], ip[2],
-                 ip[3]);
-        char ipTopic[80];
-        snprintf(ipTopic, sizeof(ipTopic), "%s/ip", MQTT_TOPIC);
-        if (mqtt.connected()) {
-          mqtt.publish(ipTopic, ipStr, true);
-          mqtt.loop();
-          // Refresh Home Assistant discovery configs on reconnect
-          publishHADiscovery();
-        }
-      }
-    }
+  // Debug: Show if Rint was calculated (ignore extreme spike values)
+  static float prevRint = NAN;
+  float currRint = learner.lastRint_mOhm();
+  float currRint25 = learner.lastRint25_mOhm();
+  if (isfinite(currRint) && currRint <= RINT_MAX_VALID_MOHM &&
+      currRint != prevRint) {
+    LOGI("*** NEW RINT CALCULATED: %.2f mOhm (25C: %.2f mOhm) ***", currRint,
+         currRint25);
+    prevRint = currRint;
+  }
 
-    // Serial.println("prepare to send");
+  applyModeCadence();
+}
 
-    bool altOn = stateDetector.alternatorOn(last_V_V);
-    float lastRint = learner.lastRint_mOhm();
-    float lastRint25 = learner.lastRint25_mOhm();
-    float baseR = learner.baseline_mOhm();
-    float soh = learner.currentSOH();
-    // Filter extreme Rint values (starter/transient artifacts)
-    float lastRint_f = (isfinite(lastRint) && lastRint <= RINT_MAX_VALID_MOHM)
-                           ? lastRint
-                           : baseR;
-    float lastRint25_f =
-        (isfinite(lastRint25) && lastRint25 <= RINT_MAX_VALID_MOHM) ? lastRint25
-                                                                    : baseR;
-
-    // Blend SOC with OCV before Ah calculation
-    float soc_for_publish = soc_pct;
-    if (isfinite(last_V_V) && isfinite(last_T_C)) {
-      float v25 = compensateOCVTo25C(last_V_V, last_T_C);
-      float ocvSOC = socFromOCV_25C(v25);
-      float alpha = SOC_MIN_ALPHA + (1.0f - SOC_MIN_ALPHA) *
-                                        expf(-rest_accum_s / SOC_FILTER_TAU_S);
-      soc_for_publish = alpha * soc_pct + (1.0f - alpha) * ocvSOC;
-    }
-    // Estimate Ah left based on rated capacity, SOH and blended SOC
-    float soh_frac = soh;
-    if (soh_frac > 1.1f)
-      soh_frac /= 100.0f;
-    float C_eff = batteryCapacityAh * soh_frac;
-    float ah_left = C_eff * (soc_for_publish / 100.0f);
-
-    Serial.print("Mode:  ");
-    Serial.print((mode == MODE_ACTIVE) ? "ACTIVE" : "PARKED-IDLE");
-    Serial.print(" %, SOH: ");
-    Serial.print(soh * 100.0f);
-    Serial.print(" %, SOC: ");
-    Serial.print(soc_pct * 1.0f);
-    Serial.printf(" Rint: %.2f mOhm, Rint25: %.2f mOhm, BaseR: %.2f mOhm\n",
-                  lastRint_f, lastRint25_f, baseR);
-    Serial.println();
-
-    TelemetryFrame tf{
-        .mode = (mode == MODE_ACTIVE ? "active" : "parked-idle"),
-        .V = last_V_V,
-        .I = last_I_A,
-        .T = last_T_C,
-        .soc_pct = soc_for_publish,
-        .soh_pct = soh * 100.0f,
-        .Rint_mOhm = lastRint_f,
-        .Rint25_mOhm = lastRint25_f,
-        .RintBaseline_mOhm = baseR,
-        .ah_left = ah_left,
-        .battery_capacity_ah = batteryCapacityAh,
-        .alternator_on = altOn,
-        .rest_s = (uint32_t)rest_accum_s,
-        .lowCurrentAccum_s = (uint32_t)lowCurrentAccum_s,
-        .up_ms = now,
-        .hasRint = (isfinite(lastRint) && lastRint <= RINT_MAX_VALID_MOHM),
-        .hasRint25 =
-            (isfinite(lastRint25) && lastRint25 <= RINT_MAX_VALID_MOHM)};
-
-    char payload[700];
-    if (buildTelemetryJson(tf, payload, sizeof(payload))) {
-      // Serial.printf("Payload length: %u", (unsigned)strlen(payload));
-      // Serial.println("");
-
-      // Call loop() to keep connection alive before publish
-      mqtt.loop();
-      delay(10);
+// Alternator ripple burst while charging
+void taskRipple(uint32_t now) {
+  if (mode == MODE_ACTIVE && stateDetector.alternatorOn(last_V_V) &&
+      now - lastRippleMs >= RIPPLE_INTERVAL_MS) {
+    EnergyScope e(energy, EC_SENSORS);
+    runRippleCapture();
+    lastRippleMs = now;
+  }
+}
 
-      mqtt.publish(MQTT_TOPIC, payload, false);
-      mqtt.loop();
+// Temperature @1 Hz and rested OCV correction
+void taskTemperature(uint32_t now) {
+  energy.on(EC_SENSORS);
+  float tC = ds.readTempC();
+  energy.off(EC_SENSORS);
+  if (isfinite(tC))
+    last_T_C = tC;
+
+  bool altOff = !stateDetector.alternatorOn(last_V_V);
+  if (altOff && rest_accum_s >= (float)REST_DETECT_SEC &&
+      isfinite(last_V_V)) {
+    float v25 = compensateOCVTo25C(last_V_V, last_T_C);
+    float ocvSOC = socFromOCV_25C(v25);
+    float oldSOC = soc_pct;
+    // Adaptive complementary filter: weight coulomb SOC by alpha that
+    // decreases as rest_accum_s grows (trust OCV more when rested).
+    float alpha = SOC_MIN_ALPHA + (1.0f - SOC_MIN_ALPHA) *
+                                      expf(-rest_accum_s / SOC_FILTER_TAU_S);
+    float newSoc = alpha * soc_pct + (1.0f - alpha) * ocvSOC;
+    soc_pct = fmaxf(0.0f, fminf(100.0f, newSoc));
+    // Save to NVM after OCV correction if it moved significantly
+    if (fabsf(soc_pct - oldSOC) > 0.5f) {
+      Preferences prefs;
+      prefs.begin("battmon", false);
+      prefs.putFloat("soc_pct", soc_pct);
+      prefs.end();
+    }
+    // One capacity-learning point per rest period, once well relaxed
+    if (!capRestPointTaken && rest_accum_s >= (float)CAPACITY_REST_SEC) {
+      onCapacityRestPoint(ocvSOC);
+      capRestPointTaken = true;
     }
+  }
+  if (rest_accum_s < (float)CAPACITY_REST_SEC)
+    capRestPointTaken = false;
+}
 
-    ble.update(last_V_V, last_I_A, last_T_C, tf.mode, soc_pct, soh * 100.0f,
-               ah_left);
-    ble.process();
+// Build the telemetry frame and queue it for the net task
+void taskPublish(uint32_t now) {
+  // Serial.println("prepare to send");
+
+  bool altOn = stateDetector.alternatorOn(last_V_V);
+  float lastRint = learner.lastRint_mOhm();
+  float lastRint25 = learner.lastRint25_mOhm();
+  float baseR = learner.baseline_mOhm();
+  float soh = learner.currentSOH();
+  // Filter extreme Rint values (starter/transient artifacts)
+  float lastRint_f = (isfinite(lastRint) && lastRint <= RINT_MAX_VALID_MOHM)
+                         ? lastRint
+                         : baseR;
+  float lastRint25_f =
+      (isfinite(lastRint25) && lastRint25 <= RINT_MAX_VALID_MOHM) ? lastRint25
+                                                                  : baseR;
+
+  // Blend SOC with OCV before Ah calculation
+  float soc_for_publish = soc_pct;
+  if (isfinite(last_V_V) && isfinite(last_T_C)) {
+    float v25 = compensateOCVTo25C(last_V_V, last_T_C);
+    float ocvSOC = socFromOCV_25C(v25);
+    float alpha = SOC_MIN_ALPHA + (1.0f - SOC_MIN_ALPHA) *
+                                      expf(-rest_accum_s / SOC_FILTER_TAU_S);
+    soc_for_publish = alpha * soc_pct + (1.0f - alpha) * ocvSOC;
+  }
+  // Estimate Ah left based on rated capacity, SOH and blended SOC
+  float soh_frac = soh;
+  if (soh_frac > 1.1f)
+    soh_frac /= 100.0f;
+  float C_eff = usableCapacityAh(soh_frac);
+  float ah_left = C_eff * (soc_for_publish / 100.0f);
+
+  LOGI("Mode: %s, SOH: %.2f %%, SOC: %.2f %%, Rint: %.2f mOhm, "
+       "Rint25: %.2f mOhm, BaseR: %.2f mOhm",
+       (mode == MODE_ACTIVE) ? "ACTIVE" : "PARKED-IDLE", soh * 100.0f,
+       soc_pct, lastRint_f, lastRint25_f, baseR);
+
+  TelemetryFrame tf{
+      .mode = (mode == MODE_ACTIVE ? "active" : "parked-idle"),
+      .V = last_V_V,
+      .I = last_I_A,
+      .T = last_T_C,
+      .soc_pct = soc_for_publish,
+      .soh_pct = soh * 100.0f,
+      .Rint_mOhm = lastRint_f,
+      .Rint25_mOhm = lastRint25_f,
+      .RintBaseline_mOhm = baseR,
+      .ah_left = ah_left,
+      .battery_capacity_ah = batteryCapacityAh,
+      .alternator_on = altOn,
+      .rest_s = (uint32_t)rest_accum_s,
+      .lowCurrentAccum_s = (uint32_t)lowCurrentAccum_s,
+      .up_ms = now,
+      .hasRint = (isfinite(lastRint) && lastRint <= RINT_MAX_VALID_MOHM),
+      .hasRint25 =
+          (isfinite(lastRint25) && lastRint25 <= RINT_MAX_VALID_MOHM),
+      .net_blocked_ms_h = netBlocked.lastHour_ms(),
+      .hasStats = true,
+      .stats = intervalStats.stats()};
+
+  // Hand over to the net task; a newer frame replaces one not yet sent
+  // Unchanged frames are only sent with the heartbeat
+  uint32_t heartbeat = (mode == MODE_ACTIVE) ? REPORT_HEARTBEAT_MS
+                                             : REPORT_HEARTBEAT_MS_IDLE;
+  bool report = !REPORT_BY_EXCEPTION ||
+                reportPolicy.check(tf, now, reportEvent, heartbeat) != RR_NONE;
+  reportEvent = false;
+  if (report) {
+    reportPolicy.sent(tf, now);
+    intervalStats.reset(now); // the next frame covers what follows
+  }
+  if (report && (telemetryEncoding & TELEMETRY_ENC_JSON)) {
+    telemetryFrame = tf;
+    telemetryPending = true;
+  }
+  if (report && (telemetryEncoding & TELEMETRY_ENC_CBOR)) {
+    PROF_SCOPE(profCbor);
+    telemetryCborLen =
+        encodeTelemetryCbor(tf, telemetryCbor, sizeof(telemetryCbor));
+  }
+  // Offline: keep one frame per OUTBOX_STORE_INTERVAL_MS for later replay
+  if (!mqtt.connected() &&
+      now - lastOutboxStoreMs >= OUTBOX_STORE_INTERVAL_MS) {
+    storeTelemetry(tf);
+    lastOutboxStoreMs = now;
+  }
+
+  {
+    PROF_SCOPE(profBle);
+    ble.update(tf, now);
+  }
+  // Flush a drain report left pending from a snapshot wake without MQTT
+  publishDrainEvents(DRAIN_EVT_NONE);
 #if DEBUG_POWER_MANAGEMENT
-    Serial.print("Voltage:");
-    Serial.print(last_V_V);
-    Serial.print(", Current:");
-    Serial.print(last_I_A);
-    Serial.print(" Time (s): ");
-    Serial.println((now - parkedIdleEnterMs) / 1000);
+  LOGD("Voltage:%.2f, Current:%.2f Time (s): %lu", last_V_V, last_I_A,
+       (unsigned long)((now - parkedIdleEnterMs) / 1000));
+#endif
+}
+
+// 5h timer: Parked&Idle → Deep Sleep (10 min cadence)
+void taskParkedTimer(uint32_t now) {
+  if (mode != MODE_PARKED_IDLE)
+    return;
+#if DEBUG_PARKED_IDLE
+  static uint32_t lastParkedPrintMs = 0;
+  if (now - lastParkedPrintMs >= 1000) {
+    LOGD("Parked&Idle time (s): %lu, time to deep sleep (s): %lu",
+         (unsigned long)((now - parkedIdleEnterMs) / 1000),
+         (unsigned long)((runtimeConfig.parkedMax_ms -
+                          (now - parkedIdleEnterMs)) /
+                         1000));
+    lastParkedPrintMs = now;
+  }
 #endif
 
-    if (mqtt.connected()) {
+  // Ensure we respect a configured timeout but never sleep before
+  // `MIN_PARKED_IDLE_BEFORE_SLEEP_MS` has elapsed after entering Parked&Idle.
+  const uint64_t parkedMax_ms = runtimeConfig.parkedMax_ms;
+  uint64_t effectiveTimeout = (parkedMax_ms >= MIN_PARKED_IDLE_BEFORE_SLEEP_MS)
+                                  ? parkedMax_ms
+                                  : MIN_PARKED_IDLE_BEFORE_SLEEP_MS;
+  if ((now - parkedIdleEnterMs) >= effectiveTimeout) {
+    if (WiFi.status() == WL_CONNECTED && mqtt.connected()) {
+      char msg[160];
+      snprintf(msg, sizeof(msg),
+               "{\"mode\":\"parked-sleep\",\"sleep_s\":%lu}",
+               (unsigned long)(PARKED_WAKE_INTERVAL_US / 1000000ULL));
+      mqtt.publish(MQTT_TOPIC, msg, true);
+      // publish() only queues: wait for the broker's acknowledgement of
+      // everything queued, then close the session cleanly
+      if (!mqtt.sync(MQTT_SYNC_TIMEOUT_MS))
+        LOGW("MQTT: parked-sleep not confirmed before sleep");
+      mqtt.disconnect();
     }
-    lastPublishMs = now;
+    saveHistory();
+    sleepRest_s = rest_accum_s; // snapshot wakes continue the rest period
+    sleepRestPointTaken = capRestPointTaken;
+    logOut.flush();
+    energy.sleep(PARKED_WAKE_INTERVAL_US);
+    goToDeepSleep(PARKED_WAKE_INTERVAL_US);
   }
+}
 
-  // --- 5h timer: Parked&Idle → Deep Sleep (10 min cadence) ---
-  if (mode == MODE_PARKED_IDLE) {
-#if DEBUG_PARKED_IDLE
-    static uint32_t lastParkedPrintMs = 0;
-    if (now - lastParkedPrintMs >= 1000) {
-      Serial.print("Parked&Idle time (s): ");
-      Serial.print((now - parkedIdleEnterMs) / 1000);
-      Serial.println();
-      Serial.print("Time to deep sleep (s): ");
-      Serial.print((PARKED_IDLE_MAX_MS - (now - parkedIdleEnterMs)) / 1000);
-      Serial.println();
-      lastParkedPrintMs = now;
+// Wi-Fi/MQTT state machines, OTA and the telemetry send. Never waits for
+// the network: MQTT connects in the background and publishes only queue.
+void taskNetService(uint32_t now) {
+  wifi.service(now);
+  energy.set(EC_WIFI_CONNECT, wifi.state() == WiFiMgr::WIFI_ST_CONNECTING);
+  energy.set(EC_WIFI, wifi.connected());
+  if (wifi.connected()) {
+    startSntp();
+    if (!otaInitialized)
+      setupOta();
+    logOut.attachWeb(web.server()); // handlers before the server starts
+    web.begin();
+  }
+  {
+    EnergyScope e(energy, EC_MQTT);
+    {
+      PROF_SCOPE(profMqtt);
+      mqtt.service(now, wifi.connected());
     }
-#endif
+    if (telemetryPending) {
+      PROF_STACK_SCOPE(stackPublish, STACK_PROBE_BYTES);
+      if (publishTelemetryJson(MQTT_TOPIC, telemetryFrame, false))
+        telemetryPending = false;
+    }
+    if (telemetryCborLen && mqtt.publish(MQTT_CBOR_TOPIC, telemetryCbor,
+                                         telemetryCborLen, false))
+      telemetryCborLen = 0;
+    if (!telemetryPending && !telemetryCborLen)
+      replayOutbox(OUTBOX_REPLAY_BUDGET_MS);
+    publishHistoryPage();
+    publishEnergyReport();
+  }
+  if (historySaveDue)
+    saveHistory(); // off the sample task: a ~7 KB flash write
+  netBlocked.tick(now);
+  EnergyScope e(energy, EC_OTA);
+  PROF_SCOPE(profOta);
+  ArduinoOTA.handle();
+}
 
-    // Ensure we respect a configured timeout but never sleep before
-    // `MIN_PARKED_IDLE_BEFORE_SLEEP_MS` has elapsed after entering Parked&Idle.
-    uint64_t effectiveTimeout =
-        (PARKED_IDLE_MAX_MS >= MIN_PARKED_IDLE_BEFORE_SLEEP_MS)
-            ? PARKED_IDLE_MAX_MS
-            : MIN_PARKED_IDLE_BEFORE_SLEEP_MS;
-    if ((now - parkedIdleEnterMs) >= effectiveTimeout) {
-      if (WiFi.status() == WL_CONNECTED && mqtt.connected()) {
-        char msg[160];
-        snprintf(msg, sizeof(msg),
-                 "{\"mode\":\"parked-sleep\",\"sleep_s\":%lu}",
-                 (unsigned long)(PARKED_WAKE_INTERVAL_US / 1000000ULL));
-        mqtt.publish(MQTT_TOPIC, msg, true);
-        mqtt.loop();
-        delay(50);
-      }
-      goToDeepSleep(PARKED_WAKE_INTERVAL_US);
+// BLE history transfer: control writes and the next DATA notifications
+void taskBleBulk(uint32_t now) { ble.serviceTransfer(now); }
+
+// Pending samples to the dashboard WebSocket clients
+void taskWeb(uint32_t now) { web.service(); }
+
+// Per-task scheduler statistics on the debug topic
+void taskSchedStats(uint32_t now) {
+  if (!mqtt.connected())
+    return;
+  char js[200];
+  for (int i = 0; i < sched.count(); ++i) {
+    if (buildSchedTaskJson(sched.task(i), js, sizeof(js)))
+      mqtt.publish(MQTT_SCHED_TOPIC, js, false);
+  }
+  if (buildReportJson(reportPolicy, js, sizeof(js)))
+    mqtt.publish(MQTT_SCHED_TOPIC, js, false);
+  if (buildBleStatsJson(ble.notifications(), ble.suppressed(),
+                        ble.connectedMs(now), js, sizeof(js)))
+    mqtt.publish(MQTT_SCHED_TOPIC, js, false);
+  if (buildCommandQueueJson(ble.commands(), "ble_cmd", js, sizeof(js)))
+    mqtt.publish(MQTT_SCHED_TOPIC, js, false);
+  if (buildCommandQueueJson(ble.localCommands(), "local_cmd", js,
+                            sizeof(js)))
+    mqtt.publish(MQTT_SCHED_TOPIC, js, false);
+}
+
+// ------------------------------ Loop ------------------------------
+// Commands typed on the USB serial console, one per line
+static void pollSerialCommands() {
+  static char line[48];
+  static size_t len = 0;
+  static bool overlong = false;
+  while (Serial.available() > 0) {
+    char c = (char)Serial.read();
+    if (c != '\n' && c != '\r') {
+      if (len < sizeof(line))
+        line[len++] = c;
+      else
+        overlong = true;
+      continue;
     }
+    if (len) // an overlong line answers UNKNOWN_CMD
+      ble.submitCommand(line, overlong ? 0 : len, CMD_SRC_SERIAL);
+    len = 0;
+    overlong = false;
   }
+}
 
-  ArduinoOTA.handle();
-  mqtt.loop();
+// Commands every pass; log output only when no task is due
+void loop() {
+  pollSerialCommands();
+  ble.process();
+  if (sched.runOnce() < 0)
+    logOut.drain(LOG_DRAIN_BUDGET_US);
 }
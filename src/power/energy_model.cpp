@@ -0,0 +1,139 @@
+#include "energy_model.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+static constexpr uint32_t ENERGY_MAGIC = 0x454E5247; // "ENRG"
+static const char *const COMP_KEYS[EC_COMPONENTS] = {
+    "sensors_ms", "wifi_connect_ms", "wifi_ms", "mqtt_ms", "ble_ms", "ota_ms"};
+
+void EnergyMeter::begin() {
+  if (_l.magic != ENERGY_MAGIC) {
+    memset(&_l, 0, sizeof(_l));
+    _l.magic = ENERGY_MAGIC;
+    _l.lastDay_mAh = NAN;
+  }
+  _lastUs = _us();
+  _fracUs = 0;
+  memset(_depth, 0, sizeof(_depth));
+}
+
+void EnergyMeter::on(EnergyComp c) {
+  if (c >= EC_COMPONENTS)
+    return;
+  tick();
+  if (_depth[c] < 255)
+    _depth[c]++;
+}
+
+void EnergyMeter::off(EnergyComp c) {
+  if (c >= EC_COMPONENTS)
+    return;
+  tick();
+  if (_depth[c])
+    _depth[c]--;
+}
+
+void EnergyMeter::set(EnergyComp c, bool active) {
+  if (c >= EC_COMPONENTS || (_depth[c] != 0) == active)
+    return;
+  tick();
+  _depth[c] = active ? 1 : 0;
+}
+
+void EnergyMeter::tick() {
+  uint64_t now = _us();
+  _fracUs += now - _lastUs;
+  _lastUs = now;
+  uint32_t ms = (uint32_t)(_fracUs / 1000u);
+  if (!ms)
+    return;
+  _fracUs -= (uint64_t)ms * 1000u;
+  charge(ms, false);
+}
+
+void EnergyMeter::sleep(uint64_t interval_us) {
+  tick();
+  charge((uint32_t)(interval_us / 1000u), true);
+}
+
+void EnergyMeter::charge(uint32_t ms, bool asleep) {
+  EnergyWindow *ws[2] = {&_l.hour, &_l.day};
+  for (EnergyWindow *w : ws) {
+    if (asleep) {
+      w->sleep_ms += ms;
+      continue;
+    }
+    w->awake_ms += ms;
+    bool any = false;
+    for (int c = 0; c < EC_COMPONENTS; ++c) {
+      if (_depth[c]) {
+        w->comp_ms[c] += ms;
+        any = true;
+      }
+    }
+    if (!any)
+      w->idle_ms += ms;
+  }
+  roll();
+}
+
+void EnergyMeter::roll() {
+  if (_l.hour.awake_ms + _l.hour.sleep_ms >= HOUR_MS) {
+    _l.lastHour = _l.hour;
+    memset(&_l.hour, 0, sizeof(_l.hour));
+    _l.reportPending = true;
+  }
+  uint32_t dayMs = _l.day.awake_ms + _l.day.sleep_ms;
+  if (dayMs >= DAY_MS) {
+    _l.lastDay_mAh = mAh(_l.day);
+    _l.lastDay_ms = dayMs;
+    memset(&_l.day, 0, sizeof(_l.day));
+  }
+}
+
+float EnergyMeter::mAh(const EnergyWindow &w) const {
+  // mA x ms -> mAh
+  double q =
+      (double)_m.awake_mA * w.awake_ms + (double)_m.sleep_mA * w.sleep_ms;
+  for (int c = 0; c < EC_COMPONENTS; ++c)
+    q += (double)_m.extra_mA[c] * w.comp_ms[c];
+  return (float)(q / 3.6e6);
+}
+
+float EnergyMeter::avg_mA(const EnergyWindow &w) const {
+  uint32_t ms = w.awake_ms + w.sleep_ms;
+  return ms ? mAh(w) * 3.6e6f / ms : NAN;
+}
+
+bool buildEnergyJson(const EnergyMeter &m, char *out, size_t outLen) {
+  const EnergyLedger &l = m.ledger();
+  const EnergyWindow &h = l.lastHour;
+  uint32_t hMs = h.awake_ms + h.sleep_ms;
+  if (!hMs)
+    return false;
+  // Normalized to a full hour / day, as windows close on the first charge
+  // past the boundary (e.g. a 5 min sleep)
+  float mAh_h = m.mAh(h) * (float)EnergyMeter::HOUR_MS / hMs;
+  int k = snprintf(out, outLen,
+                   "{\"mAh_h\":%.3f,\"avg_mA\":%.2f,\"awake_ms\":%lu,"
+                   "\"idle_ms\":%lu,\"sleep_ms\":%lu",
+                   mAh_h, m.avg_mA(h), (unsigned long)h.awake_ms,
+                   (unsigned long)h.idle_ms, (unsigned long)h.sleep_ms);
+  if (k <= 0 || (size_t)k >= outLen)
+    return false;
+  size_t n = k;
+  for (int c = 0; c < EC_COMPONENTS; ++c) {
+    k = snprintf(out + n, outLen - n, ",\"%s\":%lu", COMP_KEYS[c],
+                 (unsigned long)h.comp_ms[c]);
+    if (k <= 0 || (size_t)k >= outLen - n)
+      return false;
+    n += k;
+  }
+  if (isfinite(l.lastDay_mAh) && l.lastDay_ms)
+    k = snprintf(out + n, outLen - n, ",\"mAh_day\":%.2f}",
+                 l.lastDay_mAh * (float)EnergyMeter::DAY_MS / l.lastDay_ms);
+  else
+    k = snprintf(out + n, outLen - n, ",\"mAh_day\":null}");
+  return k > 0 && (size_t)k < outLen - n;
+}
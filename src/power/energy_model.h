@@ -0,0 +1,107 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Self-consumption accounting: how long the monitor spends awake, asleep and
+// with each power-hungry component active, turned into an estimated charge
+// (mAh) with a configurable per-component current model.
+//
+// Components can overlap (e.g. BLE advertising while Wi-Fi is associated),
+// so the model is additive: awake time is charged at `awake_mA` and every
+// component adds its own `extra_mA` on top while it is on. Awake time with
+// no component on is reported as idle.
+//
+// Windows close after one hour and one day of awake + sleep time; the
+// closed results are kept in RTC memory with the open windows, so the
+// accounting spans deep sleep.
+
+enum EnergyComp : uint8_t {
+  EC_SENSORS,      // INA226/Hall/DS18B20 reads, ripple bursts
+  EC_WIFI_CONNECT, // association + DHCP in progress
+  EC_WIFI,         // associated (modem sleep between beacons)
+  EC_MQTT,         // broker connect and publishes
+  EC_BLE,          // advertising / connected
+  EC_OTA,          // ArduinoOTA handling
+  EC_COMPONENTS
+};
+
+struct PowerModel {
+  float awake_mA; // CPU on, radios off
+  float extra_mA[EC_COMPONENTS];
+  float sleep_mA; // deep sleep, including the sensor boards
+};
+
+struct EnergyWindow {
+  uint32_t comp_ms[EC_COMPONENTS];
+  uint32_t awake_ms;
+  uint32_t idle_ms; // awake with no component on
+  uint32_t sleep_ms;
+};
+
+// Plain POD so it can live in RTC memory; begin() resets it if the magic does
+// not match.
+struct EnergyLedger {
+  uint32_t magic;
+  EnergyWindow hour; // open windows
+  EnergyWindow day;
+  EnergyWindow lastHour; // last closed hour
+  float lastDay_mAh;     // last closed day, NAN until one has closed
+  uint32_t lastDay_ms;
+  bool reportPending; // an hour closed since the last report
+};
+
+typedef uint64_t (*EnergyClockFn)(); // microseconds since boot
+
+class EnergyMeter {
+public:
+  static constexpr uint32_t HOUR_MS = 3600000UL;
+  static constexpr uint32_t DAY_MS = 24UL * HOUR_MS;
+
+  EnergyMeter(EnergyLedger &l, const PowerModel &m, EnergyClockFn usFn)
+      : _l(l), _m(m), _us(usFn) {}
+
+  // Call first thing after boot; awake time is counted from here.
+  void begin();
+  // Nestable: a component stays on until every on() has its off().
+  void on(EnergyComp c);
+  void off(EnergyComp c);
+  // Level-type state (e.g. Wi-Fi associated), not nested.
+  void set(EnergyComp c, bool active);
+  // Charge elapsed time up to now and close finished windows.
+  void tick();
+  // Charge the deep sleep about to start; call right before sleeping.
+  void sleep(uint64_t interval_us);
+
+  // Charge (mAh) of a window under the model
+  float mAh(const EnergyWindow &w) const;
+  // Average draw (mA) over a window, NAN if empty
+  float avg_mA(const EnergyWindow &w) const;
+  const EnergyLedger &ledger() const { return _l; }
+  bool reportPending() const { return _l.reportPending; }
+  void clearReport() { _l.reportPending = false; }
+
+private:
+  EnergyLedger &_l;
+  const PowerModel &_m;
+  EnergyClockFn _us;
+  uint64_t _lastUs = 0;
+  uint64_t _fracUs = 0; // sub-millisecond remainder
+  uint8_t _depth[EC_COMPONENTS] = {};
+
+  void charge(uint32_t ms, bool asleep);
+  void roll();
+};
+
+// RAII helper: component on for the lifetime of the scope.
+class EnergyScope {
+public:
+  EnergyScope(EnergyMeter &m, EnergyComp c) : _m(m), _c(c) { _m.on(_c); }
+  ~EnergyScope() { _m.off(_c); }
+
+private:
+  EnergyMeter &_m;
+  EnergyComp _c;
+};
+
+// Last closed hour (per-component times and mAh) and last closed day as JSON.
+bool buildEnergyJson(const EnergyMeter &m, char *out, size_t outLen);
@@ -5,8 +5,10 @@
 #include <esp_bt.h>
 #include <esp_sleep.h>
 
-inline void goToDeepSleep(uint64_t interval_us) {
-  NimBLEDevice::deinit(true);
+// `bleStarted` is false on the snapshot wake path, which never starts BLE.
+inline void goToDeepSleep(uint64_t interval_us, bool bleStarted = true) {
+  if (bleStarted)
+    NimBLEDevice::deinit(true);
   WiFi.disconnect(true, true);
   WiFi.mode(WIFI_OFF);
   btStop();
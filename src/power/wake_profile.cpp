@@ -0,0 +1,57 @@
+#include "wake_profile.h"
+#include <cstdio>
+#include <cstring>
+
+static constexpr uint32_t WAKE_MAGIC = 0x57414B45; // "WAKE"
+
+void WakeTimer::begin() {
+  if (_p.magic != WAKE_MAGIC) {
+    memset(&_p, 0, sizeof(_p));
+    _p.magic = WAKE_MAGIC;
+  }
+  _bootUs = _us();
+  _lastUs = _bootUs;
+  memset(_phaseUs, 0, sizeof(_phaseUs));
+}
+
+void WakeTimer::mark(WakePhase phase) {
+  uint32_t now = _us();
+  if (phase < WAKE_PHASES)
+    _phaseUs[phase] += now - _lastUs;
+  _lastUs = now;
+}
+
+void WakeTimer::finish(uint32_t budget_ms, bool fastWifi, bool published) {
+  _p.boot_ms = _bootUs / 1000u;
+  for (int i = 0; i < WAKE_PHASES; ++i)
+    _p.phase_ms[i] = _phaseUs[i] / 1000u;
+  _p.total_ms = _lastUs / 1000u;
+  _p.fastWifi = fastWifi;
+  _p.published = published;
+  _p.wakes++;
+  if (_p.total_ms > budget_ms)
+    _p.overBudget++;
+  if (_p.total_ms > _p.worst_ms)
+    _p.worst_ms = _p.total_ms;
+}
+
+bool buildWakeJson(const WakeProfile &p, uint32_t budget_ms, char *out,
+                   size_t outLen) {
+  if (p.magic != WAKE_MAGIC || p.wakes == 0)
+    return false;
+  int n = snprintf(
+      out, outLen,
+      "{\"event\":\"wake\",\"total_ms\":%lu,\"budget_ms\":%lu,"
+      "\"boot_ms\":%lu,\"sensors_ms\":%lu,\"wifi_ms\":%lu,\"mqtt_ms\":%lu,"
+      "\"publish_ms\":%lu,\"shutdown_ms\":%lu,\"fast_wifi\":%s,"
+      "\"published\":%s,\"wakes\":%lu,\"over_budget\":%lu,\"worst_ms\":%lu}",
+      (unsigned long)p.total_ms, (unsigned long)budget_ms,
+      (unsigned long)p.boot_ms, (unsigned long)p.phase_ms[WAKE_SENSORS],
+      (unsigned long)p.phase_ms[WAKE_WIFI],
+      (unsigned long)p.phase_ms[WAKE_MQTT],
+      (unsigned long)p.phase_ms[WAKE_PUBLISH],
+      (unsigned long)p.phase_ms[WAKE_SHUTDOWN], p.fastWifi ? "true" : "false",
+      p.published ? "true" : "false", (unsigned long)p.wakes,
+      (unsigned long)p.overBudget, (unsigned long)p.worst_ms);
+  return n > 0 && (size_t)n < outLen;
+}
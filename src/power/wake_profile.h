@@ -0,0 +1,63 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Per-phase timing of a snapshot (timer) wake, so the awake time that drives
+// the parked energy cost can be tracked against a budget.
+//
+// The timer accumulates the current wake; finish() copies it into the
+// profile, which lives in RTC memory and is published on the next wake.
+
+enum WakePhase : uint8_t {
+  WAKE_SENSORS,  // sensor init, state restore, temperature
+  WAKE_WIFI,     // remaining wait for association + IP
+  WAKE_MQTT,     // broker connect
+  WAKE_PUBLISH,  // telemetry, backlog, broker round-trip
+  WAKE_SHUTDOWN, // radio off
+  WAKE_PHASES
+};
+
+// Plain POD so it can live in RTC memory; begin() resets it if the magic does
+// not match.
+struct WakeProfile {
+  uint32_t magic;
+  // Last completed wake
+  uint32_t boot_ms; // reset to setup()
+  uint32_t phase_ms[WAKE_PHASES];
+  uint32_t total_ms; // reset to radio off
+  bool fastWifi;     // reconnected from the RTC cache
+  bool published;    // broker confirmed the publishes
+  // Since power-on
+  uint32_t wakes;
+  uint32_t overBudget;
+  uint32_t worst_ms;
+};
+
+typedef uint32_t (*WakeClockFn)(); // microseconds since boot
+
+class WakeTimer {
+public:
+  WakeTimer(WakeProfile &p, WakeClockFn microsFn) : _p(p), _us(microsFn) {}
+
+  // Call first thing in setup(); the clock reading is the boot time.
+  void begin();
+  // Close `phase`: it gets the time since the previous mark (or setup()).
+  void mark(WakePhase phase);
+  // Store this wake in the profile and update the budget counters.
+  void finish(uint32_t budget_ms, bool fastWifi, bool published);
+
+  uint32_t elapsed_ms() const { return _us() / 1000u; }
+  const WakeProfile &profile() const { return _p; }
+
+private:
+  WakeProfile &_p;
+  WakeClockFn _us;
+  uint32_t _bootUs = 0;
+  uint32_t _lastUs = 0;
+  uint32_t _phaseUs[WAKE_PHASES] = {};
+};
+
+// The stored (previous) wake as JSON. False if no wake has been recorded
+// yet.
+bool buildWakeJson(const WakeProfile &p, uint32_t budget_ms, char *out,
+                   size_t outLen);
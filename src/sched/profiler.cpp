@@ -0,0 +1,115 @@
+#include "profiler.h"
+#include <stdio.h>
+#include <string.h>
+
+ProfZone *ProfZone::_first = nullptr;
+ProfStack *ProfStack::_first = nullptr;
+
+ProfZone::ProfZone(const char *name) : _name(name), _next(_first) {
+  profReset(_h);
+  _first = this;
+}
+
+ProfStack::ProfStack(const char *name) : _name(name), _next(_first) {
+  _first = this;
+}
+
+void profReset(ProfHistogram &h) {
+  memset(&h, 0, sizeof(h));
+  h.min = UINT32_MAX;
+}
+
+// Values 0..3 get their own bucket; above that each octave [2^k, 2^(k+1))
+// is split in two halves.
+int profBucket(uint32_t ticks) {
+  if (ticks < 4)
+    return (int)ticks;
+  int k = 31 - __builtin_clz(ticks);
+  int half = (ticks >> (k - 1)) & 1;
+  return 4 + 2 * (k - 2) + half;
+}
+
+uint32_t profBucketUpper(int b) {
+  if (b < 4)
+    return (uint32_t)b;
+  int k = (b - 4) / 2 + 2;
+  int half = (b - 4) & 1;
+  uint64_t lo = (1ULL << k) + (half ? (1ULL << (k - 1)) : 0);
+  uint64_t hi = lo + (1ULL << (k - 1)) - 1;
+  return hi > UINT32_MAX ? UINT32_MAX : (uint32_t)hi;
+}
+
+void profRecord(ProfHistogram &h, uint32_t ticks) {
+  h.count++;
+  h.sum += ticks;
+  if (ticks < h.min)
+    h.min = ticks;
+  if (ticks > h.max)
+    h.max = ticks;
+  h.bucket[profBucket(ticks)]++;
+}
+
+uint32_t profQuantile(const ProfHistogram &h, float q) {
+  if (!h.count)
+    return 0;
+  // Rank of the quantile sample (1-based, rounded up)
+  uint64_t rank = (uint64_t)(q * h.count);
+  if ((float)rank < q * h.count)
+    rank++;
+  if (rank < 1)
+    rank = 1;
+  uint64_t seen = 0;
+  for (int b = 0; b < PROF_BUCKETS; ++b) {
+    seen += h.bucket[b];
+    if (seen >= rank) {
+      uint32_t up = profBucketUpper(b);
+      return up < h.max ? up : h.max;
+    }
+  }
+  return h.max;
+}
+
+bool buildProfJson(const char *name, const ProfHistogram &h, float ticksPerUs,
+                   char *out, size_t outLen) {
+  if (!h.count || ticksPerUs <= 0.0f)
+    return false;
+  int n = snprintf(out, outLen,
+                   "{\"zone\":\"%s\",\"n\":%lu,\"min_us\":%.2f,"
+                   "\"mean_us\":%.2f,\"p50_us\":%.2f,\"p99_us\":%.2f,"
+                   "\"max_us\":%.2f}",
+                   name, (unsigned long)h.count, h.min / ticksPerUs,
+                   (double)h.sum / h.count / ticksPerUs,
+                   profQuantile(h, 0.50f) / ticksPerUs,
+                   profQuantile(h, 0.99f) / ticksPerUs, h.max / ticksPerUs);
+  return n > 0 && (size_t)n < outLen;
+}
+
+static constexpr uint8_t STACK_PATTERN = 0xA5;
+// Left unpainted below the frame: stackPaint's own frame and spill area
+static constexpr size_t STACK_SKIP = 64;
+
+// Not inlined, so the frame address is a fixed point just below the caller.
+// Painted with a plain loop: a memset call would need stack of its own.
+__attribute__((noinline)) void stackPaint(StackProbe &p, size_t len) {
+  p.top = (uint8_t *)__builtin_frame_address(0);
+  p.len = len;
+  volatile uint8_t *b = p.top - len;
+  for (size_t i = 0; i + STACK_SKIP < len; ++i)
+    b[i] = STACK_PATTERN;
+}
+
+__attribute__((noinline)) size_t stackUsed(const StackProbe &p) {
+  const volatile uint8_t *b = p.top - p.len;
+  size_t i = 0;
+  while (i + STACK_SKIP < p.len && b[i] == STACK_PATTERN)
+    ++i;
+  return i + STACK_SKIP < p.len ? p.len - i : 0;
+}
+
+bool buildProfStackJson(const ProfStack &s, char *out, size_t outLen) {
+  if (!s.peak())
+    return false;
+  int n = snprintf(out, outLen, "{\"zone\":\"%s\",\"stack_B\":%lu}",
+                   s.name(), (unsigned long)s.peak());
+  return n > 0 && (size_t)n < outLen;
+}
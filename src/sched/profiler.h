@@ -0,0 +1,148 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Lightweight profiling zones: each zone keeps count, min, max, mean and a
+// log-bucketed latency histogram (two buckets per octave, ~41% wide) in
+// fixed memory, from which p50/p99 are read.
+//
+// Zones are declared with PROF_ZONE() and timed with PROF_SCOPE(); both
+// expand to nothing unless the build sets -DPROFILER_ENABLED=1, so a normal
+// build carries no code or RAM for them. Ticks are CPU cycles (CCOUNT) on
+// the ESP32 and nanoseconds (std::chrono) elsewhere.
+//
+// Stack probes (PROF_STACK / PROF_STACK_SCOPE) record the deepest stack use
+// of a code path by painting the free stack below it and checking how much
+// of the pattern was overwritten afterwards.
+//
+// The histogram core and the stack probe are portable and unit-tested
+// natively.
+
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 0
+#endif
+
+static constexpr int PROF_BUCKETS = 64;
+
+struct ProfHistogram {
+  uint32_t count;
+  uint32_t min, max; // ticks
+  uint64_t sum;
+  uint32_t bucket[PROF_BUCKETS];
+};
+
+void profReset(ProfHistogram &h);
+void profRecord(ProfHistogram &h, uint32_t ticks);
+// Upper edge (ticks) of the bucket holding quantile `q`, clamped to the
+// observed max; 0 if empty.
+uint32_t profQuantile(const ProfHistogram &h, float q);
+// Bucket index for `ticks` and the largest value that bucket holds
+int profBucket(uint32_t ticks);
+uint32_t profBucketUpper(int b);
+
+// Zone statistics in microseconds as JSON
+bool buildProfJson(const char *name, const ProfHistogram &h, float ticksPerUs,
+                   char *out, size_t outLen);
+
+// Named zone; all zones are chained for dumping.
+class ProfZone {
+public:
+  explicit ProfZone(const char *name);
+  const char *name() const { return _name; }
+  ProfHistogram &hist() { return _h; }
+  const ProfHistogram &hist() const { return _h; }
+  const ProfZone *next() const { return _next; }
+  ProfZone *next() { return _next; }
+  static ProfZone *first() { return _first; }
+
+private:
+  const char *_name;
+  ProfHistogram _h;
+  ProfZone *_next;
+  static ProfZone *_first;
+};
+
+#if defined(ARDUINO_ARCH_ESP32) && !defined(UNIT_TEST)
+#include <Arduino.h>
+inline uint32_t profTicks() { return ESP.getCycleCount(); }
+inline float profTicksPerUs() { return (float)ESP.getCpuFreqMHz(); }
+#else
+#include <chrono>
+inline uint32_t profTicks() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+inline float profTicksPerUs() { return 1000.0f; }
+#endif
+
+class ProfScope {
+public:
+  explicit ProfScope(ProfZone &z) : _z(z), _t0(profTicks()) {}
+  ~ProfScope() { profRecord(_z.hist(), profTicks() - _t0); }
+
+private:
+  ProfZone &_z;
+  uint32_t _t0;
+};
+
+// Stack use of the code between stackPaint() and stackUsed(), in bytes
+// below the caller's frame. The stack must grow down and have `len` bytes
+// free; painting and scanning cost O(len).
+struct StackProbe {
+  uint8_t *top;
+  size_t len;
+};
+void stackPaint(StackProbe &p, size_t len);
+size_t stackUsed(const StackProbe &p);
+
+// Named stack high-water mark; all are chained for dumping like zones.
+class ProfStack {
+public:
+  explicit ProfStack(const char *name);
+  const char *name() const { return _name; }
+  size_t peak() const { return _peak; }
+  void record(size_t bytes) { _peak = bytes > _peak ? bytes : _peak; }
+  void reset() { _peak = 0; }
+  const ProfStack *next() const { return _next; }
+  ProfStack *next() { return _next; }
+  static ProfStack *first() { return _first; }
+
+private:
+  const char *_name;
+  size_t _peak = 0;
+  ProfStack *_next;
+  static ProfStack *_first;
+};
+
+// Always inlined: the probe must be painted and read from the frame of the
+// code being measured.
+class ProfStackScope {
+public:
+  __attribute__((always_inline)) ProfStackScope(ProfStack &s, size_t len)
+      : _s(s) {
+    stackPaint(_p, len);
+  }
+  __attribute__((always_inline)) ~ProfStackScope() {
+    _s.record(stackUsed(_p));
+  }
+
+private:
+  ProfStack &_s;
+  StackProbe _p;
+};
+
+// {"zone":"<name>","stack_B":<peak>}; false until something was recorded
+bool buildProfStackJson(const ProfStack &s, char *out, size_t outLen);
+
+#if PROFILER_ENABLED
+#define PROF_ZONE(var, label) static ProfZone var(label)
+#define PROF_SCOPE(var) ProfScope prof_scope_##var(var)
+#define PROF_STACK(var, label) static ProfStack var(label)
+#define PROF_STACK_SCOPE(var, len) ProfStackScope prof_stack_##var(var, len)
+#else
+#define PROF_ZONE(var, label)
+#define PROF_SCOPE(var)
+#define PROF_STACK(var, label)
+#define PROF_STACK_SCOPE(var, len)
+#endif
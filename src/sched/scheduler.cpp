@@ -0,0 +1,123 @@
+#include "scheduler.h"
+#include <cstdio>
+#include <cstring>
+
+void Scheduler::begin(uint32_t firstDelay_ms) {
+  uint32_t now = _ms();
+  for (int i = 0; i < _count; ++i) {
+    _tasks[i].release_ms = now + firstDelay_ms;
+    memset(&_tasks[i].stats, 0, sizeof(SchedTaskStats));
+  }
+}
+
+void Scheduler::resetStats() {
+  for (int i = 0; i < _count; ++i)
+    memset(&_tasks[i].stats, 0, sizeof(SchedTaskStats));
+}
+
+int Scheduler::runOnce() {
+  const uint32_t now = _ms();
+  int best = -1;
+  for (int i = 0; i < _count; ++i) {
+    const SchedTask &t = _tasks[i];
+    if (!t.enabled || !t.fn || (int32_t)(now - t.release_ms) < 0)
+      continue;
+    if (best < 0 || t.priority < _tasks[best].priority ||
+        (t.priority == _tasks[best].priority &&
+         (int32_t)(t.release_ms - _tasks[best].release_ms) < 0))
+      best = i;
+  }
+  if (best < 0)
+    return -1;
+
+  SchedTask &t = _tasks[best];
+  const uint32_t late = now - t.release_ms;
+  if (late > t.stats.maxLate_ms)
+    t.stats.maxLate_ms = late;
+  // More than a full period late: drop the missed releases and run for the
+  // latest one, staying on the original grid
+  if (t.period_ms > 0 && late > t.period_ms) {
+    const uint32_t behind = late / t.period_ms;
+    t.stats.skipped += behind;
+    t.release_ms += behind * t.period_ms;
+  }
+
+  const uint32_t t0 = _us();
+  t.fn(now);
+  const uint32_t run_us = _us() - t0;
+
+  SchedTaskStats &s = t.stats;
+  s.runs++;
+  s.lastRun_us = run_us;
+  s.totalRun_us += run_us;
+  if (run_us > s.maxRun_us)
+    s.maxRun_us = run_us;
+  const uint32_t deadline = t.deadline_ms ? t.deadline_ms : t.period_ms;
+  if (late + run_us / 1000u > deadline)
+    s.overruns++;
+
+  // Next release on the original grid, even if it has already passed
+  if (t.period_ms > 0)
+    t.release_ms += t.period_ms;
+  else
+    t.release_ms = _ms();
+  return best;
+}
+
+void Scheduler::setPeriod(int idx, uint32_t period_ms) {
+  if (idx < 0 || idx >= _count)
+    return;
+  SchedTask &t = _tasks[idx];
+  if (t.period_ms == period_ms)
+    return;
+  uint32_t now = _ms();
+  uint32_t sooner = now + period_ms;
+  if ((int32_t)(sooner - t.release_ms) < 0)
+    t.release_ms = sooner;
+  t.period_ms = period_ms;
+}
+
+void Scheduler::setEnabled(int idx, bool enabled) {
+  if (idx < 0 || idx >= _count)
+    return;
+  SchedTask &t = _tasks[idx];
+  if (enabled && !t.enabled)
+    t.release_ms = _ms();
+  t.enabled = enabled;
+}
+
+void Scheduler::releaseNow(int idx) {
+  if (idx < 0 || idx >= _count || !_tasks[idx].enabled)
+    return;
+  _tasks[idx].release_ms = _ms();
+}
+
+uint32_t Scheduler::msUntilNext() const {
+  const uint32_t now = _ms();
+  uint32_t best = UINT32_MAX;
+  for (int i = 0; i < _count; ++i) {
+    const SchedTask &t = _tasks[i];
+    if (!t.enabled || !t.fn)
+      continue;
+    int32_t d = (int32_t)(t.release_ms - now);
+    if (d <= 0)
+      return 0;
+    if ((uint32_t)d < best)
+      best = (uint32_t)d;
+  }
+  return best;
+}
+
+bool buildSchedTaskJson(const SchedTask &t, char *out, size_t outLen) {
+  const SchedTaskStats &st = t.stats;
+  uint32_t avg = st.runs ? (uint32_t)(st.totalRun_us / st.runs) : 0;
+  int n = snprintf(out, outLen,
+                   "{\"event\":\"sched\",\"task\":\"%s\",\"runs\":%lu,"
+                   "\"overruns\":%lu,\"skipped\":%lu,\"avg_us\":%lu,"
+                   "\"max_us\":%lu,\"max_late_ms\":%lu}",
+                   t.name ? t.name : "", (unsigned long)st.runs,
+                   (unsigned long)st.overruns, (unsigned long)st.skipped,
+                   (unsigned long)avg, (unsigned long)st.maxRun_us,
+                   (unsigned long)st.maxLate_ms);
+  return n > 0 && (size_t)n < outLen;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Table-driven cooperative scheduler for the main loop.
+//
+// Each task has a period, a relative deadline and a priority (0 = most
+// urgent). `runOnce()` runs at most one task: the highest-priority task whose
+// release time has passed, ties broken by the earliest release. A task that
+// finishes after release + deadline counts as an overrun; one that starts
+// more than a full period late skips the missed releases instead of running
+// back-to-back to catch up.
+//
+// Time comes from injected clock functions so the scheduling logic can be
+// tested natively with a virtual clock.
+
+typedef uint32_t (*SchedClockFn)();
+typedef void (*SchedTaskFn)(uint32_t now_ms);
+
+struct SchedTaskStats {
+  uint32_t runs;
+  uint32_t overruns;  // finished after release + deadline
+  uint32_t skipped;   // releases dropped because the task fell behind
+  uint32_t maxRun_us; // longest single run
+  uint32_t lastRun_us;
+  uint64_t totalRun_us;
+  uint32_t maxLate_ms; // worst start latency after release
+};
+
+struct SchedTask {
+  const char *name;
+  SchedTaskFn fn;
+  uint32_t period_ms;
+  uint32_t deadline_ms; // relative to release; 0 = same as period
+  uint8_t priority;     // 0 = most urgent
+  bool enabled;
+  // Runtime (set by the scheduler)
+  uint32_t release_ms;
+  SchedTaskStats stats;
+};
+
+class Scheduler {
+public:
+  Scheduler(SchedTask *tasks, int count, SchedClockFn millisFn,
+            SchedClockFn microsFn)
+      : _tasks(tasks), _count(count), _ms(millisFn), _us(microsFn) {}
+
+  // Release every task `firstDelay_ms` from now and clear statistics.
+  void begin(uint32_t firstDelay_ms = 0);
+
+  // Run the most urgent ready task. Returns its index, or -1 if none is ready.
+  int runOnce();
+
+  // Change a task's period; the next release moves to now + period if that is
+  // sooner than the pending one.
+  void setPeriod(int idx, uint32_t period_ms);
+  void setEnabled(int idx, bool enabled);
+  // Make an enabled task ready now (e.g. on an event); its period restarts
+  // from this run.
+  void releaseNow(int idx);
+
+  // Milliseconds until the next release (0 if a task is ready now).
+  uint32_t msUntilNext() const;
+
+  int count() const { return _count; }
+  const SchedTask &task(int idx) const { return _tasks[idx]; }
+  void resetStats();
+
+private:
+  SchedTask *_tasks;
+  int _count;
+  SchedClockFn _ms;
+  SchedClockFn _us;
+};
+
+// Serialise one task's statistics as JSON. One message per task keeps each
+// publish well inside the MQTT packet limit.
+bool buildSchedTaskJson(const SchedTask &t, char *out, size_t outLen);
@@ -16,3 +16,20 @@ float DS18B20Sensor::readTempC() {
     return NAN;
   return t;
 }
+
+void DS18B20Sensor::startConversion() {
+  _ds.setWaitForConversion(false);
+  _ds.requestTemperatures();
+  _ds.setWaitForConversion(true);
+  _convStartMs = millis();
+}
+
+float DS18B20Sensor::readConversion() {
+  uint32_t maxMs = _ds.millisToWaitForConversion(_resBits);
+  while (!_ds.isConversionComplete() && millis() - _convStartMs < maxMs)
+    delay(1);
+  float t = _ds.getTempCByIndex(0);
+  if (t < -55 || t > 125)
+    return NAN;
+  return t;
+}
@@ -9,8 +9,13 @@ public:
   DS18B20Sensor(int pin, uint8_t resBits);
   void begin();
   float readTempC(); // NAN if out-of-range
+  // Split read: start a conversion, do other work, then collect the result
+  // (waits only for what is left of the conversion time).
+  void startConversion();
+  float readConversion(); // NAN if out-of-range
 private:
   OneWire _ow;
   DallasTemperature _ds;
   uint8_t _resBits;
+  uint32_t _convStartMs = 0;
 };
\ No newline at end of file
@@ -1,5 +1,6 @@
 
 #include "hall_sensor.h"
+#include "../log/logger.h"
 #include <algorithm>
 
 static inline void shortDelay() { delayMicroseconds(80); }
@@ -106,11 +107,10 @@ float HallSensor::readCurrentA(uint8_t samples, HallJitterStats *js) {
   const float current_A = (delta_corr_mV / mV_per_A) * _sign;
 
 #ifdef DEBUG_HALL_SENSOR
-  Serial.printf(
-      u8"Vref=%.1f mV Vout=%.1f mV Δraw=%.2f mV zero=%.2f mV Δcorr=%.2f mV "
-      "mV/A=%.3f I=%.3f A Δrange=[%.2f..%.2f] mV\n",
-      vref_once, vout_once, delta_raw_mV, _zero_mV, delta_corr_mV, mV_per_A,
-      current_A, minD, maxD);
+  LOGD(u8"Vref=%.1f mV Vout=%.1f mV Δraw=%.2f mV zero=%.2f mV Δcorr=%.2f mV",
+       vref_once, vout_once, delta_raw_mV, _zero_mV, delta_corr_mV);
+  LOGD(u8"mV/A=%.3f I=%.3f A Δrange=[%.2f..%.2f] mV", mV_per_A, current_A,
+       minD, maxD);
 #endif
 
   return current_A;
@@ -133,9 +133,9 @@ float HallSensor::captureZeroTrimmedMean(int N) {
   float newZero = (float)(acc / (end - start));
   _zero_mV = newZero;
 
-  Serial.printf(u8"HALL zero captured: %.3f mV (from %d) FirstPair: Vref=%.1f "
-                u8"mV Vout=%.1f mV Δ=%.2f mV\n",
-                _zero_mV, N, vref0, vout0, (vout0 - vref0));
+  LOGI(u8"HALL zero captured: %.3f mV (from %d) FirstPair: Vref=%.1f "
+       u8"mV Vout=%.1f mV Δ=%.2f mV",
+       _zero_mV, N, vref0, vout0, (vout0 - vref0));
 
   return _zero_mV;
 }
@@ -158,5 +158,5 @@ void HallZeroStore::save(float z) {
   p.putFloat("zero_mV", z);
   p.end();
   zero_mV = z;
-  Serial.printf("HALL zero saved: %.3f mV", z);
+  LOGI("HALL zero saved: %.3f mV", z);
 }
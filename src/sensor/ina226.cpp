@@ -1,6 +1,12 @@
 #include "ina226.h"
 #include <Wire.h>
 
+// Configuration register values
+static constexpr uint16_t INA226_CFG_DEFAULT = 0x4127;  // 1.1 ms, shunt+bus
+static constexpr uint16_t INA226_CFG_FAST_BUS = 0x4006; // 140 us, bus only
+static constexpr uint32_t I2C_FAST_HZ = 400000;
+static constexpr uint32_t I2C_STD_HZ = 100000;
+
 INA226Bus::INA226Bus(uint8_t addr) : _addr(addr) {}
 void INA226Bus::begin() { Wire.begin(); }
 
@@ -17,9 +23,38 @@ bool INA226Bus::readReg16(uint8_t reg, uint16_t &val) {
   return true;
 }
 
+bool INA226Bus::writeReg16(uint8_t reg, uint16_t val) {
+  Wire.beginTransmission(_addr);
+  Wire.write(reg);
+  Wire.write((uint8_t)(val >> 8));
+  Wire.write((uint8_t)(val & 0xFF));
+  return Wire.endTransmission() == 0;
+}
+
 float INA226Bus::readBusVoltage_V() {
   uint16_t raw = 0;
   if (!readReg16(0x02, raw))
     return NAN;
   return raw * 0.00125f;
-}
\ No newline at end of file
+}
+
+bool INA226Bus::captureBusRaw(uint16_t *out, int n, uint32_t periodUs) {
+  if (!out || n <= 0)
+    return false;
+  Wire.setClock(I2C_FAST_HZ);
+  bool ok = writeReg16(0x00, INA226_CFG_FAST_BUS);
+  if (ok) {
+    delayMicroseconds(200); // first conversion
+    uint32_t next = micros();
+    for (int i = 0; i < n && ok; ++i) {
+      while ((int32_t)(micros() - next) < 0) {
+      }
+      next += periodUs;
+      ok = readReg16(0x02, out[i]);
+    }
+  }
+  // Always restore the normal configuration, even after a failed burst
+  bool restored = writeReg16(0x00, INA226_CFG_DEFAULT);
+  Wire.setClock(I2C_STD_HZ);
+  return ok && restored;
+}
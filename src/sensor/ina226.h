@@ -1,4 +1,3 @@
-
 #pragma once
 #include <Arduino.h>
 
@@ -7,7 +6,15 @@ public:
   explicit INA226Bus(uint8_t addr);
   void begin();
   float readBusVoltage_V(); // NAN on failure
+
+  // Burst-capture `n` raw bus-voltage codes (1.25 mV LSB) at `periodUs`
+  // spacing for ripple analysis. The converter is switched to continuous
+  // bus-only 140 us conversions and the I2C clock to 400 kHz for the burst,
+  // then both are restored. Returns false on any I2C error.
+  bool captureBusRaw(uint16_t *out, int n, uint32_t periodUs);
+
 private:
   uint8_t _addr;
   bool readReg16(uint8_t reg, uint16_t &val);
-};
\ No newline at end of file
+  bool writeReg16(uint8_t reg, uint16_t val);
+};
@@ -0,0 +1,445 @@
+#include "telemetry_cbor.h"
+#include <math.h>
+#include <string.h>
+
+// CBOR major types and simple values
+static constexpr uint8_t MT_UINT = 0;
+static constexpr uint8_t MT_NEGINT = 1;
+static constexpr uint8_t MT_BYTES = 2;
+static constexpr uint8_t MT_TEXT = 3;
+static constexpr uint8_t MT_ARRAY = 4;
+static constexpr uint8_t MT_MAP = 5;
+static constexpr uint8_t MT_TAG = 6;
+static constexpr uint8_t MT_SIMPLE = 7;
+static constexpr uint8_t SV_FALSE = 20;
+static constexpr uint8_t SV_TRUE = 21;
+static constexpr uint8_t SV_NULL = 22;
+static constexpr uint8_t AI_F16 = 25;
+static constexpr uint8_t AI_F32 = 26;
+static constexpr uint8_t AI_F64 = 27;
+
+static constexpr uint8_t FIELD_COUNT = 18;
+static constexpr uint8_t STATS_FIELD_COUNT = 11;
+static constexpr int MAX_DEPTH = 4; // nesting skipped in unknown values
+
+static const char *const CBOR_MODES[] = {"active", "parked-idle",
+                                         "parked-sleep", "snapshot"};
+static const uint8_t CBOR_MODE_COUNT =
+    sizeof(CBOR_MODES) / sizeof(CBOR_MODES[0]);
+static const char *const MODE_UNKNOWN = "unknown";
+
+static const double SCALE[] = {1.0, 1e1, 1e2, 1e3};
+// Scaled integers stay below 2^22 so the decoded float re-rounds to the same
+// digits (its error is at most a quarter unit); larger values go as float32.
+static constexpr double SCALED_MAX = 4194304.0;
+
+enum : uint8_t {
+  K_MODE,
+  K_V,
+  K_I,
+  K_T,
+  K_SOC,
+  K_SOH,
+  K_AH_LEFT,
+  K_RINT,
+  K_RINT25,
+  K_RINT_BASE,
+  K_CAPACITY,
+  K_ALT_ON,
+  K_REST_S,
+  K_LOW_CURRENT_S,
+  K_HAS_RINT,
+  K_HAS_RINT25,
+  K_UP_MS,
+  K_NET_BLOCKED,
+  K_STAT_N,
+  K_STAT_SPAN,
+  K_V_MIN,
+  K_V_MAX,
+  K_V_MEAN,
+  K_V_RMS,
+  K_I_MIN,
+  K_I_MAX,
+  K_I_MEAN,
+  K_I_RMS,
+  K_CHARGE
+};
+
+// In key order; the encoder relies on it
+struct FloatField {
+  uint8_t key;
+  float TelemetryFrame::*field;
+  uint8_t decimals; // same as buildTelemetryJson
+};
+static const FloatField FLOATS[] = {
+    {K_V, &TelemetryFrame::V, 3},
+    {K_I, &TelemetryFrame::I, 3},
+    {K_T, &TelemetryFrame::T, 1},
+    {K_SOC, &TelemetryFrame::soc_pct, 1},
+    {K_SOH, &TelemetryFrame::soh_pct, 1},
+    {K_AH_LEFT, &TelemetryFrame::ah_left, 3},
+    {K_RINT, &TelemetryFrame::Rint_mOhm, 2},
+    {K_RINT25, &TelemetryFrame::Rint25_mOhm, 2},
+    {K_RINT_BASE, &TelemetryFrame::RintBaseline_mOhm, 2},
+    {K_CAPACITY, &TelemetryFrame::battery_capacity_ah, 1}};
+
+// Interval statistics, after K_STAT_N and K_STAT_SPAN
+struct StatField {
+  uint8_t key;
+  float IntervalStats::*field;
+  uint8_t decimals;
+};
+static const StatField STATS[] = {
+    {K_V_MIN, &IntervalStats::V_min, 3},
+    {K_V_MAX, &IntervalStats::V_max, 3},
+    {K_V_MEAN, &IntervalStats::V_mean, 3},
+    {K_V_RMS, &IntervalStats::V_rms, 3},
+    {K_I_MIN, &IntervalStats::I_min, 3},
+    {K_I_MAX, &IntervalStats::I_max, 3},
+    {K_I_MEAN, &IntervalStats::I_mean, 3},
+    {K_I_RMS, &IntervalStats::I_rms, 3},
+    {K_CHARGE, &IntervalStats::charge_mAh, 1}};
+
+struct UintField {
+  uint8_t key;
+  uint32_t TelemetryFrame::*field;
+};
+static const UintField UINTS[] = {
+    {K_REST_S, &TelemetryFrame::rest_s},
+    {K_LOW_CURRENT_S, &TelemetryFrame::lowCurrentAccum_s},
+    {K_UP_MS, &TelemetryFrame::up_ms},
+    {K_NET_BLOCKED, &TelemetryFrame::net_blocked_ms_h}};
+
+struct BoolField {
+  uint8_t key;
+  bool TelemetryFrame::*field;
+};
+static const BoolField BOOLS[] = {
+    {K_ALT_ON, &TelemetryFrame::alternator_on},
+    {K_HAS_RINT, &TelemetryFrame::hasRint},
+    {K_HAS_RINT25, &TelemetryFrame::hasRint25}};
+
+// ------------------------------ Encoder ------------------------------
+
+namespace {
+struct Out {
+  uint8_t *p;
+  size_t len;
+  size_t pos;
+  bool overflow;
+
+  void bytes(const uint8_t *b, size_t n) {
+    if (overflow || pos + n > len) {
+      overflow = true;
+      return;
+    }
+    memcpy(p + pos, b, n);
+    pos += n;
+  }
+  void byte(uint8_t b) { bytes(&b, 1); }
+  void boolean(bool v) { byte(MT_SIMPLE << 5 | (v ? SV_TRUE : SV_FALSE)); }
+  // Initial byte plus the shortest argument encoding
+  void head(uint8_t major, uint64_t v) {
+    uint8_t b[9];
+    size_t n;
+    if (v < 24) {
+      b[0] = (uint8_t)(major << 5 | v);
+      n = 1;
+    } else {
+      uint8_t ai = v <= 0xFF         ? 24
+                   : v <= 0xFFFF     ? 25
+                   : v <= 0xFFFFFFFF ? 26
+                                     : 27;
+      int w = 1 << (ai - 24);
+      b[0] = (uint8_t)(major << 5 | ai);
+      for (int i = 0; i < w; ++i)
+        b[1 + i] = (uint8_t)(v >> (8 * (w - 1 - i)));
+      n = 1 + w;
+    }
+    bytes(b, n);
+  }
+  void f32(float v) {
+    uint32_t u;
+    memcpy(&u, &v, sizeof(u));
+    uint8_t b[5] = {(uint8_t)(MT_SIMPLE << 5 | AI_F32), (uint8_t)(u >> 24),
+                    (uint8_t)(u >> 16), (uint8_t)(u >> 8), (uint8_t)u};
+    bytes(b, 5);
+  }
+  // Scaled and rounded half to even on the exact value, like fmtFixed()
+  void scaled(float v, uint8_t decimals) {
+    if (!isfinite(v)) {
+      byte(MT_SIMPLE << 5 | SV_NULL);
+      return;
+    }
+    double x = fabs((double)v) * SCALE[decimals];
+    double ip = floor(x);
+    double frac = x - ip;
+    uint64_t q = (uint64_t)ip;
+    if (frac > 0.5 || (frac == 0.5 && (q & 1)))
+      q++;
+    if (x >= SCALED_MAX || (q == 0 && signbit(v)))
+      f32(v); // keeps "-0.000" and huge values exact
+    else if (signbit(v))
+      head(MT_NEGINT, q - 1);
+    else
+      head(MT_UINT, q);
+  }
+};
+} // namespace
+
+size_t encodeTelemetryCbor(const TelemetryFrame &f, uint8_t *out,
+                           size_t outLen) {
+  Out o = {out, outLen, 0, false};
+  o.head(MT_MAP, FIELD_COUNT + (f.hasStats ? STATS_FIELD_COUNT : 0));
+
+  o.head(MT_UINT, K_MODE);
+  uint8_t mode = CBOR_MODE_COUNT;
+  for (uint8_t i = 0; i < CBOR_MODE_COUNT; ++i)
+    if (f.mode && !strcmp(f.mode, CBOR_MODES[i]))
+      mode = i;
+  if (mode < CBOR_MODE_COUNT) {
+    o.head(MT_UINT, mode);
+  } else {
+    const char *m = f.mode ? f.mode : MODE_UNKNOWN;
+    size_t n = strlen(m);
+    o.head(MT_TEXT, n);
+    o.bytes((const uint8_t *)m, n);
+  }
+
+  // Keys in ascending order (CBOR core deterministic encoding)
+  for (const FloatField &ff : FLOATS) {
+    o.head(MT_UINT, ff.key);
+    o.scaled(f.*ff.field, ff.decimals);
+  }
+  o.head(MT_UINT, K_ALT_ON);
+  o.boolean(f.alternator_on);
+  o.head(MT_UINT, K_REST_S);
+  o.head(MT_UINT, f.rest_s);
+  o.head(MT_UINT, K_LOW_CURRENT_S);
+  o.head(MT_UINT, f.lowCurrentAccum_s);
+  o.head(MT_UINT, K_HAS_RINT);
+  o.boolean(f.hasRint);
+  o.head(MT_UINT, K_HAS_RINT25);
+  o.boolean(f.hasRint25);
+  o.head(MT_UINT, K_UP_MS);
+  o.head(MT_UINT, f.up_ms);
+  o.head(MT_UINT, K_NET_BLOCKED);
+  o.head(MT_UINT, f.net_blocked_ms_h);
+  if (f.hasStats) {
+    o.head(MT_UINT, K_STAT_N);
+    o.head(MT_UINT, f.stats.n);
+    o.head(MT_UINT, K_STAT_SPAN);
+    o.head(MT_UINT, f.stats.span_ms);
+    for (const StatField &sf : STATS) {
+      o.head(MT_UINT, sf.key);
+      o.scaled(f.stats.*sf.field, sf.decimals);
+    }
+  }
+  return o.overflow ? 0 : o.pos;
+}
+
+// ------------------------------ Decoder ------------------------------
+
+namespace {
+enum ItemKind : uint8_t {
+  IT_UINT,
+  IT_NEGINT,
+  IT_FLOAT,
+  IT_BOOL,
+  IT_NULL,
+  IT_TEXT,
+  IT_OTHER
+};
+
+struct Item {
+  ItemKind kind;
+  uint64_t arg;  // integer value, string length or container size
+  double value;  // IT_FLOAT
+  const uint8_t *text;
+};
+
+static float halfToFloat(uint16_t h) {
+  int exp = (h >> 10) & 0x1F;
+  int mant = h & 0x3FF;
+  float v;
+  if (exp == 0)
+    v = ldexpf((float)mant, -24);
+  else if (exp == 31)
+    v = mant ? NAN : INFINITY;
+  else
+    v = ldexpf((float)(mant + 1024), exp - 25);
+  return (h & 0x8000) ? -v : v;
+}
+
+struct Reader {
+  const uint8_t *p;
+  size_t len;
+  size_t pos;
+
+  bool take(size_t n) {
+    if (n > len - pos)
+      return false;
+    pos += n;
+    return true;
+  }
+  bool be(int n, uint64_t &v) {
+    if ((size_t)n > len - pos)
+      return false;
+    v = 0;
+    for (int i = 0; i < n; ++i)
+      v = v << 8 | p[pos + i];
+    pos += n;
+    return true;
+  }
+
+  // Initial byte and argument. Indefinite lengths are not produced by the
+  // encoder and are rejected.
+  bool head(uint8_t &major, uint8_t &ai, uint64_t &arg) {
+    if (pos >= len)
+      return false;
+    major = p[pos] >> 5;
+    ai = p[pos++] & 0x1F;
+    arg = ai;
+    if (ai > 27)
+      return false;
+    return ai < 24 || be(1 << (ai - 24), arg);
+  }
+
+  // One data item; nested arrays/maps/tags are skipped (as IT_OTHER)
+  bool item(Item &it, int depth = 0) {
+    uint8_t major, ai;
+    uint64_t arg;
+    if (depth > MAX_DEPTH || !head(major, ai, arg))
+      return false;
+    it.arg = arg;
+    it.value = 0.0;
+    it.text = nullptr;
+    switch (major) {
+    case MT_UINT:
+      it.kind = IT_UINT;
+      return true;
+    case MT_NEGINT:
+      it.kind = IT_NEGINT;
+      return true;
+    case MT_BYTES:
+    case MT_TEXT:
+      it.kind = major == MT_TEXT ? IT_TEXT : IT_OTHER;
+      it.text = p + pos;
+      return arg <= len - pos && take((size_t)arg);
+    case MT_ARRAY:
+    case MT_MAP: {
+      it.kind = IT_OTHER;
+      uint64_t n = major == MT_MAP ? arg * 2 : arg;
+      Item sub;
+      for (uint64_t i = 0; i < n; ++i)
+        if (!item(sub, depth + 1))
+          return false;
+      return true;
+    }
+    case MT_TAG:
+      if (!item(it, depth + 1))
+        return false;
+      it.kind = IT_OTHER;
+      return true;
+    default: // MT_SIMPLE
+      if (ai == SV_FALSE || ai == SV_TRUE) {
+        it.kind = IT_BOOL;
+        it.arg = ai == SV_TRUE;
+      } else if (ai == SV_NULL || ai == SV_NULL + 1) { // null, undefined
+        it.kind = IT_NULL;
+      } else if (ai == AI_F16) {
+        it.kind = IT_FLOAT;
+        it.value = halfToFloat((uint16_t)arg);
+      } else if (ai == AI_F32) {
+        uint32_t u = (uint32_t)arg;
+        float v;
+        memcpy(&v, &u, sizeof(v));
+        it.kind = IT_FLOAT;
+        it.value = v;
+      } else if (ai == AI_F64) {
+        double v;
+        memcpy(&v, &arg, sizeof(v));
+        it.kind = IT_FLOAT;
+        it.value = v;
+      } else {
+        it.kind = IT_OTHER;
+      }
+      return true;
+    }
+  }
+};
+
+// Number as sent; integers are still scaled. NaN for null/non-numbers.
+static double itemNumber(const Item &it) {
+  switch (it.kind) {
+  case IT_UINT:
+    return (double)it.arg;
+  case IT_NEGINT:
+    return -1.0 - (double)it.arg;
+  case IT_FLOAT:
+    return it.value;
+  case IT_BOOL:
+    return (double)it.arg;
+  default:
+    return NAN;
+  }
+}
+} // namespace
+
+bool decodeTelemetryCbor(const uint8_t *buf, size_t len, TelemetryFrame &f) {
+  memset(&f, 0, sizeof(f));
+  for (const FloatField &ff : FLOATS)
+    f.*ff.field = NAN;
+  for (const StatField &sf : STATS)
+    f.stats.*sf.field = NAN;
+  f.mode = MODE_UNKNOWN;
+
+  Reader r = {buf, len, 0};
+  uint8_t major, ai;
+  uint64_t entries;
+  if (!buf || !r.head(major, ai, entries) || major != MT_MAP)
+    return false;
+
+  for (uint64_t i = 0; i < entries; ++i) {
+    Item k, v;
+    if (!r.item(k) || !r.item(v))
+      return false;
+    if (k.kind != IT_UINT)
+      continue;
+    if (k.arg == K_MODE) {
+      if (v.kind == IT_UINT && v.arg < CBOR_MODE_COUNT) {
+        f.mode = CBOR_MODES[v.arg];
+      } else if (v.kind == IT_TEXT) {
+        for (uint8_t m = 0; m < CBOR_MODE_COUNT; ++m)
+          if (strlen(CBOR_MODES[m]) == v.arg &&
+              !memcmp(CBOR_MODES[m], v.text, (size_t)v.arg))
+            f.mode = CBOR_MODES[m];
+      }
+      continue;
+    }
+    double x = itemNumber(v);
+    for (const FloatField &ff : FLOATS)
+      if (ff.key == k.arg)
+        f.*ff.field =
+            (float)(v.kind == IT_FLOAT ? x : x / SCALE[ff.decimals]);
+    for (const UintField &uf : UINTS)
+      if (uf.key == k.arg)
+        f.*uf.field = (x >= 0.0 && x <= 4294967295.0) ? (uint32_t)x : 0;
+    for (const BoolField &bf : BOOLS)
+      if (bf.key == k.arg)
+        f.*bf.field = !isnan(x) && x != 0.0;
+    if (k.arg < K_STAT_N || k.arg > K_CHARGE)
+      continue;
+    f.hasStats = true;
+    uint32_t u = (x >= 0.0 && x <= 4294967295.0) ? (uint32_t)x : 0;
+    if (k.arg == K_STAT_N)
+      f.stats.n = u;
+    else if (k.arg == K_STAT_SPAN)
+      f.stats.span_ms = u;
+    for (const StatField &sf : STATS)
+      if (sf.key == k.arg)
+        f.stats.*sf.field =
+            (float)(v.kind == IT_FLOAT ? x : x / SCALE[sf.decimals]);
+  }
+  return true;
+}
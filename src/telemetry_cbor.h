@@ -0,0 +1,56 @@
+#pragma once
+#include "telemetry_payload.h"
+#include <cstddef>
+#include <cstdint>
+
+// Compact binary telemetry: the TelemetryFrame as a CBOR (RFC 8949) map with
+// small integer keys, about 70 bytes instead of ~400 for the JSON (about 110
+// instead of ~620 with interval statistics).
+//
+// Fractional fields are sent as integers scaled to the decimals the JSON
+// uses and rounded the same way, so decoding and running buildTelemetryJson
+// gives the device's JSON byte for byte. Values that do not fit the scaled
+// form (huge, or a rounded negative zero) fall back to a float32, and
+// non-finite values are CBOR null.
+//
+//   key  field                 encoding
+//   0    mode                  uint: 0 active, 1 parked-idle,
+//                              2 parked-sleep, 3 snapshot; else text
+//   1    V                     int mV
+//   2    I                     int mA
+//   3    T                     int 0.1 degC
+//   4    soc_pct               int 0.1 %
+//   5    soh_pct               int 0.1 %
+//   6    ah_left               int mAh
+//   7    Rint_mOhm             int 0.01 mOhm
+//   8    Rint25_mOhm           int 0.01 mOhm
+//   9    RintBaseline_mOhm     int 0.01 mOhm
+//   10   battery_capacity_ah   int 0.1 Ah
+//   11   alternator_on         bool
+//   12   rest_s                uint
+//   13   lowCurrentAccum_s     uint
+//   14   hasRint               bool
+//   15   hasRint25             bool
+//   16   up_ms                 uint
+//   17   net_blocked_ms_h      uint
+//
+// Only with interval statistics (hasStats):
+//   18   interval n            uint
+//   19   interval span_ms      uint
+//   20-23 V_min/max/mean/rms   int mV
+//   24-27 I_min/max/mean/rms   int mA
+//   28   charge_mAh            int 0.1 mAh
+//
+// The decoder accepts any CBOR number type for any field and skips unknown
+// keys, so fields can be added without breaking older tools.
+//
+// The decoder is shared with the host tool, tools/telemetry_decode.cpp.
+
+static constexpr size_t TELEMETRY_CBOR_MAX = 160;
+
+// Payload size, or 0 if it does not fit in `outLen`.
+size_t encodeTelemetryCbor(const TelemetryFrame &f, uint8_t *out,
+                           size_t outLen);
+// False if the payload is malformed or not a map. Missing floats are NaN,
+// other missing fields zero; `f.mode` points to static storage.
+bool decodeTelemetryCbor(const uint8_t *buf, size_t len, TelemetryFrame &f);
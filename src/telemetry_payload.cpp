@@ -1,52 +1,61 @@
+#include "telemetry_payload.h"
+#include "json_writer.h"
 
-#include <telemetry_payload.h>
-
-bool buildTelemetryJson(const TelemetryFrame &f, char *out, size_t outLen) {
-  // Format temperature
-  char tStr[16];
-  if (isfinite(f.T)) {
-    snprintf(tStr, sizeof(tStr), "%.1f", f.T);
-  } else {
-    snprintf(tStr, sizeof(tStr), "null");
-  }
-
-  // Format Rint
-  char rStr[16];
-  if (f.hasRint && isfinite(f.Rint_mOhm)) {
-    snprintf(rStr, sizeof(rStr), "%.2f", f.Rint_mOhm);
-  } else {
-    snprintf(rStr, sizeof(rStr), "null");
-  }
-
-  // Format Rint25
-  char r25Str[16];
-  if (f.hasRint25 && isfinite(f.Rint25_mOhm)) {
-    snprintf(r25Str, sizeof(r25Str), "%.2f", f.Rint25_mOhm);
-  } else {
-    snprintf(r25Str, sizeof(r25Str), "null");
-  }
-
-  // Format SOH (check for valid value)
-  char sohStr[16];
-  if (isfinite(f.soh_pct)) {
-    snprintf(sohStr, sizeof(sohStr), "%.1f", f.soh_pct);
-  } else {
-    snprintf(sohStr, sizeof(sohStr), "null");
+// No float printf; numbers that are not finite and Rint values without
+// their flag are written as null.
+void writeTelemetryJson(JsonWriter &w, const TelemetryFrame &f) {
+  w.beginObject()
+      .str("mode", f.mode)
+      .num("voltage_V", f.V, 3)
+      .num("current_A", f.I, 3)
+      .num("temp_C", f.T, 1)
+      .num("soc_pct", f.soc_pct, 1)
+      .num("soh_pct", f.soh_pct, 1)
+      .num("ah_left", f.ah_left, 3);
+  if (f.hasRint)
+    w.num("Rint_mOhm", f.Rint_mOhm, 2);
+  else
+    w.null("Rint_mOhm");
+  if (f.hasRint25)
+    w.num("Rint25_mOhm", f.Rint25_mOhm, 2);
+  else
+    w.null("Rint25_mOhm");
+  w.num("RintBaseline_mOhm", f.RintBaseline_mOhm, 2)
+      .num("battery_capacity_ah", f.battery_capacity_ah, 1)
+      .boolean("alternator_on", f.alternator_on)
+      .u32("rest_s", f.rest_s)
+      .u32("lowCurrentAccum_s", f.lowCurrentAccum_s)
+      .boolean("hasRint", f.hasRint)
+      .boolean("hasRint25", f.hasRint25)
+      .u32("up_ms", f.up_ms)
+      .u32("net_blocked_ms_h", f.net_blocked_ms_h);
+  if (f.hasStats) {
+    const IntervalStats &s = f.stats;
+    w.beginObject("interval")
+        .u32("n", s.n)
+        .u32("span_ms", s.span_ms)
+        .num("V_min", s.V_min, 3)
+        .num("V_max", s.V_max, 3)
+        .num("V_mean", s.V_mean, 3)
+        .num("V_rms", s.V_rms, 3)
+        .num("I_min", s.I_min, 3)
+        .num("I_max", s.I_max, 3)
+        .num("I_mean", s.I_mean, 3)
+        .num("I_rms", s.I_rms, 3)
+        .num("charge_mAh", s.charge_mAh, 1)
+        .endObject();
   }
+  w.endObject();
+}
 
-  int n = snprintf(
-      out, outLen,
-      "{\"mode\":\"%s\",\"voltage_V\":%.3f,\"current_A\":%.3f,\"temp_C\":%s,"
-      "\"soc_pct\":%.1f,\"soh_pct\":%s,\"ah_left\":%.3f,"
-      "\"Rint_mOhm\":%s,\"Rint25_mOhm\":%s,\"RintBaseline_mOhm\":%.2f,"
-      "\"battery_capacity_ah\":%.1f,"
-      "\"alternator_on\":%s,\"rest_s\":%u,\"lowCurrentAccum_s\":%u,"
-      "\"hasRint\":%s,\"hasRint25\":%s,\"up_ms\":%lu}",
-      f.mode, f.V, f.I, tStr, f.soc_pct, sohStr, f.ah_left, rStr, r25Str,
-      f.RintBaseline_mOhm, f.battery_capacity_ah,
-      f.alternator_on ? "true" : "false", (unsigned)f.rest_s,
-      (unsigned)f.lowCurrentAccum_s, f.hasRint ? "true" : "false",
-      f.hasRint25 ? "true" : "false", (unsigned long)f.up_ms);
+bool buildTelemetryJson(const TelemetryFrame &f, char *out, size_t outLen) {
+  JsonWriter w(out, outLen);
+  writeTelemetryJson(w, f);
+  return w.ok();
+}
 
-  return n > 0 && (size_t)n < outLen;
+size_t telemetryJsonLength(const TelemetryFrame &f) {
+  JsonWriter w;
+  writeTelemetryJson(w, f);
+  return w.length();
 }
@@ -1,6 +1,10 @@
 
 #pragma once
-#include <Arduino.h>
+#include "battery/interval_stats.h"
+#include <cstddef>
+#include <cstdint>
+
+// Portable (no Arduino dependencies); also used by the outbox replay.
 
 struct TelemetryFrame {
   const char *mode; // "active" | "parked-idle" | "parked-sleep"
@@ -12,6 +16,18 @@ struct TelemetryFrame {
   bool alternator_on;
   uint32_t rest_s, lowCurrentAccum_s, up_ms;
   bool hasRint, hasRint25;
+  uint32_t net_blocked_ms_h; // loop time blocked in Wi-Fi/MQTT, last hour
+  // Samples since the previous published frame ("interval" object); not
+  // set for snapshot and replayed frames
+  bool hasStats;
+  IntervalStats stats;
 };
 
+class JsonWriter;
+
 bool buildTelemetryJson(const TelemetryFrame &f, char *out, size_t outLen);
+// Same JSON through any writer: a buffer, a sink (streamed publish) or a
+// dry run.
+void writeTelemetryJson(JsonWriter &w, const TelemetryFrame &f);
+// Length of that JSON, without the NUL, computed by a dry run
+size_t telemetryJsonLength(const TelemetryFrame &f);
@@ -0,0 +1,193 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <unity.h>
+
+#include "../../src/comms/ble_telemetry.cpp"
+#include "../../src/comms/report_policy.cpp"
+
+static TelemetryFrame frame() {
+  TelemetryFrame f{};
+  f.mode = "active";
+  f.V = 12.634f;
+  f.I = -1.27f;
+  f.T = 18.4f;
+  f.soc_pct = 81.25f;
+  f.soh_pct = 95.5f;
+  f.Rint_mOhm = 10.0f;
+  f.Rint25_mOhm = 9.47f;
+  f.RintBaseline_mOhm = 9.0f;
+  f.ah_left = 54.31f;
+  f.battery_capacity_ah = 70.0f;
+  f.hasRint = true;
+  f.hasRint25 = true;
+  return f;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_frame_layout(void) {
+  uint8_t b[BLE_TELEMETRY_BYTES];
+  TelemetryFrame f = frame();
+  f.alternator_on = true;
+  TEST_ASSERT_EQUAL_UINT32(20, encodeBleTelemetry(f, 0x1234, b, sizeof(b)));
+  const uint8_t expect[20] = {
+      BLE_TELEMETRY_VERSION, BLE_TF_ALTERNATOR | BLE_TF_RINT25,
+      0x34, 0x12,             // seq
+      0x5A, 0x31,             // 12634 mV
+      0x81, 0xFF,             // -127 x 10 mA
+      0xB8, 0x00,             // 184 x 0.1 C
+      0xBD, 0x1F,             // 8125 x 0.01 %
+      0x4E, 0x25,             // 9550
+      0x3E, 0x04,             // 1086 x 0.05 Ah
+      0xBC, 0x02,             // 700 x 0.1 Ah
+      0xB3, 0x03};            // 947 x 0.01 mOhm
+  TEST_ASSERT_EQUAL_MEMORY(expect, b, sizeof(expect));
+}
+
+void test_round_trip(void) {
+  uint8_t b[BLE_TELEMETRY_BYTES];
+  TelemetryFrame f = frame();
+  f.mode = "parked-idle";
+  encodeBleTelemetry(f, 7, b, sizeof(b));
+  BleTelemetry t;
+  TEST_ASSERT_TRUE(decodeBleTelemetry(b, sizeof(b), t));
+  TEST_ASSERT_EQUAL_UINT8(BLE_TELEMETRY_VERSION, t.version);
+  TEST_ASSERT_EQUAL_UINT8(BLE_TF_PARKED | BLE_TF_RINT25, t.flags);
+  TEST_ASSERT_EQUAL_UINT16(7, t.seq);
+  TEST_ASSERT_FLOAT_WITHIN(0.0005f, f.V, t.V);
+  TEST_ASSERT_FLOAT_WITHIN(0.005f, f.I, t.I);
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, f.T, t.T);
+  TEST_ASSERT_FLOAT_WITHIN(0.005f, f.soc_pct, t.soc_pct);
+  TEST_ASSERT_FLOAT_WITHIN(0.005f, f.soh_pct, t.soh_pct);
+  TEST_ASSERT_FLOAT_WITHIN(0.025f, f.ah_left, t.ah_left);
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, f.battery_capacity_ah, t.capacity_ah);
+  TEST_ASSERT_FLOAT_WITHIN(0.005f, f.Rint25_mOhm, t.Rint25_mOhm);
+}
+
+// The largest configurable capacity, and a learned one 1.5x above it, come
+// back unclamped
+void test_round_trip_capacity_upper_bound(void) {
+  uint8_t b[BLE_TELEMETRY_BYTES];
+  TelemetryFrame f = frame();
+  f.battery_capacity_ah = 1000.0f;
+  f.ah_left = 1500.0f;
+  encodeBleTelemetry(f, 0, b, sizeof(b));
+  BleTelemetry t;
+  TEST_ASSERT_TRUE(decodeBleTelemetry(b, sizeof(b), t));
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, 1000.0f, t.capacity_ah);
+  TEST_ASSERT_FLOAT_WITHIN(0.025f, 1500.0f, t.ah_left);
+  f.battery_capacity_ah = 999.9f;
+  f.ah_left = 987.65f;
+  encodeBleTelemetry(f, 0, b, sizeof(b));
+  TEST_ASSERT_TRUE(decodeBleTelemetry(b, sizeof(b), t));
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, 999.9f, t.capacity_ah);
+  TEST_ASSERT_FLOAT_WITHIN(0.025f, 987.65f, t.ah_left);
+}
+
+void test_missing_and_clamped_values(void) {
+  uint8_t b[BLE_TELEMETRY_BYTES];
+  TelemetryFrame f = frame();
+  f.T = NAN;
+  f.soh_pct = NAN;
+  f.hasRint25 = false; // Rint25 value ignored without its flag
+  f.I = -500.0f;
+  f.V = 70.0f;
+  f.ah_left = -3.0f;
+  encodeBleTelemetry(f, 0, b, sizeof(b));
+  BleTelemetry t;
+  TEST_ASSERT_TRUE(decodeBleTelemetry(b, sizeof(b), t));
+  TEST_ASSERT_TRUE(std::isnan(t.T));
+  TEST_ASSERT_TRUE(std::isnan(t.soh_pct));
+  TEST_ASSERT_TRUE(std::isnan(t.Rint25_mOhm));
+  TEST_ASSERT_EQUAL_UINT8(0, t.flags);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, -327.67f, t.I);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 65.534f, t.V);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.0f, t.ah_left);
+}
+
+void test_bad_input_rejected(void) {
+  uint8_t b[BLE_TELEMETRY_BYTES + 4] = {};
+  TelemetryFrame f = frame();
+  TEST_ASSERT_EQUAL_UINT32(0, encodeBleTelemetry(f, 0, b, 19));
+  encodeBleTelemetry(f, 0, b, sizeof(b));
+  BleTelemetry t;
+  TEST_ASSERT_FALSE(decodeBleTelemetry(b, 19, t));
+  TEST_ASSERT_TRUE(decodeBleTelemetry(b, sizeof(b), t)); // longer is fine
+  b[0] = BLE_TELEMETRY_VERSION + 1;
+  TEST_ASSERT_FALSE(decodeBleTelemetry(b, sizeof(b), t));
+}
+
+void test_gate_ignores_fields_not_in_frame(void) {
+  ReportPolicy p(bleReportConfig());
+  TelemetryFrame f = frame();
+  p.sent(f, 0);
+  f.Rint_mOhm = 25.0f;
+  f.RintBaseline_mOhm = 12.0f;
+  TEST_ASSERT_EQUAL(RR_NONE, p.check(f, 2000, false, 60000));
+  f.V += 0.05f;
+  TEST_ASSERT_EQUAL(RR_DEADBAND, p.check(f, 4000, false, 60000));
+}
+
+void test_stats_json(void) {
+  char js[160];
+  TEST_ASSERT_TRUE(buildBleStatsJson(30, 1770, 1800000, js, sizeof(js)));
+  TEST_ASSERT_EQUAL_STRING("{\"task\":\"ble\",\"notify\":30,\"suppressed\":"
+                           "1770,\"connected_s\":1800,\"notify_h\":60.0}",
+                           js);
+  TEST_ASSERT_FALSE(buildBleStatsJson(30, 1770, 1800000, js, 20));
+}
+
+// One hour connected at the 2 s publish cadence: a parked battery with
+// sensor noise, then an engine start and 20 min of charging.
+void test_notifications_per_hour(void) {
+  const uint32_t PUBLISH_MS = 2000, HOUR_MS = 3600000;
+  const int LEGACY_PER_PUBLISH = 8; // one per string characteristic
+  ReportPolicy gate(bleReportConfig());
+  uint32_t seed = 12345;
+  auto noise = [&seed](float amp) {
+    seed = seed * 1103515245u + 12345u;
+    return amp * ((float)((seed >> 16) & 0x7FFF) / 16383.5f - 1.0f);
+  };
+  uint32_t publishes = 0, notifies = 0;
+  for (uint32_t t = 0; t < HOUR_MS; t += PUBLISH_MS) {
+    TelemetryFrame f = frame();
+    bool charging = t >= 40 * 60000;
+    f.V = (charging ? 14.2f : 12.6f) + noise(0.004f);
+    f.I = (charging ? 8.0f : -0.3f) + noise(0.1f);
+    f.alternator_on = charging;
+    f.T = 18.0f + t / (float)HOUR_MS; // slow drift
+    f.soc_pct = 80.0f + (charging ? (t - 40 * 60000) / 120000.0f : 0.0f);
+    if (t == 40 * 60000)
+      f.I = -150.0f; // crank
+    publishes++;
+    if (gate.check(f, t, false, 60000) != RR_NONE) {
+      gate.sent(f, t);
+      notifies++;
+    }
+  }
+  char msg[120];
+  snprintf(msg, sizeof(msg),
+           "notifications/h: %lu before (string characteristics), %lu after",
+           (unsigned long)(publishes * LEGACY_PER_PUBLISH),
+           (unsigned long)notifies);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_EQUAL_UINT32(1800, publishes);
+  // Heartbeats alone are 60 per hour; the noise must not add many more
+  TEST_ASSERT_TRUE(notifies >= 60);
+  TEST_ASSERT_TRUE(notifies < 120);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_frame_layout);
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_round_trip_capacity_upper_bound);
+  RUN_TEST(test_missing_and_clamped_values);
+  RUN_TEST(test_bad_input_rejected);
+  RUN_TEST(test_gate_ignores_fields_not_in_frame);
+  RUN_TEST(test_stats_json);
+  RUN_TEST(test_notifications_per_hour);
+  return UNITY_END();
+}
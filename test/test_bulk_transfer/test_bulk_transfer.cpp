@@ -0,0 +1,330 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <unity.h>
+
+// Sender and receiver run against each other in a loopback.
+#include "../../src/comms/bulk_transfer.cpp"
+#include "../../src/history/history_source.cpp"
+#include "../../src/history/rollup.cpp"
+#include "../../src/json_writer.cpp"
+
+// Source 0: `size` bytes of a counting pattern; source 1 exists but is
+// empty. The tag is settable to simulate content changing between
+// transfers.
+struct PatternSource : BulkSource {
+  uint32_t size = 0, tag = 1;
+  uint32_t reads = 0;
+  bool open(uint8_t source, uint32_t, uint32_t &total,
+            uint32_t &t) override {
+    if (source > 1)
+      return false;
+    total = source == 0 ? size : 0;
+    t = tag;
+    return true;
+  }
+  size_t read(uint32_t offset, uint8_t *out, size_t len) override {
+    reads++;
+    if (offset >= size)
+      return 0;
+    if (len > size - offset)
+      len = size - offset;
+    for (size_t i = 0; i < len; ++i)
+      out[i] = pattern(offset + i);
+    return len;
+  }
+  static uint8_t pattern(uint32_t at) { return (uint8_t)(at * 7 + (at >> 8)); }
+};
+
+static PatternSource src;
+static BulkSender sender;
+static uint8_t rxBuf[16384];
+static BulkReceiver *rx;
+static uint32_t now;
+
+// Loopback link: a few notifications per connection event, with the
+// notifications and ACKs to drop chosen by index.
+struct Link {
+  uint32_t notifies = 0, acks = 0;
+  uint32_t dropNotify[8] = {0}, dropAck[8] = {0}; // 1-based indices
+  bool dropped(const uint32_t *list, uint32_t idx) {
+    for (int i = 0; i < 8; ++i)
+      if (list[i] == idx)
+        return true;
+    return false;
+  }
+  void control(const uint8_t *m, size_t n) {
+    if (!n)
+      return;
+    if (m[0] == BULK_ACK && dropped(dropAck, ++acks))
+      return;
+    sender.onControl(m, n, now);
+  }
+  // One connection event: up to `perEvent` notifications, `ms` long
+  void event(int perEvent, uint32_t ms) {
+    uint8_t pkt[256], ctl[16];
+    for (int k = 0; k < perEvent; ++k) {
+      size_t n = sender.poll(pkt, sizeof(pkt), now);
+      if (!n)
+        break;
+      if (dropped(dropNotify, ++notifies))
+        continue;
+      control(ctl, rx->onNotify(pkt, n, ctl, sizeof(ctl)));
+    }
+    now += ms;
+  }
+  void run(int perEvent = 6, uint32_t ms = 15, int maxEvents = 5000) {
+    for (int e = 0; e < maxEvents && (sender.active() || !rx->done()); ++e)
+      event(perEvent, ms);
+  }
+};
+
+static BulkReceiver receiver(rxBuf, sizeof(rxBuf));
+
+void setUp(void) {
+  src = PatternSource();
+  sender = BulkSender(&src);
+  sender.setMaxNotify(244); // MTU 247
+  receiver = BulkReceiver(rxBuf, sizeof(rxBuf));
+  rx = &receiver;
+  memset(rxBuf, 0, sizeof(rxBuf));
+  now = 1000;
+}
+
+void tearDown(void) {}
+
+static void startTransfer(Link &link, uint8_t source, uint8_t window) {
+  uint8_t ctl[16];
+  link.control(ctl, rx->start(source, 0, window, ctl, sizeof(ctl)));
+}
+
+static void assertPattern(uint32_t size) {
+  for (uint32_t i = 0; i < size; ++i)
+    if (rxBuf[i] != PatternSource::pattern(i)) {
+      char msg[48];
+      snprintf(msg, sizeof(msg), "byte %u differs", (unsigned)i);
+      TEST_FAIL_MESSAGE(msg);
+    }
+}
+
+void test_full_transfer(void) {
+  src.size = 10000;
+  Link link;
+  startTransfer(link, 0, 8);
+  link.run();
+  TEST_ASSERT_TRUE(rx->done());
+  TEST_ASSERT_FALSE(sender.active());
+  TEST_ASSERT_EQUAL_UINT32(10000, rx->received());
+  assertPattern(10000);
+  // 237-byte chunks, none sent twice
+  TEST_ASSERT_EQUAL_UINT32((10000 + 236) / 237, sender.chunks());
+  TEST_ASSERT_EQUAL_UINT32(0, sender.rewinds());
+  TEST_ASSERT_EQUAL_UINT32(0, rx->duplicates());
+}
+
+void test_window_limits_unacked_chunks(void) {
+  src.size = 5000;
+  uint8_t ctl[16], pkt[256];
+  sender.onControl(ctl, rx->start(0, 0, 4, ctl, sizeof(ctl)), now);
+  TEST_ASSERT_EQUAL_UINT32(BULK_INFO_LEN, sender.poll(pkt, sizeof(pkt), now));
+  TEST_ASSERT_EQUAL_UINT32(0, rx->onNotify(pkt, BULK_INFO_LEN, ctl, 16));
+  TEST_ASSERT_EQUAL_UINT32(5000, rx->total());
+  // Without ACKs the sender stops after 4 chunks
+  int sent = 0;
+  while (sender.poll(pkt, sizeof(pkt), now))
+    sent++;
+  TEST_ASSERT_EQUAL_INT(4, sent);
+  // An ACK for two chunks opens the window by two
+  uint8_t ack[BULK_ACK_LEN] = {BULK_ACK, 0, 0, 0, 0, 0};
+  bulkPut32(ack + 1, 2 * 237);
+  sender.onControl(ack, sizeof(ack), now);
+  sent = 0;
+  while (sender.poll(pkt, sizeof(pkt), now))
+    sent++;
+  TEST_ASSERT_EQUAL_INT(2, sent);
+  TEST_ASSERT_EQUAL_UINT32(2 * 237, sender.acked());
+}
+
+void test_lost_chunk_resent_after_gap_ack(void) {
+  src.size = 8000;
+  Link link;
+  link.dropNotify[0] = 5; // INFO is notification 1
+  link.dropNotify[1] = 20;
+  startTransfer(link, 0, 8);
+  link.run();
+  TEST_ASSERT_TRUE(rx->done());
+  assertPattern(8000);
+  TEST_ASSERT_EQUAL_UINT32(2, sender.rewinds());
+  TEST_ASSERT_TRUE(now - 1000 < BULK_ACK_TIMEOUT_MS); // no timeout needed
+}
+
+void test_lost_ack_recovered_by_timeout(void) {
+  src.size = 3000;
+  Link link;
+  link.dropAck[0] = 4; // the final ACK (13 chunks, one every 4)
+  startTransfer(link, 0, 8);
+  link.run();
+  TEST_ASSERT_TRUE(rx->done());
+  TEST_ASSERT_FALSE(sender.active());
+  assertPattern(3000);
+  TEST_ASSERT_TRUE(sender.rewinds() >= 1);
+  TEST_ASSERT_TRUE(rx->duplicates() >= 1);
+}
+
+void test_resume_sends_only_the_rest(void) {
+  src.size = 6000;
+  Link link;
+  startTransfer(link, 0, 8);
+  for (int e = 0; e < 3; ++e)
+    link.event(6, 15);
+  uint32_t got = rx->received();
+  TEST_ASSERT_TRUE(got > 0 && got < 6000);
+  // Connection lost: the device forgets the transfer
+  sender.abort();
+  uint32_t chunks0 = sender.chunks();
+  startTransfer(link, 0, 8);
+  link.run();
+  TEST_ASSERT_TRUE(rx->done());
+  assertPattern(6000);
+  uint32_t resent = sender.chunks() - chunks0;
+  TEST_ASSERT_EQUAL_UINT32((6000 - got + 236) / 237, resent);
+}
+
+void test_resume_restarts_when_content_changed(void) {
+  src.size = 6000;
+  Link link;
+  startTransfer(link, 0, 8);
+  link.event(6, 15);
+  TEST_ASSERT_TRUE(rx->received() > 0);
+  sender.abort();
+  src.tag = 2; // e.g. the oldest bucket left the ring
+  src.size = 5000;
+  startTransfer(link, 0, 8);
+  link.run();
+  TEST_ASSERT_TRUE(rx->done());
+  TEST_ASSERT_EQUAL_UINT32(5000, rx->received());
+  assertPattern(5000);
+}
+
+void test_errors_and_empty_source(void) {
+  Link link;
+  startTransfer(link, 9, 8);
+  link.event(6, 15);
+  TEST_ASSERT_EQUAL_UINT8(BULK_ERR_SOURCE, rx->status());
+  TEST_ASSERT_FALSE(sender.active());
+  TEST_ASSERT_FALSE(rx->done());
+
+  uint8_t start[BULK_START_LEN] = {BULK_START, 0};
+  bulkPut32(start + 6, 100); // offset past the end of 0 bytes
+  start[10] = 4;
+  sender.onControl(start, sizeof(start), now);
+  uint8_t pkt[256];
+  TEST_ASSERT_EQUAL_UINT32(BULK_INFO_LEN, sender.poll(pkt, sizeof(pkt), now));
+  TEST_ASSERT_EQUAL_UINT8(BULK_ERR_OFFSET, pkt[2]);
+
+  BulkReceiver empty(rxBuf, sizeof(rxBuf));
+  rx = &empty;
+  startTransfer(link, 1, 8);
+  link.run();
+  TEST_ASSERT_TRUE(rx->done());
+  TEST_ASSERT_EQUAL_UINT32(0, rx->total());
+}
+
+void test_unsent_notification_repeated(void) {
+  src.size = 1000;
+  uint8_t ctl[16], pkt[256], again[256];
+  sender.onControl(ctl, rx->start(0, 0, 8, ctl, sizeof(ctl)), now);
+  size_t n = sender.poll(pkt, sizeof(pkt), now);
+  sender.unsent();
+  TEST_ASSERT_EQUAL_UINT32(n, sender.poll(again, sizeof(again), now));
+  TEST_ASSERT_EQUAL_MEMORY(pkt, again, n);
+  n = sender.poll(pkt, sizeof(pkt), now);
+  sender.unsent();
+  TEST_ASSERT_EQUAL_UINT32(n, sender.poll(again, sizeof(again), now));
+  TEST_ASSERT_EQUAL_MEMORY(pkt, again, n);
+  TEST_ASSERT_EQUAL_UINT32(1, sender.chunks());
+}
+
+static RollupState rstate;
+
+void test_rollup_source_matches_query(void) {
+  Rollup roll(rstate);
+  roll.clear();
+  const uint32_t T0 = 1704067200u;
+  for (uint32_t t = T0; t < T0 + 3 * 3600 + 600; t += 30)
+    roll.add(t, 12.5f + (t % 7) * 0.01f, -1.0f, 20.0f, 80.0f, 5.0f);
+  RollupSource rs(roll);
+  sender = BulkSender(&rs);
+  sender.setMaxNotify(100); // small chunks straddle record boundaries
+  BulkReceiver r(rxBuf, sizeof(rxBuf));
+  rx = &r;
+  Link link;
+  uint8_t ctl[16];
+  const uint32_t from = T0 + 3600;
+  link.control(ctl, rx->start(TIER_MINUTE, from, 8, ctl, sizeof(ctl)));
+  link.run();
+  TEST_ASSERT_TRUE(rx->done());
+  RollupBucket expect[ROLLUP_MINUTES];
+  size_t n = roll.query(TIER_MINUTE, from, 0xFFFFFFFFu, expect,
+                        ROLLUP_MINUTES);
+  TEST_ASSERT_TRUE(n > 60);
+  TEST_ASSERT_EQUAL_UINT32(n * sizeof(RollupBucket), rx->total());
+  TEST_ASSERT_EQUAL_MEMORY(expect, rxBuf, n * sizeof(RollupBucket));
+
+  // Hours: all closed ones, tagged with the first one's start
+  BulkReceiver h(rxBuf, sizeof(rxBuf));
+  rx = &h;
+  link.control(ctl, rx->start(TIER_HOUR, 0, 8, ctl, sizeof(ctl)));
+  link.run();
+  TEST_ASSERT_TRUE(rx->done());
+  TEST_ASSERT_EQUAL_UINT32(3 * sizeof(RollupBucket), rx->total());
+  RollupBucket b;
+  memcpy(&b, rxBuf, sizeof(b));
+  TEST_ASSERT_EQUAL_UINT32(T0, b.start);
+}
+
+// What a full history download costs on the air: connection events of
+// 7.5 ms (the fast parameters, rounded up to 8) carrying up to 6
+// notifications each, and how much of that is RollupBucket payload.
+void test_throughput_model(void) {
+  src.size = ROLLUP_BUCKETS * sizeof(RollupBucket);
+  Link link;
+  startTransfer(link, 0, 16);
+  uint32_t t0 = now;
+  auto c0 = std::chrono::steady_clock::now();
+  link.run(6, 8);
+  auto c1 = std::chrono::steady_clock::now();
+  TEST_ASSERT_TRUE(rx->done());
+  assertPattern(src.size);
+  double secs = (now - t0) / 1000.0;
+  double notifies = link.notifies;
+  double payload = src.size;
+  double onAir = payload + notifies * BULK_DATA_HEADER;
+  char msg[160];
+  snprintf(msg, sizeof(msg),
+           "%u bytes in %.3f s (%.1f kB/s), %u notifications, %.1f%% "
+           "payload, %.2f us host CPU per chunk",
+           (unsigned)src.size, secs, payload / secs / 1000.0,
+           (unsigned)link.notifies, 100.0 * payload / onAir,
+           std::chrono::duration<double, std::micro>(c1 - c0).count() /
+               sender.chunks());
+  TEST_MESSAGE(msg);
+  // The whole history in well under a second at the fast interval
+  TEST_ASSERT_TRUE(secs < 1.0);
+  TEST_ASSERT_TRUE(payload / onAir > 0.95);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_full_transfer);
+  RUN_TEST(test_window_limits_unacked_chunks);
+  RUN_TEST(test_lost_chunk_resent_after_gap_ack);
+  RUN_TEST(test_lost_ack_recovered_by_timeout);
+  RUN_TEST(test_resume_sends_only_the_rest);
+  RUN_TEST(test_resume_restarts_when_content_changed);
+  RUN_TEST(test_errors_and_empty_source);
+  RUN_TEST(test_unsent_notification_repeated);
+  RUN_TEST(test_rollup_source_matches_query);
+  RUN_TEST(test_throughput_model);
+  return UNITY_END();
+}
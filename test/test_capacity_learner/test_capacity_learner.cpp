@@ -0,0 +1,257 @@
+#include <cmath>
+#include <cstring>
+#include <unity.h>
+
+#include "../../src/learner/capacity_learner.cpp"
+
+static CapacityFit fit;
+static CapacityAnchor anchor;
+static CapacityConfig cfg;
+static const float NOMINAL_AH = 70.0f;
+
+static CapacityLearner makeLearner() {
+  CapacityLearner l(fit, anchor);
+  l.begin(cfg);
+  return l;
+}
+
+// Discharge `dSoc` percent of a battery with true capacity `trueAh` between
+// two rest points, in `steps` coulomb-counting increments.
+static uint8_t cycle(CapacityLearner &l, float fromSoc, float toSoc,
+                     float trueAh, int steps = 100) {
+  float dAh = (fromSoc - toSoc) / 100.0f * trueAh;
+  for (int i = 0; i < steps; ++i)
+    l.addCharge(dAh / steps);
+  return l.addRestPoint(toSoc, NOMINAL_AH);
+}
+
+void setUp(void) {
+  memset(&fit, 0, sizeof(fit));
+  memset(&anchor, 0, sizeof(anchor));
+  cfg = CapacityConfig();
+}
+void tearDown(void) {}
+
+void test_capacity_begin_resets_invalid_state(void) {
+  memset(&fit, 0xA5, sizeof(fit));
+  memset(&anchor, 0xA5, sizeof(anchor));
+  CapacityLearner l = makeLearner();
+  TEST_ASSERT_EQUAL(CAPACITY_FIT_MAGIC, fit.magic);
+  TEST_ASSERT_EQUAL(CAPACITY_ANCHOR_MAGIC, anchor.magic);
+  TEST_ASSERT_FALSE(l.anchored());
+  TEST_ASSERT_TRUE(std::isnan(l.capacityAh()));
+  TEST_ASSERT_FALSE(l.confident());
+}
+
+void test_capacity_begin_keeps_valid_state(void) {
+  // Simulates the fit coming back from NVS and the anchor from RTC memory
+  CapacityLearner a = makeLearner();
+  a.addRestPoint(90.0f, NOMINAL_AH);
+  cycle(a, 90.0f, 60.0f, 60.0f);
+  float c = a.capacityAh();
+
+  CapacityLearner b(fit, anchor);
+  b.begin(cfg);
+  TEST_ASSERT_TRUE(b.anchored());
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, c, b.capacityAh());
+}
+
+void test_capacity_first_rest_point_anchors(void) {
+  CapacityLearner l = makeLearner();
+  TEST_ASSERT_EQUAL(CAP_EVT_ANCHORED, l.addRestPoint(85.0f, NOMINAL_AH));
+  TEST_ASSERT_TRUE(l.anchored());
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, 85.0f, anchor.soc_pct);
+}
+
+void test_capacity_charge_ignored_without_anchor(void) {
+  CapacityLearner l = makeLearner();
+  l.addCharge(5.0f);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.0f, anchor.netAh);
+}
+
+void test_capacity_single_pair_estimate(void) {
+  CapacityLearner l = makeLearner();
+  l.addRestPoint(90.0f, NOMINAL_AH);
+  TEST_ASSERT_EQUAL(CAP_EVT_UPDATED, cycle(l, 90.0f, 60.0f, 55.0f));
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 55.0f, l.capacityAh());
+  TEST_ASSERT_TRUE(l.sigmaAh() > 0.0f);
+  // One pair is never enough to override the configured capacity
+  TEST_ASSERT_FALSE(l.confident());
+}
+
+void test_capacity_converges_and_becomes_confident(void) {
+  CapacityLearner l = makeLearner();
+  l.addRestPoint(95.0f, NOMINAL_AH);
+  for (int i = 0; i < 6; ++i) {
+    cycle(l, 95.0f, 55.0f, 52.0f);
+    // recharge: counted charge is negative, OCV back to 95 %
+    cycle(l, 55.0f, 95.0f, 52.0f);
+  }
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, 52.0f, l.capacityAh());
+  TEST_ASSERT_TRUE(l.confident());
+}
+
+// A new nominal capacity (battery swap, SET_CAP) forgets the old fit, so it
+// no longer overrides the configured capacity
+void test_capacity_nominal_change_resets_fit(void) {
+  CapacityLearner l = makeLearner();
+  TEST_ASSERT_FALSE(l.setNominal(NOMINAL_AH)); // first call only records
+  l.addRestPoint(95.0f, NOMINAL_AH);
+  for (int i = 0; i < 6; ++i) {
+    cycle(l, 95.0f, 55.0f, 52.0f);
+    cycle(l, 55.0f, 95.0f, 52.0f);
+  }
+  TEST_ASSERT_TRUE(l.confident());
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, 52.0f, usableCapacityAh(l, NOMINAL_AH, 1.0f));
+  TEST_ASSERT_FALSE(l.setNominal(NOMINAL_AH)); // unchanged: fit kept
+  TEST_ASSERT_TRUE(l.confident());
+
+  TEST_ASSERT_TRUE(l.setNominal(100.0f));
+  TEST_ASSERT_FALSE(l.confident());
+  TEST_ASSERT_FALSE(l.anchored());
+  TEST_ASSERT_EQUAL(CAPACITY_FIT_MAGIC, fit.magic);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 90.0f, usableCapacityAh(l, 100.0f, 0.9f));
+}
+
+void test_capacity_charging_pairs_count(void) {
+  CapacityLearner l = makeLearner();
+  l.addRestPoint(40.0f, NOMINAL_AH);
+  TEST_ASSERT_EQUAL(CAP_EVT_UPDATED, cycle(l, 40.0f, 80.0f, 64.0f));
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 64.0f, l.capacityAh());
+}
+
+void test_capacity_small_swing_refreshes_anchor_when_idle(void) {
+  CapacityLearner l = makeLearner();
+  l.addRestPoint(80.0f, NOMINAL_AH);
+  l.addCharge(0.05f);
+  TEST_ASSERT_EQUAL(CAP_EVT_ANCHORED, l.addRestPoint(81.0f, NOMINAL_AH));
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, 81.0f, anchor.soc_pct);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.0f, anchor.netAh);
+}
+
+void test_capacity_small_swing_keeps_anchor_after_use(void) {
+  CapacityLearner l = makeLearner();
+  l.addRestPoint(80.0f, NOMINAL_AH);
+  l.addCharge(3.0f);
+  TEST_ASSERT_EQUAL(CAP_EVT_NONE, l.addRestPoint(76.0f, NOMINAL_AH));
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, 80.0f, anchor.soc_pct);
+  // The swing keeps growing until it is large enough to fit
+  l.addCharge(4.0f);
+  TEST_ASSERT_EQUAL(CAP_EVT_UPDATED, l.addRestPoint(70.0f, NOMINAL_AH));
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 70.0f, l.capacityAh());
+}
+
+void test_capacity_excess_throughput_drops_anchor(void) {
+  CapacityLearner l = makeLearner();
+  l.addRestPoint(80.0f, NOMINAL_AH);
+  // Lots of charge back and forth, tiny net change
+  for (int i = 0; i < 200; ++i)
+    l.addCharge((i & 1) ? -1.0f : 1.0f);
+  TEST_ASSERT_EQUAL(CAP_EVT_ANCHORED, l.addRestPoint(79.0f, NOMINAL_AH));
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.0f, anchor.throughputAh);
+}
+
+void test_capacity_rejects_implausible_pair(void) {
+  CapacityLearner l = makeLearner();
+  l.addRestPoint(90.0f, NOMINAL_AH);
+  // 40 % SOC drop for 2 Ah implies a 5 Ah battery
+  l.addCharge(2.0f);
+  TEST_ASSERT_EQUAL(CAP_EVT_REJECTED, l.addRestPoint(50.0f, NOMINAL_AH));
+  TEST_ASSERT_TRUE(std::isnan(l.capacityAh()));
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, 50.0f, anchor.soc_pct);
+}
+
+void test_capacity_high_throughput_pair_weighs_less(void) {
+  CapacityLearner l = makeLearner();
+  l.addRestPoint(90.0f, NOMINAL_AH);
+  cycle(l, 90.0f, 50.0f, 60.0f); // clean pair
+  // Same swing, but 200 Ah of extra charge cycled through on the way
+  for (int i = 0; i < 200; ++i)
+    l.addCharge((i & 1) ? -1.0f : 1.0f);
+  cycle(l, 50.0f, 10.0f, 40.0f);
+  // An unweighted fit gives exactly 50 Ah; the clean pair pulls it higher
+  TEST_ASSERT_TRUE(l.capacityAh() > 55.0f);
+}
+
+void test_capacity_forgetting_tracks_change(void) {
+  CapacityLearner l = makeLearner();
+  l.addRestPoint(90.0f, NOMINAL_AH);
+  for (int i = 0; i < 5; ++i) {
+    cycle(l, 90.0f, 50.0f, 60.0f);
+    cycle(l, 50.0f, 90.0f, 60.0f);
+  }
+  for (int i = 0; i < 40; ++i) {
+    cycle(l, 90.0f, 50.0f, 45.0f);
+    cycle(l, 50.0f, 90.0f, 45.0f);
+  }
+  TEST_ASSERT_FLOAT_WITHIN(0.5f, 45.0f, l.capacityAh());
+}
+
+void test_capacity_scatter_inflates_sigma(void) {
+  CapacityLearner a = makeLearner();
+  a.addRestPoint(90.0f, NOMINAL_AH);
+  for (int i = 0; i < 4; ++i) {
+    cycle(a, 90.0f, 50.0f, 60.0f);
+    cycle(a, 50.0f, 90.0f, 60.0f);
+  }
+  float cleanSigma = a.sigmaAh();
+
+  memset(&fit, 0, sizeof(fit));
+  memset(&anchor, 0, sizeof(anchor));
+  CapacityLearner b = makeLearner();
+  b.addRestPoint(90.0f, NOMINAL_AH);
+  for (int i = 0; i < 4; ++i) {
+    cycle(b, 90.0f, 50.0f, 45.0f);
+    cycle(b, 50.0f, 90.0f, 75.0f);
+  }
+  TEST_ASSERT_TRUE(b.sigmaAh() > 2.0f * cleanSigma);
+}
+
+void test_capacity_nonfinite_inputs_ignored(void) {
+  CapacityLearner l = makeLearner();
+  TEST_ASSERT_EQUAL(CAP_EVT_NONE, l.addRestPoint(NAN, NOMINAL_AH));
+  TEST_ASSERT_EQUAL(CAP_EVT_NONE, l.addRestPoint(80.0f, 0.0f));
+  TEST_ASSERT_FALSE(l.anchored());
+  l.addRestPoint(80.0f, NOMINAL_AH);
+  l.addCharge(NAN);
+  l.addCharge(INFINITY);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.0f, anchor.netAh);
+}
+
+void test_capacity_json(void) {
+  CapacityLearner l = makeLearner();
+  char js[160];
+  TEST_ASSERT_TRUE(buildCapacityJson(l, NOMINAL_AH, js, sizeof(js)));
+  TEST_ASSERT_NOT_NULL(strstr(js, "\"capacity_ah\":null"));
+  TEST_ASSERT_NOT_NULL(strstr(js, "\"confident\":false"));
+
+  l.addRestPoint(90.0f, NOMINAL_AH);
+  cycle(l, 90.0f, 60.0f, 55.0f);
+  TEST_ASSERT_TRUE(buildCapacityJson(l, NOMINAL_AH, js, sizeof(js)));
+  TEST_ASSERT_NOT_NULL(strstr(js, "\"capacity_ah\":55.00"));
+  TEST_ASSERT_NOT_NULL(strstr(js, "\"nominal_ah\":70.0"));
+
+  TEST_ASSERT_FALSE(buildCapacityJson(l, NOMINAL_AH, js, 16));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_capacity_begin_resets_invalid_state);
+  RUN_TEST(test_capacity_begin_keeps_valid_state);
+  RUN_TEST(test_capacity_first_rest_point_anchors);
+  RUN_TEST(test_capacity_charge_ignored_without_anchor);
+  RUN_TEST(test_capacity_single_pair_estimate);
+  RUN_TEST(test_capacity_converges_and_becomes_confident);
+  RUN_TEST(test_capacity_nominal_change_resets_fit);
+  RUN_TEST(test_capacity_charging_pairs_count);
+  RUN_TEST(test_capacity_small_swing_refreshes_anchor_when_idle);
+  RUN_TEST(test_capacity_small_swing_keeps_anchor_after_use);
+  RUN_TEST(test_capacity_excess_throughput_drops_anchor);
+  RUN_TEST(test_capacity_rejects_implausible_pair);
+  RUN_TEST(test_capacity_high_throughput_pair_weighs_less);
+  RUN_TEST(test_capacity_forgetting_tracks_change);
+  RUN_TEST(test_capacity_scatter_inflates_sigma);
+  RUN_TEST(test_capacity_nonfinite_inputs_ignored);
+  RUN_TEST(test_capacity_json);
+  return UNITY_END();
+}
@@ -0,0 +1,188 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <unity.h>
+
+#include "../../src/comms/command_parser.cpp"
+#include "../../src/config/config_store.cpp"
+#include "../../src/log/logger.cpp"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static CommandParse parse(const char *s, ParsedCommand &p) {
+  return parseCommand(s, strlen(s), p);
+}
+
+static void assertCommand(const char *s, CommandId id, float param) {
+  ParsedCommand p;
+  TEST_ASSERT_EQUAL_UINT8_MESSAGE(CMD_PARSE_OK, parse(s, p), s);
+  TEST_ASSERT_EQUAL_UINT8_MESSAGE(id, p.spec->id, s);
+  if (std::isnan(param))
+    TEST_ASSERT_TRUE_MESSAGE(std::isnan(p.param), s);
+  else
+    TEST_ASSERT_EQUAL_FLOAT_MESSAGE(param, p.param, s);
+}
+
+static void assertResult(const char *s, CommandParse r) {
+  ParsedCommand p;
+  TEST_ASSERT_EQUAL_UINT8_MESSAGE(r, parse(s, p), s);
+}
+
+void test_plain_commands(void) {
+  assertCommand("CLEAR_NVM", CMD_CLEAR_NVM, NAN);
+  assertCommand("NVS_TEST", CMD_NVS_TEST, NAN);
+  assertCommand("RESET", CMD_RESET, NAN);
+  assertCommand("CLEAR_RESET", CMD_CLEAR_RESET, NAN);
+  assertCommand("reset", CMD_RESET, NAN);
+  assertCommand("Clear_Nvm", CMD_CLEAR_NVM, NAN);
+}
+
+void test_numeric_arguments(void) {
+  assertCommand("SET_CAP:12.5", CMD_SET_CAP, 12.5f);
+  assertCommand("SET_CAP 12.5", CMD_SET_CAP, 12.5f);
+  assertCommand("set_cap=70", CMD_SET_CAP, 70.0f);
+  assertCommand("SET_CAP12.5", CMD_SET_CAP, 12.5f); // as accepted before
+  assertCommand("SET_BASE:35.0", CMD_SET_BASE, 35.0f);
+  assertCommand("SET_BASELINE=4.25", CMD_SET_BASE, 4.25f);
+  assertCommand("SET_BASE.5", CMD_SET_BASE, 0.5f);
+}
+
+void test_word_arguments(void) {
+  assertCommand("ENC:JSON", CMD_SET_ENC, 1.0f);
+  assertCommand("ENC CBOR", CMD_SET_ENC, 2.0f);
+  assertCommand("enc=both", CMD_SET_ENC, 3.0f);
+  assertCommand("HIST:M", CMD_HISTORY, 0.0f);
+  assertCommand("HIST H", CMD_HISTORY, 1.0f);
+  assertCommand("hist=d", CMD_HISTORY, 2.0f);
+  assertCommand("LOG:E", CMD_LOG_LEVEL, (float)LL_ERROR);
+  assertCommand("LOG W", CMD_LOG_LEVEL, (float)LL_WARN);
+  assertCommand("log=info", CMD_LOG_LEVEL, (float)LL_INFO);
+  assertCommand("LOG:Debug", CMD_LOG_LEVEL, (float)LL_DEBUG);
+}
+
+void test_bad_parameters(void) {
+  const char *bad[] = {"SET_CAP",      "SET_CAP:",       "SET_CAP:-1",
+                       "SET_CAP:0",    "SET_CAP:abc",    "SET_CAP:12.5Ah",
+                       "SET_CAP:inf",  "SET_CAP:nan",    "SET_BASE: ",
+                       "ENC:XML",      "ENC:JSONX",      "ENC:JS",
+                       "HIST:X",       "HIST:MH",        "HIST",
+                       "LOG:DE",       "LOG:",           "RESET:now",
+                       "CLEAR_NVM 1",  "SET_CAP:123456789012345678"};
+  for (const char *s : bad)
+    assertResult(s, CMD_PARSE_BAD_PARAM);
+  // The spec is known even when the argument is not
+  ParsedCommand p;
+  parse("SET_CAP:x", p);
+  TEST_ASSERT_EQUAL_UINT8(CMD_SET_CAP, p.spec->id);
+}
+
+void test_config_arguments(void) {
+  size_t n;
+  const ConfigField *f = configFields(n);
+  ParsedCommand p;
+  TEST_ASSERT_EQUAL_UINT8(CMD_PARSE_OK, parse("CFG:sample_ms=2000", p));
+  TEST_ASSERT_EQUAL_UINT8(CMD_CONFIG, p.spec->id);
+  TEST_ASSERT_EQUAL_STRING("sample_ms", f[p.field].name);
+  TEST_ASSERT_EQUAL_FLOAT(2000.0f, p.param);
+  // Read: no value, param stays NAN
+  TEST_ASSERT_EQUAL_UINT8(CMD_PARSE_OK, parse("cfg REST_A", p));
+  TEST_ASSERT_EQUAL_STRING("rest_a", f[p.field].name);
+  TEST_ASSERT_TRUE(std::isnan(p.param));
+  TEST_ASSERT_EQUAL_UINT8(CMD_PARSE_OK, parse("CFG=idle_a:0.25", p));
+  TEST_ASSERT_EQUAL_STRING("idle_a", f[p.field].name);
+  TEST_ASSERT_EQUAL_FLOAT(0.25f, p.param);
+  // Longer than the numeric buffer, as a whole
+  TEST_ASSERT_EQUAL_UINT8(CMD_PARSE_OK,
+                          parse("CFG:publish_idle_ms=3600000", p));
+  TEST_ASSERT_EQUAL_FLOAT(3600000.0f, p.param);
+  const char *bad[] = {"CFG",          "CFG:",           "CFG:nope=1",
+                       "CFG:sample",   "CFG:sample_ms=", "CFG:sample_ms=10",
+                       "CFG:tlm_enc=4", "CFG:sample_ms=100.5",
+                       "CFG:rest_a=x", "CFG:rest_a=nan"};
+  for (const char *s : bad)
+    assertResult(s, CMD_PARSE_BAD_PARAM);
+}
+
+void test_unknown_commands(void) {
+  const char *unknown[] = {"", "   ", "RESETX", "RESE", "SET", "SET_CAPX:1",
+                           "SET_BASELINEX=3", "HISTORY:M", "XRESET",
+                           "PROF", // profiler not built in
+                           "ENCODING:JSON"};
+  for (const char *s : unknown)
+    assertResult(s, CMD_PARSE_UNKNOWN);
+}
+
+void test_whitespace_and_unterminated_input(void) {
+  assertCommand("  RESET\r\n", CMD_RESET, NAN);
+  assertCommand("SET_CAP:12.5\n", CMD_SET_CAP, 12.5f);
+  assertCommand("\tLOG W ", CMD_LOG_LEVEL, (float)LL_WARN);
+  // MQTT payloads are not NUL-terminated: only `len` bytes count
+  const char buf[] = {'H', 'I', 'S', 'T', ':', 'D', 'X', 'Y'};
+  ParsedCommand p;
+  TEST_ASSERT_EQUAL_UINT8(CMD_PARSE_OK, parseCommand(buf, 6, p));
+  TEST_ASSERT_EQUAL_FLOAT(2.0f, p.param);
+  const char num[] = {'S', 'E', 'T', '_', 'C', 'A', 'P', ':', '7', '5'};
+  TEST_ASSERT_EQUAL_UINT8(CMD_PARSE_OK, parseCommand(num, 9, p));
+  TEST_ASSERT_EQUAL_FLOAT(7.0f, p.param);
+}
+
+void test_table_is_well_formed(void) {
+  size_t n;
+  const CommandSpec *t = commandTable(n);
+  TEST_ASSERT_TRUE(n >= 10);
+  for (size_t i = 0; i < n; ++i) {
+    for (const char *c = t[i].name; *c; ++c)
+      TEST_ASSERT_TRUE(!(*c >= 'a' && *c <= 'z'));
+    TEST_ASSERT_TRUE(t[i].queued && strncmp(t[i].queued, "QUEUED_", 7) == 0);
+    TEST_ASSERT_TRUE((t[i].arg == ARG_WORD) == (t[i].words != nullptr));
+    for (size_t j = i + 1; j < n; ++j)
+      TEST_ASSERT_TRUE(strcmp(t[i].name, t[j].name) != 0);
+    // Every name parses to its own entry
+    ParsedCommand p;
+    parse(t[i].name, p);
+    TEST_ASSERT_TRUE(p.spec == &t[i]);
+  }
+}
+
+// Parse rate over a mix of valid, invalid and unknown lines
+void test_parse_throughput(void) {
+  static const char *lines[] = {
+      "SET_CAP:12.5", "set_baseline=35.0", "ENC:CBOR", "HIST H",
+      "LOG:I",        "RESET",             "CLEAR_NVM", "SET_CAP:abc",
+      "UNKNOWN",      "  nvs_test\r\n"};
+  const size_t L = sizeof(lines) / sizeof(lines[0]);
+  size_t lens[L];
+  for (size_t i = 0; i < L; ++i)
+    lens[i] = strlen(lines[i]);
+  const int ROUNDS = 200000;
+  ParsedCommand p;
+  uint32_t ok = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int r = 0; r < ROUNDS; ++r)
+    for (size_t i = 0; i < L; ++i)
+      ok += parseCommand(lines[i], lens[i], p) == CMD_PARSE_OK;
+  auto t1 = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() /
+              ((double)ROUNDS * L);
+  char msg[96];
+  snprintf(msg, sizeof(msg), "%.1f ns per command, %.2f M commands/s", ns,
+           1000.0 / ns);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_EQUAL_UINT32((uint32_t)ROUNDS * 8, ok);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_plain_commands);
+  RUN_TEST(test_numeric_arguments);
+  RUN_TEST(test_word_arguments);
+  RUN_TEST(test_bad_parameters);
+  RUN_TEST(test_config_arguments);
+  RUN_TEST(test_unknown_commands);
+  RUN_TEST(test_whitespace_and_unterminated_input);
+  RUN_TEST(test_table_is_well_formed);
+  RUN_TEST(test_parse_throughput);
+  return UNITY_END();
+}
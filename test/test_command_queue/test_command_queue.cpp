@@ -0,0 +1,139 @@
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <unity.h>
+
+#include "../../src/comms/command_queue.cpp"
+
+static CommandQueue *q;
+
+void setUp(void) { q = new CommandQueue(); }
+
+void tearDown(void) { delete q; }
+
+static bool pushCmd(uint8_t cmd, float param, uint16_t *id = nullptr) {
+  QueuedCommand c{cmd, 0, param, CMD_SRC_BLE, 0};
+  bool ok = q->push(c);
+  if (ok && id)
+    *id = c.id;
+  return ok;
+}
+
+void test_fifo_order_with_ids(void) {
+  uint16_t a, b;
+  TEST_ASSERT_TRUE(pushCmd(4, 12.5f, &a));
+  TEST_ASSERT_TRUE(pushCmd(5, 35.0f, &b));
+  TEST_ASSERT_EQUAL_UINT16(1, a);
+  TEST_ASSERT_EQUAL_UINT16(2, b);
+  TEST_ASSERT_EQUAL_UINT8(2, q->depth());
+  QueuedCommand c;
+  TEST_ASSERT_TRUE(q->pop(c));
+  TEST_ASSERT_EQUAL_UINT8(4, c.cmd);
+  TEST_ASSERT_EQUAL_UINT16(a, c.id);
+  TEST_ASSERT_EQUAL_FLOAT(12.5f, c.param);
+  TEST_ASSERT_TRUE(q->pop(c));
+  TEST_ASSERT_EQUAL_UINT8(5, c.cmd);
+  TEST_ASSERT_EQUAL_UINT16(b, c.id);
+  TEST_ASSERT_FALSE(q->pop(c));
+  TEST_ASSERT_EQUAL_UINT8(0, q->depth());
+}
+
+// The old single slot lost the first of two quick writes
+void test_second_write_not_lost(void) {
+  pushCmd(4, 10.0f);
+  pushCmd(9, 2.0f);
+  QueuedCommand c;
+  TEST_ASSERT_TRUE(q->pop(c));
+  TEST_ASSERT_EQUAL_FLOAT(10.0f, c.param);
+  TEST_ASSERT_TRUE(q->pop(c));
+  TEST_ASSERT_EQUAL_UINT8(9, c.cmd);
+}
+
+void test_full_queue_drops_and_counts(void) {
+  for (int k = 0; k < CMD_QUEUE_SLOTS; ++k)
+    TEST_ASSERT_TRUE(pushCmd(1, (float)k));
+  TEST_ASSERT_FALSE(pushCmd(2, 99.0f));
+  TEST_ASSERT_FALSE(pushCmd(2, 99.0f));
+  TEST_ASSERT_EQUAL_UINT32(2, q->dropped());
+  TEST_ASSERT_EQUAL_UINT32(CMD_QUEUE_SLOTS, q->queued());
+  TEST_ASSERT_EQUAL_UINT8(CMD_QUEUE_SLOTS, q->depth());
+  TEST_ASSERT_EQUAL_UINT8(CMD_QUEUE_SLOTS, q->maxDepth());
+  // The queued commands are intact and room is back after a pop
+  QueuedCommand c;
+  TEST_ASSERT_TRUE(q->pop(c));
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, c.param);
+  uint16_t id;
+  TEST_ASSERT_TRUE(pushCmd(3, 7.0f, &id));
+  TEST_ASSERT_EQUAL_UINT16(CMD_QUEUE_SLOTS + 1, id); // drops use no ID
+  for (int k = 1; k < CMD_QUEUE_SLOTS; ++k) {
+    TEST_ASSERT_TRUE(q->pop(c));
+    TEST_ASSERT_EQUAL_FLOAT((float)k, c.param);
+  }
+  TEST_ASSERT_TRUE(q->pop(c));
+  TEST_ASSERT_EQUAL_UINT8(3, c.cmd);
+}
+
+void test_ids_wrap_without_zero(void) {
+  QueuedCommand c;
+  uint16_t id = 0, prev = 0;
+  for (uint32_t k = 0; k < 70000; ++k) {
+    TEST_ASSERT_TRUE(pushCmd(1, 0.0f, &id));
+    TEST_ASSERT_TRUE(q->pop(c));
+    TEST_ASSERT_TRUE(id != 0);
+    if (k)
+      TEST_ASSERT_EQUAL_UINT16(prev == 0xFFFF ? 1 : prev + 1, id);
+    prev = id;
+  }
+  TEST_ASSERT_EQUAL_UINT8(1, q->maxDepth());
+  TEST_ASSERT_EQUAL_UINT32(70000, q->queued());
+}
+
+void test_stats_json(void) {
+  pushCmd(1, 0.0f);
+  pushCmd(1, 0.0f);
+  QueuedCommand c;
+  q->pop(c);
+  char js[96];
+  TEST_ASSERT_TRUE(buildCommandQueueJson(*q, "ble_cmd", js, sizeof(js)));
+  TEST_ASSERT_EQUAL_STRING("{\"task\":\"ble_cmd\",\"depth\":1,\"max_depth\":2,"
+                           "\"queued\":2,\"dropped\":0}",
+                           js);
+  TEST_ASSERT_FALSE(buildCommandQueueJson(*q, "ble_cmd", js, 20));
+}
+
+// A push/pop pair is a few stores: cheap enough for the NimBLE callback
+// and an every-pass check in loop()
+void test_push_pop_cost(void) {
+  const int N = 1000000;
+  QueuedCommand c;
+  uint32_t sum = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int k = 0; k < N; ++k) {
+    pushCmd(1, (float)k);
+    q->pop(c);
+    sum += c.id;
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  for (int k = 0; k < N; ++k)
+    sum += q->pop(c);
+  auto t2 = std::chrono::steady_clock::now();
+  auto ns = [N](std::chrono::steady_clock::duration d) {
+    return std::chrono::duration<double, std::nano>(d).count() / N;
+  };
+  char msg[96];
+  snprintf(msg, sizeof(msg), "push+pop %.1f ns, empty pop %.1f ns (%u)",
+           ns(t1 - t0), ns(t2 - t1), (unsigned)(sum & 1));
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_EQUAL_UINT32(0, q->dropped());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_fifo_order_with_ids);
+  RUN_TEST(test_second_write_not_lost);
+  RUN_TEST(test_full_queue_drops_and_counts);
+  RUN_TEST(test_ids_wrap_without_zero);
+  RUN_TEST(test_stats_json);
+  RUN_TEST(test_push_pop_cost);
+  return UNITY_END();
+}
@@ -0,0 +1,217 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <unity.h>
+
+#include "../../src/config/config_store.cpp"
+
+// The firmware's defaults (app_config.h)
+static const RuntimeConfig DEFAULTS = {70.0f, 1,    0.60f, 0.65f, 500,
+                                       1000,  2000, 10000, 600000};
+
+static const ConfigField &field(const char *name) {
+  const ConfigField *f = configField(name, strlen(name));
+  TEST_ASSERT_NOT_NULL(f);
+  return *f;
+}
+
+static bool sameConfig(const RuntimeConfig &a, const RuntimeConfig &b) {
+  size_t n;
+  const ConfigField *f = configFields(n);
+  for (size_t i = 0; i < n; ++i)
+    if (configGet(a, f[i]) != configGet(b, f[i]))
+      return false;
+  return true;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_schema_is_well_formed(void) {
+  size_t n;
+  const ConfigField *f = configFields(n);
+  TEST_ASSERT_EQUAL_UINT32(9, n);
+  for (size_t i = 0; i < n; ++i) {
+    TEST_ASSERT_TRUE(f[i].min <= f[i].max);
+    TEST_ASSERT_TRUE(f[i].offset + 4u <= sizeof(RuntimeConfig));
+    // The defaults are valid
+    TEST_ASSERT_TRUE_MESSAGE(configInRange(f[i], configGet(DEFAULTS, f[i])),
+                             f[i].name);
+    for (const char *c = f[i].name; *c; ++c)
+      TEST_ASSERT_TRUE(!(*c >= 'A' && *c <= 'Z'));
+    for (size_t j = i + 1; j < n; ++j)
+      TEST_ASSERT_TRUE(strcmp(f[i].name, f[j].name) != 0);
+    TEST_ASSERT_TRUE(configField(f[i].name, strlen(f[i].name)) == &f[i]);
+  }
+  TEST_ASSERT_TRUE(configField("SAMPLE_MS", 9) == &field("sample_ms"));
+  TEST_ASSERT_NULL(configField("sample", 6));
+  TEST_ASSERT_NULL(configField("sample_ms_x", 11));
+  TEST_ASSERT_NULL(configField("", 0));
+}
+
+void test_set_get_and_bounds(void) {
+  RuntimeConfig c = DEFAULTS;
+  TEST_ASSERT_TRUE(configSet(c, field("sample_ms"), 2000.0f));
+  TEST_ASSERT_EQUAL_UINT32(2000, c.sample_ms);
+  TEST_ASSERT_TRUE(configSet(c, field("rest_a"), 0.25f));
+  TEST_ASSERT_EQUAL_FLOAT(0.25f, c.rest_A);
+  TEST_ASSERT_TRUE(configSet(c, field("parked_max_ms"), 14400000.0f));
+  TEST_ASSERT_EQUAL_UINT32(14400000, c.parkedMax_ms);
+  // Out of bounds, not an integer, not finite: unchanged
+  TEST_ASSERT_FALSE(configSet(c, field("sample_ms"), 49.0f));
+  TEST_ASSERT_FALSE(configSet(c, field("sample_ms"), 1500.5f));
+  TEST_ASSERT_FALSE(configSet(c, field("tlm_enc"), 0.0f));
+  TEST_ASSERT_FALSE(configSet(c, field("capacity_ah"), NAN));
+  TEST_ASSERT_FALSE(configSet(c, field("idle_a"), INFINITY));
+  TEST_ASSERT_EQUAL_UINT32(2000, c.sample_ms);
+  TEST_ASSERT_EQUAL_UINT32(1, c.telemetryEnc);
+  TEST_ASSERT_EQUAL_FLOAT(70.0f, c.capacity_Ah);
+  TEST_ASSERT_EQUAL_FLOAT(0.65f, configGet(c, field("idle_a")));
+}
+
+void test_round_trip(void) {
+  RuntimeConfig c = DEFAULTS, out;
+  configSet(c, field("capacity_ah"), 95.5f);
+  configSet(c, field("tlm_enc"), 3.0f);
+  configSet(c, field("publish_idle_ms"), 600000.0f);
+  uint8_t blob[CONFIG_BLOB_MAX];
+  size_t n = configEncode(c, blob, sizeof(blob));
+  TEST_ASSERT_EQUAL_UINT32(CONFIG_HEADER_BYTES + 9 * 4 + 4, n);
+  TEST_ASSERT_EQUAL_UINT8(CONFIG_VERSION, blob[2]);
+  uint8_t rejected = 0xFF;
+  TEST_ASSERT_EQUAL_UINT8(CFG_LOAD_OK,
+                          configDecode(blob, n, DEFAULTS, out, &rejected));
+  TEST_ASSERT_EQUAL_UINT8(0, rejected);
+  TEST_ASSERT_TRUE(sameConfig(c, out));
+  // Too small a buffer
+  TEST_ASSERT_EQUAL_UINT32(0, configEncode(c, blob, n - 1));
+}
+
+void test_corrupt_or_foreign_blob_gives_defaults(void) {
+  RuntimeConfig c = DEFAULTS, out;
+  configSet(c, field("sample_ms"), 500.0f);
+  uint8_t blob[CONFIG_BLOB_MAX];
+  size_t n = configEncode(c, blob, sizeof(blob));
+  // Every single-bit flip is caught by the CRC (or the header checks)
+  for (size_t i = 0; i < n; ++i) {
+    for (int b = 0; b < 8; ++b) {
+      blob[i] ^= (uint8_t)(1 << b);
+      TEST_ASSERT_EQUAL_UINT8(CFG_LOAD_DEFAULTS,
+                              configDecode(blob, n, DEFAULTS, out));
+      TEST_ASSERT_TRUE(sameConfig(DEFAULTS, out));
+      blob[i] ^= (uint8_t)(1 << b);
+    }
+  }
+  // Truncated, missing, another version (even with a valid CRC)
+  TEST_ASSERT_EQUAL_UINT8(CFG_LOAD_DEFAULTS,
+                          configDecode(blob, n - 1, DEFAULTS, out));
+  TEST_ASSERT_EQUAL_UINT8(CFG_LOAD_DEFAULTS,
+                          configDecode(nullptr, 0, DEFAULTS, out));
+  blob[2]++;
+  uint32_t crc = cfgCrc(blob, n - 4);
+  cfgPut32(blob + n - 4, crc);
+  TEST_ASSERT_EQUAL_UINT8(CFG_LOAD_DEFAULTS,
+                          configDecode(blob, n, DEFAULTS, out));
+  TEST_ASSERT_TRUE(sameConfig(DEFAULTS, out));
+}
+
+// A blob written before fields were appended keeps its values; the new
+// fields take their defaults. One written by a newer firmware (more
+// fields) loads the ones we know.
+void test_older_and_newer_blobs(void) {
+  RuntimeConfig c = DEFAULTS, out;
+  configSet(c, field("capacity_ah"), 44.0f);
+  configSet(c, field("sample_ms"), 250.0f);
+  uint8_t blob[CONFIG_BLOB_MAX];
+  configEncode(c, blob, sizeof(blob));
+  // Keep the first five fields only
+  blob[3] = 5;
+  size_t n = CONFIG_HEADER_BYTES + 5 * 4 + 4;
+  cfgPut32(blob + n - 4, cfgCrc(blob, n - 4));
+  TEST_ASSERT_EQUAL_UINT8(CFG_LOAD_UPGRADED,
+                          configDecode(blob, n, DEFAULTS, out));
+  TEST_ASSERT_EQUAL_FLOAT(44.0f, out.capacity_Ah);
+  TEST_ASSERT_EQUAL_UINT32(250, out.sample_ms);
+  TEST_ASSERT_EQUAL_UINT32(DEFAULTS.sampleIdle_ms, out.sampleIdle_ms);
+  TEST_ASSERT_EQUAL_UINT32(DEFAULTS.parkedMax_ms, out.parkedMax_ms);
+
+  // Two extra fields
+  n = configEncode(c, blob, sizeof(blob)) - 4;
+  memset(blob + n, 0xAB, 8);
+  blob[3] += 2;
+  n += 8;
+  cfgPut32(blob + n, cfgCrc(blob, n));
+  TEST_ASSERT_EQUAL_UINT8(CFG_LOAD_OK,
+                          configDecode(blob, n + 4, DEFAULTS, out));
+  TEST_ASSERT_TRUE(sameConfig(c, out));
+}
+
+void test_out_of_bounds_value_falls_back(void) {
+  RuntimeConfig c = DEFAULTS, out;
+  configSet(c, field("capacity_ah"), 100.0f);
+  c.sample_ms = 5;    // below its minimum
+  c.idle_A = NAN;     // not a number
+  c.telemetryEnc = 7; // above its maximum
+  uint8_t blob[CONFIG_BLOB_MAX];
+  size_t n = configEncode(c, blob, sizeof(blob));
+  uint8_t rejected = 0;
+  TEST_ASSERT_EQUAL_UINT8(CFG_LOAD_OK,
+                          configDecode(blob, n, DEFAULTS, out, &rejected));
+  TEST_ASSERT_EQUAL_UINT8(3, rejected);
+  TEST_ASSERT_EQUAL_FLOAT(100.0f, out.capacity_Ah);
+  TEST_ASSERT_EQUAL_UINT32(DEFAULTS.sample_ms, out.sample_ms);
+  TEST_ASSERT_EQUAL_FLOAT(DEFAULTS.idle_A, out.idle_A);
+  TEST_ASSERT_EQUAL_UINT32(DEFAULTS.telemetryEnc, out.telemetryEnc);
+}
+
+void test_format_and_json(void) {
+  RuntimeConfig c = DEFAULTS;
+  char buf[384];
+  configFormat(c, field("rest_a"), buf, sizeof(buf));
+  TEST_ASSERT_EQUAL_STRING("rest_a=0.6", buf);
+  configFormat(c, field("parked_max_ms"), buf, sizeof(buf));
+  TEST_ASSERT_EQUAL_STRING("parked_max_ms=600000", buf);
+  TEST_ASSERT_TRUE(buildConfigJson(c, 412, buf, sizeof(buf)));
+  TEST_ASSERT_EQUAL_STRING(
+      "{\"v\":1,\"capacity_ah\":70,\"tlm_enc\":1,\"rest_a\":0.6,"
+      "\"idle_a\":0.65,\"sample_ms\":500,\"sample_idle_ms\":1000,"
+      "\"publish_ms\":2000,\"publish_idle_ms\":10000,"
+      "\"parked_max_ms\":600000,\"load_us\":412}",
+      buf);
+  TEST_ASSERT_FALSE(buildConfigJson(c, 0, buf, 40));
+}
+
+// Boot path cost of the CPU side: CRC, header and per-field bounds checks
+// for one blob. On the device the NVS read dominates; see the boot log
+// ("config: ... in N us") for that against the per-key reads it replaced.
+void test_decode_cost(void) {
+  uint8_t blob[CONFIG_BLOB_MAX];
+  size_t n = configEncode(DEFAULTS, blob, sizeof(blob));
+  const int N = 200000;
+  const uint8_t *volatile in = blob; // keep the loop from being hoisted
+  RuntimeConfig out;
+  uint32_t ok = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < N; ++i)
+    ok += configDecode(in, n, DEFAULTS, out) == CFG_LOAD_OK;
+  auto t1 = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / N;
+  char msg[96];
+  snprintf(msg, sizeof(msg), "decode %u-byte blob: %.1f ns", (unsigned)n, ns);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_EQUAL_UINT32(N, ok);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_schema_is_well_formed);
+  RUN_TEST(test_set_get_and_bounds);
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_corrupt_or_foreign_blob_gives_defaults);
+  RUN_TEST(test_older_and_newer_blobs);
+  RUN_TEST(test_out_of_bounds_value_falls_back);
+  RUN_TEST(test_format_and_json);
+  RUN_TEST(test_decode_cost);
+  return UNITY_END();
+}
@@ -0,0 +1,109 @@
+#include <unity.h>
+
+#include "../../src/comms/conn_backoff.cpp"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_backoff_doubles_per_failure(void) {
+  ConnBackoff b(1000, 60000, 0);
+  TEST_ASSERT_EQUAL_UINT32(1000, b.nextDelayMs(0));
+  TEST_ASSERT_EQUAL_UINT32(2000, b.nextDelayMs(0));
+  TEST_ASSERT_EQUAL_UINT32(4000, b.nextDelayMs(0));
+  TEST_ASSERT_EQUAL_UINT32(8000, b.nextDelayMs(0));
+  TEST_ASSERT_EQUAL_UINT8(4, b.failures());
+}
+
+void test_backoff_capped_at_max(void) {
+  ConnBackoff b(1000, 5000, 0);
+  uint32_t d = 0;
+  for (int i = 0; i < 10; ++i)
+    d = b.nextDelayMs(0);
+  TEST_ASSERT_EQUAL_UINT32(5000, d);
+}
+
+void test_backoff_many_failures_no_overflow(void) {
+  ConnBackoff b(1000, 300000, 0);
+  uint32_t d = 0;
+  for (int i = 0; i < 400; ++i)
+    d = b.nextDelayMs(0);
+  TEST_ASSERT_EQUAL_UINT32(300000, d);
+  TEST_ASSERT_EQUAL_UINT8(255, b.failures()); // saturates
+}
+
+void test_backoff_jitter_within_bounds(void) {
+  // 50% jitter on 4000 ms: anywhere in [2000, 4000]
+  for (uint32_t rnd = 0; rnd < 5000; rnd += 7) {
+    ConnBackoff b(1000, 60000, 50);
+    b.nextDelayMs(rnd);
+    b.nextDelayMs(rnd);
+    uint32_t d = b.nextDelayMs(rnd);
+    TEST_ASSERT_TRUE(d >= 2000 && d <= 4000);
+  }
+}
+
+void test_backoff_jitter_spreads(void) {
+  ConnBackoff a(1000, 60000, 50), b(1000, 60000, 50);
+  TEST_ASSERT_TRUE(a.nextDelayMs(12345) != b.nextDelayMs(678));
+}
+
+void test_backoff_reset(void) {
+  ConnBackoff b(1000, 60000, 0);
+  b.nextDelayMs(0);
+  b.nextDelayMs(0);
+  b.reset();
+  TEST_ASSERT_EQUAL_UINT8(0, b.failures());
+  TEST_ASSERT_EQUAL_UINT32(1000, b.nextDelayMs(0));
+}
+
+void test_meter_accumulates_current_hour(void) {
+  BlockedTimeMeter m;
+  m.add(1000, 200);
+  m.add(5000, 300);
+  TEST_ASSERT_EQUAL_UINT32(500, m.currentHour_ms());
+  TEST_ASSERT_EQUAL_UINT32(0, m.lastHour_ms());
+}
+
+void test_meter_rolls_window(void) {
+  BlockedTimeMeter m;
+  m.add(0, 200);
+  m.add(1000, 300);
+  m.tick(BlockedTimeMeter::WINDOW_MS + 10);
+  TEST_ASSERT_EQUAL_UINT32(500, m.lastHour_ms());
+  TEST_ASSERT_EQUAL_UINT32(0, m.currentHour_ms());
+  m.add(BlockedTimeMeter::WINDOW_MS + 20, 40);
+  TEST_ASSERT_EQUAL_UINT32(40, m.currentHour_ms());
+}
+
+void test_meter_gap_reads_zero(void) {
+  BlockedTimeMeter m;
+  m.add(0, 700);
+  // Nothing for over two windows: the last full hour had no blocking
+  m.tick(2 * BlockedTimeMeter::WINDOW_MS + 5);
+  TEST_ASSERT_EQUAL_UINT32(0, m.lastHour_ms());
+}
+
+void test_meter_millis_wraparound(void) {
+  BlockedTimeMeter m;
+  uint32_t t0 = 0xFFFFFFFFu - 1000u;
+  m.add(t0, 100);
+  m.add(t0 + 2000u, 50); // wrapped
+  TEST_ASSERT_EQUAL_UINT32(150, m.currentHour_ms());
+  m.tick(t0 + BlockedTimeMeter::WINDOW_MS);
+  TEST_ASSERT_EQUAL_UINT32(150, m.lastHour_ms());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_backoff_doubles_per_failure);
+  RUN_TEST(test_backoff_capped_at_max);
+  RUN_TEST(test_backoff_many_failures_no_overflow);
+  RUN_TEST(test_backoff_jitter_within_bounds);
+  RUN_TEST(test_backoff_jitter_spreads);
+  RUN_TEST(test_backoff_reset);
+  RUN_TEST(test_meter_accumulates_current_hour);
+  RUN_TEST(test_meter_rolls_window);
+  RUN_TEST(test_meter_gap_reads_zero);
+  RUN_TEST(test_meter_millis_wraparound);
+  return UNITY_END();
+}
@@ -0,0 +1,236 @@
+#include <cmath>
+#include <cstring>
+#include <unity.h>
+
+#include "../../src/battery/drain_analyzer.cpp"
+
+static DrainState state;
+static DrainConfig cfg;
+
+static DrainAnalyzer makeAnalyzer() {
+  DrainAnalyzer a(state);
+  a.begin(cfg);
+  return a;
+}
+
+void setUp(void) {
+  memset(&state, 0, sizeof(state));
+  cfg = DrainConfig();
+}
+void tearDown(void) {}
+
+void test_drain_begin_resets_invalid_state(void) {
+  memset(&state, 0xA5, sizeof(state));
+  DrainAnalyzer a = makeAnalyzer();
+  TEST_ASSERT_EQUAL(DRAIN_STATE_MAGIC, state.magic);
+  TEST_ASSERT_FALSE(a.reportPending());
+  TEST_ASSERT_FALSE(a.inSession());
+  TEST_ASSERT_TRUE(std::isnan(a.mean_A()));
+}
+
+void test_drain_begin_keeps_valid_state(void) {
+  // Simulates RTC memory surviving a deep-sleep cycle
+  DrainAnalyzer a = makeAnalyzer();
+  a.beginSession();
+  a.addSample(0.5f, 300.0f);
+
+  DrainAnalyzer b(state);
+  b.begin(cfg);
+  TEST_ASSERT_TRUE(b.inSession());
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.5f, b.mean_A());
+  TEST_ASSERT_FLOAT_WITHIN(0.1f, 300.0f, b.session_s());
+}
+
+void test_drain_constant_current_stats(void) {
+  DrainAnalyzer a = makeAnalyzer();
+  for (int i = 0; i < 100; ++i)
+    a.addSample(0.40f, 1.0f);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.40f, a.mean_A());
+  // Sketch buckets are ~25% wide; the estimate must land in the right one
+  TEST_ASSERT_FLOAT_WITHIN(0.40f * 0.25f, 0.40f, a.percentile(0.5f));
+  TEST_ASSERT_FLOAT_WITHIN(0.40f * 0.25f, 0.40f, a.percentile(0.99f));
+}
+
+void test_drain_percentiles_mixed_distribution(void) {
+  DrainAnalyzer a = makeAnalyzer();
+  // 90% of the time at 50 mA, 10% at 2 A (module waking periodically)
+  for (int i = 0; i < 900; ++i)
+    a.addSample(0.05f, 1.0f);
+  for (int i = 0; i < 100; ++i)
+    a.addSample(2.0f, 1.0f);
+  TEST_ASSERT_FLOAT_WITHIN(0.05f * 0.25f, 0.05f, a.percentile(0.5f));
+  TEST_ASSERT_FLOAT_WITHIN(2.0f * 0.25f, 2.0f, a.percentile(0.99f));
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.9f * 0.05f + 0.1f * 2.0f, a.mean_A());
+}
+
+void test_drain_time_weighting(void) {
+  DrainAnalyzer a = makeAnalyzer();
+  // One snapshot covering 300 s outweighs 10 one-second samples
+  a.addSample(1.0f, 300.0f);
+  for (int i = 0; i < 10; ++i)
+    a.addSample(0.1f, 1.0f);
+  TEST_ASSERT_FLOAT_WITHIN(1.0f * 0.25f, 1.0f, a.percentile(0.5f));
+}
+
+void test_drain_charging_counts_as_under(void) {
+  DrainAnalyzer a = makeAnalyzer();
+  for (int i = 0; i < 60; ++i)
+    a.addSample(-3.0f, 1.0f);
+  for (int i = 0; i < 40; ++i)
+    a.addSample(0.5f, 1.0f);
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, a.percentile(0.5f));
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.2f, a.mean_A());
+}
+
+void test_drain_step_event_detected(void) {
+  DrainAnalyzer a = makeAnalyzer();
+  a.beginSession();
+  for (int i = 0; i < 10; ++i)
+    TEST_ASSERT_EQUAL(DRAIN_EVT_NONE, a.addSample(0.05f, 1.0f));
+  // First high sample is only a candidate
+  TEST_ASSERT_EQUAL(DRAIN_EVT_NONE, a.addSample(0.85f, 1.0f));
+  uint8_t evt = a.addSample(0.85f, 1.0f);
+  TEST_ASSERT_TRUE(evt & DRAIN_EVT_STEP);
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 0.80f, a.lastStep_A());
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 0.85f, a.level_A());
+
+  // Step back down
+  a.addSample(0.05f, 1.0f);
+  evt = a.addSample(0.05f, 1.0f);
+  TEST_ASSERT_TRUE(evt & DRAIN_EVT_STEP);
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, -0.80f, a.lastStep_A());
+}
+
+void test_drain_single_transient_is_not_a_step(void) {
+  DrainAnalyzer a = makeAnalyzer();
+  a.beginSession();
+  for (int i = 0; i < 10; ++i)
+    a.addSample(0.05f, 1.0f);
+  TEST_ASSERT_EQUAL(DRAIN_EVT_NONE, a.addSample(3.0f, 1.0f));
+  TEST_ASSERT_EQUAL(DRAIN_EVT_NONE, a.addSample(0.05f, 1.0f));
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 0.05f, a.level_A());
+}
+
+void test_drain_no_sleep_flagged_after_settle(void) {
+  cfg.settleSec = 600;
+  DrainAnalyzer a = makeAnalyzer();
+  a.beginSession();
+  uint8_t seen = 0;
+  for (int i = 0; i < 20; ++i)
+    seen |= a.addSample(0.9f, 60.0f); // module stays awake at 0.9 A
+  TEST_ASSERT_TRUE(seen & DRAIN_EVT_NO_SLEEP);
+
+  // Raised once per session only
+  TEST_ASSERT_FALSE(a.addSample(0.9f, 60.0f) & DRAIN_EVT_NO_SLEEP);
+}
+
+void test_drain_no_sleep_not_flagged_when_asleep(void) {
+  cfg.settleSec = 600;
+  DrainAnalyzer a = makeAnalyzer();
+  a.beginSession();
+  uint8_t seen = 0;
+  for (int i = 0; i < 3; ++i)
+    seen |= a.addSample(0.9f, 60.0f);
+  for (int i = 0; i < 20; ++i)
+    seen |= a.addSample(0.02f, 60.0f);
+  TEST_ASSERT_FALSE(seen & DRAIN_EVT_NO_SLEEP);
+}
+
+void test_drain_end_session_resets_tracking(void) {
+  DrainAnalyzer a = makeAnalyzer();
+  a.beginSession();
+  a.addSample(0.5f, 100.0f);
+  a.endSession();
+  TEST_ASSERT_FALSE(a.inSession());
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, a.session_s());
+  TEST_ASSERT_TRUE(std::isnan(a.level_A()));
+  // Period statistics are kept across sessions
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.5f, a.mean_A());
+}
+
+void test_drain_daily_report(void) {
+  cfg.reportSec = 3600;
+  DrainAnalyzer a = makeAnalyzer();
+  a.beginSession();
+  uint8_t evt = 0;
+  for (int i = 0; i < 12 && !(evt & DRAIN_EVT_REPORT); ++i)
+    evt = a.addSample(0.5f, 300.0f); // 12 snapshot wakes = 1 hour
+  TEST_ASSERT_TRUE(evt & DRAIN_EVT_REPORT);
+  TEST_ASSERT_TRUE(a.reportPending());
+
+  const DrainReport &r = a.report();
+  TEST_ASSERT_EQUAL(1, r.seq);
+  TEST_ASSERT_EQUAL(3600, r.period_s);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.5f, r.mean_A);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.5f, r.ah);
+  TEST_ASSERT_FLOAT_WITHIN(0.5f * 0.25f, 0.5f, r.p50_A);
+  TEST_ASSERT_TRUE(r.flags & DRAIN_FLAG_HIGH_DRAIN);
+
+  // Accumulators restart for the next period
+  TEST_ASSERT_TRUE(std::isnan(a.mean_A()));
+  a.clearReport();
+  TEST_ASSERT_FALSE(a.reportPending());
+}
+
+void test_drain_report_json(void) {
+  DrainReport r;
+  memset(&r, 0, sizeof(r));
+  r.seq = 3;
+  r.period_s = 86400;
+  r.mean_A = 0.045f;
+  r.p50_A = 0.04f;
+  r.p90_A = 0.06f;
+  r.p99_A = 0.9f;
+  r.max_A = 1.2f;
+  r.ah = 1.08f;
+  r.steps = 4;
+  r.flags = DRAIN_FLAG_NO_SLEEP;
+
+  char json[256];
+  TEST_ASSERT_TRUE(buildDrainReportJson(r, json, sizeof(json)));
+  TEST_ASSERT_NOT_NULL(strstr(json, "\"seq\":3"));
+  TEST_ASSERT_NOT_NULL(strstr(json, "\"period_s\":86400"));
+  TEST_ASSERT_NOT_NULL(strstr(json, "\"mean_mA\":45.0"));
+  TEST_ASSERT_NOT_NULL(strstr(json, "\"p99_mA\":900.0"));
+  TEST_ASSERT_NOT_NULL(strstr(json, "\"steps\":4"));
+  TEST_ASSERT_NOT_NULL(strstr(json, "\"no_sleep\":true"));
+  TEST_ASSERT_NOT_NULL(strstr(json, "\"high_drain\":false"));
+
+  char small[32];
+  TEST_ASSERT_FALSE(buildDrainReportJson(r, small, sizeof(small)));
+}
+
+void test_drain_ignores_invalid_samples(void) {
+  DrainAnalyzer a = makeAnalyzer();
+  TEST_ASSERT_EQUAL(DRAIN_EVT_NONE, a.addSample(NAN, 1.0f));
+  TEST_ASSERT_EQUAL(DRAIN_EVT_NONE, a.addSample(0.5f, 0.0f));
+  TEST_ASSERT_EQUAL(DRAIN_EVT_NONE, a.addSample(0.5f, -1.0f));
+  TEST_ASSERT_TRUE(std::isnan(a.mean_A()));
+}
+
+void test_drain_state_is_fixed_size(void) {
+  // Must fit comfortably in the 8 KB RTC slow memory
+  TEST_ASSERT_TRUE(sizeof(DrainState) <= 256);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+
+  RUN_TEST(test_drain_begin_resets_invalid_state);
+  RUN_TEST(test_drain_begin_keeps_valid_state);
+  RUN_TEST(test_drain_constant_current_stats);
+  RUN_TEST(test_drain_percentiles_mixed_distribution);
+  RUN_TEST(test_drain_time_weighting);
+  RUN_TEST(test_drain_charging_counts_as_under);
+  RUN_TEST(test_drain_step_event_detected);
+  RUN_TEST(test_drain_single_transient_is_not_a_step);
+  RUN_TEST(test_drain_no_sleep_flagged_after_settle);
+  RUN_TEST(test_drain_no_sleep_not_flagged_when_asleep);
+  RUN_TEST(test_drain_end_session_resets_tracking);
+  RUN_TEST(test_drain_daily_report);
+  RUN_TEST(test_drain_report_json);
+  RUN_TEST(test_drain_ignores_invalid_samples);
+  RUN_TEST(test_drain_state_is_fixed_size);
+
+  return UNITY_END();
+}
@@ -0,0 +1,174 @@
+#include <cmath>
+#include <cstring>
+#include <unity.h>
+
+#include "../../src/power/energy_model.cpp"
+
+// Virtual microsecond clock
+static uint64_t g_us = 0;
+static uint64_t fakeMicros() { return g_us; }
+static void advanceMs(uint32_t ms) { g_us += (uint64_t)ms * 1000u; }
+
+// Round numbers: 10 mA awake, +100 mA Wi-Fi connect, +20 mA BLE, 1 mA asleep
+static const PowerModel model = {10.0f, {0, 100.0f, 0, 0, 20.0f, 0}, 1.0f};
+static EnergyLedger ledger;
+
+void setUp(void) {
+  g_us = 0;
+  memset(&ledger, 0, sizeof(ledger));
+}
+void tearDown(void) {}
+
+void test_begin_resets_garbage(void) {
+  memset(&ledger, 0xA5, sizeof(ledger));
+  EnergyMeter m(ledger, model, fakeMicros);
+  m.begin();
+  TEST_ASSERT_EQUAL_UINT32(0, ledger.hour.awake_ms);
+  TEST_ASSERT_TRUE(std::isnan(ledger.lastDay_mAh));
+  TEST_ASSERT_FALSE(m.reportPending());
+}
+
+void test_idle_and_component_times(void) {
+  EnergyMeter m(ledger, model, fakeMicros);
+  m.begin();
+  advanceMs(100); // idle
+  m.on(EC_SENSORS);
+  advanceMs(30);
+  m.off(EC_SENSORS);
+  m.set(EC_WIFI_CONNECT, true);
+  advanceMs(200);
+  m.set(EC_WIFI_CONNECT, false);
+  m.tick();
+  TEST_ASSERT_EQUAL_UINT32(330, ledger.hour.awake_ms);
+  TEST_ASSERT_EQUAL_UINT32(100, ledger.hour.idle_ms);
+  TEST_ASSERT_EQUAL_UINT32(30, ledger.hour.comp_ms[EC_SENSORS]);
+  TEST_ASSERT_EQUAL_UINT32(200, ledger.hour.comp_ms[EC_WIFI_CONNECT]);
+}
+
+void test_overlapping_components(void) {
+  EnergyMeter m(ledger, model, fakeMicros);
+  m.begin();
+  m.set(EC_BLE, true);
+  advanceMs(50);
+  m.on(EC_SENSORS);
+  advanceMs(10);
+  m.off(EC_SENSORS);
+  m.tick();
+  TEST_ASSERT_EQUAL_UINT32(60, ledger.hour.comp_ms[EC_BLE]);
+  TEST_ASSERT_EQUAL_UINT32(10, ledger.hour.comp_ms[EC_SENSORS]);
+  TEST_ASSERT_EQUAL_UINT32(0, ledger.hour.idle_ms);
+}
+
+void test_nested_scopes(void) {
+  EnergyMeter m(ledger, model, fakeMicros);
+  m.begin();
+  {
+    EnergyScope a(m, EC_SENSORS);
+    advanceMs(5);
+    {
+      EnergyScope b(m, EC_SENSORS);
+      advanceMs(5);
+    }
+    advanceMs(5); // still on after the inner scope
+  }
+  advanceMs(5);
+  m.tick();
+  TEST_ASSERT_EQUAL_UINT32(15, ledger.hour.comp_ms[EC_SENSORS]);
+  TEST_ASSERT_EQUAL_UINT32(5, ledger.hour.idle_ms);
+}
+
+void test_sub_millisecond_remainder_kept(void) {
+  EnergyMeter m(ledger, model, fakeMicros);
+  m.begin();
+  for (int i = 0; i < 10; ++i) {
+    g_us += 300; // 0.3 ms per step
+    m.tick();
+  }
+  TEST_ASSERT_EQUAL_UINT32(3, ledger.hour.awake_ms);
+}
+
+void test_mah_from_model(void) {
+  EnergyMeter m(ledger, model, fakeMicros);
+  m.begin();
+  m.set(EC_WIFI_CONNECT, true);
+  advanceMs(36000); // 36 s at 110 mA = 1.1 mAh
+  m.set(EC_WIFI_CONNECT, false);
+  m.sleep(360000ULL * 1000u); // 360 s at 1 mA = 0.1 mAh
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 1.2f, m.mAh(ledger.hour));
+  TEST_ASSERT_EQUAL_UINT32(360000, ledger.hour.sleep_ms);
+}
+
+void test_hour_closes_across_sleep(void) {
+  EnergyMeter m(ledger, model, fakeMicros);
+  // 12 snapshot wakes of 300 ms + 5 min sleep: the hour closes on the 12th
+  for (int i = 0; i < 12; ++i) {
+    g_us = 0; // every wake is a fresh boot
+    m.begin();
+    advanceMs(300);
+    TEST_ASSERT_FALSE(m.reportPending());
+    m.sleep(300ULL * 1000000u);
+  }
+  TEST_ASSERT_TRUE(m.reportPending());
+  TEST_ASSERT_EQUAL_UINT32(3600, ledger.lastHour.awake_ms);
+  TEST_ASSERT_EQUAL_UINT32(3600000, ledger.lastHour.sleep_ms);
+  TEST_ASSERT_EQUAL_UINT32(0, ledger.hour.awake_ms);
+  m.clearReport();
+  TEST_ASSERT_FALSE(m.reportPending());
+}
+
+void test_day_closes(void) {
+  EnergyMeter m(ledger, model, fakeMicros);
+  m.begin();
+  for (int h = 0; h < 24; ++h)
+    m.sleep(3600ULL * 1000000u); // 1 mA for 24 h
+  TEST_ASSERT_FLOAT_WITHIN(1e-3f, 24.0f, ledger.lastDay_mAh);
+  TEST_ASSERT_EQUAL_UINT32(EnergyMeter::DAY_MS, ledger.lastDay_ms);
+}
+
+void test_json_normalized_hour(void) {
+  EnergyMeter m(ledger, model, fakeMicros);
+  m.begin();
+  m.set(EC_BLE, true);
+  advanceMs(600000); // 10 min awake at 30 mA = 5 mAh
+  m.set(EC_BLE, false);
+  m.sleep(3000ULL * 1000000u); // 50 min at 1 mA, window = 1 h
+  char buf[300];
+  TEST_ASSERT_TRUE(buildEnergyJson(m, buf, sizeof(buf)));
+  TEST_ASSERT_NOT_NULL(strstr(buf, "\"mAh_h\":5.833"));
+  TEST_ASSERT_NOT_NULL(strstr(buf, "\"ble_ms\":600000"));
+  TEST_ASSERT_NOT_NULL(strstr(buf, "\"idle_ms\":0"));
+  TEST_ASSERT_NOT_NULL(strstr(buf, "\"mAh_day\":null"));
+}
+
+void test_json_false_before_first_hour(void) {
+  EnergyMeter m(ledger, model, fakeMicros);
+  m.begin();
+  advanceMs(1000);
+  m.tick();
+  char buf[300];
+  TEST_ASSERT_FALSE(buildEnergyJson(m, buf, sizeof(buf)));
+}
+
+void test_json_buffer_too_small(void) {
+  EnergyMeter m(ledger, model, fakeMicros);
+  m.begin();
+  m.sleep(3600ULL * 1000000u);
+  char buf[64];
+  TEST_ASSERT_FALSE(buildEnergyJson(m, buf, sizeof(buf)));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_begin_resets_garbage);
+  RUN_TEST(test_idle_and_component_times);
+  RUN_TEST(test_overlapping_components);
+  RUN_TEST(test_nested_scopes);
+  RUN_TEST(test_sub_millisecond_remainder_kept);
+  RUN_TEST(test_mah_from_model);
+  RUN_TEST(test_hour_closes_across_sleep);
+  RUN_TEST(test_day_closes);
+  RUN_TEST(test_json_normalized_hour);
+  RUN_TEST(test_json_false_before_first_hour);
+  RUN_TEST(test_json_buffer_too_small);
+  return UNITY_END();
+}
@@ -0,0 +1,170 @@
+#include <cstring>
+#include <unity.h>
+
+#include "../../src/comms/ha_discovery.cpp"
+#include "../../src/json_writer.cpp"
+
+static const char *ID = "Toyota_batt_sensor";
+static const char *CLIENT = "esp32-batt";
+static const char *STATE = "car/battery/telemetry";
+
+static char buf[HA_DISCOVERY_MAX];
+
+static size_t build() {
+  return buildHaDiscovery(ID, CLIENT, STATE, buf, sizeof(buf));
+}
+
+static int count(const char *hay, const char *needle) {
+  int n = 0;
+  for (const char *p = strstr(hay, needle); p; p = strstr(p + 1, needle))
+    ++n;
+  return n;
+}
+
+// Minimal structural check: balanced brackets outside strings, escapes valid
+static bool wellFormed(const char *s) {
+  char stack[16];
+  int depth = 0;
+  bool inStr = false;
+  for (; *s; ++s) {
+    char c = *s;
+    if (inStr) {
+      if (c == '\\') {
+        if (!strchr("\"\\/bfnrtu", s[1]))
+          return false;
+        ++s;
+      } else if (c == '"') {
+        inStr = false;
+      } else if ((unsigned char)c < 0x20) {
+        return false;
+      }
+    } else if (c == '"') {
+      inStr = true;
+    } else if (c == '{' || c == '[') {
+      if (depth == (int)sizeof(stack))
+        return false;
+      stack[depth++] = c == '{' ? '}' : ']';
+    } else if (c == '}' || c == ']') {
+      if (!depth || stack[--depth] != c)
+        return false;
+    }
+  }
+  return !inStr && depth == 0;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_payload_fits(void) {
+  size_t n = build();
+  TEST_ASSERT_GREATER_THAN(0, n);
+  TEST_ASSERT_EQUAL(strlen(buf), n);
+  TEST_ASSERT_LESS_THAN(HA_DISCOVERY_MAX, n);
+  TEST_ASSERT_TRUE(wellFormed(buf));
+}
+
+void test_device_block(void) {
+  build();
+  TEST_ASSERT_EQUAL(0, strncmp(buf,
+                               "{\"dev\":{\"ids\":[\"Toyota_batt_sensor\","
+                               "\"esp32-batt\"],\"name\":\"Battery Monitor\"}",
+                               60));
+  TEST_ASSERT_NOT_NULL(strstr(buf, "\"stat_t\":\"car/battery/telemetry\""));
+  TEST_ASSERT_EQUAL(1, count(buf, "\"stat_t\""));
+}
+
+void test_each_entity_once(void) {
+  build();
+  TEST_ASSERT_EQUAL(10, HA_ENTITY_COUNT);
+  TEST_ASSERT_EQUAL((int)HA_ENTITY_COUNT, count(buf, "\"uniq_id\""));
+  char uid[64];
+  for (size_t i = 0; i < HA_ENTITY_COUNT; ++i) {
+    snprintf(uid, sizeof(uid), "\"uniq_id\":\"%s_%s\"", ID,
+             HA_ENTITIES[i].id);
+    TEST_ASSERT_EQUAL(1, count(buf, uid));
+  }
+  TEST_ASSERT_EQUAL(1, count(buf, "\"Rint (mOhm)\""));
+}
+
+void test_unique_ids_distinct(void) {
+  for (size_t i = 0; i < HA_ENTITY_COUNT; ++i)
+    for (size_t j = i + 1; j < HA_ENTITY_COUNT; ++j)
+      TEST_ASSERT_TRUE(strcmp(HA_ENTITIES[i].id, HA_ENTITIES[j].id) != 0);
+}
+
+void test_binary_sensor_payloads(void) {
+  build();
+  TEST_ASSERT_NOT_NULL(strstr(buf, "\"p\":\"binary_sensor\",\"name\":"
+                                   "\"Alternator On\",\"val_tpl\":\"{{ "
+                                   "value_json.alternator_on }}\",\"pl_on\":"
+                                   "\"true\",\"pl_off\":\"false\""));
+  TEST_ASSERT_EQUAL(1, count(buf, "\"pl_on\""));
+}
+
+void test_templates_unchanged(void) {
+  build();
+  TEST_ASSERT_NOT_NULL(
+      strstr(buf, "\"val_tpl\":\"{{ '%.2f' | format(value_json.voltage_V) "
+                  "}}\""));
+  TEST_ASSERT_NOT_NULL(strstr(buf, "\"unit_of_meas\":\"m\xCE\xA9\""));
+  TEST_ASSERT_NOT_NULL(strstr(buf, "\"dev_cla\":\"battery\""));
+}
+
+void test_hash_stable_and_sensitive(void) {
+  size_t n = build();
+  uint32_t h = haDiscoveryHash(buf, n);
+  TEST_ASSERT_EQUAL_HEX32(h, haDiscoveryHash(buf, build()));
+  TEST_ASSERT_TRUE(h != 0);
+  size_t m = buildHaDiscovery(ID, CLIENT, "car/battery/other", buf,
+                              sizeof(buf));
+  TEST_ASSERT_TRUE(haDiscoveryHash(buf, m) != h);
+  // FNV-1a reference values
+  TEST_ASSERT_EQUAL_HEX32(0x811C9DC5u, haDiscoveryHash("", 0));
+  TEST_ASSERT_EQUAL_HEX32(0xE40C292Cu, haDiscoveryHash("a", 1));
+}
+
+void test_escaping(void) {
+  size_t n = buildHaDiscovery("id", "cli\"ent", "a\\b", buf, sizeof(buf));
+  TEST_ASSERT_GREATER_THAN(0, n);
+  TEST_ASSERT_TRUE(wellFormed(buf));
+  TEST_ASSERT_NOT_NULL(strstr(buf, "\"cli\\\"ent\""));
+  TEST_ASSERT_NOT_NULL(strstr(buf, "\"stat_t\":\"a\\\\b\""));
+}
+
+void test_buffer_too_small(void) {
+  size_t n = build();
+  char small[HA_DISCOVERY_MAX];
+  TEST_ASSERT_EQUAL(0, buildHaDiscovery(ID, CLIENT, STATE, small, n));
+  TEST_ASSERT_EQUAL(n, buildHaDiscovery(ID, CLIENT, STATE, small, n + 1));
+  TEST_ASSERT_EQUAL(0, buildHaDiscovery(ID, CLIENT, STATE, small, 0));
+}
+
+void test_topics(void) {
+  char t[96];
+  TEST_ASSERT_TRUE(haDiscoveryTopic(ID, t, sizeof(t)));
+  TEST_ASSERT_EQUAL_STRING("homeassistant/device/Toyota_batt_sensor/config",
+                           t);
+  TEST_ASSERT_TRUE(haLegacyTopic(ID, 0, t, sizeof(t)));
+  TEST_ASSERT_EQUAL_STRING(
+      "homeassistant/sensor/Toyota_batt_sensor_voltage/config", t);
+  TEST_ASSERT_TRUE(haLegacyTopic(ID, 6, t, sizeof(t)));
+  TEST_ASSERT_EQUAL_STRING(
+      "homeassistant/binary_sensor/Toyota_batt_sensor_alternator/config", t);
+  TEST_ASSERT_FALSE(haLegacyTopic(ID, HA_ENTITY_COUNT, t, sizeof(t)));
+  TEST_ASSERT_FALSE(haDiscoveryTopic(ID, t, 20));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_payload_fits);
+  RUN_TEST(test_device_block);
+  RUN_TEST(test_each_entity_once);
+  RUN_TEST(test_unique_ids_distinct);
+  RUN_TEST(test_binary_sensor_payloads);
+  RUN_TEST(test_templates_unchanged);
+  RUN_TEST(test_hash_stable_and_sensitive);
+  RUN_TEST(test_escaping);
+  RUN_TEST(test_buffer_too_small);
+  RUN_TEST(test_topics);
+  return UNITY_END();
+}
@@ -0,0 +1,127 @@
+#include <cmath>
+#include <unity.h>
+
+#include "../../src/battery/interval_stats.cpp"
+
+static IntervalAggregator agg;
+
+void setUp(void) {
+  agg = IntervalAggregator();
+  agg.reset(0);
+}
+
+void tearDown(void) {}
+
+void test_empty_interval(void) {
+  IntervalStats s = agg.stats();
+  TEST_ASSERT_EQUAL_UINT32(0, s.n);
+  TEST_ASSERT_EQUAL_UINT32(0, s.span_ms);
+  TEST_ASSERT_TRUE(isnan(s.V_min));
+  TEST_ASSERT_TRUE(isnan(s.I_rms));
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, s.charge_mAh);
+}
+
+void test_min_max_mean_rms(void) {
+  const float V[] = {12.0f, 12.6f, 11.4f, 12.2f};
+  const float I[] = {1.0f, -3.0f, 2.0f, 4.0f};
+  for (int k = 0; k < 4; ++k)
+    agg.add(V[k], I[k], 500 * (k + 1));
+  IntervalStats s = agg.stats();
+  TEST_ASSERT_EQUAL_UINT32(4, s.n);
+  TEST_ASSERT_EQUAL_UINT32(2000, s.span_ms);
+  TEST_ASSERT_EQUAL_FLOAT(11.4f, s.V_min);
+  TEST_ASSERT_EQUAL_FLOAT(12.6f, s.V_max);
+  TEST_ASSERT_FLOAT_WITHIN(1e-5f, 12.05f, s.V_mean);
+  TEST_ASSERT_EQUAL_FLOAT(-3.0f, s.I_min);
+  TEST_ASSERT_EQUAL_FLOAT(4.0f, s.I_max);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, 1.0f, s.I_mean);
+  TEST_ASSERT_FLOAT_WITHIN(1e-5f, sqrtf(30.0f / 4.0f), s.I_rms);
+}
+
+// A 2 s burst between two 60 s publishes shows in max, mean and RMS
+void test_burst_between_publishes(void) {
+  for (uint32_t t = 500; t <= 60000; t += 500) {
+    bool burst = t > 30000 && t <= 32000;
+    agg.add(burst ? 11.2f : 12.6f, burst ? 80.0f : 0.5f, t);
+  }
+  IntervalStats s = agg.stats();
+  TEST_ASSERT_EQUAL_UINT32(120, s.n);
+  TEST_ASSERT_EQUAL_FLOAT(80.0f, s.I_max);
+  TEST_ASSERT_EQUAL_FLOAT(11.2f, s.V_min);
+  TEST_ASSERT_FLOAT_WITHIN(1e-3f, (4 * 80.0f + 116 * 0.5f) / 120, s.I_mean);
+  TEST_ASSERT_FLOAT_WITHIN(1e-2f, sqrtf((4 * 6400.0f + 116 * 0.25f) / 120),
+                           s.I_rms);
+  TEST_ASSERT_GREATER_THAN(s.I_mean, s.I_rms);
+}
+
+void test_charge_trapezoid(void) {
+  agg.add(12.0f, 0.0f, 0);
+  agg.add(12.0f, 3.6f, 1000);    // ramp: 1.8 As
+  agg.add(12.0f, 3.6f, 2000);    // flat: 3.6 As
+  agg.add(12.0f, -3.6f, 3000);   // crossing zero: 0 As
+  IntervalStats s = agg.stats(); // 5.4 As = 1.5 mAh
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 1.5f, s.charge_mAh);
+}
+
+void test_reset_keeps_last_sample_for_charge(void) {
+  agg.add(12.0f, 3.6f, 1000);
+  agg.reset(1000);
+  IntervalStats s = agg.stats();
+  TEST_ASSERT_EQUAL_UINT32(0, s.n);
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, s.charge_mAh);
+  agg.add(12.0f, 3.6f, 2000); // 3.6 As since the sample before the reset
+  s = agg.stats();
+  TEST_ASSERT_EQUAL_UINT32(1, s.n);
+  TEST_ASSERT_EQUAL_UINT32(1000, s.span_ms);
+  TEST_ASSERT_FLOAT_WITHIN(1e-5f, 1.0f, s.charge_mAh);
+  TEST_ASSERT_EQUAL_FLOAT(3.6f, s.I_min);
+}
+
+void test_non_finite_samples_skipped(void) {
+  agg.add(NAN, 2.0f, 500);
+  agg.add(12.5f, NAN, 1000);
+  agg.add(INFINITY, -INFINITY, 1500);
+  IntervalStats s = agg.stats();
+  TEST_ASSERT_EQUAL_UINT32(1, s.n);
+  TEST_ASSERT_EQUAL_FLOAT(12.5f, s.V_min);
+  TEST_ASSERT_EQUAL_FLOAT(12.5f, s.V_max);
+  TEST_ASSERT_EQUAL_FLOAT(2.0f, s.I_mean);
+  TEST_ASSERT_EQUAL_UINT32(500, s.span_ms);
+}
+
+// Running means stay accurate over a long interval of float samples
+void test_long_interval_precision(void) {
+  double sum = 0, sumSq = 0;
+  const uint32_t N = 100000;
+  for (uint32_t k = 0; k < N; ++k) {
+    float v = 12.6f + 0.05f * sinf(k * 0.01f);
+    sum += v;
+    sumSq += (double)v * v;
+    agg.add(v, v - 12.6f, k * 500);
+  }
+  IntervalStats s = agg.stats();
+  TEST_ASSERT_FLOAT_WITHIN(1e-3f, (float)(sum / N), s.V_mean);
+  TEST_ASSERT_FLOAT_WITHIN(1e-3f, (float)sqrt(sumSq / N), s.V_rms);
+}
+
+void test_span_wraps_with_millis(void) {
+  agg.reset(0xFFFFF000u);
+  agg.add(12.0f, 1.0f, 0xFFFFF800u);
+  agg.add(12.0f, 1.0f, 0x00000800u);
+  IntervalStats s = agg.stats();
+  TEST_ASSERT_EQUAL_UINT32(0x1800, s.span_ms);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 4.096f / 3.6f, s.charge_mAh);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_empty_interval);
+  RUN_TEST(test_min_max_mean_rms);
+  RUN_TEST(test_burst_between_publishes);
+  RUN_TEST(test_charge_trapezoid);
+  RUN_TEST(test_reset_keeps_last_sample_for_charge);
+  RUN_TEST(test_non_finite_samples_skipped);
+  RUN_TEST(test_long_interval_precision);
+  RUN_TEST(test_span_wraps_with_millis);
+  return UNITY_END();
+}
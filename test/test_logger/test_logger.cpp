@@ -0,0 +1,192 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <unity.h>
+
+#include "../../src/log/logger.cpp"
+
+static uint32_t fakeNow = 0;
+static uint32_t fakeClock() { return fakeNow; }
+
+Logger logger(fakeClock);
+
+static char line[LOG_LINE_MAX];
+
+void setUp(void) {
+  fakeNow = 0;
+  logger.setLevel(LL_INFO);
+  while (logger.pop(line, sizeof(line))) {
+  }
+}
+
+void tearDown(void) {}
+
+// The deferred formatter must match printf for the conversions in use
+template <typename... A>
+static void assertLikePrintf(const char *fmt, A... args) {
+  char ref[128], got[128];
+  snprintf(ref, sizeof(ref), fmt, args...);
+  const LogArg a[sizeof...(A) + 1] = {logArg(args)..., logArg(0)};
+  logFormat(got, sizeof(got), fmt, a, sizeof...(A));
+  TEST_ASSERT_EQUAL_STRING(ref, got);
+}
+
+void test_format_matches_printf(void) {
+  assertLikePrintf("plain text");
+  assertLikePrintf("%d %i %u", -42, 7, 4000000000u);
+  assertLikePrintf("%5d|%-5d|%05d|%+d", 42, 42, 42, 42);
+  assertLikePrintf("%x %X %#x %o %c", 255u, 255u, 255u, 8u, 'A');
+  assertLikePrintf("%.2f mOhm (25C: %.2f mOhm)", 12.345f, -0.5f);
+  assertLikePrintf("%8.3f|%-8.1f|%e|%g", 3.14159f, 2.5f, 12345.0f, 0.0001f);
+  assertLikePrintf("%s=%s %10s|%-4s|", "SSID", "home", "r", "l");
+  assertLikePrintf("100%% done, %u%%", 50u);
+}
+
+void test_length_modifiers_dropped(void) {
+  char out[64];
+  const LogArg a[] = {logArg(123456ul), logArg(-5l), logArg((unsigned)7)};
+  logFormat(out, sizeof(out), "%lu %ld %hu", a, 3);
+  TEST_ASSERT_EQUAL_STRING("123456 -5 7", out);
+}
+
+void test_missing_args_and_bad_specs_kept(void) {
+  char out[64];
+  const LogArg a[] = {logArg(1)};
+  logFormat(out, sizeof(out), "%d %d %q 50%", a, 1);
+  TEST_ASSERT_EQUAL_STRING("1 %d %q 50%", out);
+}
+
+void test_trailing_newline_and_truncation(void) {
+  char out[8];
+  const LogArg a[] = {logArg(12345678)};
+  TEST_ASSERT_EQUAL_UINT32(7, logFormat(out, sizeof(out), "v=%d\n", a, 1));
+  TEST_ASSERT_EQUAL_STRING("v=12345", out);
+  char big[32];
+  logFormat(big, sizeof(big), "done\n", a, 0);
+  TEST_ASSERT_EQUAL_STRING("done", big);
+}
+
+void test_long_string_argument(void) {
+  static const char longStr[] = "0123456789012345678901234567890123456789"
+                                "0123456789012345678901234567890123456789";
+  char out[128];
+  const LogArg a[] = {logArg(longStr)};
+  logFormat(out, sizeof(out), "<%s>", a, 1);
+  TEST_ASSERT_EQUAL_UINT32(strlen(longStr) + 2, strlen(out));
+}
+
+void test_records_in_order_with_prefix(void) {
+  fakeNow = 12345;
+  LOGI("MQTT connected.");
+  fakeNow = 12400;
+  LOGW("WiFi failed (reason %u), retry in %lu ms\n", 201u, 5000ul);
+  fakeNow = 99999; // formatting later keeps the record's own time
+  TEST_ASSERT_TRUE(logger.pop(line, sizeof(line)));
+  TEST_ASSERT_EQUAL_STRING("[12.345] I MQTT connected.", line);
+  TEST_ASSERT_TRUE(logger.pop(line, sizeof(line)));
+  TEST_ASSERT_EQUAL_STRING("[12.400] W WiFi failed (reason 201), retry in "
+                           "5000 ms",
+                           line);
+  TEST_ASSERT_FALSE(logger.pop(line, sizeof(line)));
+  TEST_ASSERT_TRUE(logger.empty());
+}
+
+void test_level_filter(void) {
+  LOGD("hidden %d", 1);
+  TEST_ASSERT_TRUE(logger.empty());
+  logger.setLevel(LL_DEBUG);
+  LOGD("shown %d", 2);
+  TEST_ASSERT_TRUE(logger.pop(line, sizeof(line)));
+  TEST_ASSERT_EQUAL_STRING("[0.000] D shown 2", line);
+  logger.setLevel(LL_ERROR);
+  LOGW("hidden");
+  LOGE("error");
+  TEST_ASSERT_TRUE(logger.pop(line, sizeof(line)));
+  TEST_ASSERT_EQUAL_STRING("[0.000] E error", line);
+  TEST_ASSERT_FALSE(logger.pop(line, sizeof(line)));
+}
+
+void test_full_ring_drops_and_reports(void) {
+  for (int k = 0; k < LOG_RING_ENTRIES + 5; ++k)
+    LOGI("n=%d", k);
+  TEST_ASSERT_EQUAL_UINT32(5, logger.dropped());
+  TEST_ASSERT_TRUE(logger.pop(line, sizeof(line)));
+  TEST_ASSERT_EQUAL_STRING("[0.000] W log: 5 records dropped", line);
+  for (int k = 0; k < LOG_RING_ENTRIES; ++k) {
+    TEST_ASSERT_TRUE(logger.pop(line, sizeof(line)));
+    char expect[32];
+    snprintf(expect, sizeof(expect), "[0.000] I n=%d", k);
+    TEST_ASSERT_EQUAL_STRING(expect, line);
+  }
+  TEST_ASSERT_FALSE(logger.pop(line, sizeof(line)));
+  // Ring reusable after wrapping
+  LOGI("again");
+  TEST_ASSERT_TRUE(logger.pop(line, sizeof(line)));
+  TEST_ASSERT_EQUAL_STRING("[0.000] I again", line);
+}
+
+void test_level_names(void) {
+  TEST_ASSERT_EQUAL_UINT8(LL_ERROR, logLevelFromName("e"));
+  TEST_ASSERT_EQUAL_UINT8(LL_WARN, logLevelFromName("WARN"));
+  TEST_ASSERT_EQUAL_UINT8(LL_INFO, logLevelFromName("info"));
+  TEST_ASSERT_EQUAL_UINT8(LL_DEBUG, logLevelFromName("D"));
+  TEST_ASSERT_EQUAL_UINT8(LL_COUNT, logLevelFromName("DE"));
+  TEST_ASSERT_EQUAL_UINT8(LL_COUNT, logLevelFromName("X"));
+  TEST_ASSERT_EQUAL_UINT8(LL_COUNT, logLevelFromName(""));
+  TEST_ASSERT_EQUAL_STRING("DEBUG", logLevelName(LL_DEBUG));
+}
+
+// Hot path: storing a record vs. formatting the same line as printf did
+void test_log_call_cost(void) {
+  const int ROUNDS = 4000;
+  const int N = ROUNDS * (LOG_RING_ENTRIES / 2);
+  const uint32_t dropped0 = logger.dropped();
+  std::chrono::steady_clock::duration tLog{0}, tFmt{0};
+  for (int r = 0; r < ROUNDS; ++r) {
+    auto t0 = std::chrono::steady_clock::now();
+    for (int k = 0; k < LOG_RING_ENTRIES / 2; ++k)
+      LOGI("Rint: %.2f mOhm, Rint25: %.2f mOhm, BaseR: %.2f mOhm", 11.5f,
+           10.9f, (float)k);
+    auto t1 = std::chrono::steady_clock::now();
+    for (int k = 0; k < LOG_RING_ENTRIES / 2; ++k)
+      snprintf(line, sizeof(line),
+               "Rint: %.2f mOhm, Rint25: %.2f mOhm, BaseR: %.2f mOhm\n",
+               11.5f, 10.9f, (float)k);
+    auto t2 = std::chrono::steady_clock::now();
+    tLog += t1 - t0;
+    tFmt += t2 - t1;
+    while (logger.pop(line, sizeof(line))) {
+    }
+  }
+  logger.setLevel(LL_WARN);
+  auto t3 = std::chrono::steady_clock::now();
+  for (int k = 0; k < N; ++k)
+    LOGI("filtered %d", k);
+  auto t4 = std::chrono::steady_clock::now();
+  auto ns = [N](std::chrono::steady_clock::duration d) {
+    return std::chrono::duration<double, std::nano>(d).count() / N;
+  };
+  char msg[128];
+  snprintf(msg, sizeof(msg),
+           "log call %.1f ns, snprintf %.1f ns, filtered %.1f ns", ns(tLog),
+           ns(tFmt), ns(t4 - t3));
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_EQUAL_UINT32(dropped0, logger.dropped());
+  TEST_ASSERT_TRUE(ns(tLog) < ns(tFmt));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_format_matches_printf);
+  RUN_TEST(test_length_modifiers_dropped);
+  RUN_TEST(test_missing_args_and_bad_specs_kept);
+  RUN_TEST(test_trailing_newline_and_truncation);
+  RUN_TEST(test_long_string_argument);
+  RUN_TEST(test_records_in_order_with_prefix);
+  RUN_TEST(test_level_filter);
+  RUN_TEST(test_full_ring_drops_and_reports);
+  RUN_TEST(test_level_names);
+  RUN_TEST(test_log_call_cost);
+  return UNITY_END();
+}
@@ -0,0 +1,520 @@
+#include <cstring>
+#include <string>
+#include <unity.h>
+#include <vector>
+
+#include "../../src/comms/mqtt_session.cpp"
+
+// Loopback broker stand-in: parses what the client writes, answers CONNECT,
+// PUBLISH (QoS 1), SUBSCRIBE and PINGREQ, and sends publishes to subscribed
+// topics back to the client. Faults: a refused CONNACK, missing PUBACKs or
+// PINGRESPs, and a small write window that splits packets.
+struct Msg {
+  std::string topic, payload;
+  uint8_t qos;
+  bool dup, retain;
+  uint16_t pid;
+};
+
+struct LoopbackBroker : MqttTransport {
+  size_t window = 1 << 20; // bytes taken per write()
+  uint8_t connackCode = 0;
+  bool ackPublish = true;
+  bool answerPing = true;
+
+  std::vector<uint8_t> in, out;
+  std::vector<uint8_t> types; // packet types received, in order
+  std::vector<Msg> msgs;
+  std::vector<std::string> subs;
+  std::vector<uint16_t> unacked;
+  std::vector<uint8_t> connect; // body of the last CONNECT
+  int pubacks = 0;
+  bool bad = false;
+
+  size_t write(const uint8_t *data, size_t len) override {
+    size_t n = len < window ? len : window;
+    in.insert(in.end(), data, data + n);
+    parse();
+    return n;
+  }
+
+  void reset() {
+    in.clear();
+    out.clear();
+    types.clear();
+    msgs.clear();
+  }
+
+  static std::string str(const uint8_t *p) {
+    return std::string((const char *)p + 2, p[0] << 8 | p[1]);
+  }
+
+  void reply(uint8_t type, uint16_t pid) {
+    uint8_t pkt[5] = {type, 2, (uint8_t)(pid >> 8), (uint8_t)pid, 0};
+    if (type == 0x90) { // SUBACK with granted QoS 1
+      pkt[1] = 3;
+      pkt[4] = 1;
+    }
+    out.insert(out.end(), pkt, pkt + pkt[1] + 2);
+  }
+
+  void send(const std::string &topic, const std::string &payload,
+            uint8_t qos, bool retain = false) {
+    size_t rem = 2 + topic.size() + (qos ? 2 : 0) + payload.size();
+    out.push_back((uint8_t)(0x30 | qos << 1 | retain));
+    do {
+      uint8_t b = rem & 0x7F;
+      rem >>= 7;
+      out.push_back(rem ? b | 0x80 : b);
+    } while (rem);
+    out.push_back((uint8_t)(topic.size() >> 8));
+    out.push_back((uint8_t)topic.size());
+    out.insert(out.end(), topic.begin(), topic.end());
+    if (qos) {
+      out.push_back(0x12);
+      out.push_back(0x34);
+    }
+    out.insert(out.end(), payload.begin(), payload.end());
+  }
+
+  void parse() {
+    for (;;) {
+      size_t rem = 0, i = 1;
+      for (int shift = 0; i < in.size(); shift += 7) {
+        rem |= (size_t)(in[i] & 0x7F) << shift;
+        if (!(in[i++] & 0x80))
+          break;
+      }
+      if (in.size() < 2 || in.size() < i + rem || (in[i - 1] & 0x80))
+        return;
+      handle(in[0], &in[i], rem);
+      in.erase(in.begin(), in.begin() + i + rem);
+    }
+  }
+
+  void handle(uint8_t hdr, const uint8_t *b, size_t len) {
+    uint8_t type = hdr >> 4;
+    types.push_back(type);
+    switch (type) {
+    case 1: // CONNECT
+      connect.assign(b, b + len);
+      out.push_back(0x20);
+      out.push_back(2);
+      out.push_back(0);
+      out.push_back(connackCode);
+      return;
+    case 3: { // PUBLISH
+      Msg m;
+      m.qos = (hdr >> 1) & 3;
+      m.dup = hdr & 0x08;
+      m.retain = hdr & 0x01;
+      m.topic = str(b);
+      size_t pos = 2 + m.topic.size();
+      m.pid = m.qos ? (uint16_t)(b[pos] << 8 | b[pos + 1]) : 0;
+      pos += m.qos ? 2 : 0;
+      m.payload.assign((const char *)b + pos, len - pos);
+      msgs.push_back(m);
+      if (m.qos)
+        ackPublish ? reply(0x40, m.pid) : unacked.push_back(m.pid);
+      for (size_t s = 0; s < subs.size(); ++s)
+        if (subs[s] == m.topic)
+          send(m.topic, m.payload, m.qos);
+      return;
+    }
+    case 4: // PUBACK from the client
+      pubacks++;
+      return;
+    case 8: // SUBSCRIBE
+      subs.push_back(str(b + 2));
+      reply(0x90, (uint16_t)(b[0] << 8 | b[1]));
+      return;
+    case 12: // PINGREQ
+      if (answerPing) {
+        out.push_back(0xD0);
+        out.push_back(0);
+      }
+      return;
+    case 14: // DISCONNECT
+      return;
+    default:
+      bad = true;
+    }
+  }
+
+  void ackHeld() {
+    for (size_t i = 0; i < unacked.size(); ++i)
+      reply(0x40, unacked[i]);
+    unacked.clear();
+  }
+
+  void deliver(MqttSession &s) {
+    std::vector<uint8_t> o;
+    o.swap(out);
+    if (!o.empty())
+      s.receive(o.data(), o.size());
+  }
+};
+
+static uint8_t queue[1024];
+static MqttSession *session;
+static LoopbackBroker *broker;
+static MqttSessionConfig cfg;
+static std::vector<Msg> received;
+
+static void onMsg(void *, const char *topic, const uint8_t *payload,
+                  size_t len, bool retained) {
+  Msg m;
+  m.topic = topic;
+  m.payload.assign((const char *)payload, len);
+  m.retain = retained;
+  received.push_back(m);
+}
+
+// Poll and feed the broker's answers back until nothing moves
+static bool pump(uint32_t now) {
+  for (int i = 0; i < 50; ++i) {
+    if (!session->poll(*broker, now))
+      return false;
+    if (broker->out.empty() && (broker->window == 0 || session->idle()))
+      break;
+    broker->deliver(*session);
+  }
+  return true;
+}
+
+static void connectAt(uint32_t now) {
+  session->begin(cfg, now);
+  TEST_ASSERT_TRUE(pump(now));
+  TEST_ASSERT_TRUE(session->connected());
+}
+
+static bool pub(const char *topic, const char *payload, uint8_t qos) {
+  return session->publish(topic, (const uint8_t *)payload, strlen(payload),
+                          false, qos);
+}
+
+void setUp(void) {
+  static MqttSession s(queue, sizeof(queue));
+  static LoopbackBroker b;
+  s = MqttSession(queue, sizeof(queue));
+  b = LoopbackBroker();
+  session = &s;
+  broker = &b;
+  cfg = MqttSessionConfig();
+  cfg.clientId = "esp32-batt";
+  received.clear();
+  session->onMessage(onMsg, nullptr);
+}
+
+void tearDown(void) {}
+
+void test_connect_packet(void) {
+  cfg.user = "user";
+  cfg.pass = "pw";
+  connectAt(0);
+  const std::vector<uint8_t> &c = broker->connect;
+  TEST_ASSERT_EQUAL(10 + 2 + 10 + 2 + 4 + 2 + 2, c.size());
+  TEST_ASSERT_EQUAL_MEMORY("\x00\x04MQTT\x04", c.data(), 7);
+  TEST_ASSERT_EQUAL_HEX8(0xC2, c[7]); // user, password, clean session
+  TEST_ASSERT_EQUAL(15, c[8] << 8 | c[9]);
+  TEST_ASSERT_EQUAL_STRING("esp32-batt", LoopbackBroker::str(&c[10]).c_str());
+  TEST_ASSERT_EQUAL_STRING("user", LoopbackBroker::str(&c[22]).c_str());
+  TEST_ASSERT_EQUAL_STRING("pw", LoopbackBroker::str(&c[28]).c_str());
+  TEST_ASSERT_EQUAL(0, session->connackCode());
+}
+
+void test_publish_needs_connack(void) {
+  TEST_ASSERT_FALSE(pub("t", "x", 0));
+  session->begin(cfg, 0);
+  TEST_ASSERT_FALSE(pub("t", "x", 0)); // CONNECT not answered yet
+  TEST_ASSERT_TRUE(session->poll(*broker, 0));
+  broker->deliver(*session);
+  TEST_ASSERT_TRUE(pub("t", "x", 0));
+}
+
+void test_qos0_leaves_queue_when_sent(void) {
+  connectAt(0);
+  TEST_ASSERT_TRUE(pub("car/battery", "{\"V\":12.6}", 0));
+  TEST_ASSERT_GREATER_THAN(0, session->queuedBytes());
+  TEST_ASSERT_TRUE(pump(1));
+  TEST_ASSERT_EQUAL(1, broker->msgs.size());
+  TEST_ASSERT_EQUAL_STRING("car/battery", broker->msgs[0].topic.c_str());
+  TEST_ASSERT_EQUAL_STRING("{\"V\":12.6}", broker->msgs[0].payload.c_str());
+  TEST_ASSERT_EQUAL(0, broker->msgs[0].qos);
+  TEST_ASSERT_EQUAL(0, session->queuedBytes());
+  TEST_ASSERT_TRUE(session->idle());
+}
+
+void test_qos1_held_until_puback(void) {
+  connectAt(0);
+  broker->ackPublish = false;
+  TEST_ASSERT_TRUE(session->publish("t", (const uint8_t *)"ab", 2, true, 1));
+  TEST_ASSERT_TRUE(pump(1));
+  TEST_ASSERT_EQUAL(1, broker->msgs.size());
+  TEST_ASSERT_TRUE(broker->msgs[0].retain);
+  TEST_ASSERT_EQUAL(1, broker->msgs[0].qos);
+  TEST_ASSERT_EQUAL(1, session->inflight());
+  TEST_ASSERT_FALSE(session->idle());
+  broker->ackHeld();
+  broker->deliver(*session);
+  TEST_ASSERT_EQUAL(0, session->inflight());
+  TEST_ASSERT_EQUAL(1, session->acked());
+  TEST_ASSERT_TRUE(session->idle());
+}
+
+void test_partial_writes_keep_packets_whole(void) {
+  connectAt(0);
+  broker->window = 3;
+  TEST_ASSERT_TRUE(pub("a/1", "first payload", 1));
+  TEST_ASSERT_TRUE(session->poll(*broker, 1)); // first packet half sent
+  TEST_ASSERT_TRUE(session->subscribe("a/cmd", 1));
+  TEST_ASSERT_TRUE(pub("a/2", "second", 0));
+  for (uint32_t t = 2; t < 100 && !session->idle(); ++t) {
+    TEST_ASSERT_TRUE(session->poll(*broker, t));
+    broker->deliver(*session);
+  }
+  TEST_ASSERT_FALSE(broker->bad);
+  TEST_ASSERT_TRUE(session->idle());
+  // SUBSCRIBE waited for the end of the first PUBLISH
+  TEST_ASSERT_EQUAL(4, broker->types.size());
+  TEST_ASSERT_EQUAL(3, broker->types[1]);
+  TEST_ASSERT_EQUAL(8, broker->types[2]);
+  TEST_ASSERT_EQUAL(3, broker->types[3]);
+  TEST_ASSERT_EQUAL_STRING("first payload", broker->msgs[0].payload.c_str());
+  TEST_ASSERT_EQUAL_STRING("second", broker->msgs[1].payload.c_str());
+}
+
+void test_resend_with_dup_after_reconnect(void) {
+  connectAt(0);
+  broker->ackPublish = false;
+  TEST_ASSERT_TRUE(pub("t", "one", 1));
+  TEST_ASSERT_TRUE(pub("t", "two", 1));
+  TEST_ASSERT_TRUE(pump(1));
+  TEST_ASSERT_EQUAL(2, session->inflight());
+  session->end(); // connection lost
+  broker->reset();
+  broker->ackPublish = true;
+  connectAt(100);
+  TEST_ASSERT_EQUAL(2, broker->msgs.size());
+  TEST_ASSERT_TRUE(broker->msgs[0].dup);
+  TEST_ASSERT_EQUAL_STRING("one", broker->msgs[0].payload.c_str());
+  TEST_ASSERT_EQUAL_STRING("two", broker->msgs[1].payload.c_str());
+  TEST_ASSERT_EQUAL(2, session->resent());
+  TEST_ASSERT_TRUE(session->idle());
+}
+
+void test_unsent_publish_not_marked_dup(void) {
+  connectAt(0);
+  broker->window = 0;
+  TEST_ASSERT_TRUE(pub("t", "held", 1));
+  TEST_ASSERT_TRUE(session->poll(*broker, 1));
+  session->end();
+  broker->reset();
+  broker->window = 1 << 20;
+  connectAt(2);
+  TEST_ASSERT_EQUAL(1, broker->msgs.size());
+  TEST_ASSERT_FALSE(broker->msgs[0].dup);
+  TEST_ASSERT_EQUAL(0, session->resent());
+}
+
+void test_qos0_dropped_with_connection_is_not_resent(void) {
+  connectAt(0);
+  TEST_ASSERT_TRUE(pub("t", "gone", 0));
+  TEST_ASSERT_TRUE(pump(1));
+  session->end();
+  broker->reset();
+  connectAt(2);
+  TEST_ASSERT_EQUAL(0, broker->msgs.size());
+}
+
+// The snapshot wake only drops its RTC batch and outbox records once the
+// session is idle again (MqttMgr::sync()). A connection lost before the
+// PUBACKs leaves it busy, so the data is kept for the next wake.
+void test_lost_session_before_puback_is_not_synced(void) {
+  connectAt(0);
+  broker->ackPublish = false;
+  TEST_ASSERT_TRUE(pub("car/battery/batch", "batch", 1));
+  TEST_ASSERT_TRUE(pub("esp32-batt/sync", "1", 1)); // sync token
+  TEST_ASSERT_TRUE(pump(1));
+  TEST_ASSERT_EQUAL(2, broker->msgs.size()); // on the wire, not acked
+  TEST_ASSERT_FALSE(session->idle());
+  session->end(); // TCP session lost
+  TEST_ASSERT_FALSE(session->connected());
+  TEST_ASSERT_FALSE(session->idle());
+  TEST_ASSERT_EQUAL(0, session->acked());
+  // Acknowledged after all: only now is the session idle
+  broker->reset();
+  broker->ackPublish = true;
+  connectAt(10);
+  TEST_ASSERT_EQUAL(2, session->acked());
+  TEST_ASSERT_TRUE(session->idle());
+}
+
+void test_puback_timeout_kills_session(void) {
+  connectAt(0);
+  broker->ackPublish = false;
+  TEST_ASSERT_TRUE(pub("t", "x", 1));
+  TEST_ASSERT_TRUE(pump(1000));
+  TEST_ASSERT_TRUE(session->poll(*broker, 1000 + cfg.ackTimeout_ms));
+  TEST_ASSERT_FALSE(session->poll(*broker, 1001 + cfg.ackTimeout_ms));
+}
+
+void test_keepalive_ping(void) {
+  connectAt(0);
+  uint32_t ka = cfg.keepAlive_s * 1000UL;
+  TEST_ASSERT_TRUE(pump(ka - 1));
+  TEST_ASSERT_EQUAL(1, broker->types.size()); // CONNECT only
+  TEST_ASSERT_TRUE(pump(ka));
+  TEST_ASSERT_EQUAL(12, broker->types.back());
+  TEST_ASSERT_TRUE(pump(ka + cfg.ackTimeout_ms + 1)); // PINGRESP came back
+  broker->answerPing = false;
+  TEST_ASSERT_TRUE(pump(3 * ka));
+  TEST_ASSERT_EQUAL(12, broker->types.back());
+  TEST_ASSERT_FALSE(session->poll(*broker, 3 * ka + cfg.ackTimeout_ms + 1));
+}
+
+void test_connack_refused(void) {
+  broker->connackCode = 5; // not authorized
+  session->begin(cfg, 0);
+  TEST_ASSERT_FALSE(pump(0));
+  TEST_ASSERT_FALSE(session->connected());
+  TEST_ASSERT_EQUAL(5, session->connackCode());
+}
+
+void test_connack_timeout(void) {
+  session->begin(cfg, 0);
+  TEST_ASSERT_TRUE(session->poll(*broker, 0));
+  broker->out.clear(); // CONNACK lost
+  TEST_ASSERT_TRUE(session->poll(*broker, cfg.ackTimeout_ms));
+  TEST_ASSERT_FALSE(session->poll(*broker, cfg.ackTimeout_ms + 1));
+}
+
+void test_queue_full_then_compacted(void) {
+  connectAt(0);
+  broker->ackPublish = false;
+  char payload[200];
+  memset(payload, 'x', sizeof(payload) - 1);
+  payload[sizeof(payload) - 1] = '\0';
+  int n = 0;
+  while (pub("t", payload, 1))
+    ++n;
+  TEST_ASSERT_EQUAL(4, n); // 1024 B queue, ~220 B per record
+  TEST_ASSERT_TRUE(pump(1));
+  TEST_ASSERT_FALSE(pub("t", payload, 1));
+  // Acking the oldest frees the head; the new record is moved down
+  uint16_t held = broker->unacked.back();
+  broker->unacked.pop_back();
+  broker->ackHeld();
+  broker->deliver(*session);
+  TEST_ASSERT_EQUAL(1, session->inflight());
+  TEST_ASSERT_TRUE(pub("t", payload, 1));
+  broker->unacked.push_back(held);
+  broker->ackPublish = true;
+  broker->ackHeld();
+  TEST_ASSERT_TRUE(pump(2));
+  TEST_ASSERT_TRUE(session->idle());
+  TEST_ASSERT_EQUAL(5, broker->msgs.size());
+  TEST_ASSERT_EQUAL_STRING(payload, broker->msgs[4].payload.c_str());
+}
+
+void test_oversized_publish_rejected(void) {
+  connectAt(0);
+  static char big[sizeof(queue)];
+  memset(big, 'x', sizeof(big) - 1);
+  big[sizeof(big) - 1] = '\0';
+  TEST_ASSERT_FALSE(pub("t", big, 0));
+  TEST_ASSERT_TRUE(session->idle());
+}
+
+void test_streamed_publish(void) {
+  connectAt(0);
+  TEST_ASSERT_TRUE(session->beginPublish("car/battery", 11, false, 1));
+  TEST_ASSERT_FALSE(session->beginPublish("other", 1, false, 0));
+  TEST_ASSERT_TRUE(session->write((const uint8_t *)"hello", 5));
+  TEST_ASSERT_TRUE(pump(1)); // an open record is not sent yet
+  TEST_ASSERT_EQUAL(0, broker->msgs.size());
+  TEST_ASSERT_TRUE(session->write((const uint8_t *)" world", 6));
+  TEST_ASSERT_FALSE(session->write((const uint8_t *)"!", 1)); // over length
+  TEST_ASSERT_TRUE(session->endPublish());
+  TEST_ASSERT_TRUE(pump(2));
+  TEST_ASSERT_EQUAL(1, broker->msgs.size());
+  TEST_ASSERT_EQUAL_STRING("hello world", broker->msgs[0].payload.c_str());
+  TEST_ASSERT_TRUE(session->idle());
+}
+
+void test_incomplete_stream_discarded(void) {
+  connectAt(0);
+  TEST_ASSERT_TRUE(pub("t", "kept", 0));
+  size_t before = session->queuedBytes();
+  TEST_ASSERT_TRUE(session->beginPublish("t", 10, false, 1));
+  TEST_ASSERT_TRUE(session->write((const uint8_t *)"short", 5));
+  TEST_ASSERT_FALSE(session->endPublish());
+  TEST_ASSERT_EQUAL(before, session->queuedBytes());
+  TEST_ASSERT_TRUE(pump(1));
+  TEST_ASSERT_EQUAL(1, broker->msgs.size());
+  TEST_ASSERT_EQUAL_STRING("kept", broker->msgs[0].payload.c_str());
+  TEST_ASSERT_FALSE(broker->bad);
+}
+
+void test_subscribe_and_loopback(void) {
+  connectAt(0);
+  TEST_ASSERT_TRUE(session->subscribe("esp32-batt/cmd", 1));
+  TEST_ASSERT_TRUE(pump(1));
+  TEST_ASSERT_EQUAL(1, broker->subs.size());
+  TEST_ASSERT_TRUE(pub("esp32-batt/cmd", "CAP?", 1));
+  TEST_ASSERT_TRUE(pump(2));
+  TEST_ASSERT_EQUAL(1, received.size());
+  TEST_ASSERT_EQUAL_STRING("esp32-batt/cmd", received[0].topic.c_str());
+  TEST_ASSERT_EQUAL_STRING("CAP?", received[0].payload.c_str());
+  TEST_ASSERT_FALSE(received[0].retain);
+  TEST_ASSERT_TRUE(pump(3)); // PUBACK for the QoS 1 delivery
+  TEST_ASSERT_EQUAL(1, broker->pubacks);
+  // A retained message (sent on subscribe) is flagged to the handler
+  broker->send("esp32-batt/cmd", "SLEEP", 0, true);
+  broker->deliver(*session);
+  TEST_ASSERT_TRUE(session->poll(*broker, 4));
+  TEST_ASSERT_EQUAL(2, received.size());
+  TEST_ASSERT_TRUE(received[1].retain);
+}
+
+void test_oversized_incoming_skipped(void) {
+  connectAt(0);
+  broker->send("big", std::string(400, 'x'), 0);
+  broker->send("small", "ok", 0);
+  broker->deliver(*session);
+  TEST_ASSERT_TRUE(session->poll(*broker, 1));
+  TEST_ASSERT_EQUAL(1, received.size());
+  TEST_ASSERT_EQUAL_STRING("small", received[0].topic.c_str());
+}
+
+void test_malformed_input_kills_session(void) {
+  connectAt(0);
+  const uint8_t junk[] = {0x00, 0x00};
+  session->receive(junk, sizeof(junk));
+  TEST_ASSERT_FALSE(session->poll(*broker, 1));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_connect_packet);
+  RUN_TEST(test_publish_needs_connack);
+  RUN_TEST(test_qos0_leaves_queue_when_sent);
+  RUN_TEST(test_qos1_held_until_puback);
+  RUN_TEST(test_partial_writes_keep_packets_whole);
+  RUN_TEST(test_resend_with_dup_after_reconnect);
+  RUN_TEST(test_unsent_publish_not_marked_dup);
+  RUN_TEST(test_qos0_dropped_with_connection_is_not_resent);
+  RUN_TEST(test_lost_session_before_puback_is_not_synced);
+  RUN_TEST(test_puback_timeout_kills_session);
+  RUN_TEST(test_keepalive_ping);
+  RUN_TEST(test_connack_refused);
+  RUN_TEST(test_connack_timeout);
+  RUN_TEST(test_queue_full_then_compacted);
+  RUN_TEST(test_oversized_publish_rejected);
+  RUN_TEST(test_streamed_publish);
+  RUN_TEST(test_incomplete_stream_discarded);
+  RUN_TEST(test_subscribe_and_loopback);
+  RUN_TEST(test_oversized_incoming_skipped);
+  RUN_TEST(test_malformed_input_kills_session);
+  return UNITY_END();
+}
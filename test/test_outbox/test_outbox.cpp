@@ -0,0 +1,394 @@
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <unity.h>
+#include <vector>
+
+#include "../../src/comms/outbox.cpp"
+#include "../../src/json_writer.cpp"
+#include "../../src/telemetry_payload.cpp"
+
+// In-memory segment store
+class MemStorage : public OutboxStorage {
+public:
+  std::map<uint32_t, std::vector<uint8_t>> segs;
+  bool failWrites = false;
+  int appends = 0;
+
+  int list(uint32_t *ids, int maxIds) override {
+    int n = 0;
+    for (auto &kv : segs)
+      if (n < maxIds)
+        ids[n++] = kv.first;
+    return n;
+  }
+  bool append(uint32_t id, const uint8_t *data, size_t len) override {
+    if (failWrites)
+      return false;
+    appends++;
+    segs[id].insert(segs[id].end(), data, data + len);
+    return true;
+  }
+  int32_t read(uint32_t id, uint32_t offset, uint8_t *out,
+               size_t len) override {
+    auto it = segs.find(id);
+    if (it == segs.end())
+      return -1;
+    if (offset >= it->second.size())
+      return 0;
+    size_t n = it->second.size() - offset;
+    if (n > len)
+      n = len;
+    memcpy(out, it->second.data() + offset, n);
+    return (int32_t)n;
+  }
+  int32_t size(uint32_t id) override {
+    auto it = segs.find(id);
+    return it == segs.end() ? -1 : (int32_t)it->second.size();
+  }
+  bool remove(uint32_t id) override { return segs.erase(id) > 0; }
+};
+
+static MemStorage fs;
+static OutboxCursor cursor;
+static const uint32_t PER_SEG = Outbox::RECORDS_PER_SEGMENT;
+
+static TelemetryFrame makeFrame(uint32_t up_ms) {
+  TelemetryFrame f = {};
+  f.mode = "snapshot";
+  f.V = 12.634f;
+  f.I = -0.42f;
+  f.T = 18.3f;
+  f.soc_pct = 81.27f;
+  f.soh_pct = 94.5f;
+  f.Rint_mOhm = 6.21f;
+  f.Rint25_mOhm = 6.05f;
+  f.RintBaseline_mOhm = 5.9f;
+  f.ah_left = 45.67f;
+  f.battery_capacity_ah = 60.0f;
+  f.alternator_on = false;
+  f.rest_s = 1800;
+  f.lowCurrentAccum_s = 900;
+  f.up_ms = up_ms;
+  f.hasRint = true;
+  f.hasRint25 = true;
+  return f;
+}
+
+static OutboxRecord makeRecord(uint32_t seq) {
+  OutboxRecord r;
+  packOutboxRecord(makeFrame(seq), 1700000000u + seq, r);
+  return r;
+}
+
+static uint32_t seqOf(const OutboxRecord &r) {
+  TelemetryFrame f;
+  uint32_t ts = 0;
+  TEST_ASSERT_TRUE(unpackOutboxRecord(r, f, ts));
+  return f.up_ms;
+}
+
+// Peek and commit everything, checking records arrive in order
+static uint32_t drain(Outbox &o, uint32_t expectFirst) {
+  OutboxRecord batch[8];
+  uint32_t next = expectFirst, total = 0;
+  int n;
+  while ((n = o.peek(batch, 8)) > 0) {
+    for (int i = 0; i < n; ++i)
+      TEST_ASSERT_EQUAL_UINT32(next++, seqOf(batch[i]));
+    o.commit(n, 100u * n, 1);
+    total += n;
+  }
+  return total;
+}
+
+void setUp(void) {
+  fs.segs.clear();
+  fs.failWrites = false;
+  fs.appends = 0;
+  memset(&cursor, 0, sizeof(cursor));
+}
+void tearDown(void) {}
+
+void test_record_round_trip(void) {
+  OutboxRecord r;
+  TelemetryFrame in = makeFrame(123456);
+  in.alternator_on = true;
+  packOutboxRecord(in, 1735689600u, r);
+  TelemetryFrame out;
+  uint32_t ts = 0;
+  TEST_ASSERT_TRUE(unpackOutboxRecord(r, out, ts));
+  TEST_ASSERT_EQUAL_UINT32(1735689600u, ts);
+  TEST_ASSERT_EQUAL_UINT32(123456, out.up_ms);
+  TEST_ASSERT_EQUAL_STRING("snapshot", out.mode);
+  TEST_ASSERT_FLOAT_WITHIN(0.0005f, in.V, out.V);
+  TEST_ASSERT_FLOAT_WITHIN(0.005f, in.I, out.I);
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, in.T, out.T);
+  TEST_ASSERT_FLOAT_WITHIN(0.005f, in.soc_pct, out.soc_pct);
+  TEST_ASSERT_FLOAT_WITHIN(0.005f, in.Rint25_mOhm, out.Rint25_mOhm);
+  TEST_ASSERT_FLOAT_WITHIN(0.005f, in.ah_left, out.ah_left);
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, in.battery_capacity_ah,
+                           out.battery_capacity_ah);
+  TEST_ASSERT_EQUAL_UINT32(1800, out.rest_s);
+  TEST_ASSERT_TRUE(out.alternator_on);
+  TEST_ASSERT_TRUE(out.hasRint);
+}
+
+void test_record_nulls_and_saturation(void) {
+  TelemetryFrame in = makeFrame(1);
+  in.T = NAN;
+  in.soh_pct = NAN;
+  in.Rint_mOhm = INFINITY;
+  in.I = -500.0f;               // beyond the int16 range
+  in.rest_s = 3u * 24u * 3600u; // beyond uint16
+  OutboxRecord r;
+  packOutboxRecord(in, 0, r);
+  TelemetryFrame out;
+  uint32_t ts = 1;
+  TEST_ASSERT_TRUE(unpackOutboxRecord(r, out, ts));
+  TEST_ASSERT_EQUAL_UINT32(0, ts);
+  TEST_ASSERT_TRUE(std::isnan(out.T));
+  TEST_ASSERT_TRUE(std::isnan(out.soh_pct));
+  TEST_ASSERT_TRUE(std::isnan(out.Rint_mOhm));
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, -327.67f, out.I);
+  TEST_ASSERT_EQUAL_UINT32(65535, out.rest_s);
+}
+
+void test_record_crc_detects_corruption(void) {
+  OutboxRecord r = makeRecord(7);
+  r.b[9] ^= 0x04;
+  TelemetryFrame f;
+  uint32_t ts;
+  TEST_ASSERT_FALSE(unpackOutboxRecord(r, f, ts));
+}
+
+void test_record_json_has_timestamp(void) {
+  char js[700];
+  OutboxRecord r = makeRecord(5);
+  TEST_ASSERT_TRUE(buildOutboxRecordJson(r, js, sizeof(js)));
+  TEST_ASSERT_NOT_NULL(strstr(js, "\"mode\":\"snapshot\""));
+  TEST_ASSERT_NOT_NULL(strstr(js, "\"voltage_V\":12.634"));
+  TEST_ASSERT_NOT_NULL(strstr(js, ",\"ts\":1700000005}"));
+
+  packOutboxRecord(makeFrame(5), 0, r);
+  TEST_ASSERT_TRUE(buildOutboxRecordJson(r, js, sizeof(js)));
+  TEST_ASSERT_NOT_NULL(strstr(js, ",\"ts\":null}"));
+  TEST_ASSERT_FALSE(buildOutboxRecordJson(r, js, 60));
+}
+
+// Records carry no interval statistics, whatever was in the frame before
+void test_replayed_record_has_no_interval(void) {
+  OutboxRecord r = makeRecord(3);
+  TelemetryFrame f;
+  memset(&f, 0x01, sizeof(f)); // stack garbage
+  uint32_t ts;
+  TEST_ASSERT_TRUE(unpackOutboxRecord(r, f, ts));
+  TEST_ASSERT_FALSE(f.hasStats);
+  TEST_ASSERT_EQUAL_UINT32(0, f.stats.n);
+  char js[700];
+  TEST_ASSERT_TRUE(buildOutboxRecordJson(r, js, sizeof(js)));
+  TEST_ASSERT_NULL(strstr(js, "\"interval\""));
+}
+
+void test_outbox_fifo(void) {
+  Outbox o(fs, cursor, 8);
+  o.begin();
+  TEST_ASSERT_TRUE(o.empty());
+  for (uint32_t i = 0; i < 20; ++i)
+    TEST_ASSERT_TRUE(o.push(makeRecord(i)));
+  TEST_ASSERT_EQUAL_UINT32(20, o.pending());
+  TEST_ASSERT_EQUAL_UINT32(20, drain(o, 0));
+  TEST_ASSERT_TRUE(o.empty());
+  TEST_ASSERT_EQUAL_UINT32(20, o.stats().replayed);
+}
+
+void test_outbox_peek_does_not_consume(void) {
+  Outbox o(fs, cursor, 8);
+  o.begin();
+  for (uint32_t i = 0; i < 5; ++i)
+    o.push(makeRecord(i));
+  OutboxRecord batch[3];
+  TEST_ASSERT_EQUAL(3, o.peek(batch, 3));
+  TEST_ASSERT_EQUAL(3, o.peek(batch, 3));
+  TEST_ASSERT_EQUAL_UINT32(0, seqOf(batch[0]));
+  o.commit(2, 0, 0); // e.g. third publish failed
+  TEST_ASSERT_EQUAL(3, o.peek(batch, 3));
+  TEST_ASSERT_EQUAL_UINT32(2, seqOf(batch[0]));
+  TEST_ASSERT_EQUAL_UINT32(3, o.pending());
+}
+
+void test_outbox_rotates_segments(void) {
+  Outbox o(fs, cursor, 8);
+  o.begin();
+  for (uint32_t i = 0; i < 2 * PER_SEG + 1; ++i)
+    o.push(makeRecord(i));
+  TEST_ASSERT_EQUAL_UINT16(3, o.segments());
+  TEST_ASSERT_EQUAL(3, (int)fs.segs.size());
+  for (auto &kv : fs.segs)
+    TEST_ASSERT_TRUE(kv.second.size() <= Outbox::SEGMENT_BYTES);
+  TEST_ASSERT_EQUAL_UINT32(2 * PER_SEG + 1, drain(o, 0));
+}
+
+void test_outbox_drained_segments_deleted(void) {
+  Outbox o(fs, cursor, 8);
+  o.begin();
+  for (uint32_t i = 0; i < PER_SEG + 10; ++i)
+    o.push(makeRecord(i));
+  drain(o, 0);
+  TEST_ASSERT_EQUAL(0, (int)fs.segs.size());
+  TEST_ASSERT_EQUAL_UINT16(0, o.segments());
+  // New data starts a fresh segment with a new number
+  o.push(makeRecord(99));
+  TEST_ASSERT_EQUAL(1, (int)fs.segs.size());
+  TEST_ASSERT_EQUAL_UINT32(3, fs.segs.begin()->first);
+}
+
+void test_outbox_bounded_drops_oldest(void) {
+  Outbox o(fs, cursor, 3);
+  o.begin();
+  uint32_t total = 4 * PER_SEG + 5;
+  for (uint32_t i = 0; i < total; ++i)
+    o.push(makeRecord(i));
+  TEST_ASSERT_EQUAL_UINT16(3, o.segments());
+  TEST_ASSERT_EQUAL(3, (int)fs.segs.size());
+  TEST_ASSERT_EQUAL_UINT32(2 * PER_SEG, o.stats().dropped);
+  TEST_ASSERT_EQUAL_UINT32(total - 2 * PER_SEG, o.pending());
+  TEST_ASSERT_EQUAL_UINT32(total - 2 * PER_SEG, drain(o, 2 * PER_SEG));
+}
+
+void test_outbox_drop_counts_only_unsent(void) {
+  Outbox o(fs, cursor, 2);
+  o.begin();
+  for (uint32_t i = 0; i < 2 * PER_SEG; ++i)
+    o.push(makeRecord(i));
+  OutboxRecord batch[8];
+  o.commit(o.peek(batch, 8), 0, 0); // 8 of the oldest segment were sent
+  o.push(makeRecord(2 * PER_SEG));  // forces a third segment
+  TEST_ASSERT_EQUAL_UINT32(PER_SEG - 8, o.stats().dropped);
+  TEST_ASSERT_EQUAL_UINT32(PER_SEG + 1, o.pending());
+  TEST_ASSERT_EQUAL_UINT32(PER_SEG + 1, drain(o, PER_SEG));
+}
+
+void test_outbox_resume_after_deep_sleep(void) {
+  {
+    Outbox o(fs, cursor, 8);
+    o.begin();
+    for (uint32_t i = 0; i < PER_SEG + 20; ++i)
+      o.push(makeRecord(i));
+    OutboxRecord batch[8];
+    for (int k = 0; k < 3; ++k)
+      o.commit(o.peek(batch, 8), 0, 0);
+  }
+  // Flash and RTC cursor survive; RAM state is rebuilt
+  Outbox o(fs, cursor, 8);
+  o.begin();
+  TEST_ASSERT_EQUAL_UINT32(PER_SEG + 20 - 24, o.pending());
+  TEST_ASSERT_EQUAL_UINT32(PER_SEG + 20 - 24, drain(o, 24));
+}
+
+void test_outbox_power_loss_replays_from_oldest(void) {
+  {
+    Outbox o(fs, cursor, 8);
+    o.begin();
+    for (uint32_t i = 0; i < 30; ++i)
+      o.push(makeRecord(i));
+    OutboxRecord batch[8];
+    o.commit(o.peek(batch, 8), 0, 0);
+  }
+  memset(&cursor, 0xA5, sizeof(cursor)); // RTC memory lost
+  Outbox o(fs, cursor, 8);
+  o.begin();
+  TEST_ASSERT_EQUAL_UINT32(30, o.pending()); // at-least-once
+  TEST_ASSERT_EQUAL_UINT32(30, drain(o, 0));
+}
+
+void test_outbox_torn_tail_record(void) {
+  {
+    Outbox o(fs, cursor, 8);
+    o.begin();
+    for (uint32_t i = 0; i < 5; ++i)
+      o.push(makeRecord(i));
+  }
+  // Power lost half-way through appending the sixth record
+  OutboxRecord r = makeRecord(5);
+  fs.segs.begin()->second.insert(fs.segs.begin()->second.end(), r.b,
+                                 r.b + OUTBOX_RECORD_SIZE / 2);
+  Outbox o(fs, cursor, 8);
+  o.begin();
+  TEST_ASSERT_EQUAL_UINT32(5, o.pending());
+  o.push(makeRecord(6)); // goes to a new segment, not after the torn bytes
+  TEST_ASSERT_EQUAL(2, (int)fs.segs.size());
+  OutboxRecord batch[8];
+  TEST_ASSERT_EQUAL(5, o.peek(batch, 8));
+  o.commit(5, 0, 0);
+  TEST_ASSERT_EQUAL(1, o.peek(batch, 8));
+  TEST_ASSERT_EQUAL_UINT32(6, seqOf(batch[0]));
+}
+
+void test_outbox_skips_corrupt_record(void) {
+  Outbox o(fs, cursor, 8);
+  o.begin();
+  for (uint32_t i = 0; i < 6; ++i)
+    o.push(makeRecord(i));
+  fs.segs.begin()->second[3 * OUTBOX_RECORD_SIZE + 10] ^= 0xFF;
+  OutboxRecord batch[8];
+  TEST_ASSERT_EQUAL(3, o.peek(batch, 8)); // stops before the bad record
+  o.commit(3, 0, 0);
+  TEST_ASSERT_EQUAL(2, o.peek(batch, 8)); // bad record skipped
+  TEST_ASSERT_EQUAL_UINT32(4, seqOf(batch[0]));
+  TEST_ASSERT_EQUAL_UINT32(1, o.stats().corrupt);
+  o.commit(2, 0, 0);
+  TEST_ASSERT_TRUE(o.empty());
+  TEST_ASSERT_EQUAL(0, (int)fs.segs.size());
+}
+
+void test_outbox_write_error_counted(void) {
+  Outbox o(fs, cursor, 8);
+  o.begin();
+  fs.failWrites = true;
+  TEST_ASSERT_FALSE(o.push(makeRecord(0)));
+  TEST_ASSERT_EQUAL_UINT32(1, o.stats().writeErrors);
+  TEST_ASSERT_EQUAL_UINT32(0, o.pending());
+  fs.failWrites = false;
+  TEST_ASSERT_TRUE(o.push(makeRecord(1)));
+  TEST_ASSERT_EQUAL_UINT32(1, drain(o, 1));
+}
+
+void test_outbox_stats_json(void) {
+  Outbox o(fs, cursor, 8);
+  o.begin();
+  for (uint32_t i = 0; i < 10; ++i)
+    o.push(makeRecord(i));
+  OutboxRecord batch[8];
+  o.commit(o.peek(batch, 8), 4000, 200); // 8 records in 0.2 s
+  char js[256];
+  TEST_ASSERT_TRUE(buildOutboxJson(o, js, sizeof(js)));
+  TEST_ASSERT_NOT_NULL(strstr(js, "\"event\":\"outbox\""));
+  TEST_ASSERT_NOT_NULL(strstr(js, "\"pending\":2"));
+  TEST_ASSERT_NOT_NULL(strstr(js, "\"stored\":10"));
+  TEST_ASSERT_NOT_NULL(strstr(js, "\"replay_rec_s\":40.0"));
+  TEST_ASSERT_NOT_NULL(strstr(js, "\"replay_B_s\":20000"));
+  TEST_ASSERT_FALSE(buildOutboxJson(o, js, 30));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_record_round_trip);
+  RUN_TEST(test_record_nulls_and_saturation);
+  RUN_TEST(test_record_crc_detects_corruption);
+  RUN_TEST(test_record_json_has_timestamp);
+  RUN_TEST(test_replayed_record_has_no_interval);
+  RUN_TEST(test_outbox_fifo);
+  RUN_TEST(test_outbox_peek_does_not_consume);
+  RUN_TEST(test_outbox_rotates_segments);
+  RUN_TEST(test_outbox_drained_segments_deleted);
+  RUN_TEST(test_outbox_bounded_drops_oldest);
+  RUN_TEST(test_outbox_drop_counts_only_unsent);
+  RUN_TEST(test_outbox_resume_after_deep_sleep);
+  RUN_TEST(test_outbox_power_loss_replays_from_oldest);
+  RUN_TEST(test_outbox_torn_tail_record);
+  RUN_TEST(test_outbox_skips_corrupt_record);
+  RUN_TEST(test_outbox_write_error_counted);
+  RUN_TEST(test_outbox_stats_json);
+  return UNITY_END();
+}
@@ -0,0 +1,182 @@
+#include <cstring>
+#include <unity.h>
+
+#include "../../src/sched/profiler.cpp"
+
+static ProfHistogram h;
+
+void setUp(void) { profReset(h); }
+void tearDown(void) {}
+
+void test_small_values_exact_buckets(void) {
+  for (uint32_t v = 0; v < 4; ++v) {
+    TEST_ASSERT_EQUAL_INT((int)v, profBucket(v));
+    TEST_ASSERT_EQUAL_UINT32(v, profBucketUpper(profBucket(v)));
+  }
+}
+
+void test_bucket_bounds_cover_value(void) {
+  // Every value lies within its bucket, and buckets are at most ~50% wide
+  const uint32_t vals[] = {4,    5,     6,       7,          8,         100,
+                           1000, 65535, 1000000, 0x80000000, UINT32_MAX};
+  for (uint32_t v : vals) {
+    int b = profBucket(v);
+    TEST_ASSERT_TRUE(b < PROF_BUCKETS);
+    TEST_ASSERT_TRUE(v <= profBucketUpper(b));
+    TEST_ASSERT_TRUE(v > profBucketUpper(b - 1));
+  }
+  TEST_ASSERT_EQUAL_INT(PROF_BUCKETS - 1, profBucket(UINT32_MAX));
+}
+
+void test_buckets_monotonic(void) {
+  for (int b = 1; b < PROF_BUCKETS; ++b)
+    TEST_ASSERT_TRUE(profBucketUpper(b) > profBucketUpper(b - 1));
+}
+
+void test_min_max_mean(void) {
+  profRecord(h, 100);
+  profRecord(h, 300);
+  profRecord(h, 200);
+  TEST_ASSERT_EQUAL_UINT32(3, h.count);
+  TEST_ASSERT_EQUAL_UINT32(100, h.min);
+  TEST_ASSERT_EQUAL_UINT32(300, h.max);
+  TEST_ASSERT_EQUAL_UINT64(600, h.sum);
+}
+
+void test_quantile_empty(void) {
+  TEST_ASSERT_EQUAL_UINT32(0, profQuantile(h, 0.99f));
+}
+
+void test_p99_catches_outlier(void) {
+  // 980 fast samples and 20 slow ones: p99 must land in the slow bucket
+  for (int i = 0; i < 980; ++i)
+    profRecord(h, 1000);
+  for (int i = 0; i < 20; ++i)
+    profRecord(h, 50000);
+  uint32_t p50 = profQuantile(h, 0.50f);
+  uint32_t p99 = profQuantile(h, 0.99f);
+  TEST_ASSERT_TRUE(p50 >= 1000 && p50 < 1500);
+  TEST_ASSERT_TRUE(p99 >= 50000 && p99 <= h.max);
+}
+
+void test_quantile_clamped_to_max(void) {
+  profRecord(h, 1000);
+  TEST_ASSERT_EQUAL_UINT32(1000, profQuantile(h, 0.99f));
+}
+
+void test_reset(void) {
+  profRecord(h, 10);
+  profReset(h);
+  TEST_ASSERT_EQUAL_UINT32(0, h.count);
+  TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, h.min);
+}
+
+void test_scope_records_elapsed(void) {
+  ProfZone z("test");
+  {
+    ProfScope s(z);
+    volatile uint32_t x = 0;
+    for (int i = 0; i < 10000; ++i)
+      x += i;
+  }
+  TEST_ASSERT_EQUAL_UINT32(1, z.hist().count);
+  TEST_ASSERT_TRUE(z.hist().max > 0);
+}
+
+void test_zones_chained(void) {
+  ProfZone a("a");
+  ProfZone b("b");
+  TEST_ASSERT_TRUE(ProfZone::first() == &b);
+  TEST_ASSERT_TRUE(ProfZone::first()->next() == &a);
+}
+
+void test_json_in_microseconds(void) {
+  // 240 ticks/us (240 MHz CCOUNT)
+  profRecord(h, 2400);
+  profRecord(h, 4800);
+  char buf[200];
+  TEST_ASSERT_TRUE(buildProfJson("ina", h, 240.0f, buf, sizeof(buf)));
+  TEST_ASSERT_NOT_NULL(strstr(buf, "\"zone\":\"ina\""));
+  TEST_ASSERT_NOT_NULL(strstr(buf, "\"n\":2"));
+  TEST_ASSERT_NOT_NULL(strstr(buf, "\"min_us\":10.00"));
+  TEST_ASSERT_NOT_NULL(strstr(buf, "\"mean_us\":15.00"));
+  TEST_ASSERT_NOT_NULL(strstr(buf, "\"max_us\":20.00"));
+}
+
+void test_json_empty_or_small_buffer(void) {
+  char buf[200];
+  TEST_ASSERT_FALSE(buildProfJson("x", h, 240.0f, buf, sizeof(buf)));
+  profRecord(h, 10);
+  char tiny[16];
+  TEST_ASSERT_FALSE(buildProfJson("x", h, 240.0f, tiny, sizeof(tiny)));
+}
+
+// Frame of a little over N bytes, all of it written; returns the last byte
+template <size_t N> __attribute__((noinline)) static uint8_t useStack() {
+  volatile uint8_t buf[N];
+  for (size_t i = 0; i < N; ++i)
+    buf[i] = (uint8_t)i;
+  return buf[N - 1];
+}
+
+void test_stack_probe_measures_depth(void) {
+  StackProbe p;
+  stackPaint(p, 8192);
+  size_t idle = stackUsed(p);
+  stackPaint(p, 8192);
+  TEST_ASSERT_EQUAL_UINT8((uint8_t)(512 - 1), useStack<512>());
+  size_t small = stackUsed(p);
+  stackPaint(p, 8192);
+  TEST_ASSERT_EQUAL_UINT8((uint8_t)(1536 - 1), useStack<1536>());
+  size_t big = stackUsed(p);
+  TEST_ASSERT_LESS_THAN(128, idle);
+  TEST_ASSERT_GREATER_OR_EQUAL(512, small);
+  TEST_ASSERT_LESS_THAN(512 + 256, small);
+  TEST_ASSERT_GREATER_OR_EQUAL(1536, big);
+  TEST_ASSERT_LESS_THAN(1536 + 256, big);
+}
+
+void test_stack_scope_keeps_peak(void) {
+  ProfStack s("publish");
+  TEST_ASSERT_TRUE(ProfStack::first() == &s);
+  char buf[64];
+  TEST_ASSERT_FALSE(buildProfStackJson(s, buf, sizeof(buf)));
+  {
+    ProfStackScope sc(s, 4096);
+    useStack<1024>();
+  }
+  size_t peak = s.peak();
+  {
+    ProfStackScope sc(s, 4096);
+    useStack<256>();
+  }
+  TEST_ASSERT_EQUAL(peak, s.peak());
+  TEST_ASSERT_GREATER_OR_EQUAL(1024, peak);
+  TEST_ASSERT_TRUE(buildProfStackJson(s, buf, sizeof(buf)));
+  char exp[64];
+  snprintf(exp, sizeof(exp), "{\"zone\":\"publish\",\"stack_B\":%lu}",
+           (unsigned long)peak);
+  TEST_ASSERT_EQUAL_STRING(exp, buf);
+  TEST_ASSERT_FALSE(buildProfStackJson(s, buf, 8));
+  s.reset();
+  TEST_ASSERT_EQUAL(0, s.peak());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_small_values_exact_buckets);
+  RUN_TEST(test_bucket_bounds_cover_value);
+  RUN_TEST(test_buckets_monotonic);
+  RUN_TEST(test_min_max_mean);
+  RUN_TEST(test_quantile_empty);
+  RUN_TEST(test_p99_catches_outlier);
+  RUN_TEST(test_quantile_clamped_to_max);
+  RUN_TEST(test_reset);
+  RUN_TEST(test_scope_records_elapsed);
+  RUN_TEST(test_zones_chained);
+  RUN_TEST(test_json_in_microseconds);
+  RUN_TEST(test_json_empty_or_small_buffer);
+  RUN_TEST(test_stack_probe_measures_depth);
+  RUN_TEST(test_stack_scope_keeps_peak);
+  return UNITY_END();
+}
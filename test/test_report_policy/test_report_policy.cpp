@@ -0,0 +1,213 @@
+#include <cmath>
+#include <cstring>
+#include <unity.h>
+
+#include "../../src/comms/report_policy.cpp"
+
+static const uint32_t HB_MS = 60000; // heartbeat
+
+static TelemetryFrame frame() {
+  TelemetryFrame f{};
+  f.mode = "parked-idle";
+  f.V = 12.60f;
+  f.I = -0.05f;
+  f.T = 15.0f;
+  f.soc_pct = 80.0f;
+  f.soh_pct = 95.0f;
+  f.Rint_mOhm = 10.0f;
+  f.Rint25_mOhm = 9.5f;
+  f.RintBaseline_mOhm = 9.0f;
+  f.ah_left = 50.0f;
+  f.battery_capacity_ah = 70.0f;
+  f.hasRint = true;
+  return f;
+}
+
+// Policy that has just reported `frame()` at t = 0
+static ReportPolicy primed(const ReportConfig &cfg = ReportConfig()) {
+  ReportPolicy p(cfg);
+  TelemetryFrame f = frame();
+  TEST_ASSERT_EQUAL(RR_FIRST, p.check(f, 0, false, HB_MS));
+  p.sent(f, 0);
+  return p;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_first_frame_reported(void) {
+  ReportPolicy p;
+  TelemetryFrame f = frame();
+  TEST_ASSERT_EQUAL(RR_FIRST, p.check(f, 1234, false, HB_MS));
+}
+
+void test_unchanged_frame_suppressed(void) {
+  ReportPolicy p = primed();
+  TelemetryFrame f = frame();
+  f.up_ms = 999999; // counters alone never trigger
+  f.rest_s = 500;
+  for (uint32_t t = 2000; t < HB_MS; t += 2000)
+    TEST_ASSERT_EQUAL(RR_NONE, p.check(f, t, false, HB_MS));
+  TEST_ASSERT_EQUAL_UINT32(29, p.suppressed());
+  TEST_ASSERT_EQUAL_UINT32(1, p.reports());
+}
+
+void test_heartbeat_expires(void) {
+  ReportPolicy p = primed();
+  TelemetryFrame f = frame();
+  TEST_ASSERT_EQUAL(RR_NONE, p.check(f, HB_MS - 1, false, HB_MS));
+  TEST_ASSERT_EQUAL(RR_HEARTBEAT, p.check(f, HB_MS, false, HB_MS));
+  p.sent(f, HB_MS);
+  TEST_ASSERT_EQUAL(RR_NONE, p.check(f, HB_MS + 1, false, HB_MS));
+  // 0 disables the heartbeat
+  TEST_ASSERT_EQUAL(RR_NONE, p.check(f, 10 * HB_MS, false, 0));
+}
+
+void test_absolute_deadband(void) {
+  ReportPolicy p = primed();
+  TelemetryFrame f = frame();
+  f.V = 12.615f; // within 20 mV
+  uint16_t changed = 0xFFFF;
+  TEST_ASSERT_EQUAL(RR_NONE, p.check(f, 2000, false, HB_MS, &changed));
+  TEST_ASSERT_EQUAL_HEX16(0, changed);
+  f.V = 12.63f;
+  TEST_ASSERT_EQUAL(RR_DEADBAND, p.check(f, 4000, false, HB_MS, &changed));
+  TEST_ASSERT_EQUAL_HEX16(1u << RF_V, changed);
+}
+
+void test_relative_deadband(void) {
+  ReportPolicy p = primed();
+  TelemetryFrame f = frame();
+  TelemetryFrame big = frame();
+  big.I = 40.0f;
+  p.sent(big, 0);
+  // 5 % of 40 A = 2 A, larger than the 0.2 A absolute band
+  f = big;
+  f.I = 41.5f;
+  TEST_ASSERT_EQUAL(RR_NONE, p.check(f, 2000, false, HB_MS));
+  f.I = 42.5f;
+  TEST_ASSERT_EQUAL(RR_DEADBAND, p.check(f, 2000, false, HB_MS));
+}
+
+void test_reference_is_last_report_not_last_sample(void) {
+  // Slow drift is reported once it adds up past the band
+  ReportPolicy p = primed();
+  TelemetryFrame f = frame();
+  int reported = 0;
+  for (int i = 1; i <= 10; ++i) {
+    f.V = 12.60f + 0.007f * i;
+    if (p.check(f, i * 2000, false, HB_MS) == RR_DEADBAND) {
+      p.sent(f, i * 2000);
+      reported = i;
+      break;
+    }
+  }
+  TEST_ASSERT_EQUAL(3, reported); // 21 mV > 20 mV band
+}
+
+void test_nan_transitions_reported(void) {
+  ReportPolicy p = primed();
+  TelemetryFrame f = frame();
+  f.T = NAN; // sensor lost
+  uint16_t changed = 0;
+  TEST_ASSERT_EQUAL(RR_DEADBAND, p.check(f, 2000, false, HB_MS, &changed));
+  TEST_ASSERT_EQUAL_HEX16(1u << RF_T, changed);
+  p.sent(f, 2000);
+  // Still NaN
+  TEST_ASSERT_EQUAL(RR_NONE, p.check(f, 4000, false, HB_MS));
+  f.T = 15.0f;
+  TEST_ASSERT_EQUAL(RR_DEADBAND, p.check(f, 6000, false, HB_MS));
+}
+
+void test_state_changes_reported(void) {
+  ReportPolicy p = primed();
+  TelemetryFrame f = frame();
+  char mode[] = "active"; // different storage, compared by content
+  f.mode = mode;
+  TEST_ASSERT_EQUAL(RR_STATE, p.check(f, 2000, false, HB_MS));
+  f = frame();
+  char same[] = "parked-idle";
+  f.mode = same;
+  TEST_ASSERT_EQUAL(RR_NONE, p.check(f, 2000, false, HB_MS));
+  f.alternator_on = true;
+  TEST_ASSERT_EQUAL(RR_STATE, p.check(f, 2000, false, HB_MS));
+  f = frame();
+  f.hasRint25 = true;
+  TEST_ASSERT_EQUAL(RR_STATE, p.check(f, 2000, false, HB_MS));
+}
+
+void test_event_reports_immediately(void) {
+  ReportPolicy p = primed();
+  TelemetryFrame f = frame();
+  TEST_ASSERT_EQUAL(RR_EVENT, p.check(f, 1, true, HB_MS));
+}
+
+void test_field_max_silence(void) {
+  ReportConfig cfg;
+  cfg.field[RF_SOC].maxSilence_ms = 10000;
+  ReportPolicy p = primed(cfg);
+  TelemetryFrame f = frame();
+  TEST_ASSERT_EQUAL(RR_NONE, p.check(f, 9999, false, HB_MS));
+  TEST_ASSERT_EQUAL(RR_SILENCE, p.check(f, 10000, false, HB_MS));
+}
+
+void test_reset_forces_report(void) {
+  ReportPolicy p = primed();
+  TelemetryFrame f = frame();
+  p.reset();
+  TEST_ASSERT_EQUAL(RR_FIRST, p.check(f, 2000, false, HB_MS));
+}
+
+void test_millis_wraparound(void) {
+  ReportPolicy p;
+  TelemetryFrame f = frame();
+  uint32_t t0 = 0xFFFFFFFFu - 1000u;
+  p.sent(f, t0);
+  TEST_ASSERT_EQUAL(RR_NONE, p.check(f, t0 + 30000u, false, HB_MS));
+  TEST_ASSERT_EQUAL(RR_HEARTBEAT,
+                    p.check(f, t0 + HB_MS, false, HB_MS));
+}
+
+void test_parked_hour_traffic(void) {
+  // Parked: 2 s evaluation, small noise, 1 min heartbeat
+  ReportPolicy p = primed();
+  TelemetryFrame f = frame();
+  for (uint32_t t = 2000; t <= 3600000; t += 2000) {
+    f.V = 12.60f + ((t / 2000) % 3) * 0.004f; // +-4 mV noise
+    f.up_ms = t;
+    if (p.check(f, t, false, HB_MS) != RR_NONE)
+      p.sent(f, t);
+  }
+  TEST_ASSERT_EQUAL_UINT32(61, p.reports()); // first + 60 heartbeats
+  TEST_ASSERT_EQUAL_UINT32(1740, p.suppressed());
+}
+
+void test_report_json(void) {
+  ReportPolicy p = primed();
+  TelemetryFrame f = frame();
+  p.check(f, 2000, false, HB_MS);
+  char js[96];
+  TEST_ASSERT_TRUE(buildReportJson(p, js, sizeof(js)));
+  TEST_ASSERT_EQUAL_STRING("{\"task\":\"report\",\"sent\":1,\"suppressed\":1}",
+                           js);
+  TEST_ASSERT_FALSE(buildReportJson(p, js, 10));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_first_frame_reported);
+  RUN_TEST(test_unchanged_frame_suppressed);
+  RUN_TEST(test_heartbeat_expires);
+  RUN_TEST(test_absolute_deadband);
+  RUN_TEST(test_relative_deadband);
+  RUN_TEST(test_reference_is_last_report_not_last_sample);
+  RUN_TEST(test_nan_transitions_reported);
+  RUN_TEST(test_state_changes_reported);
+  RUN_TEST(test_event_reports_immediately);
+  RUN_TEST(test_field_max_silence);
+  RUN_TEST(test_reset_forces_report);
+  RUN_TEST(test_millis_wraparound);
+  RUN_TEST(test_parked_hour_traffic);
+  RUN_TEST(test_report_json);
+  return UNITY_END();
+}
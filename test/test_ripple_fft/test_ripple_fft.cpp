@@ -0,0 +1,296 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unity.h>
+
+#include "../../src/battery/ripple_analyzer.cpp"
+#include "../../src/dsp/fft_q15.cpp"
+
+static const double PI_D = 3.14159265358979323846;
+static const float FS_HZ = 4000.0f;
+static const float LSB_MV = 1.25f;
+
+static int16_t re[1024];
+static int16_t im[1024];
+static uint16_t raw[RIPPLE_N];
+static RippleAnalyzer analyzer;
+
+// Bus voltage ~13.9 V (11120 codes) plus tones given in codes
+static void synth(const float *freqHz, const float *ampCodes, int tones,
+                  float noiseCodes) {
+  srand(1234);
+  for (int i = 0; i < RIPPLE_N; ++i) {
+    double v = 11120.0;
+    for (int t = 0; t < tones; ++t)
+      v += ampCodes[t] * sin(2.0 * PI_D * freqHz[t] * i / FS_HZ + 0.3 * t);
+    if (noiseCodes > 0.0f)
+      v += noiseCodes * ((rand() / (double)RAND_MAX) * 2.0 - 1.0);
+    raw[i] = (uint16_t)lround(v);
+  }
+}
+
+void setUp(void) {
+  memset(re, 0, sizeof(re));
+  memset(im, 0, sizeof(im));
+}
+void tearDown(void) {}
+
+// ---------------- FFT kernel ----------------
+
+void test_fft_rejects_bad_size(void) {
+  TEST_ASSERT_FALSE(fftQ15(re, im, 0));
+  TEST_ASSERT_FALSE(fftQ15(re, im, FFT_Q15_MAX_LOG2 + 1));
+  TEST_ASSERT_TRUE(fftQ15(re, im, 1));
+}
+
+void test_fft_impulse_is_flat(void) {
+  const int log2n = 6, n = 1 << log2n;
+  re[0] = 16384;
+  TEST_ASSERT_TRUE(fftQ15(re, im, log2n));
+  for (int k = 0; k < n; ++k) {
+    TEST_ASSERT_INT_WITHIN(1, 16384 / n, re[k]);
+    TEST_ASSERT_INT_WITHIN(1, 0, im[k]);
+  }
+}
+
+void test_fft_dc(void) {
+  const int log2n = 8, n = 1 << log2n;
+  for (int i = 0; i < n; ++i)
+    re[i] = 10000;
+  fftQ15(re, im, log2n);
+  TEST_ASSERT_INT_WITHIN(2, 10000, re[0]);
+  for (int k = 1; k < n; ++k)
+    TEST_ASSERT_TRUE(fftQ15Power(re, im, k) <= 8);
+}
+
+void test_fft_cosine_on_bin(void) {
+  const int log2n = 8, n = 1 << log2n, bin = 16;
+  for (int i = 0; i < n; ++i)
+    re[i] = (int16_t)lround(16000.0 * cos(2.0 * PI_D * bin * i / n));
+  fftQ15(re, im, log2n);
+  // X[k]/N = A/2 at +k and -k
+  TEST_ASSERT_INT_WITHIN(4, 8000, re[bin]);
+  TEST_ASSERT_INT_WITHIN(4, 8000, re[n - bin]);
+  TEST_ASSERT_INT_WITHIN(4, 0, im[bin]);
+  for (int k = 0; k < n; ++k) {
+    if (k == bin || k == n - bin)
+      continue;
+    TEST_ASSERT_TRUE(fftQ15Power(re, im, k) <= 32);
+  }
+}
+
+void test_fft_sine_phase(void) {
+  const int log2n = 7, n = 1 << log2n, bin = 5;
+  for (int i = 0; i < n; ++i)
+    re[i] = (int16_t)lround(12000.0 * sin(2.0 * PI_D * bin * i / n));
+  fftQ15(re, im, log2n);
+  // sin -> -i*A/2 at +k
+  TEST_ASSERT_INT_WITHIN(4, 0, re[bin]);
+  TEST_ASSERT_INT_WITHIN(4, -6000, im[bin]);
+  TEST_ASSERT_INT_WITHIN(4, 6000, im[n - bin]);
+}
+
+void test_fft_matches_float_dft(void) {
+  const int log2n = 9, n = 1 << log2n;
+  srand(42);
+  static double xin[512];
+  for (int i = 0; i < n; ++i) {
+    xin[i] = (rand() % 32001) - 16000;
+    re[i] = (int16_t)xin[i];
+  }
+  fftQ15(re, im, log2n);
+  double maxErr = 0.0;
+  for (int k = 0; k < n; k += 7) {
+    double sr = 0.0, si = 0.0;
+    for (int i = 0; i < n; ++i) {
+      double a = -2.0 * PI_D * k * i / n;
+      sr += xin[i] * cos(a);
+      si += xin[i] * sin(a);
+    }
+    maxErr = fmax(maxErr, fabs(sr / n - re[k]));
+    maxErr = fmax(maxErr, fabs(si / n - im[k]));
+  }
+  // 9 stages of rounding: error stays within a few LSB
+  TEST_ASSERT_TRUE(maxErr < 4.0);
+}
+
+void test_fft_full_scale_does_not_overflow(void) {
+  const int log2n = 10, n = 1 << log2n;
+  for (int i = 0; i < n; ++i)
+    re[i] = (i & 1) ? -32767 : 32767; // all energy at Nyquist
+  fftQ15(re, im, log2n);
+  // Truncating >>1 per stage biases results by a few LSB over 10 stages
+  TEST_ASSERT_INT_WITHIN(16, 32767, re[n / 2]);
+  TEST_ASSERT_INT_WITHIN(8, 0, re[0]);
+}
+
+// ---------------- Ripple analyzer ----------------
+
+void test_ripple_known_tone_on_bin(void) {
+  // Bin width is 4000/512 = 7.8125 Hz; 1203.125 Hz is bin 154
+  float f[] = {1203.125f};
+  float a[] = {40.0f}; // 50 mV amplitude
+  synth(f, a, 1, 0.0f);
+  RippleResult r = analyzer.analyze(raw, RIPPLE_N, FS_HZ, LSB_MV);
+  TEST_ASSERT_TRUE(r.valid);
+  TEST_ASSERT_FLOAT_WITHIN(1.0f, 1203.125f, r.dominant_Hz);
+  TEST_ASSERT_FLOAT_WITHIN(2.5f, 50.0f, r.dominant_mV);
+  TEST_ASSERT_FLOAT_WITHIN(1.5f, 50.0f / sqrtf(2.0f), r.ripple_mVrms);
+  TEST_ASSERT_FLOAT_WITHIN(2.6f, 100.0f, r.ripple_mVpp);
+}
+
+void test_ripple_known_tone_off_bin(void) {
+  float f[] = {757.0f}; // 96.9 bins
+  float a[] = {80.0f};  // 100 mV
+  synth(f, a, 1, 0.0f);
+  RippleResult r = analyzer.analyze(raw, RIPPLE_N, FS_HZ, LSB_MV);
+  TEST_ASSERT_FLOAT_WITHIN(3.0f, 757.0f, r.dominant_Hz);
+  TEST_ASSERT_FLOAT_WITHIN(10.0f, 100.0f, r.dominant_mV);
+}
+
+void test_ripple_strongest_of_two_tones(void) {
+  float f[] = {312.5f, 1500.0f};
+  float a[] = {20.0f, 60.0f};
+  synth(f, a, 2, 2.0f);
+  RippleResult r = analyzer.analyze(raw, RIPPLE_N, FS_HZ, LSB_MV);
+  TEST_ASSERT_FLOAT_WITHIN(4.0f, 1500.0f, r.dominant_Hz);
+  TEST_ASSERT_FLOAT_WITHIN(7.5f, 75.0f, r.dominant_mV);
+}
+
+void test_ripple_ignores_slow_variation(void) {
+  float f[] = {10.0f, 937.5f};
+  float a[] = {200.0f, 20.0f}; // big slow load swing, small ripple
+  synth(f, a, 2, 0.0f);
+  RippleResult r = analyzer.analyze(raw, RIPPLE_N, FS_HZ, LSB_MV);
+  TEST_ASSERT_FLOAT_WITHIN(4.0f, 937.5f, r.dominant_Hz);
+}
+
+void test_ripple_healthy_bridge_scores_low(void) {
+  // Clean 6-pulse ripple at 1200 Hz plus broadband noise
+  float f[] = {1203.125f};
+  float a[] = {60.0f};
+  synth(f, a, 1, 3.0f);
+  RippleResult r = analyzer.analyze(raw, RIPPLE_N, FS_HZ, LSB_MV);
+  TEST_ASSERT_TRUE(std::isfinite(r.diodeScore));
+  TEST_ASSERT_FLOAT_WITHIN(4.0f, 1203.125f, r.ripple_Hz);
+  TEST_ASSERT_TRUE(r.diodeScore < 0.1f);
+}
+
+void test_ripple_open_diode_scores_high(void) {
+  // Ripple line at 6*f_e plus strong f_e and 2*f_e components
+  const float fe = 187.5f; // 24 bins
+  float f[] = {6.0f * fe, fe, 2.0f * fe};
+  float a[] = {40.0f, 30.0f, 20.0f};
+  synth(f, a, 3, 2.0f);
+  RippleResult r = analyzer.analyze(raw, RIPPLE_N, FS_HZ, LSB_MV);
+  TEST_ASSERT_FLOAT_WITHIN(8.0f, 6.0f * fe, r.ripple_Hz);
+  TEST_ASSERT_TRUE(r.diodeScore > 0.3f);
+}
+
+void test_ripple_fault_line_dominant_still_scores_high(void) {
+  // The sub-harmonic is now the strongest line; the analyzer must still find
+  // the 6x ripple line above it.
+  const float fe = 195.3125f; // 25 bins
+  float f[] = {fe, 6.0f * fe};
+  float a[] = {60.0f, 40.0f};
+  synth(f, a, 2, 2.0f);
+  RippleResult r = analyzer.analyze(raw, RIPPLE_N, FS_HZ, LSB_MV);
+  TEST_ASSERT_FLOAT_WITHIN(4.0f, fe, r.dominant_Hz);
+  TEST_ASSERT_FLOAT_WITHIN(8.0f, 6.0f * fe, r.ripple_Hz);
+  TEST_ASSERT_TRUE(r.diodeScore > 0.5f);
+}
+
+void test_ripple_flat_input(void) {
+  for (int i = 0; i < RIPPLE_N; ++i)
+    raw[i] = 11000;
+  RippleResult r = analyzer.analyze(raw, RIPPLE_N, FS_HZ, LSB_MV);
+  TEST_ASSERT_TRUE(r.valid);
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, r.ripple_mVrms);
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, r.ripple_mVpp);
+  TEST_ASSERT_TRUE(std::isnan(r.diodeScore));
+}
+
+void test_ripple_rejects_bad_input(void) {
+  RippleResult r = analyzer.analyze(raw, 100, FS_HZ, LSB_MV);
+  TEST_ASSERT_FALSE(r.valid);
+  r = analyzer.analyze(nullptr, RIPPLE_N, FS_HZ, LSB_MV);
+  TEST_ASSERT_FALSE(r.valid);
+}
+
+void test_ripple_json(void) {
+  RippleResult r = {true, 35.4f, 100.0f, 1203.1f, 50.0f, 1203.1f, NAN};
+  char json[256];
+  TEST_ASSERT_TRUE(buildRippleJson(r, json, sizeof(json)));
+  TEST_ASSERT_NOT_NULL(strstr(json, "\"ripple_mVrms\":35.4"));
+  TEST_ASSERT_NOT_NULL(strstr(json, "\"dominant_Hz\":1203.1"));
+  TEST_ASSERT_NOT_NULL(strstr(json, "\"diode_score\":null"));
+  r.diodeScore = 0.42f;
+  TEST_ASSERT_TRUE(buildRippleJson(r, json, sizeof(json)));
+  TEST_ASSERT_NOT_NULL(strstr(json, "\"diode_score\":0.420"));
+}
+
+// ---------------- Benchmark ----------------
+
+void test_fft_benchmark(void) {
+  const int log2n = RIPPLE_LOG2N, n = 1 << log2n, iters = 2000;
+  static int16_t src[512];
+  srand(7);
+  for (int i = 0; i < n; ++i)
+    src[i] = (int16_t)((rand() % 32001) - 16000);
+
+  auto t0 = std::chrono::steady_clock::now();
+  uint32_t sink = 0;
+  for (int it = 0; it < iters; ++it) {
+    memcpy(re, src, n * sizeof(int16_t));
+    memset(im, 0, sizeof(im));
+    fftQ15(re, im, log2n);
+    sink += (uint16_t)re[it % n];
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  double us = std::chrono::duration<double, std::micro>(t1 - t0).count();
+
+  float f[] = {1203.125f};
+  float a[] = {40.0f};
+  synth(f, a, 1, 2.0f);
+  auto t2 = std::chrono::steady_clock::now();
+  for (int it = 0; it < 200; ++it)
+    sink += (uint32_t)analyzer.analyze(raw, RIPPLE_N, FS_HZ, LSB_MV)
+                .dominant_Hz;
+  auto t3 = std::chrono::steady_clock::now();
+  double usA = std::chrono::duration<double, std::micro>(t3 - t2).count();
+
+  char msg[160];
+  snprintf(msg, sizeof(msg),
+           "[bench] fftQ15 N=%d: %.2f us/FFT (%.0f FFT/s); analyze: %.2f "
+           "us/capture (sink=%u)",
+           n, us / iters, iters * 1e6 / us, usA / 200, (unsigned)sink);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_TRUE(us > 0.0);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+
+  RUN_TEST(test_fft_rejects_bad_size);
+  RUN_TEST(test_fft_impulse_is_flat);
+  RUN_TEST(test_fft_dc);
+  RUN_TEST(test_fft_cosine_on_bin);
+  RUN_TEST(test_fft_sine_phase);
+  RUN_TEST(test_fft_matches_float_dft);
+  RUN_TEST(test_fft_full_scale_does_not_overflow);
+  RUN_TEST(test_ripple_known_tone_on_bin);
+  RUN_TEST(test_ripple_known_tone_off_bin);
+  RUN_TEST(test_ripple_strongest_of_two_tones);
+  RUN_TEST(test_ripple_ignores_slow_variation);
+  RUN_TEST(test_ripple_healthy_bridge_scores_low);
+  RUN_TEST(test_ripple_open_diode_scores_high);
+  RUN_TEST(test_ripple_fault_line_dominant_still_scores_high);
+  RUN_TEST(test_ripple_flat_input);
+  RUN_TEST(test_ripple_rejects_bad_input);
+  RUN_TEST(test_ripple_json);
+  RUN_TEST(test_fft_benchmark);
+
+  return UNITY_END();
+}
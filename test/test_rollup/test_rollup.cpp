@@ -0,0 +1,261 @@
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <unity.h>
+
+#include "../../src/history/rollup.cpp"
+#include "../../src/json_writer.cpp"
+
+static RollupState state;
+static Rollup roll(state);
+
+// 2024-01-01 00:00:00 UTC
+static const uint32_t T0 = 1704067200u;
+
+void setUp(void) {
+  memset(&state, 0xA5, sizeof(state));
+  roll.begin();
+}
+
+void tearDown(void) {}
+
+// One sample every 30 s from `from` for `seconds`
+static void feed(uint32_t from, uint32_t seconds, float V, float I) {
+  for (uint32_t t = from; t < from + seconds; t += 30)
+    roll.add(t, V, I, 20.0f, 80.0f, 5.0f);
+}
+
+void test_begin_clears_invalid_state(void) {
+  for (int k = 0; k < TIER_COUNT; ++k)
+    TEST_ASSERT_EQUAL_UINT16(0, roll.count((RollupTier)k));
+  RollupBucket b;
+  TEST_ASSERT_FALSE(roll.current(TIER_MINUTE, b));
+  TEST_ASSERT_EQUAL_HEX32(ROLLUP_MAGIC, state.magic);
+}
+
+void test_minute_bucket_stats(void) {
+  roll.add(T0 + 5, 12.6f, 1.0f, 20.0f, 80.0f, 5.0f);
+  roll.add(T0 + 25, 12.0f, -3.0f, 22.0f, 82.0f, 5.5f);
+  roll.add(T0 + 45, 12.3f, 5.0f, NAN, NAN, NAN);
+  TEST_ASSERT_EQUAL_UINT16(0, roll.count(TIER_MINUTE));
+  roll.add(T0 + 60, 12.3f, 0.0f, 21.0f, 81.0f, 5.0f); // closes the minute
+
+  RollupBucket b;
+  TEST_ASSERT_EQUAL_UINT16(1, roll.count(TIER_MINUTE));
+  TEST_ASSERT_TRUE(roll.at(TIER_MINUTE, 0, b));
+  TEST_ASSERT_EQUAL_UINT32(T0, b.start);
+  TEST_ASSERT_EQUAL_UINT16(3, b.n);
+  TEST_ASSERT_EQUAL_UINT16(12000, b.V_min_mV);
+  TEST_ASSERT_EQUAL_UINT16(12600, b.V_max_mV);
+  TEST_ASSERT_EQUAL_UINT16(12300, b.V_mean_mV);
+  TEST_ASSERT_EQUAL_INT16(-300, b.I_min_cA);
+  TEST_ASSERT_EQUAL_INT16(500, b.I_max_cA);
+  TEST_ASSERT_EQUAL_INT16(100, b.I_mean_cA);
+  TEST_ASSERT_EQUAL_INT16(210, b.T_dC); // NaN temperature skipped
+  TEST_ASSERT_EQUAL_UINT16(8100, b.soc_cpct);
+  TEST_ASSERT_EQUAL_UINT16(525, b.rint_cmOhm);
+}
+
+void test_missing_fields_are_none(void) {
+  roll.add(T0, NAN, 2.0f, NAN, NAN, NAN);
+  roll.add(T0 + 1, 12.0f, NAN, 20.0f, 80.0f, 5.0f); // no current: dropped
+  roll.add(T0 + 60, 12.0f, 0.0f, 20.0f, 80.0f, 5.0f);
+  RollupBucket b;
+  TEST_ASSERT_TRUE(roll.at(TIER_MINUTE, 0, b));
+  TEST_ASSERT_EQUAL_UINT16(1, b.n);
+  TEST_ASSERT_EQUAL_UINT16(ROLLUP_NONE_U, b.V_mean_mV);
+  TEST_ASSERT_EQUAL_INT16(ROLLUP_NONE, b.T_dC);
+  TEST_ASSERT_TRUE(isnan(rollupV(b.V_min_mV)));
+  TEST_ASSERT_TRUE(isnan(rollupSoc(b.soc_cpct)));
+  TEST_ASSERT_EQUAL_FLOAT(2.0f, rollupI(b.I_mean_cA));
+}
+
+// Minutes roll into the hour, hours into the day, weighted by samples
+void test_cascade_to_hour_and_day(void) {
+  feed(T0, 3600, 12.5f, 2.0f);
+  // First sample of the next hour closes the minute and the hour
+  TEST_ASSERT_TRUE(roll.add(T0 + 3600, 12.5f, 2.0f, 20.0f, 80.0f, 5.0f));
+  TEST_ASSERT_EQUAL_UINT16(60, roll.count(TIER_MINUTE));
+  TEST_ASSERT_EQUAL_UINT16(1, roll.count(TIER_HOUR));
+  RollupBucket h;
+  roll.at(TIER_HOUR, 0, h);
+  TEST_ASSERT_EQUAL_UINT32(T0, h.start);
+  TEST_ASSERT_EQUAL_UINT16(120, h.n);
+  TEST_ASSERT_EQUAL_UINT16(12500, h.V_mean_mV);
+
+  feed(T0 + 3630, 23 * 3600 - 30, 12.0f, -1.0f);
+  TEST_ASSERT_EQUAL_UINT16(0, roll.count(TIER_DAY));
+  roll.add(T0 + 86400, 12.0f, 0.0f, 20.0f, 80.0f, 5.0f);
+  TEST_ASSERT_EQUAL_UINT16(1, roll.count(TIER_DAY));
+  TEST_ASSERT_EQUAL_UINT16(24, roll.count(TIER_HOUR));
+  RollupBucket d;
+  roll.at(TIER_DAY, 0, d);
+  TEST_ASSERT_EQUAL_UINT32(T0, d.start);
+  TEST_ASSERT_EQUAL_UINT16(2880, d.n);
+  TEST_ASSERT_EQUAL_UINT16(12000, d.V_min_mV);
+  TEST_ASSERT_EQUAL_UINT16(12500, d.V_max_mV);
+  TEST_ASSERT_EQUAL_INT16(-100, d.I_min_cA);
+  TEST_ASSERT_EQUAL_INT16(200, d.I_max_cA);
+  // (121 * 2 - 2759 * 1) / 2880
+  TEST_ASSERT_INT_WITHIN(1, -87, d.I_mean_cA);
+}
+
+// A gap (deep sleep, power off) leaves no empty buckets behind
+void test_gap_closes_all_open_buckets(void) {
+  feed(T0, 600, 12.5f, 1.0f);
+  TEST_ASSERT_TRUE(roll.add(T0 + 3 * 86400, 12.5f, 1.0f, 20, 80, 5));
+  TEST_ASSERT_EQUAL_UINT16(10, roll.count(TIER_MINUTE));
+  TEST_ASSERT_EQUAL_UINT16(1, roll.count(TIER_HOUR));
+  TEST_ASSERT_EQUAL_UINT16(1, roll.count(TIER_DAY));
+  RollupBucket b;
+  TEST_ASSERT_TRUE(roll.current(TIER_DAY, b));
+  TEST_ASSERT_EQUAL_UINT32(T0 + 3 * 86400, b.start);
+  TEST_ASSERT_EQUAL_UINT16(1, b.n);
+}
+
+void test_current_merges_open_buckets(void) {
+  feed(T0, 150, 12.0f, 3.0f); // two closed minutes and 30 s open
+  RollupBucket b;
+  TEST_ASSERT_TRUE(roll.current(TIER_MINUTE, b));
+  TEST_ASSERT_EQUAL_UINT32(T0 + 120, b.start);
+  TEST_ASSERT_EQUAL_UINT16(1, b.n);
+  TEST_ASSERT_TRUE(roll.current(TIER_HOUR, b));
+  TEST_ASSERT_EQUAL_UINT32(T0, b.start);
+  TEST_ASSERT_EQUAL_UINT16(5, b.n);
+  TEST_ASSERT_TRUE(roll.current(TIER_DAY, b));
+  TEST_ASSERT_EQUAL_UINT32(T0, b.start);
+  TEST_ASSERT_EQUAL_UINT16(5, b.n);
+  TEST_ASSERT_EQUAL_INT16(300, b.I_mean_cA);
+}
+
+void test_ring_overwrites_oldest(void) {
+  feed(T0, (ROLLUP_MINUTES + 10) * 60 + 30, 12.0f, 1.0f);
+  TEST_ASSERT_EQUAL_UINT16(ROLLUP_MINUTES, roll.count(TIER_MINUTE));
+  RollupBucket first, last;
+  roll.at(TIER_MINUTE, 0, first);
+  roll.at(TIER_MINUTE, ROLLUP_MINUTES - 1, last);
+  TEST_ASSERT_EQUAL_UINT32(T0 + 10 * 60, first.start);
+  TEST_ASSERT_EQUAL_UINT32(T0 + (ROLLUP_MINUTES + 9) * 60, last.start);
+  TEST_ASSERT_FALSE(roll.at(TIER_MINUTE, ROLLUP_MINUTES, last));
+}
+
+void test_query_range_and_paging(void) {
+  feed(T0, ROLLUP_MINUTES * 2 * 60, 12.0f, 1.0f);
+  RollupBucket out[8];
+  // [T0+200 min, T0+205 min): five buckets
+  size_t n = roll.query(TIER_MINUTE, T0 + 200 * 60, T0 + 205 * 60, out, 8);
+  TEST_ASSERT_EQUAL_UINT32(5, n);
+  TEST_ASSERT_EQUAL_UINT32(T0 + 200 * 60, out[0].start);
+  TEST_ASSERT_EQUAL_UINT32(T0 + 204 * 60, out[4].start);
+  // Pages of 2 over the same range
+  n = roll.query(TIER_MINUTE, T0 + 200 * 60, T0 + 205 * 60, out, 2, 4);
+  TEST_ASSERT_EQUAL_UINT32(1, n);
+  TEST_ASSERT_EQUAL_UINT32(T0 + 204 * 60, out[0].start);
+  // From before the oldest bucket (already overwritten)
+  n = roll.query(TIER_MINUTE, 0, 0xFFFFFFFFu, out, 8);
+  TEST_ASSERT_EQUAL_UINT32(8, n);
+  TEST_ASSERT_EQUAL_UINT32(T0 + (ROLLUP_MINUTES - 1) * 60, out[0].start);
+  TEST_ASSERT_EQUAL_UINT32(0, roll.query(TIER_DAY, 0, 0xFFFFFFFFu, out, 8));
+}
+
+void test_clock_and_time_guards(void) {
+  TEST_ASSERT_FALSE(roll.add(0, 12.0f, 1.0f, 20, 80, 5)); // clock unknown
+  roll.add(T0 + 600, 12.0f, 1.0f, 20, 80, 5);
+  roll.add(T0 + 300, 13.0f, 9.0f, 20, 80, 5); // clock stepped back
+  roll.add(T0 + 660, 12.0f, 1.0f, 20, 80, 5);
+  TEST_ASSERT_EQUAL_UINT16(1, roll.count(TIER_MINUTE));
+  RollupBucket b;
+  roll.at(TIER_MINUTE, 0, b);
+  TEST_ASSERT_EQUAL_UINT32(T0 + 600, b.start);
+  TEST_ASSERT_EQUAL_UINT16(1, b.n);
+  TEST_ASSERT_EQUAL_INT16(100, b.I_max_cA);
+}
+
+void test_values_clamped(void) {
+  roll.add(T0, 99.0f, 500.0f, -400.0f, 80, 1000.0f);
+  roll.add(T0 + 60, -1.0f, -500.0f, 20, 80, 5);
+  RollupBucket b;
+  roll.at(TIER_MINUTE, 0, b);
+  TEST_ASSERT_EQUAL_UINT16(65534, b.V_max_mV);
+  TEST_ASSERT_EQUAL_INT16(32767, b.I_max_cA);
+  TEST_ASSERT_EQUAL_INT16(-4000, b.T_dC);
+  TEST_ASSERT_EQUAL_UINT16(65534, b.rint_cmOhm);
+  roll.add(T0 + 120, 12.0f, 0.0f, 20, 80, 5);
+  roll.at(TIER_MINUTE, 1, b);
+  TEST_ASSERT_EQUAL_UINT16(0, b.V_min_mV);
+  TEST_ASSERT_EQUAL_INT16(-32767, b.I_min_cA);
+}
+
+// Checkpoint round trip: the copy is valid, any corruption is not
+void test_seal_and_valid(void) {
+  feed(T0, 7200, 12.4f, 1.5f);
+  roll.seal();
+  TEST_ASSERT_TRUE(roll.valid());
+
+  static RollupState copy;
+  memcpy(&copy, &state, sizeof(copy));
+  Rollup restored(copy);
+  restored.begin();
+  TEST_ASSERT_EQUAL_UINT16(1, restored.count(TIER_HOUR));
+  TEST_ASSERT_EQUAL_UINT16(roll.count(TIER_MINUTE),
+                           restored.count(TIER_MINUTE));
+
+  copy.buckets[5].n ^= 1;
+  TEST_ASSERT_FALSE(restored.valid());
+  restored.begin();
+  TEST_ASSERT_EQUAL_UINT16(0, restored.count(TIER_MINUTE));
+
+  roll.add(T0 + 7200, 12.4f, 1.5f, 20, 80, 5); // changed since the seal
+  TEST_ASSERT_FALSE(roll.valid());
+}
+
+void test_json_rows(void) {
+  roll.add(T0, 12.6f, -1.25f, 21.5f, 80.0f, 5.0f);
+  roll.add(T0 + 30, 12.4f, -0.75f, NAN, 80.0f, NAN);
+  roll.add(T0 + 60, 12.4f, 0.0f, 20, 80, 5);
+  RollupBucket b;
+  roll.at(TIER_MINUTE, 0, b);
+  char buf[160];
+  TEST_ASSERT_TRUE(buildRollupJson(TIER_MINUTE, &b, 1, buf, sizeof(buf)));
+  TEST_ASSERT_EQUAL_STRING("{\"tier\":\"minute\",\"rows\":[[1704067200,2,"
+                           "12.400,12.600,12.500,-1.25,-0.75,-1.00,21.5,"
+                           "80.00,5.00]]}",
+                           buf);
+  TEST_ASSERT_TRUE(buildRollupJson(TIER_DAY, &b, 0, buf, sizeof(buf)));
+  TEST_ASSERT_EQUAL_STRING("{\"tier\":\"day\",\"rows\":[]}", buf);
+  TEST_ASSERT_FALSE(buildRollupJson(TIER_MINUTE, &b, 1, buf, 40));
+}
+
+// Sample cost does not grow with the history held: a full day of 1 s
+// samples (every bucket close included) stays well inside the budget.
+void test_sample_cost_bounded(void) {
+  auto t0 = std::chrono::steady_clock::now();
+  for (uint32_t t = T0; t < T0 + 86400; ++t)
+    roll.add(t, 12.5f, 1.0f, 20.0f, 80.0f, 5.0f);
+  double us = std::chrono::duration<double, std::micro>(
+                  std::chrono::steady_clock::now() - t0)
+                  .count();
+  char msg[64];
+  snprintf(msg, sizeof(msg), "%.3f us per sample", us / 86400);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_TRUE(us / 86400 < 5.0);
+  TEST_ASSERT_EQUAL_UINT16(23, roll.count(TIER_HOUR));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_begin_clears_invalid_state);
+  RUN_TEST(test_minute_bucket_stats);
+  RUN_TEST(test_missing_fields_are_none);
+  RUN_TEST(test_cascade_to_hour_and_day);
+  RUN_TEST(test_gap_closes_all_open_buckets);
+  RUN_TEST(test_current_merges_open_buckets);
+  RUN_TEST(test_ring_overwrites_oldest);
+  RUN_TEST(test_query_range_and_paging);
+  RUN_TEST(test_clock_and_time_guards);
+  RUN_TEST(test_values_clamped);
+  RUN_TEST(test_seal_and_valid);
+  RUN_TEST(test_json_rows);
+  RUN_TEST(test_sample_cost_bounded);
+  return UNITY_END();
+}
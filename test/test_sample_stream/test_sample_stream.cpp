@@ -0,0 +1,197 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <unity.h>
+
+#include "../../src/comms/sample_stream.cpp"
+
+static SampleStream stream;
+static StreamClients clients;
+static uint8_t frame[SAMPLE_FRAME_MAX];
+
+void setUp(void) {
+  stream = SampleStream();
+  clients = StreamClients();
+}
+
+void tearDown(void) {}
+
+void test_empty_stream_encodes_nothing(void) {
+  TEST_ASSERT_EQUAL_UINT32(0, stream.pending());
+  TEST_ASSERT_EQUAL_UINT32(0, stream.encode(frame, sizeof(frame)));
+}
+
+void test_frame_layout(void) {
+  stream.push(0x01020304u, 12.345f, -1.5f);
+  stream.push(0x01020304u + 500, 12.6f, 2.25f);
+  size_t len = stream.encode(frame, sizeof(frame));
+  TEST_ASSERT_EQUAL_UINT32(SAMPLE_FRAME_HEADER + 2 * 6, len);
+  const uint8_t expect[] = {
+      1,    2,    0,    0,    0,    0,    // version, n, seq 0
+      0x04, 0x03, 0x02, 0x01,             // t_ms
+      0,    0,    0x39, 0x30, 0x6A, 0xFF, // +0 ms, 12345 mV, -150 x 10 mA
+      0xF4, 0x01, 0x38, 0x31, 0xE1, 0x00, // +500 ms, 12600 mV, 225 x 10 mA
+  };
+  TEST_ASSERT_EQUAL_MEMORY(expect, frame, sizeof(expect));
+  TEST_ASSERT_EQUAL_UINT32(0, stream.pending());
+}
+
+void test_round_trip(void) {
+  for (uint32_t k = 0; k < 10; ++k)
+    stream.push(1000 + 40 * k, 12.0f + 0.01f * k, 0.5f * k - 2.0f);
+  size_t len = stream.encode(frame, sizeof(frame));
+  SampleFrameHeader h;
+  StreamSample s[16];
+  TEST_ASSERT_EQUAL_INT(10, decodeSampleFrame(frame, len, h, s, 16));
+  TEST_ASSERT_EQUAL_UINT32(0, h.seq);
+  for (uint32_t k = 0; k < 10; ++k) {
+    TEST_ASSERT_EQUAL_UINT32(1000 + 40 * k, s[k].t_ms);
+    TEST_ASSERT_FLOAT_WITHIN(0.0005f, 12.0f + 0.01f * k, s[k].V);
+    TEST_ASSERT_FLOAT_WITHIN(0.005f, 0.5f * k - 2.0f, s[k].I);
+  }
+  // The next frame continues the sequence
+  stream.push(2000, 12.0f, 0.0f);
+  len = stream.encode(frame, sizeof(frame));
+  TEST_ASSERT_EQUAL_INT(1, decodeSampleFrame(frame, len, h, s, 16));
+  TEST_ASSERT_EQUAL_UINT32(10, h.seq);
+}
+
+void test_missing_and_clamped_values(void) {
+  stream.push(0, NAN, INFINITY);
+  stream.push(10, 99.0f, 500.0f);
+  stream.push(20, -1.0f, -500.0f);
+  size_t len = stream.encode(frame, sizeof(frame));
+  SampleFrameHeader h;
+  StreamSample s[3];
+  TEST_ASSERT_EQUAL_INT(3, decodeSampleFrame(frame, len, h, s, 3));
+  TEST_ASSERT_TRUE(isnan(s[0].V));
+  TEST_ASSERT_TRUE(isnan(s[0].I));
+  TEST_ASSERT_EQUAL_FLOAT(65.534f, s[1].V);
+  TEST_ASSERT_EQUAL_FLOAT(327.67f, s[1].I);
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, s[2].V);
+  TEST_ASSERT_EQUAL_FLOAT(-327.67f, s[2].I);
+}
+
+void test_small_buffer_keeps_rest_pending(void) {
+  for (uint32_t k = 0; k < 5; ++k)
+    stream.push(k, 12.0f, 0.0f);
+  TEST_ASSERT_EQUAL_UINT32(0, stream.encode(frame, SAMPLE_FRAME_HEADER + 5));
+  size_t len = stream.encode(frame, SAMPLE_FRAME_HEADER + 2 * 6 + 3);
+  TEST_ASSERT_EQUAL_UINT32(SAMPLE_FRAME_HEADER + 2 * 6, len);
+  TEST_ASSERT_EQUAL_UINT32(3, stream.pending());
+  SampleFrameHeader h;
+  StreamSample s[8];
+  len = stream.encode(frame, sizeof(frame));
+  TEST_ASSERT_EQUAL_INT(3, decodeSampleFrame(frame, len, h, s, 8));
+  TEST_ASSERT_EQUAL_UINT32(2, h.seq);
+}
+
+// A full ring drops new samples; the gap shows in the sequence numbers
+void test_overrun_leaves_sequence_gap(void) {
+  for (uint32_t k = 0; k < SAMPLE_STREAM_CAPACITY + 3; ++k)
+    stream.push(k, 12.0f, 0.0f);
+  TEST_ASSERT_EQUAL_UINT32(3, stream.overruns());
+  TEST_ASSERT_EQUAL_UINT32(SAMPLE_STREAM_CAPACITY, stream.pending());
+  size_t len = stream.encode(frame, sizeof(frame));
+  SampleFrameHeader h;
+  StreamSample s[SAMPLE_STREAM_CAPACITY];
+  TEST_ASSERT_EQUAL_INT(SAMPLE_STREAM_CAPACITY,
+                        decodeSampleFrame(frame, len, h, s, 64));
+  stream.push(100, 12.0f, 0.0f);
+  stream.push(101, 12.0f, 0.0f);
+  len = stream.encode(frame, sizeof(frame));
+  TEST_ASSERT_EQUAL_INT(2, decodeSampleFrame(frame, len, h, s, 64));
+  TEST_ASSERT_EQUAL_UINT32(SAMPLE_STREAM_CAPACITY + 3, h.seq);
+}
+
+void test_decode_rejects_malformed(void) {
+  stream.push(0, 12.0f, 0.0f);
+  size_t len = stream.encode(frame, sizeof(frame));
+  SampleFrameHeader h;
+  StreamSample s[2];
+  TEST_ASSERT_EQUAL_INT(-1, decodeSampleFrame(frame, len - 1, h, s, 2));
+  TEST_ASSERT_EQUAL_INT(-1, decodeSampleFrame(frame, 4, h, s, 2));
+  frame[0] = 9;
+  TEST_ASSERT_EQUAL_INT(-1, decodeSampleFrame(frame, len, h, s, 2));
+}
+
+void test_client_send_and_drop(void) {
+  TEST_ASSERT_EQUAL_UINT8(StreamClients::SEND, clients.offer(7, false));
+  TEST_ASSERT_EQUAL_UINT8(StreamClients::DROP, clients.offer(7, true));
+  TEST_ASSERT_EQUAL_UINT8(StreamClients::SEND, clients.offer(7, false));
+  TEST_ASSERT_EQUAL_UINT8(1, clients.count());
+  TEST_ASSERT_EQUAL_UINT32(2, clients.at(0).sent);
+  TEST_ASSERT_EQUAL_UINT32(1, clients.at(0).dropped);
+  TEST_ASSERT_EQUAL_UINT16(0, clients.at(0).dropRun);
+}
+
+// A slow client only loses its own frames
+void test_slow_client_does_not_affect_others(void) {
+  for (int k = 0; k < 20; ++k) {
+    TEST_ASSERT_EQUAL_UINT8(StreamClients::SEND, clients.offer(1, false));
+    TEST_ASSERT_EQUAL_UINT8(k % 2 ? StreamClients::SEND : StreamClients::DROP,
+                            clients.offer(2, k % 2 == 0));
+  }
+  TEST_ASSERT_EQUAL_UINT32(20, clients.at(0).sent);
+  TEST_ASSERT_EQUAL_UINT32(0, clients.at(0).dropped);
+  TEST_ASSERT_EQUAL_UINT32(10, clients.at(1).dropped);
+  TEST_ASSERT_EQUAL_UINT32(30, clients.sent());
+  TEST_ASSERT_EQUAL_UINT32(10, clients.dropped());
+}
+
+void test_stalled_client_closed(void) {
+  for (uint16_t k = 1; k < STREAM_MAX_DROP_RUN; ++k)
+    TEST_ASSERT_EQUAL_UINT8(StreamClients::DROP, clients.offer(3, true));
+  TEST_ASSERT_EQUAL_UINT8(StreamClients::CLOSE, clients.offer(3, true));
+  TEST_ASSERT_EQUAL_UINT8(0, clients.count());
+  TEST_ASSERT_EQUAL_UINT32(STREAM_MAX_DROP_RUN, clients.dropped());
+}
+
+void test_client_limit_and_remove(void) {
+  for (uint32_t id = 1; id <= STREAM_MAX_CLIENTS; ++id)
+    TEST_ASSERT_EQUAL_UINT8(StreamClients::SEND, clients.offer(id, false));
+  TEST_ASSERT_EQUAL_UINT8(StreamClients::CLOSE, clients.offer(99, false));
+  clients.remove(2);
+  TEST_ASSERT_EQUAL_UINT8(STREAM_MAX_CLIENTS - 1, clients.count());
+  TEST_ASSERT_EQUAL_UINT8(StreamClients::SEND, clients.offer(99, false));
+  clients.remove(12345); // unknown: no-op
+  TEST_ASSERT_EQUAL_UINT8(STREAM_MAX_CLIENTS, clients.count());
+}
+
+// The sampling side stays a few stores per sample
+void test_push_cost(void) {
+  const int N = 1000000;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int k = 0; k < N; ++k) {
+    stream.push((uint32_t)k, 12.5f, 1.0f);
+    if ((k & 31) == 31)
+      stream.encode(frame, sizeof(frame));
+  }
+  double ns = std::chrono::duration<double, std::nano>(
+                  std::chrono::steady_clock::now() - t0)
+                  .count() /
+              N;
+  char msg[64];
+  snprintf(msg, sizeof(msg), "%.1f ns per sample (push + encode)", ns);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_EQUAL_UINT32(0, stream.overruns());
+  TEST_ASSERT_TRUE(ns < 200.0);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_empty_stream_encodes_nothing);
+  RUN_TEST(test_frame_layout);
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_missing_and_clamped_values);
+  RUN_TEST(test_small_buffer_keeps_rest_pending);
+  RUN_TEST(test_overrun_leaves_sequence_gap);
+  RUN_TEST(test_decode_rejects_malformed);
+  RUN_TEST(test_client_send_and_drop);
+  RUN_TEST(test_slow_client_does_not_affect_others);
+  RUN_TEST(test_stalled_client_closed);
+  RUN_TEST(test_client_limit_and_remove);
+  RUN_TEST(test_push_cost);
+  return UNITY_END();
+}
@@ -0,0 +1,266 @@
+#include <cstring>
+#include <unity.h>
+
+#include "../../src/sched/scheduler.cpp"
+
+// Virtual clock: tasks advance it to simulate their run time
+static uint32_t vMs = 0;
+static uint32_t vUs = 0;
+static uint32_t vMillis() { return vMs; }
+static uint32_t vMicros() { return vUs; }
+static void advanceMs(uint32_t ms) {
+  vMs += ms;
+  vUs += ms * 1000u;
+}
+
+static int runsA, runsB, runsC;
+static uint32_t costA_ms, costB_ms;
+static char order[32];
+static int orderLen;
+
+static void taskA(uint32_t) {
+  runsA++;
+  order[orderLen++] = 'A';
+  advanceMs(costA_ms);
+}
+static void taskB(uint32_t) {
+  runsB++;
+  order[orderLen++] = 'B';
+  advanceMs(costB_ms);
+}
+static void taskC(uint32_t) {
+  runsC++;
+  order[orderLen++] = 'C';
+}
+
+static SchedTask tasks[3];
+
+static void initTasks() {
+  // name, fn, period, deadline, priority, enabled
+  tasks[0] = SchedTask{"a", taskA, 100, 0, 0, true, 0, {}};
+  tasks[1] = SchedTask{"b", taskB, 250, 50, 1, true, 0, {}};
+  tasks[2] = SchedTask{"c", taskC, 1000, 0, 2, true, 0, {}};
+}
+
+// Drive the scheduler like loop() does until the virtual clock reaches `ms`
+static void runUntil(Scheduler &s, uint32_t ms) {
+  while (vMillis() < ms) {
+    if (s.runOnce() < 0)
+      advanceMs(1);
+  }
+}
+
+void setUp(void) {
+  vMs = 0;
+  vUs = 0;
+  runsA = runsB = runsC = 0;
+  costA_ms = costB_ms = 0;
+  memset(order, 0, sizeof(order));
+  orderLen = 0;
+  initTasks();
+}
+void tearDown(void) {}
+
+void test_sched_runs_periodic_tasks(void) {
+  Scheduler s(tasks, 3, vMillis, vMicros);
+  s.begin();
+  runUntil(s, 1000);
+  TEST_ASSERT_EQUAL(10, runsA); // t = 0, 100, ..., 900
+  TEST_ASSERT_EQUAL(4, runsB);  // t = 0, 250, 500, 750
+  TEST_ASSERT_EQUAL(1, runsC);
+  TEST_ASSERT_EQUAL_UINT32(0, tasks[0].stats.overruns);
+  TEST_ASSERT_EQUAL_UINT32(0, tasks[0].stats.skipped);
+}
+
+void test_sched_priority_order_when_all_ready(void) {
+  Scheduler s(tasks, 3, vMillis, vMicros);
+  s.begin();
+  TEST_ASSERT_EQUAL(0, s.runOnce());
+  TEST_ASSERT_EQUAL(1, s.runOnce());
+  TEST_ASSERT_EQUAL(2, s.runOnce());
+  TEST_ASSERT_EQUAL(-1, s.runOnce());
+  TEST_ASSERT_EQUAL_STRING("ABC", order);
+}
+
+void test_sched_equal_priority_earliest_release_first(void) {
+  tasks[1].priority = 0;
+  Scheduler s(tasks, 3, vMillis, vMicros);
+  s.begin();
+  tasks[0].release_ms = 20;
+  tasks[1].release_ms = 10;
+  advanceMs(30);
+  TEST_ASSERT_EQUAL(1, s.runOnce());
+  TEST_ASSERT_EQUAL(0, s.runOnce());
+}
+
+void test_sched_nothing_ready_before_release(void) {
+  Scheduler s(tasks, 3, vMillis, vMicros);
+  s.begin(50);
+  TEST_ASSERT_EQUAL(-1, s.runOnce());
+  TEST_ASSERT_EQUAL_UINT32(50, s.msUntilNext());
+  advanceMs(50);
+  TEST_ASSERT_EQUAL_UINT32(0, s.msUntilNext());
+  TEST_ASSERT_EQUAL(0, s.runOnce());
+}
+
+void test_sched_runtime_stats(void) {
+  costA_ms = 3;
+  Scheduler s(tasks, 3, vMillis, vMicros);
+  s.begin();
+  runUntil(s, 500);
+  TEST_ASSERT_EQUAL_UINT32(5, tasks[0].stats.runs);
+  TEST_ASSERT_EQUAL_UINT32(3000, tasks[0].stats.maxRun_us);
+  TEST_ASSERT_EQUAL_UINT32(3000, tasks[0].stats.lastRun_us);
+  TEST_ASSERT_EQUAL_UINT64(15000, tasks[0].stats.totalRun_us);
+}
+
+void test_sched_slow_task_delays_lower_priority(void) {
+  costA_ms = 30;
+  Scheduler s(tasks, 3, vMillis, vMicros);
+  s.begin();
+  s.runOnce(); // A at t=0, ends at t=30
+  s.runOnce(); // B released at t=0, starts 30 ms late
+  TEST_ASSERT_EQUAL_UINT32(30, tasks[1].stats.maxLate_ms);
+  TEST_ASSERT_EQUAL_UINT32(0, tasks[1].stats.overruns); // deadline 50 ms
+}
+
+void test_sched_deadline_overrun_counted(void) {
+  costA_ms = 60; // B's deadline is 50 ms after release
+  Scheduler s(tasks, 3, vMillis, vMicros);
+  s.begin();
+  s.runOnce();
+  s.runOnce();
+  TEST_ASSERT_EQUAL_UINT32(1, tasks[1].stats.overruns);
+  TEST_ASSERT_EQUAL_UINT32(0, tasks[0].stats.overruns); // 60 < period
+}
+
+void test_sched_self_overrun_counted(void) {
+  costB_ms = 80; // longer than its own 50 ms deadline
+  Scheduler s(tasks, 3, vMillis, vMicros);
+  s.begin();
+  tasks[0].enabled = false;
+  s.runOnce();
+  TEST_ASSERT_EQUAL_UINT32(1, tasks[1].stats.overruns);
+}
+
+void test_sched_skips_missed_releases(void) {
+  Scheduler s(tasks, 3, vMillis, vMicros);
+  s.begin();
+  s.runOnce(); // A at t=0
+  advanceMs(350);
+  // Releases at 100/200/300 are due: run once, drop 200 and 300
+  TEST_ASSERT_EQUAL(0, s.runOnce());
+  TEST_ASSERT_EQUAL_UINT32(2, tasks[0].stats.skipped);
+  TEST_ASSERT_EQUAL_UINT32(400, tasks[0].release_ms);
+  TEST_ASSERT_EQUAL(2, runsA);
+}
+
+// Ending less than a period past the next release is not a full period
+// late: the task runs again at once and nothing is skipped
+void test_sched_short_overrun_does_not_skip(void) {
+  costA_ms = 130;
+  tasks[1].enabled = tasks[2].enabled = false;
+  Scheduler s(tasks, 3, vMillis, vMicros);
+  s.begin();
+  TEST_ASSERT_EQUAL(0, s.runOnce()); // t=0..130
+  TEST_ASSERT_EQUAL_UINT32(100, tasks[0].release_ms);
+  TEST_ASSERT_EQUAL(0, s.runOnce()); // release 100, 30 ms late
+  TEST_ASSERT_EQUAL_UINT32(0, tasks[0].stats.skipped);
+  TEST_ASSERT_EQUAL_UINT32(30, tasks[0].stats.maxLate_ms);
+  TEST_ASSERT_EQUAL_UINT32(200, tasks[0].release_ms);
+  TEST_ASSERT_EQUAL(2, runsA);
+}
+
+void test_sched_keeps_phase(void) {
+  costA_ms = 7;
+  Scheduler s(tasks, 3, vMillis, vMicros);
+  s.begin();
+  s.runOnce();
+  // Next release stays on the 100 ms grid, independent of run time
+  TEST_ASSERT_EQUAL_UINT32(100, tasks[0].release_ms);
+}
+
+void test_sched_set_period_pulls_release_in(void) {
+  Scheduler s(tasks, 3, vMillis, vMicros);
+  s.begin();
+  tasks[2].release_ms = 1000;
+  advanceMs(10);
+  s.setPeriod(2, 100);
+  TEST_ASSERT_EQUAL_UINT32(110, tasks[2].release_ms);
+  // Lengthening never pushes a pending release out
+  s.setPeriod(2, 5000);
+  TEST_ASSERT_EQUAL_UINT32(110, tasks[2].release_ms);
+  TEST_ASSERT_EQUAL_UINT32(5000, tasks[2].period_ms);
+}
+
+void test_sched_disabled_task_not_run(void) {
+  Scheduler s(tasks, 3, vMillis, vMicros);
+  s.begin();
+  s.setEnabled(0, false);
+  runUntil(s, 500);
+  TEST_ASSERT_EQUAL(0, runsA);
+  s.setEnabled(0, true);
+  TEST_ASSERT_EQUAL(0, s.runOnce()); // released immediately
+}
+
+void test_sched_release_now(void) {
+  Scheduler s(tasks, 3, vMillis, vMicros);
+  s.begin();
+  runUntil(s, 20); // c ran at 0, next release at 1000
+  runsC = 0;
+  s.releaseNow(2);
+  TEST_ASSERT_EQUAL(2, s.runOnce());
+  TEST_ASSERT_EQUAL(1, runsC);
+  TEST_ASSERT_EQUAL_UINT32(1020, tasks[2].release_ms);
+  // Disabled tasks stay disabled
+  s.setEnabled(2, false);
+  s.releaseNow(2);
+  TEST_ASSERT_EQUAL(-1, s.runOnce());
+}
+
+void test_sched_millis_wraparound(void) {
+  vMs = 0xFFFFFFFFu - 150u; // millis() wraps 150 ms from now
+  Scheduler s(tasks, 3, vMillis, vMicros);
+  s.begin();
+  for (int i = 0; i < 1000; ++i)
+    if (s.runOnce() < 0)
+      advanceMs(1);
+  TEST_ASSERT_TRUE(vMs < 1000u); // clock has wrapped
+  TEST_ASSERT_EQUAL(10, runsA);
+  TEST_ASSERT_EQUAL_UINT32(0, tasks[0].stats.skipped);
+  TEST_ASSERT_EQUAL_UINT32(0, tasks[0].stats.maxLate_ms);
+}
+
+void test_sched_task_json(void) {
+  costA_ms = 2;
+  Scheduler s(tasks, 3, vMillis, vMicros);
+  s.begin();
+  runUntil(s, 200);
+  char js[200];
+  TEST_ASSERT_TRUE(buildSchedTaskJson(tasks[0], js, sizeof(js)));
+  TEST_ASSERT_NOT_NULL(strstr(js, "\"task\":\"a\""));
+  TEST_ASSERT_NOT_NULL(strstr(js, "\"runs\":2"));
+  TEST_ASSERT_NOT_NULL(strstr(js, "\"avg_us\":2000"));
+  TEST_ASSERT_FALSE(buildSchedTaskJson(tasks[0], js, 20));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_sched_runs_periodic_tasks);
+  RUN_TEST(test_sched_priority_order_when_all_ready);
+  RUN_TEST(test_sched_equal_priority_earliest_release_first);
+  RUN_TEST(test_sched_nothing_ready_before_release);
+  RUN_TEST(test_sched_runtime_stats);
+  RUN_TEST(test_sched_slow_task_delays_lower_priority);
+  RUN_TEST(test_sched_deadline_overrun_counted);
+  RUN_TEST(test_sched_self_overrun_counted);
+  RUN_TEST(test_sched_skips_missed_releases);
+  RUN_TEST(test_sched_short_overrun_does_not_skip);
+  RUN_TEST(test_sched_keeps_phase);
+  RUN_TEST(test_sched_set_period_pulls_release_in);
+  RUN_TEST(test_sched_disabled_task_not_run);
+  RUN_TEST(test_sched_release_now);
+  RUN_TEST(test_sched_millis_wraparound);
+  RUN_TEST(test_sched_task_json);
+  return UNITY_END();
+}
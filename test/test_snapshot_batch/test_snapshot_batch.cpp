@@ -0,0 +1,203 @@
+#include <cmath>
+#include <cstring>
+#include <unity.h>
+
+#include "../../src/comms/outbox.cpp"
+#include "../../src/comms/snapshot_batch.cpp"
+#include "../../src/json_writer.cpp"
+#include "../../src/telemetry_payload.cpp"
+
+static SnapshotBatch rtc;
+
+static TelemetryFrame frame(float V) {
+  TelemetryFrame f{};
+  f.mode = "snapshot";
+  f.V = V;
+  f.I = -0.05f;
+  f.T = 12.5f;
+  f.soc_pct = 81.0f;
+  f.soh_pct = 95.0f;
+  f.Rint_mOhm = NAN;
+  f.Rint25_mOhm = NAN;
+  f.RintBaseline_mOhm = 9.0f;
+  f.ah_left = 40.0f;
+  f.battery_capacity_ah = 70.0f;
+  f.rest_s = 600;
+  f.up_ms = 120;
+  return f;
+}
+
+void setUp(void) { memset(&rtc, 0, sizeof(rtc)); }
+void tearDown(void) {}
+
+void test_begin_resets_garbage(void) {
+  memset(&rtc, 0xA5, sizeof(rtc));
+  SnapshotBatcher b(rtc, 6);
+  b.begin();
+  TEST_ASSERT_EQUAL_UINT8(0, b.count());
+}
+
+void test_batch_survives_reboot(void) {
+  SnapshotBatcher b(rtc, 6);
+  b.begin();
+  b.add(frame(12.6f), 1000);
+  b.add(frame(12.5f), 1300);
+  SnapshotBatcher b2(rtc, 6); // next wake
+  b2.begin();
+  TEST_ASSERT_EQUAL_UINT8(2, b2.count());
+}
+
+void test_due_every_nth_wake(void) {
+  SnapshotBatcher b(rtc, 3);
+  b.begin();
+  TEST_ASSERT_FALSE(b.due(false)); // wake 1
+  b.add(frame(12.6f), 0);
+  TEST_ASSERT_FALSE(b.due(false)); // wake 2
+  b.add(frame(12.6f), 300);
+  TEST_ASSERT_TRUE(b.due(false)); // wake 3 completes the batch
+  b.add(frame(12.6f), 600);
+  b.clear();
+  TEST_ASSERT_FALSE(b.due(false));
+}
+
+void test_event_forces_radio(void) {
+  SnapshotBatcher b(rtc, 6);
+  b.begin();
+  TEST_ASSERT_TRUE(b.due(true));
+}
+
+void test_every_is_clamped(void) {
+  SnapshotBatcher one(rtc, 0);
+  one.begin();
+  TEST_ASSERT_TRUE(one.due(false)); // 0 behaves as 1: every wake
+
+  SnapshotBatcher big(rtc, 200);
+  big.begin();
+  for (int i = 0; i < SNAPSHOT_BATCH_MAX - 1; ++i)
+    TEST_ASSERT_TRUE(big.add(frame(12.6f), i));
+  TEST_ASSERT_TRUE(big.due(false)); // capped at the batch size
+}
+
+void test_full_rejects_add(void) {
+  SnapshotBatcher b(rtc, 6);
+  b.begin();
+  for (int i = 0; i < SNAPSHOT_BATCH_MAX; ++i)
+    TEST_ASSERT_TRUE(b.add(frame(12.6f), i));
+  TEST_ASSERT_TRUE(b.full());
+  TEST_ASSERT_FALSE(b.add(frame(12.6f), 99));
+  TEST_ASSERT_EQUAL_UINT8(SNAPSHOT_BATCH_MAX, b.count());
+}
+
+void test_full_batch_fits_mqtt_packet(void) {
+  // PubSubClient buffer (MQTT_MAX_PACKET_SIZE) holds header + topic + payload
+  TEST_ASSERT_TRUE(SNAPSHOT_BATCH_BYTES + 5 + 2 + strlen("car/battery/batch") <=
+                   512);
+}
+
+void test_encode_decode_round_trip(void) {
+  SnapshotBatcher b(rtc, 6);
+  b.begin();
+  b.add(frame(12.61f), 1700000000UL);
+  b.add(frame(12.58f), 1700000300UL);
+  b.add(frame(12.55f), 1700000600UL);
+  uint8_t buf[SNAPSHOT_BATCH_BYTES];
+  size_t n = b.encode(1700000610UL, buf, sizeof(buf));
+  TEST_ASSERT_EQUAL_UINT32(SNAPSHOT_BATCH_HEADER + 3 * OUTBOX_RECORD_SIZE, n);
+
+  SnapshotBatchEntry e[SNAPSHOT_BATCH_MAX];
+  uint32_t sentAt = 0;
+  int m = decodeSnapshotBatch(buf, n, e, SNAPSHOT_BATCH_MAX, &sentAt);
+  TEST_ASSERT_EQUAL_INT(3, m);
+  TEST_ASSERT_EQUAL_UINT32(1700000610UL, sentAt);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 12.61f, e[0].f.V); // oldest first
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 12.55f, e[2].f.V);
+  TEST_ASSERT_EQUAL_UINT32(1700000300UL, e[1].ts);
+  TEST_ASSERT_EQUAL_UINT32(610, e[0].age_s);
+  TEST_ASSERT_EQUAL_UINT32(10, e[2].age_s);
+  TEST_ASSERT_EQUAL_STRING("snapshot", e[0].f.mode);
+  TEST_ASSERT_TRUE(std::isnan(e[0].f.Rint_mOhm));
+  TEST_ASSERT_FALSE(e[0].f.hasStats); // no "interval" object when printed
+}
+
+void test_age_from_unset_clock(void) {
+  // Before SNTP the clock counts from power-on; ages are still valid
+  SnapshotBatcher b(rtc, 6);
+  b.begin();
+  b.add(frame(12.6f), 40);
+  b.add(frame(12.6f), 340);
+  uint8_t buf[SNAPSHOT_BATCH_BYTES];
+  size_t n = b.encode(345, buf, sizeof(buf));
+  SnapshotBatchEntry e[2];
+  TEST_ASSERT_EQUAL_INT(2, decodeSnapshotBatch(buf, n, e, 2));
+  TEST_ASSERT_EQUAL_UINT32(305, e[0].age_s);
+  TEST_ASSERT_EQUAL_UINT32(5, e[1].age_s);
+}
+
+void test_encode_buffer_too_small(void) {
+  SnapshotBatcher b(rtc, 6);
+  b.begin();
+  b.add(frame(12.6f), 0);
+  uint8_t buf[SNAPSHOT_BATCH_HEADER + OUTBOX_RECORD_SIZE - 1];
+  TEST_ASSERT_EQUAL_UINT32(0, b.encode(0, buf, sizeof(buf)));
+}
+
+void test_decode_rejects_malformed(void) {
+  SnapshotBatcher b(rtc, 6);
+  b.begin();
+  b.add(frame(12.6f), 0);
+  uint8_t buf[SNAPSHOT_BATCH_BYTES];
+  size_t n = b.encode(10, buf, sizeof(buf));
+  SnapshotBatchEntry e[2];
+  TEST_ASSERT_EQUAL_INT(-1, decodeSnapshotBatch(buf, 4, e, 2));     // short
+  TEST_ASSERT_EQUAL_INT(-1, decodeSnapshotBatch(buf, n - 1, e, 2)); // length
+  buf[0] = 'X';
+  TEST_ASSERT_EQUAL_INT(-1, decodeSnapshotBatch(buf, n, e, 2)); // magic
+  buf[0] = 'S';
+  buf[2] = 9;
+  TEST_ASSERT_EQUAL_INT(-1, decodeSnapshotBatch(buf, n, e, 2)); // version
+}
+
+void test_decode_skips_corrupt_record(void) {
+  SnapshotBatcher b(rtc, 6);
+  b.begin();
+  b.add(frame(12.61f), 100);
+  b.add(frame(12.58f), 400);
+  b.add(frame(12.55f), 700);
+  uint8_t buf[SNAPSHOT_BATCH_BYTES];
+  size_t n = b.encode(710, buf, sizeof(buf));
+  buf[SNAPSHOT_BATCH_HEADER + OUTBOX_RECORD_SIZE + 9] ^= 0x40; // record 1
+  SnapshotBatchEntry e[3];
+  TEST_ASSERT_EQUAL_INT(2, decodeSnapshotBatch(buf, n, e, 3));
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 12.61f, e[0].f.V);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 12.55f, e[1].f.V);
+}
+
+void test_decode_limited_by_max(void) {
+  SnapshotBatcher b(rtc, 6);
+  b.begin();
+  for (int i = 0; i < 5; ++i)
+    b.add(frame(12.6f), i * 300);
+  uint8_t buf[SNAPSHOT_BATCH_BYTES];
+  size_t n = b.encode(1500, buf, sizeof(buf));
+  SnapshotBatchEntry e[2];
+  TEST_ASSERT_EQUAL_INT(2, decodeSnapshotBatch(buf, n, e, 2));
+  TEST_ASSERT_EQUAL_UINT32(300, e[1].ts);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_begin_resets_garbage);
+  RUN_TEST(test_batch_survives_reboot);
+  RUN_TEST(test_due_every_nth_wake);
+  RUN_TEST(test_event_forces_radio);
+  RUN_TEST(test_every_is_clamped);
+  RUN_TEST(test_full_rejects_add);
+  RUN_TEST(test_full_batch_fits_mqtt_packet);
+  RUN_TEST(test_encode_decode_round_trip);
+  RUN_TEST(test_age_from_unset_clock);
+  RUN_TEST(test_encode_buffer_too_small);
+  RUN_TEST(test_decode_rejects_malformed);
+  RUN_TEST(test_decode_skips_corrupt_record);
+  RUN_TEST(test_decode_limited_by_max);
+  return UNITY_END();
+}
@@ -0,0 +1,281 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <unity.h>
+
+#include "../../src/json_writer.cpp"
+#include "../../src/telemetry_cbor.cpp"
+#include "../../src/telemetry_payload.cpp"
+
+static TelemetryFrame frame() {
+  TelemetryFrame f{};
+  f.mode = "active";
+  f.V = 12.654f;
+  f.I = -1.234f;
+  f.T = 21.5f;
+  f.soc_pct = 85.2f;
+  f.soh_pct = 97.5f;
+  f.Rint_mOhm = 10.25f;
+  f.Rint25_mOhm = 9.87f;
+  f.RintBaseline_mOhm = 9.5f;
+  f.ah_left = 55.321f;
+  f.battery_capacity_ah = 70.0f;
+  f.alternator_on = true;
+  f.rest_s = 1234;
+  f.lowCurrentAccum_s = 56;
+  f.up_ms = 3600123;
+  f.hasRint = true;
+  f.hasRint25 = false;
+  f.net_blocked_ms_h = 42;
+  return f;
+}
+
+// Device JSON and JSON rebuilt from the CBOR payload must be identical
+static void assertSameJson(const TelemetryFrame &f) {
+  uint8_t cbor[TELEMETRY_CBOR_MAX];
+  size_t n = encodeTelemetryCbor(f, cbor, sizeof(cbor));
+  TEST_ASSERT_TRUE(n > 0);
+  TelemetryFrame d;
+  TEST_ASSERT_TRUE(decodeTelemetryCbor(cbor, n, d));
+  char a[700], b[700];
+  TEST_ASSERT_TRUE(buildTelemetryJson(f, a, sizeof(a)));
+  TEST_ASSERT_TRUE(buildTelemetryJson(d, b, sizeof(b)));
+  TEST_ASSERT_EQUAL_STRING(a, b);
+}
+
+static uint32_t rngState = 777;
+static uint32_t rng() {
+  rngState = rngState * 1664525u + 1013904223u;
+  return rngState;
+}
+static float randFloat(float lo, float hi) {
+  return lo + (hi - lo) * (rng() >> 8) / 16777216.0f;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_round_trip_fields(void) {
+  TelemetryFrame f = frame();
+  uint8_t buf[TELEMETRY_CBOR_MAX];
+  size_t n = encodeTelemetryCbor(f, buf, sizeof(buf));
+  TelemetryFrame d;
+  TEST_ASSERT_TRUE(decodeTelemetryCbor(buf, n, d));
+  TEST_ASSERT_EQUAL_STRING("active", d.mode);
+  TEST_ASSERT_FLOAT_WITHIN(0.0005f, 12.654f, d.V);
+  TEST_ASSERT_FLOAT_WITHIN(0.0005f, -1.234f, d.I);
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, 21.5f, d.T);
+  TEST_ASSERT_FLOAT_WITHIN(0.0005f, 55.321f, d.ah_left);
+  TEST_ASSERT_FLOAT_WITHIN(0.005f, 10.25f, d.Rint_mOhm);
+  TEST_ASSERT_TRUE(d.alternator_on);
+  TEST_ASSERT_TRUE(d.hasRint);
+  TEST_ASSERT_FALSE(d.hasRint25);
+  TEST_ASSERT_EQUAL_UINT32(1234, d.rest_s);
+  TEST_ASSERT_EQUAL_UINT32(3600123, d.up_ms);
+  TEST_ASSERT_EQUAL_UINT32(42, d.net_blocked_ms_h);
+}
+
+void test_payload_is_compact(void) {
+  TelemetryFrame f = frame();
+  uint8_t buf[TELEMETRY_CBOR_MAX];
+  size_t n = encodeTelemetryCbor(f, buf, sizeof(buf));
+  char js[700];
+  TEST_ASSERT_TRUE(buildTelemetryJson(f, js, sizeof(js)));
+  TEST_ASSERT_TRUE(n <= 80);
+  TEST_ASSERT_TRUE(n * 4 < strlen(js));
+  // Map of 18 entries, key 0 = mode index 0
+  TEST_ASSERT_EQUAL_HEX8(0xB2, buf[0]);
+  TEST_ASSERT_EQUAL_HEX8(0x00, buf[1]);
+  TEST_ASSERT_EQUAL_HEX8(0x00, buf[2]);
+  // Key 1 = 12654 mV as a 16-bit unsigned integer
+  TEST_ASSERT_EQUAL_HEX8(0x01, buf[3]);
+  TEST_ASSERT_EQUAL_HEX8(0x19, buf[4]);
+  TEST_ASSERT_EQUAL_HEX8(0x31, buf[5]);
+  TEST_ASSERT_EQUAL_HEX8(0x6E, buf[6]);
+}
+
+void test_interval_stats_round_trip(void) {
+  TelemetryFrame f = frame();
+  f.hasStats = true;
+  f.stats = {120, 60000, 11.2f, 12.65f, 12.571f, 12.5714f,
+             -0.5f, 80.25f, 3.1f, NAN, -51.68f};
+  uint8_t buf[TELEMETRY_CBOR_MAX];
+  size_t n = encodeTelemetryCbor(f, buf, sizeof(buf));
+  TEST_ASSERT_TRUE(n > 0 && n <= 120);
+  TEST_ASSERT_EQUAL_HEX8(0xB8, buf[0]); // map of 29 entries
+  TEST_ASSERT_EQUAL_HEX8(29, buf[1]);
+  TelemetryFrame d;
+  TEST_ASSERT_TRUE(decodeTelemetryCbor(buf, n, d));
+  TEST_ASSERT_TRUE(d.hasStats);
+  TEST_ASSERT_EQUAL_UINT32(120, d.stats.n);
+  TEST_ASSERT_EQUAL_UINT32(60000, d.stats.span_ms);
+  TEST_ASSERT_FLOAT_WITHIN(0.0005f, 80.25f, d.stats.I_max);
+  TEST_ASSERT_TRUE(isnan(d.stats.I_rms));
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, -51.68f, d.stats.charge_mAh);
+  assertSameJson(f);
+  // Frames without statistics decode without them
+  f.hasStats = false;
+  n = encodeTelemetryCbor(f, buf, sizeof(buf));
+  TEST_ASSERT_TRUE(decodeTelemetryCbor(buf, n, d));
+  TEST_ASSERT_FALSE(d.hasStats);
+}
+
+void test_non_finite_is_null(void) {
+  TelemetryFrame f = frame();
+  f.T = NAN;
+  f.soh_pct = INFINITY;
+  uint8_t buf[TELEMETRY_CBOR_MAX];
+  size_t n = encodeTelemetryCbor(f, buf, sizeof(buf));
+  TelemetryFrame d;
+  TEST_ASSERT_TRUE(decodeTelemetryCbor(buf, n, d));
+  TEST_ASSERT_TRUE(isnan(d.T));
+  TEST_ASSERT_TRUE(isnan(d.soh_pct));
+  assertSameJson(f);
+}
+
+void test_json_identical_for_random_frames(void) {
+  const char *modes[] = {"active", "parked-idle", "parked-sleep",
+                         "snapshot"};
+  for (int i = 0; i < 5000; ++i) {
+    TelemetryFrame f{};
+    f.mode = modes[i % 4];
+    f.V = randFloat(0.0f, 16.0f);
+    f.I = randFloat(-150.0f, 150.0f);
+    f.T = (i % 11) ? randFloat(-40.0f, 85.0f) : NAN;
+    f.soc_pct = randFloat(0.0f, 100.0f);
+    f.soh_pct = randFloat(0.0f, 110.0f);
+    f.Rint_mOhm = randFloat(0.0f, 300.0f);
+    f.Rint25_mOhm = randFloat(0.0f, 300.0f);
+    f.RintBaseline_mOhm = randFloat(0.0f, 100.0f);
+    f.ah_left = randFloat(0.0f, 200.0f);
+    f.battery_capacity_ah = randFloat(1.0f, 200.0f);
+    f.alternator_on = rng() & 1;
+    f.rest_s = rng();
+    f.lowCurrentAccum_s = rng();
+    f.up_ms = rng();
+    f.hasRint = rng() & 1;
+    f.hasRint25 = rng() & 1;
+    f.net_blocked_ms_h = rng();
+    assertSameJson(f);
+  }
+}
+
+void test_edge_values_keep_json(void) {
+  // Negative zero after rounding, ties, huge values fall back to float32
+  const float vals[] = {-0.0004f, -0.0f, 0.0625f, 2.5f, -2.5f,
+                        4194.303f, 4194.305f, 1e9f, -3.4e38f};
+  for (float v : vals) {
+    TelemetryFrame f = frame();
+    f.V = f.I = f.T = f.soc_pct = f.Rint_mOhm = f.ah_left = v;
+    assertSameJson(f);
+  }
+}
+
+void test_unknown_mode_sent_as_text(void) {
+  TelemetryFrame f = frame();
+  f.mode = "storage";
+  uint8_t buf[TELEMETRY_CBOR_MAX];
+  size_t n = encodeTelemetryCbor(f, buf, sizeof(buf));
+  TEST_ASSERT_EQUAL_HEX8(0x67, buf[2]); // text(7)
+  TelemetryFrame d;
+  TEST_ASSERT_TRUE(decodeTelemetryCbor(buf, n, d));
+  TEST_ASSERT_EQUAL_STRING("unknown", d.mode);
+}
+
+void test_decoder_accepts_other_encodings(void) {
+  // {99: [1, {2: 3}], 1: 12.5 (float16), 2: -1.5 (float64), 12: 7,
+  //  "x": h'00', 11: true}
+  const uint8_t buf[] = {0xA6, 0x18, 0x63, 0x82, 0x01, 0xA1, 0x02, 0x03,
+                         0x01, 0xF9, 0x4A, 0x40, 0x02, 0xFB, 0xBF, 0xF8,
+                         0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x07,
+                         0x61, 0x78, 0x41, 0x00, 0x0B, 0xF5};
+  TelemetryFrame d;
+  TEST_ASSERT_TRUE(decodeTelemetryCbor(buf, sizeof(buf), d));
+  TEST_ASSERT_EQUAL_FLOAT(12.5f, d.V);
+  TEST_ASSERT_EQUAL_FLOAT(-1.5f, d.I);
+  TEST_ASSERT_EQUAL_UINT32(7, d.rest_s);
+  TEST_ASSERT_TRUE(d.alternator_on);
+  TEST_ASSERT_TRUE(isnan(d.T)); // missing
+  TEST_ASSERT_EQUAL_UINT32(0, d.up_ms);
+}
+
+void test_decoder_rejects_malformed(void) {
+  TelemetryFrame f = frame();
+  uint8_t buf[TELEMETRY_CBOR_MAX];
+  size_t n = encodeTelemetryCbor(f, buf, sizeof(buf));
+  TelemetryFrame d;
+  for (size_t len = 0; len < n; ++len)
+    TEST_ASSERT_FALSE(decodeTelemetryCbor(buf, len, d));
+  const uint8_t array[] = {0x81, 0x01};
+  TEST_ASSERT_FALSE(decodeTelemetryCbor(array, sizeof(array), d));
+  const uint8_t indefinite[] = {0xBF, 0x01, 0x02, 0xFF};
+  TEST_ASSERT_FALSE(decodeTelemetryCbor(indefinite, sizeof(indefinite), d));
+  // Huge text length must not read past the buffer
+  const uint8_t text[] = {0xA1, 0x00, 0x7B, 0xFF, 0xFF, 0xFF, 0xFF,
+                          0xFF, 0xFF, 0xFF, 0xF0};
+  TEST_ASSERT_FALSE(decodeTelemetryCbor(text, sizeof(text), d));
+  // Nesting deeper than the skip limit
+  const uint8_t deep[] = {0xA1, 0x18, 0x63, 0x81, 0x81, 0x81,
+                          0x81, 0x81, 0x81, 0x01};
+  TEST_ASSERT_FALSE(decodeTelemetryCbor(deep, sizeof(deep), d));
+}
+
+void test_encode_buffer_too_small(void) {
+  TelemetryFrame f = frame();
+  uint8_t buf[TELEMETRY_CBOR_MAX];
+  size_t n = encodeTelemetryCbor(f, buf, sizeof(buf));
+  TEST_ASSERT_EQUAL_UINT32(0, encodeTelemetryCbor(f, buf, n - 1));
+  TEST_ASSERT_EQUAL_UINT32(n, encodeTelemetryCbor(f, buf, n));
+}
+
+void test_benchmark_size_and_time_vs_json(void) {
+  TelemetryFrame f = frame();
+  const int iters = 100000;
+  char js[700];
+  uint8_t cbor[TELEMETRY_CBOR_MAX];
+  uint32_t sink = 0;
+  size_t jsonLen = 0, cborLen = 0;
+
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < iters; ++i) {
+    f.up_ms = i;
+    buildTelemetryJson(f, js, sizeof(js));
+    jsonLen = strlen(js);
+    sink += (uint8_t)js[jsonLen - 3];
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  for (int i = 0; i < iters; ++i) {
+    f.up_ms = i;
+    cborLen = encodeTelemetryCbor(f, cbor, sizeof(cbor));
+    sink += cbor[cborLen - 1];
+  }
+  auto t2 = std::chrono::steady_clock::now();
+  double jNs = std::chrono::duration<double, std::nano>(t1 - t0).count();
+  double cNs = std::chrono::duration<double, std::nano>(t2 - t1).count();
+
+  char msg[200];
+  snprintf(msg, sizeof(msg),
+           "[bench] telemetry frame: JSON %u bytes %.0f ns, CBOR %u bytes "
+           "%.0f ns (sink=%u)",
+           (unsigned)jsonLen, jNs / iters, (unsigned)cborLen, cNs / iters,
+           (unsigned)sink);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_TRUE(cborLen < jsonLen);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip_fields);
+  RUN_TEST(test_payload_is_compact);
+  RUN_TEST(test_interval_stats_round_trip);
+  RUN_TEST(test_non_finite_is_null);
+  RUN_TEST(test_json_identical_for_random_frames);
+  RUN_TEST(test_edge_values_keep_json);
+  RUN_TEST(test_unknown_mode_sent_as_text);
+  RUN_TEST(test_decoder_accepts_other_encodings);
+  RUN_TEST(test_decoder_rejects_malformed);
+  RUN_TEST(test_encode_buffer_too_small);
+  RUN_TEST(test_benchmark_size_and_time_vs_json);
+  return UNITY_END();
+}
@@ -1,98 +1,70 @@
+#include <chrono>
 #include <cmath>
 #include <cstdio>
 #include <cstring>
 #include <unity.h>
 
-// Mock Arduino dependencies
-#define isfinite std::isfinite
-
-// Include telemetry structures and implementation
-struct TelemetryFrame {
-  const char *mode;
-  float V, I, T;
-  float soc_pct, soh_pct;
-  float Rint_mOhm, Rint25_mOhm, RintBaseline_mOhm;
-  float ah_left;
-  bool alternator_on;
-  uint32_t rest_s, lowCurrentAccum_s, up_ms;
-  bool hasRint, hasRint25;
-};
-
-bool buildTelemetryJson(const TelemetryFrame &f, char *out, size_t outLen) {
-  // Handle all potentially infinite values safely
-  char vStr[16], iStr[16], tStr[16], socStr[16], sohStr[16], ahStr[16];
-
-  if (isfinite(f.V)) {
-    snprintf(vStr, sizeof(vStr), "%.3f", f.V);
-  } else {
-    snprintf(vStr, sizeof(vStr), "null");
-  }
-
-  if (isfinite(f.I)) {
-    snprintf(iStr, sizeof(iStr), "%.3f", f.I);
-  } else {
-    snprintf(iStr, sizeof(iStr), "null");
-  }
-
-  if (isfinite(f.T)) {
-    snprintf(tStr, sizeof(tStr), "%.1f", f.T);
-  } else {
-    snprintf(tStr, sizeof(tStr), "null");
-  }
-
-  if (isfinite(f.soc_pct)) {
-    snprintf(socStr, sizeof(socStr), "%.1f", f.soc_pct);
-  } else {
-    snprintf(socStr, sizeof(socStr), "null");
+#include "../../src/json_writer.cpp"
+#include "../../src/sched/profiler.cpp"
+#include "../../src/telemetry_payload.cpp"
+
+// Reference: the former snprintf-based builder (null for values that are
+// not finite). The streaming writer must match it byte for byte.
+static bool buildTelemetryJsonSnprintf(const TelemetryFrame &f, char *out,
+                                       size_t outLen) {
+  char v[7][24];
+  const float vals[7] = {f.V, f.I, f.T, f.soc_pct, f.soh_pct, f.ah_left,
+                         f.RintBaseline_mOhm};
+  const int dec[7] = {3, 3, 1, 1, 1, 3, 2};
+  for (int i = 0; i < 7; ++i) {
+    if (std::isfinite(vals[i]))
+      snprintf(v[i], sizeof(v[i]), "%.*f", dec[i], vals[i]);
+    else
+      snprintf(v[i], sizeof(v[i]), "null");
   }
-
-  if (isfinite(f.soh_pct)) {
-    snprintf(sohStr, sizeof(sohStr), "%.1f", f.soh_pct);
-  } else {
-    snprintf(sohStr, sizeof(sohStr), "null");
-  }
-
-  if (isfinite(f.ah_left)) {
-    snprintf(ahStr, sizeof(ahStr), "%.3f", f.ah_left);
-  } else {
-    snprintf(ahStr, sizeof(ahStr), "null");
-  }
-
-  char rStr[16];
-  if (f.hasRint && isfinite(f.Rint_mOhm)) {
+  char cap[24], rStr[24], r25Str[24];
+  if (std::isfinite(f.battery_capacity_ah))
+    snprintf(cap, sizeof(cap), "%.1f", f.battery_capacity_ah);
+  else
+    snprintf(cap, sizeof(cap), "null");
+  if (f.hasRint && std::isfinite(f.Rint_mOhm))
     snprintf(rStr, sizeof(rStr), "%.2f", f.Rint_mOhm);
-  } else {
+  else
     snprintf(rStr, sizeof(rStr), "null");
-  }
-
-  char r25Str[16];
-  if (f.hasRint25 && isfinite(f.Rint25_mOhm)) {
+  if (f.hasRint25 && std::isfinite(f.Rint25_mOhm))
     snprintf(r25Str, sizeof(r25Str), "%.2f", f.Rint25_mOhm);
-  } else {
+  else
     snprintf(r25Str, sizeof(r25Str), "null");
-  }
-
-  char rBaseStr[16];
-  if (isfinite(f.RintBaseline_mOhm)) {
-    snprintf(rBaseStr, sizeof(rBaseStr), "%.2f", f.RintBaseline_mOhm);
-  } else {
-    snprintf(rBaseStr, sizeof(rBaseStr), "null");
-  }
 
   int n = snprintf(
       out, outLen,
       "{\"mode\":\"%s\",\"voltage_V\":%s,\"current_A\":%s,\"temp_C\":%s,"
       "\"soc_pct\":%s,\"soh_pct\":%s,\"ah_left\":%s,"
       "\"Rint_mOhm\":%s,\"Rint25_mOhm\":%s,\"RintBaseline_mOhm\":%s,"
-      "\"alternator_on\":%s,\"rest_s\":%u,\"lowCurrentAccum_s\":%u,\"up_ms\":%"
-      "lu}",
-      f.mode, vStr, iStr, tStr, socStr, sohStr, ahStr, rStr, r25Str, rBaseStr,
+      "\"battery_capacity_ah\":%s,"
+      "\"alternator_on\":%s,\"rest_s\":%u,\"lowCurrentAccum_s\":%u,"
+      "\"hasRint\":%s,\"hasRint25\":%s,\"up_ms\":%lu,"
+      "\"net_blocked_ms_h\":%lu}",
+      f.mode, v[0], v[1], v[2], v[3], v[4], v[5], rStr, r25Str, v[6], cap,
       f.alternator_on ? "true" : "false", (unsigned)f.rest_s,
-      (unsigned)f.lowCurrentAccum_s, (unsigned long)f.up_ms);
-
+      (unsigned)f.lowCurrentAccum_s, f.hasRint ? "true" : "false",
+      f.hasRint25 ? "true" : "false", (unsigned long)f.up_ms,
+      (unsigned long)f.net_blocked_ms_h);
   return n > 0 && (size_t)n < outLen;
 }
 
+// Build with the streaming writer and check it against the reference
+static bool buildChecked(const TelemetryFrame &f, char *out, size_t outLen) {
+  char ref[1024];
+  TEST_ASSERT_TRUE(outLen <= sizeof(ref));
+  bool okRef = buildTelemetryJsonSnprintf(f, ref, outLen);
+  bool ok = buildTelemetryJson(f, out, outLen);
+  TEST_ASSERT_EQUAL(okRef, ok);
+  if (ok)
+    TEST_ASSERT_EQUAL_STRING(ref, out);
+  return ok;
+}
+
 // Helper function to check if JSON contains a key-value pair
 bool jsonContains(const char *json, const char *key, const char *value) {
   char searchStr[256];
@@ -121,15 +93,19 @@ void test_telemetry_basic_active_mode(void) {
                           .Rint25_mOhm = 10.2f,
                           .RintBaseline_mOhm = 10.0f,
                           .ah_left = 12.340f,
+                          .battery_capacity_ah = 0.0f,
                           .alternator_on = true,
                           .rest_s = 0,
                           .lowCurrentAccum_s = 0,
                           .up_ms = 123456,
                           .hasRint = true,
-                          .hasRint25 = true};
+                          .hasRint25 = true,
+                          .net_blocked_ms_h = 0,
+                          .hasStats = false,
+                          .stats = {}};
 
   char json[512];
-  bool success = buildTelemetryJson(frame, json, sizeof(json));
+  bool success = buildChecked(frame, json, sizeof(json));
 
   TEST_ASSERT_TRUE(success);
   TEST_ASSERT_TRUE(jsonContainsString(json, "mode", "active"));
@@ -152,15 +128,19 @@ void test_telemetry_parked_idle_mode(void) {
                           .Rint25_mOhm = 10.8f,
                           .RintBaseline_mOhm = 10.0f,
                           .ah_left = 10.500f,
+                          .battery_capacity_ah = 0.0f,
                           .alternator_on = false,
                           .rest_s = 300,
                           .lowCurrentAccum_s = 150,
                           .up_ms = 456789,
                           .hasRint = true,
-                          .hasRint25 = true};
+                          .hasRint25 = true,
+                          .net_blocked_ms_h = 0,
+                          .hasStats = false,
+                          .stats = {}};
 
   char json[512];
-  bool success = buildTelemetryJson(frame, json, sizeof(json));
+  bool success = buildChecked(frame, json, sizeof(json));
 
   TEST_ASSERT_TRUE(success);
   TEST_ASSERT_TRUE(jsonContainsString(json, "mode", "parked-idle"));
@@ -180,15 +160,19 @@ void test_telemetry_null_temperature(void) {
                           .Rint25_mOhm = 10.0f,
                           .RintBaseline_mOhm = 10.0f,
                           .ah_left = 11.0f,
+                          .battery_capacity_ah = 0.0f,
                           .alternator_on = true,
                           .rest_s = 0,
                           .lowCurrentAccum_s = 0,
                           .up_ms = 1000,
                           .hasRint = true,
-                          .hasRint25 = true};
+                          .hasRint25 = true,
+                          .net_blocked_ms_h = 0,
+                          .hasStats = false,
+                          .stats = {}};
 
   char json[512];
-  bool success = buildTelemetryJson(frame, json, sizeof(json));
+  bool success = buildChecked(frame, json, sizeof(json));
 
   TEST_ASSERT_TRUE(success);
   TEST_ASSERT_TRUE(jsonContains(json, "temp_C", "null"));
@@ -206,16 +190,20 @@ void test_telemetry_null_rint_no_flags(void) {
       .Rint25_mOhm = 10.2f,
       .RintBaseline_mOhm = 10.0f,
       .ah_left = 11.0f,
+      .battery_capacity_ah = 0.0f,
       .alternator_on = false,
       .rest_s = 0,
       .lowCurrentAccum_s = 0,
       .up_ms = 1000,
       .hasRint = false,  // No Rint available
-      .hasRint25 = false // No Rint25 available
+      .hasRint25 = false, // No Rint25 available
+      .net_blocked_ms_h = 0,
+      .hasStats = false,
+      .stats = {}
   };
 
   char json[512];
-  bool success = buildTelemetryJson(frame, json, sizeof(json));
+  bool success = buildChecked(frame, json, sizeof(json));
 
   TEST_ASSERT_TRUE(success);
   TEST_ASSERT_TRUE(jsonContains(json, "Rint_mOhm", "null"));
@@ -233,15 +221,19 @@ void test_telemetry_null_rint_nan_values(void) {
                           .Rint25_mOhm = NAN,
                           .RintBaseline_mOhm = 10.0f,
                           .ah_left = 11.0f,
+                          .battery_capacity_ah = 0.0f,
                           .alternator_on = false,
                           .rest_s = 0,
                           .lowCurrentAccum_s = 0,
                           .up_ms = 1000,
                           .hasRint = true, // Flag set but value is NAN
-                          .hasRint25 = true};
+                          .hasRint25 = true,
+                          .net_blocked_ms_h = 0,
+                          .hasStats = false,
+                          .stats = {}};
 
   char json[512];
-  bool success = buildTelemetryJson(frame, json, sizeof(json));
+  bool success = buildChecked(frame, json, sizeof(json));
 
   TEST_ASSERT_TRUE(success);
   TEST_ASSERT_TRUE(jsonContains(json, "Rint_mOhm", "null"));
@@ -259,15 +251,19 @@ void test_telemetry_null_soh(void) {
                           .Rint25_mOhm = 10.2f,
                           .RintBaseline_mOhm = 10.0f,
                           .ah_left = 11.0f,
+                          .battery_capacity_ah = 0.0f,
                           .alternator_on = false,
                           .rest_s = 0,
                           .lowCurrentAccum_s = 0,
                           .up_ms = 1000,
                           .hasRint = true,
-                          .hasRint25 = true};
+                          .hasRint25 = true,
+                          .net_blocked_ms_h = 0,
+                          .hasStats = false,
+                          .stats = {}};
 
   char json[512];
-  bool success = buildTelemetryJson(frame, json, sizeof(json));
+  bool success = buildChecked(frame, json, sizeof(json));
 
   TEST_ASSERT_TRUE(success);
   TEST_ASSERT_TRUE(jsonContains(json, "soh_pct", "null"));
@@ -284,15 +280,19 @@ void test_telemetry_buffer_too_small(void) {
                           .Rint25_mOhm = 10.0f,
                           .RintBaseline_mOhm = 10.0f,
                           .ah_left = 11.0f,
+                          .battery_capacity_ah = 0.0f,
                           .alternator_on = false,
                           .rest_s = 0,
                           .lowCurrentAccum_s = 0,
                           .up_ms = 1000,
                           .hasRint = true,
-                          .hasRint25 = true};
+                          .hasRint25 = true,
+                          .net_blocked_ms_h = 0,
+                          .hasStats = false,
+                          .stats = {}};
 
   char json[50]; // Too small
-  bool success = buildTelemetryJson(frame, json, sizeof(json));
+  bool success = buildChecked(frame, json, sizeof(json));
 
   TEST_ASSERT_FALSE(success);
 }
@@ -308,21 +308,25 @@ void test_telemetry_exact_buffer_size(void) {
                           .Rint25_mOhm = 10.0f,
                           .RintBaseline_mOhm = 10.0f,
                           .ah_left = 11.0f,
+                          .battery_capacity_ah = 0.0f,
                           .alternator_on = false,
                           .rest_s = 0,
                           .lowCurrentAccum_s = 0,
                           .up_ms = 1000,
                           .hasRint = true,
-                          .hasRint25 = true};
+                          .hasRint25 = true,
+                          .net_blocked_ms_h = 0,
+                          .hasStats = false,
+                          .stats = {}};
 
   // First get required size
   char temp[512];
-  buildTelemetryJson(frame, temp, sizeof(temp));
+  buildChecked(frame, temp, sizeof(temp));
   size_t requiredSize = strlen(temp) + 1;
 
   // Test with exact size
   char *json = new char[requiredSize];
-  bool success = buildTelemetryJson(frame, json, requiredSize);
+  bool success = buildChecked(frame, json, requiredSize);
 
   TEST_ASSERT_TRUE(success);
   delete[] json;
@@ -339,15 +343,19 @@ void test_telemetry_high_precision_values(void) {
                           .Rint25_mOhm = 10.234f,
                           .RintBaseline_mOhm = 10.123f,
                           .ah_left = 12.3456f,
+                          .battery_capacity_ah = 0.0f,
                           .alternator_on = true,
                           .rest_s = 0,
                           .lowCurrentAccum_s = 0,
                           .up_ms = 123456,
                           .hasRint = true,
-                          .hasRint25 = true};
+                          .hasRint25 = true,
+                          .net_blocked_ms_h = 0,
+                          .hasStats = false,
+                          .stats = {}};
 
   char json[512];
-  bool success = buildTelemetryJson(frame, json, sizeof(json));
+  bool success = buildChecked(frame, json, sizeof(json));
 
   TEST_ASSERT_TRUE(success);
   // Voltage should be 3 decimal places
@@ -367,15 +375,19 @@ void test_telemetry_zero_values(void) {
                           .Rint25_mOhm = 0.0f,
                           .RintBaseline_mOhm = 0.0f,
                           .ah_left = 0.0f,
+                          .battery_capacity_ah = 0.0f,
                           .alternator_on = false,
                           .rest_s = 0,
                           .lowCurrentAccum_s = 0,
                           .up_ms = 0,
                           .hasRint = true,
-                          .hasRint25 = true};
+                          .hasRint25 = true,
+                          .net_blocked_ms_h = 0,
+                          .hasStats = false,
+                          .stats = {}};
 
   char json[512];
-  bool success = buildTelemetryJson(frame, json, sizeof(json));
+  bool success = buildChecked(frame, json, sizeof(json));
 
   TEST_ASSERT_TRUE(success);
   TEST_ASSERT_TRUE(jsonContains(json, "voltage_V", "0.000"));
@@ -393,15 +405,19 @@ void test_telemetry_large_uptime(void) {
                           .Rint25_mOhm = 10.0f,
                           .RintBaseline_mOhm = 10.0f,
                           .ah_left = 11.0f,
+                          .battery_capacity_ah = 0.0f,
                           .alternator_on = false,
                           .rest_s = 86400,            // 24 hours
                           .lowCurrentAccum_s = 43200, // 12 hours
                           .up_ms = 4294967295,        // Max uint32 (~49 days)
                           .hasRint = true,
-                          .hasRint25 = true};
+                          .hasRint25 = true,
+                          .net_blocked_ms_h = 0,
+                          .hasStats = false,
+                          .stats = {}};
 
   char json[512];
-  bool success = buildTelemetryJson(frame, json, sizeof(json));
+  bool success = buildChecked(frame, json, sizeof(json));
 
   TEST_ASSERT_TRUE(success);
   TEST_ASSERT_TRUE(jsonContains(json, "rest_s", "86400"));
@@ -419,15 +435,19 @@ void test_telemetry_negative_current_discharge(void) {
                           .Rint25_mOhm = 10.0f,
                           .RintBaseline_mOhm = 10.0f,
                           .ah_left = 8.5f,
+                          .battery_capacity_ah = 0.0f,
                           .alternator_on = false,
                           .rest_s = 0,
                           .lowCurrentAccum_s = 0,
                           .up_ms = 1000,
                           .hasRint = true,
-                          .hasRint25 = true};
+                          .hasRint25 = true,
+                          .net_blocked_ms_h = 0,
+                          .hasStats = false,
+                          .stats = {}};
 
   char json[512];
-  bool success = buildTelemetryJson(frame, json, sizeof(json));
+  bool success = buildChecked(frame, json, sizeof(json));
 
   TEST_ASSERT_TRUE(success);
   TEST_ASSERT_TRUE(jsonContains(json, "current_A", "-5.500"));
@@ -444,15 +464,19 @@ void test_telemetry_all_nulls(void) {
                           .Rint25_mOhm = NAN,
                           .RintBaseline_mOhm = 10.0f,
                           .ah_left = 11.0f,
+                          .battery_capacity_ah = 0.0f,
                           .alternator_on = false,
                           .rest_s = 0,
                           .lowCurrentAccum_s = 0,
                           .up_ms = 1000,
                           .hasRint = false,
-                          .hasRint25 = false};
+                          .hasRint25 = false,
+                          .net_blocked_ms_h = 0,
+                          .hasStats = false,
+                          .stats = {}};
 
   char json[512];
-  bool success = buildTelemetryJson(frame, json, sizeof(json));
+  bool success = buildChecked(frame, json, sizeof(json));
 
   TEST_ASSERT_TRUE(success);
   TEST_ASSERT_TRUE(jsonContains(json, "temp_C", "null"));
@@ -476,13 +500,17 @@ void test_telemetry_infinite_values(void) {
            .Rint25_mOhm = 36.0f,
            .RintBaseline_mOhm = 35.0f,
            .ah_left = 35.0f,
+           .battery_capacity_ah = 0.0f,
            .alternator_on = false,
            .rest_s = 0,
            .lowCurrentAccum_s = 0,
            .up_ms = 10000,
            .hasRint = true,
-           .hasRint25 = true};
-  bool success = buildTelemetryJson(frame, json, sizeof(json));
+           .hasRint25 = true,
+           .net_blocked_ms_h = 0,
+           .hasStats = false,
+           .stats = {}};
+  bool success = buildChecked(frame, json, sizeof(json));
   TEST_ASSERT_TRUE(success);
   // Infinity should be serialized as null for safety
   TEST_ASSERT_TRUE(jsonContains(json, "voltage_V", "null"));
@@ -490,18 +518,297 @@ void test_telemetry_infinite_values(void) {
   // Negative infinity current
   frame.V = 12.5f;
   frame.I = -INFINITY;
-  success = buildTelemetryJson(frame, json, sizeof(json));
+  success = buildChecked(frame, json, sizeof(json));
   TEST_ASSERT_TRUE(success);
   TEST_ASSERT_TRUE(jsonContains(json, "current_A", "null"));
 
   // Infinite SOC (calculation error)
   frame.I = 2.5f;
   frame.soc_pct = INFINITY;
-  success = buildTelemetryJson(frame, json, sizeof(json));
+  success = buildChecked(frame, json, sizeof(json));
   TEST_ASSERT_TRUE(success);
   TEST_ASSERT_TRUE(jsonContains(json, "soc_pct", "null"));
 }
 
+// ---------------- Streaming writer ----------------
+
+static uint32_t rngState = 12345;
+static uint32_t rng() {
+  rngState = rngState * 1664525u + 1013904223u;
+  return rngState;
+}
+static float randFloat(float lo, float hi) {
+  return lo + (hi - lo) * (rng() >> 8) / 16777216.0f;
+}
+
+void test_fmt_fixed_matches_printf(void) {
+  char a[48], b[48];
+  for (int i = 0; i < 20000; ++i) {
+    float v = randFloat(-2000.0f, 2000.0f);
+    uint8_t d = (uint8_t)(i % 4);
+    fmtFixed(a, v, d);
+    snprintf(b, sizeof(b), "%.*f", d, v);
+    TEST_ASSERT_EQUAL_STRING(b, a);
+  }
+}
+
+void test_fmt_fixed_ties_and_edges(void) {
+  // Exact binary ties round half to even, like printf
+  const float vals[] = {0.125f, 0.375f, 2.5f,   3.5f,  -0.125f, 0.0f,
+                        -0.0f,  -0.0004f, 1e-9f, 999.9995f, 123456.7f,
+                        4.2e9f, 1e15f, -3.4e38f};
+  char a[48], b[48];
+  for (float v : vals) {
+    for (uint8_t d = 0; d <= 6; ++d) {
+      fmtFixed(a, v, d);
+      snprintf(b, sizeof(b), "%.*f", d, v);
+      TEST_ASSERT_EQUAL_STRING(b, a);
+    }
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, fmtFixed(a, NAN, 2));
+  TEST_ASSERT_EQUAL_UINT32(0, fmtFixed(a, -INFINITY, 2));
+}
+
+static TelemetryFrame randomFrame(int i) {
+  static const char *modes[] = {"active", "parked-idle", "snapshot"};
+  TelemetryFrame f{};
+  f.mode = modes[i % 3];
+  f.V = randFloat(0.0f, 16.0f);
+  f.I = randFloat(-150.0f, 150.0f);
+  f.T = (i % 17) ? randFloat(-40.0f, 85.0f) : NAN;
+  f.soc_pct = randFloat(0.0f, 100.0f);
+  f.soh_pct = (i % 13) ? randFloat(0.0f, 110.0f) : INFINITY;
+  f.Rint_mOhm = randFloat(1.0f, 300.0f);
+  f.Rint25_mOhm = (i % 7) ? randFloat(1.0f, 300.0f) : NAN;
+  f.RintBaseline_mOhm = randFloat(1.0f, 100.0f);
+  f.ah_left = randFloat(0.0f, 200.0f);
+  f.battery_capacity_ah = randFloat(1.0f, 200.0f);
+  f.alternator_on = rng() & 1;
+  f.rest_s = rng();
+  f.lowCurrentAccum_s = rng() % 100000;
+  f.up_ms = rng();
+  f.hasRint = rng() & 1;
+  f.hasRint25 = rng() & 1;
+  f.net_blocked_ms_h = rng() % 3600000;
+  return f;
+}
+
+void test_random_frames_match_reference(void) {
+  char json[700];
+  for (int i = 0; i < 2000; ++i)
+    buildChecked(randomFrame(i), json, sizeof(json));
+}
+
+void test_every_buffer_size_matches_reference(void) {
+  // Success exactly when snprintf would not truncate, always NUL-terminated
+  TelemetryFrame f{};
+  f.mode = "active";
+  f.V = 12.65f;
+  f.I = -1.2f;
+  f.T = 25.3f;
+  f.soc_pct = 85.0f;
+  f.soh_pct = 97.5f;
+  f.hasRint = true;
+  f.Rint_mOhm = 10.5f;
+  char full[700];
+  TEST_ASSERT_TRUE(buildTelemetryJson(f, full, sizeof(full)));
+  size_t need = strlen(full) + 1;
+  for (size_t len = 1; len <= need; ++len) {
+    char buf[700];
+    memset(buf, 'x', sizeof(buf));
+    bool ok = buildChecked(f, buf, len);
+    TEST_ASSERT_EQUAL(len == need, ok);
+    TEST_ASSERT_TRUE(memchr(buf, '\0', len) != nullptr);
+    TEST_ASSERT_EQUAL('x', buf[len]); // nothing written past the buffer
+  }
+}
+
+void test_writer_escapes_strings(void) {
+  char buf[64];
+  JsonWriter w(buf, sizeof(buf));
+  w.beginObject().str("s", "a\"b\\c").u32("n", 7).endObject();
+  TEST_ASSERT_TRUE(w.ok());
+  TEST_ASSERT_EQUAL_STRING("{\"s\":\"a\\\"b\\\\c\",\"n\":7}", buf);
+}
+
+// Stand-in for the MQTT client: collects streamed bytes, can fail after
+// `limit` of them
+struct Collector {
+  char data[700];
+  size_t len = 0;
+  size_t limit = sizeof(data);
+  int calls = 0;
+};
+
+static bool collect(void *ctx, const char *s, size_t n) {
+  Collector *c = static_cast<Collector *>(ctx);
+  c->calls++;
+  if (c->len + n > c->limit)
+    return false;
+  memcpy(c->data + c->len, s, n);
+  c->len += n;
+  return true;
+}
+
+void test_interval_stats_object(void) {
+  TelemetryFrame f = randomFrame(7);
+  char plain[700], json[900];
+  TEST_ASSERT_TRUE(buildTelemetryJson(f, plain, sizeof(plain)));
+  TEST_ASSERT_NULL(strstr(plain, "interval"));
+  f.hasStats = true;
+  f.stats = {120, 60000, 11.2f, 12.65f, 12.571f, 12.5714f,
+             -0.5f, 80.25f, 3.1f, 14.62f, 51.68f};
+  f.stats.V_rms = NAN;
+  TEST_ASSERT_TRUE(buildTelemetryJson(f, json, sizeof(json)));
+  // Same fields, then the interval object last
+  TEST_ASSERT_EQUAL_MEMORY(plain, json, strlen(plain) - 1);
+  TEST_ASSERT_EQUAL_STRING(
+      ",\"interval\":{\"n\":120,\"span_ms\":60000,\"V_min\":11.200,"
+      "\"V_max\":12.650,\"V_mean\":12.571,\"V_rms\":null,"
+      "\"I_min\":-0.500,\"I_max\":80.250,\"I_mean\":3.100,"
+      "\"I_rms\":14.620,\"charge_mAh\":51.7}}",
+      json + strlen(plain) - 1);
+  TEST_ASSERT_EQUAL(strlen(json), telemetryJsonLength(f));
+}
+
+void test_stream_matches_buffer(void) {
+  char ref[700];
+  for (int i = 0; i < 300; ++i) {
+    TelemetryFrame f = randomFrame(i);
+    TEST_ASSERT_TRUE(buildTelemetryJson(f, ref, sizeof(ref)));
+    TEST_ASSERT_EQUAL(strlen(ref), telemetryJsonLength(f));
+    // Staging buffers from the 2-byte minimum up, plus the firmware's
+    size_t chunkLen = (i % 40) + 2;
+    if (i % 41 == 0)
+      chunkLen = 128;
+    char chunk[128];
+    Collector c;
+    JsonWriter w(chunk, chunkLen, collect, &c);
+    writeTelemetryJson(w, f);
+    TEST_ASSERT_TRUE(w.flush());
+    TEST_ASSERT_EQUAL(strlen(ref), w.length());
+    TEST_ASSERT_EQUAL(strlen(ref), c.len);
+    TEST_ASSERT_EQUAL_MEMORY(ref, c.data, c.len);
+  }
+}
+
+void test_stream_sink_failure(void) {
+  TelemetryFrame f = randomFrame(1);
+  char chunk[32];
+  Collector c;
+  c.limit = 100;
+  JsonWriter w(chunk, sizeof(chunk), collect, &c);
+  writeTelemetryJson(w, f);
+  TEST_ASSERT_FALSE(w.flush());
+  // Nothing more reaches the sink once it failed
+  int calls = c.calls;
+  w.str("x", "y");
+  w.flush();
+  TEST_ASSERT_EQUAL(calls, c.calls);
+  // A one-byte staging buffer cannot stream
+  Collector d;
+  JsonWriter tiny(chunk, 1, collect, &d);
+  writeTelemetryJson(tiny, f);
+  TEST_ASSERT_FALSE(tiny.flush());
+}
+
+void test_dry_run_counts_only(void) {
+  JsonWriter w;
+  w.beginObject().str("s", "a\"b").num("v", 1.5f, 2).endObject();
+  TEST_ASSERT_TRUE(w.flush());
+  TEST_ASSERT_EQUAL(strlen("{\"s\":\"a\\\"b\",\"v\":1.50}"), w.length());
+}
+
+// Publish path before: whole payload formatted on the stack, then copied
+// into the client. After: dry run for the length, then streamed through a
+// 128-byte staging buffer.
+__attribute__((noinline)) static bool publishBuffered(const TelemetryFrame &f,
+                                                      Collector &c) {
+  char payload[700];
+  if (!buildTelemetryJson(f, payload, sizeof(payload)))
+    return false;
+  return collect(&c, payload, strlen(payload));
+}
+
+__attribute__((noinline)) static bool publishStreamed(const TelemetryFrame &f,
+                                                      Collector &c) {
+  if (!telemetryJsonLength(f))
+    return false;
+  char chunk[128];
+  JsonWriter w(chunk, sizeof(chunk), collect, &c);
+  writeTelemetryJson(w, f);
+  return w.flush();
+}
+
+void test_publish_stack_use(void) {
+  TelemetryFrame f = randomFrame(5);
+  ProfStack before("buffered"), after("streamed");
+  for (int i = 0; i < 3; ++i) {
+    Collector a, b;
+    {
+      ProfStackScope s(before, 4096);
+      TEST_ASSERT_TRUE(publishBuffered(f, a));
+    }
+    {
+      ProfStackScope s(after, 4096);
+      TEST_ASSERT_TRUE(publishStreamed(f, b));
+    }
+    TEST_ASSERT_EQUAL(a.len, b.len);
+    TEST_ASSERT_EQUAL_MEMORY(a.data, b.data, a.len);
+  }
+  char msg[120];
+  snprintf(msg, sizeof(msg),
+           "[stack] telemetry publish: buffered %lu B, streamed %lu B",
+           (unsigned long)before.peak(), (unsigned long)after.peak());
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_GREATER_OR_EQUAL(700, before.peak());
+  TEST_ASSERT_LESS_THAN(before.peak(), after.peak());
+}
+
+void test_benchmark_vs_snprintf(void) {
+  TelemetryFrame f{};
+  f.mode = "active";
+  f.V = 12.6789f;
+  f.I = 1.2345f;
+  f.T = 25.678f;
+  f.soc_pct = 85.432f;
+  f.soh_pct = 97.654f;
+  f.Rint_mOhm = 10.567f;
+  f.Rint25_mOhm = 10.234f;
+  f.RintBaseline_mOhm = 10.123f;
+  f.ah_left = 12.3456f;
+  f.battery_capacity_ah = 70.0f;
+  f.up_ms = 123456;
+  f.hasRint = f.hasRint25 = true;
+  const int iters = 100000;
+  char json[700];
+  uint32_t sink = 0;
+
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < iters; ++i) {
+    f.up_ms = i;
+    buildTelemetryJsonSnprintf(f, json, sizeof(json));
+    sink += (uint8_t)json[20];
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  for (int i = 0; i < iters; ++i) {
+    f.up_ms = i;
+    buildTelemetryJson(f, json, sizeof(json));
+    sink += (uint8_t)json[20];
+  }
+  auto t2 = std::chrono::steady_clock::now();
+  double sUs = std::chrono::duration<double, std::micro>(t1 - t0).count();
+  double wUs = std::chrono::duration<double, std::micro>(t2 - t1).count();
+
+  char msg[160];
+  snprintf(msg, sizeof(msg),
+           "[bench] telemetry JSON: snprintf %.0f frames/s, writer %.0f "
+           "frames/s (x%.1f, sink=%u)",
+           iters * 1e6 / sUs, iters * 1e6 / wUs, sUs / wUs, (unsigned)sink);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_TRUE(wUs > 0.0);
+}
+
 int main(int argc, char **argv) {
   UNITY_BEGIN();
 
@@ -519,6 +826,17 @@ int main(int argc, char **argv) {
   RUN_TEST(test_telemetry_negative_current_discharge);
   RUN_TEST(test_telemetry_all_nulls);
   RUN_TEST(test_telemetry_infinite_values);
+  RUN_TEST(test_fmt_fixed_matches_printf);
+  RUN_TEST(test_fmt_fixed_ties_and_edges);
+  RUN_TEST(test_random_frames_match_reference);
+  RUN_TEST(test_every_buffer_size_matches_reference);
+  RUN_TEST(test_interval_stats_object);
+  RUN_TEST(test_stream_matches_buffer);
+  RUN_TEST(test_stream_sink_failure);
+  RUN_TEST(test_dry_run_counts_only);
+  RUN_TEST(test_publish_stack_use);
+  RUN_TEST(test_writer_escapes_strings);
+  RUN_TEST(test_benchmark_vs_snprintf);
 
   return UNITY_END();
 }
@@ -0,0 +1,143 @@
+#include <cstring>
+#include <unity.h>
+
+#include "../../src/power/wake_profile.cpp"
+
+// Virtual microsecond clock
+static uint32_t g_us = 0;
+static uint32_t fakeMicros() { return g_us; }
+
+static WakeProfile prof;
+
+void setUp(void) {
+  g_us = 0;
+  memset(&prof, 0, sizeof(prof));
+}
+void tearDown(void) {}
+
+// One wake: boot at 40 ms, then 30/120/50/20/5 ms phases (265 ms total)
+static void runWake(WakeTimer &t, bool fast = true, bool published = true) {
+  g_us = 40000;
+  t.begin();
+  g_us += 30000;
+  t.mark(WAKE_SENSORS);
+  g_us += 120000;
+  t.mark(WAKE_WIFI);
+  g_us += 50000;
+  t.mark(WAKE_MQTT);
+  g_us += 20000;
+  t.mark(WAKE_PUBLISH);
+  g_us += 5000;
+  t.mark(WAKE_SHUTDOWN);
+  t.finish(300, fast, published);
+}
+
+void test_begin_resets_garbage_profile(void) {
+  memset(&prof, 0xA5, sizeof(prof));
+  WakeTimer t(prof, fakeMicros);
+  t.begin();
+  TEST_ASSERT_EQUAL_UINT32(0, prof.wakes);
+  TEST_ASSERT_EQUAL_UINT32(0, prof.worst_ms);
+  TEST_ASSERT_EQUAL_UINT32(0, prof.phase_ms[WAKE_WIFI]);
+}
+
+void test_begin_keeps_valid_profile(void) {
+  WakeTimer t(prof, fakeMicros);
+  runWake(t);
+  WakeTimer t2(prof, fakeMicros); // next boot
+  t2.begin();
+  TEST_ASSERT_EQUAL_UINT32(1, prof.wakes);
+  TEST_ASSERT_EQUAL_UINT32(265, prof.total_ms);
+}
+
+void test_phases_and_total(void) {
+  WakeTimer t(prof, fakeMicros);
+  runWake(t);
+  TEST_ASSERT_EQUAL_UINT32(40, prof.boot_ms);
+  TEST_ASSERT_EQUAL_UINT32(30, prof.phase_ms[WAKE_SENSORS]);
+  TEST_ASSERT_EQUAL_UINT32(120, prof.phase_ms[WAKE_WIFI]);
+  TEST_ASSERT_EQUAL_UINT32(50, prof.phase_ms[WAKE_MQTT]);
+  TEST_ASSERT_EQUAL_UINT32(20, prof.phase_ms[WAKE_PUBLISH]);
+  TEST_ASSERT_EQUAL_UINT32(5, prof.phase_ms[WAKE_SHUTDOWN]);
+  TEST_ASSERT_EQUAL_UINT32(265, prof.total_ms);
+  TEST_ASSERT_TRUE(prof.fastWifi);
+  TEST_ASSERT_TRUE(prof.published);
+}
+
+void test_repeated_mark_accumulates(void) {
+  WakeTimer t(prof, fakeMicros);
+  t.begin();
+  g_us += 10000;
+  t.mark(WAKE_WIFI);
+  g_us += 7000;
+  t.mark(WAKE_PUBLISH);
+  g_us += 15000;
+  t.mark(WAKE_WIFI);
+  t.finish(300, false, false);
+  TEST_ASSERT_EQUAL_UINT32(25, prof.phase_ms[WAKE_WIFI]);
+  TEST_ASSERT_EQUAL_UINT32(7, prof.phase_ms[WAKE_PUBLISH]);
+  TEST_ASSERT_EQUAL_UINT32(32, prof.total_ms);
+}
+
+void test_over_budget_and_worst(void) {
+  WakeTimer t(prof, fakeMicros);
+  runWake(t); // 265 ms
+  TEST_ASSERT_EQUAL_UINT32(0, prof.overBudget);
+
+  // Slow association (DHCP fallback): 2 s in Wi-Fi
+  g_us = 0; // micros() restarts on every boot
+  t.begin();
+  g_us += 2000000;
+  t.mark(WAKE_WIFI);
+  t.finish(300, false, true);
+  TEST_ASSERT_EQUAL_UINT32(1, prof.overBudget);
+  TEST_ASSERT_EQUAL_UINT32(2000, prof.worst_ms);
+  TEST_ASSERT_FALSE(prof.fastWifi);
+
+  runWake(t);
+  TEST_ASSERT_EQUAL_UINT32(3, prof.wakes);
+  TEST_ASSERT_EQUAL_UINT32(1, prof.overBudget);
+  TEST_ASSERT_EQUAL_UINT32(2000, prof.worst_ms); // kept
+  TEST_ASSERT_EQUAL_UINT32(265, prof.total_ms);  // last wake only
+}
+
+void test_json_false_before_first_wake(void) {
+  WakeTimer t(prof, fakeMicros);
+  t.begin();
+  char buf[320];
+  TEST_ASSERT_FALSE(buildWakeJson(prof, 300, buf, sizeof(buf)));
+}
+
+void test_json_fields(void) {
+  WakeTimer t(prof, fakeMicros);
+  runWake(t, true, false);
+  char buf[320];
+  TEST_ASSERT_TRUE(buildWakeJson(prof, 300, buf, sizeof(buf)));
+  TEST_ASSERT_NOT_NULL(strstr(buf, "\"event\":\"wake\""));
+  TEST_ASSERT_NOT_NULL(strstr(buf, "\"total_ms\":265"));
+  TEST_ASSERT_NOT_NULL(strstr(buf, "\"budget_ms\":300"));
+  TEST_ASSERT_NOT_NULL(strstr(buf, "\"wifi_ms\":120"));
+  TEST_ASSERT_NOT_NULL(strstr(buf, "\"fast_wifi\":true"));
+  TEST_ASSERT_NOT_NULL(strstr(buf, "\"published\":false"));
+  TEST_ASSERT_NOT_NULL(strstr(buf, "\"worst_ms\":265"));
+}
+
+void test_json_buffer_too_small(void) {
+  WakeTimer t(prof, fakeMicros);
+  runWake(t);
+  char buf[64];
+  TEST_ASSERT_FALSE(buildWakeJson(prof, 300, buf, sizeof(buf)));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_begin_resets_garbage_profile);
+  RUN_TEST(test_begin_keeps_valid_profile);
+  RUN_TEST(test_phases_and_total);
+  RUN_TEST(test_repeated_mark_accumulates);
+  RUN_TEST(test_over_budget_and_worst);
+  RUN_TEST(test_json_false_before_first_wake);
+  RUN_TEST(test_json_fields);
+  RUN_TEST(test_json_buffer_too_small);
+  return UNITY_END();
+}
@@ -0,0 +1,91 @@
+// Host-side decoder for the binary telemetry payloads: prints one JSON line
+// per frame, in the same format as the device's telemetry JSON.
+//
+//   car/battery/cbor   CBOR telemetry frame (src/telemetry_cbor.h)
+//   car/battery/batch  snapshot batch (src/comms/snapshot_batch.h); each line
+//                      gets the capture "ts" and "age_s"
+//
+// Build (no dependencies, the firmware's portable sources are compiled in):
+//   g++ -std=c++11 -O2 -o telemetry_decode tools/telemetry_decode.cpp
+//
+// Usage:
+//   mosquitto_sub -t car/battery/cbor -C 1 -N | ./telemetry_decode
+//   ./telemetry_decode b20000011931...     (payload as hex arguments)
+
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "../src/comms/outbox.cpp"
+#include "../src/comms/snapshot_batch.cpp"
+#include "../src/json_writer.cpp"
+#include "../src/telemetry_cbor.cpp"
+#include "../src/telemetry_payload.cpp"
+
+static bool parseHex(const char *s, std::vector<uint8_t> &out) {
+  out.clear();
+  int hi = -1;
+  for (; *s; ++s) {
+    if (isspace((unsigned char)*s))
+      continue;
+    if (!isxdigit((unsigned char)*s))
+      return false;
+    int v = isdigit((unsigned char)*s) ? *s - '0'
+                                       : tolower((unsigned char)*s) - 'a' + 10;
+    if (hi < 0) {
+      hi = v;
+    } else {
+      out.push_back((uint8_t)(hi << 4 | v));
+      hi = -1;
+    }
+  }
+  return hi < 0 && !out.empty();
+}
+
+static bool decodePayload(const std::vector<uint8_t> &p) {
+  char js[700];
+  if (p.size() >= 2 && p[0] == 'S' && p[1] == 'B') {
+    SnapshotBatchEntry e[SNAPSHOT_BATCH_MAX];
+    int n = decodeSnapshotBatch(p.data(), p.size(), e, SNAPSHOT_BATCH_MAX);
+    if (n < 0)
+      return false;
+    for (int i = 0; i < n; ++i) {
+      if (!buildTelemetryJson(e[i].f, js, sizeof(js)))
+        return false;
+      js[strlen(js) - 1] = '\0'; // reopen the object
+      printf("%s,\"ts\":%lu,\"age_s\":%lu}\n", js, (unsigned long)e[i].ts,
+             (unsigned long)e[i].age_s);
+    }
+    return true;
+  }
+  TelemetryFrame f{};
+  if (!decodeTelemetryCbor(p.data(), p.size(), f) ||
+      !buildTelemetryJson(f, js, sizeof(js)))
+    return false;
+  printf("%s\n", js);
+  return true;
+}
+
+int main(int argc, char **argv) {
+  std::vector<uint8_t> payload;
+  if (argc > 1) {
+    int rc = 0;
+    for (int i = 1; i < argc; ++i) {
+      if (!parseHex(argv[i], payload) || !decodePayload(payload)) {
+        fprintf(stderr, "telemetry_decode: cannot decode argument %d\n", i);
+        rc = 1;
+      }
+    }
+    return rc;
+  }
+  int c;
+  while ((c = getchar()) != EOF)
+    payload.push_back((uint8_t)c);
+  if (!decodePayload(payload)) {
+    fprintf(stderr, "telemetry_decode: cannot decode %u bytes from stdin\n",
+            (unsigned)payload.size());
+    return 1;
+  }
+  return 0;
+}